@@ -1,6 +1,11 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <cstdlib>
 #include <iostream>
 #include <stdexcept>
+#include <utility>
+#include <vector>
 //#include "wx/string.h"
 
 #include "matrix.h"
@@ -38,6 +43,123 @@ void test_add_1() {
     }
 }
 
+void test_add_2() {
+    // big enough for the SIMD kernels, odd sized so the tail is used as well
+    const int R = 37, C = 29;
+    Matrix<float> test = Matrix<float>(R, C);
+    Matrix<float> test2 = Matrix<float>(R, C);
+    Matrix<float> test3 = Matrix<float>(R, C);
+    Matrix<float> test4 = Matrix<float>(R, C);
+    for (int r = 0; r < R; r++)
+        for (int c = 0; c < C; c++) {
+            float a = r * 0.5f - c, b = c * 0.25f + 1;
+            test.set(r, c, a);
+            test2.set(r, c, b);
+            test3.set(r, c, (a + b) * 3.0f);
+            test4.set(r, c, a * b);
+        }
+
+    cout << "add_2 (SIMD addInPlace, multiplyInPlace): ";
+    Matrix<float> res = test;
+    res.addInPlace(test2); // THE TEST
+    res.multiplyInPlace(3.0f);
+    (res == test3) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "add_2 (SIMD hadamardInPlace): ";
+    test.hadamardInPlace(test2); // THE TEST
+    (test == test4) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+}
+
+// whether a + b compiles
+template <class A, class B, class = void>
+struct CanAdd : std::false_type {};
+
+template <class A, class B>
+struct CanAdd<A, B, decltype((void) (std::declval<const A&>() + std::declval<const B&>()))> : std::true_type {};
+
+void test_add_3() {
+    int a[] = { 2, 3, 4, 5, 6, 7 };
+    int b[] = { 10, 11, 12, 13, 14, 15 };
+    int c[] = { 1, 2, 3, 4, 5, 6 };
+    int d[] = { 14, 18, 22, 26, 30, 34 }; // d=a+b+c*2
+    int e[] = { 20, 33, 48, 65, 84, 105 }; // e=hadamard(a,b)
+
+    Matrix<int> test = Matrix<int>(2, 3, a);
+    Matrix<int> test2 = Matrix<int>(2, 3, b);
+    Matrix<int> test3 = Matrix<int>(2, 3, c);
+    Matrix<int> test4 = Matrix<int>(2, 3, d);
+    Matrix<int> test5 = Matrix<int>(2, 3, e);
+
+    cout << "add_3 (fused expression a+b+c*2): ";
+    Matrix<int> res = test + test2 + test3 * 2; // THE TEST
+    (res == test4) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "add_3 (fused expression, result is operand): ";
+    res = test;
+    res = hadamard(res, test2) + res * 0; // THE TEST
+    (res == test5) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "add_3 (same element types only): ";
+    Matrix<float> f = Matrix<float>(2, 3, MatrixInit::Zero), g = f;
+    f.set(1, 2, 1.5f);
+    g.set(1, 2, 2.5f);
+    Matrix<float> fsum = f + g + hadamard(f, g) * 2.0f; // THE TEST
+    (fsum.get(1, 2) == 11.5f && fsum.get(0, 0) == 0.0f && CanAdd<Matrix<int>, Matrix<int> >::value &&
+     !CanAdd<Matrix<int>, Matrix<float> >::value && !CanAdd<Matrix<float>, decltype(test + test2)>::value)
+        ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+}
+
+void test_map_1() {
+    int a[] = { -2, 3, -4, 5, 6, -7 };
+    int b[] = { 1, 1, 1, 1, 1, 1 };
+    float h[] = { 0.5f, 2.0f, 0.5f, 3.0f, 3.5f, 0.5f };    // relu(a+b)/2, at least 0.5
+    int c[] = { 4, 6, 8, 10, 12, 14 };
+
+    Matrix<int> ma(2, 3, a), mb(2, 3, b), mc(2, 3, c);
+
+    cout << "map_1 (map and zip fused with an expression): ";
+    Matrix<float> res = (ma + mb).map([](int x) { return x > 0 ? x / 2.0f : 0.0f; }); // THE TEST
+    res = zip(res, ma, [](float x, int) { return x < 0.5f ? 0.5f : x; });
+    Matrix<int> lim = zip(ma, mb * -3, mc, [](int x, int lo, int hi) { return x < lo ? lo : hi < x ? hi : x; });
+    int l[] = { -2, 3, -3, 5, 6, -3 };
+    (res == Matrix<float>(2, 3, h) && lim == Matrix<int>(2, 3, l)) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "map_1 (apply in place, one, two and three inputs): ";
+    Matrix<int> x = ma;
+    x.apply([](int v) { return v * v; }); // THE TEST
+    x.apply(mb, [](int v, int w) { return v + w; });
+    x.apply(mb, mc, [](int v, int w, int z) { return v * w - z; });
+    bool ok = true;
+    for (int i = 0; i < 6; i++)
+        ok = ok && x.data()[i] == a[i] * a[i] + 1 - c[i];
+    bool thrown = false;
+    try {
+        x.apply(Matrix<int>(3, 2), [](int v, int w) { return v + w; });
+    } catch (const invalid_argument&) {
+        thrown = true;
+    }
+    (ok && thrown) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "map_1 (large, parallel): ";
+    const size_t n = 300;
+    Matrix<double> p(n, n), q(n, n);
+    for (size_t i = 0; i < n * n; i++) {
+        p.data()[i] = (double) (i % 13) / 7 - 1;
+        q.data()[i] = (double) (i % 5);
+    }
+    MatrixConfig::setThreadCount(4);
+    MatrixConfig::setParallelThreshold(1024);
+    Matrix<double> r = zip(p, q, [](double u, double v) { return exp(u) * v; }); // THE TEST
+    Matrix<double> s = p;
+    s.apply([](double u) { return u < 0 ? 0.0 : u; });
+    MatrixConfig::setThreadCount(0);
+    MatrixConfig::setParallelThreshold(1 << 16);
+    ok = r.rows() == n && r.cols() == n;
+    for (size_t i = 0; i < n * n; i++)
+        ok = ok && r.data()[i] == exp(p.data()[i]) * q.data()[i] && s.data()[i] == max(p.data()[i], 0.0);
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+}
+
 void test_multiply_1() {
     int a[] = { 2, 3, 4, 5, 6, 7 };
     int b[] = { 9, 6, 8, 5, 7, 4 };
@@ -94,6 +216,833 @@ void test_multiply_2() {
     (test == test3) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
 }
 
+void test_multiply_3() {
+    // large enough to go through the blocked kernel, with partial tiles
+    const int R = 131, K = 260, C = 75;
+    Matrix<double> test = Matrix<double>(R, K);
+    Matrix<double> test2 = Matrix<double>(K, C);
+    for (int r = 0; r < R; r++)
+        for (int k = 0; k < K; k++)
+            test.set(r, k, (r * 7 + k * 3) % 11 / 3.0);
+    for (int k = 0; k < K; k++)
+        for (int c = 0; c < C; c++)
+            test2.set(k, c, (k * 5 + c) % 13 / 7.0);
+
+    Matrix<double> test3 = Matrix<double>(R, C);
+    for (int r = 0; r < R; r++)
+        for (int c = 0; c < C; c++) {
+            double temp = 0;
+            for (int k = 0; k < K; k++)
+                temp += test.get(r, k) * test2.get(k, c);
+            test3.set(r, c, temp);
+        }
+
+    cout << "multiply_3 (blocked * operator): ";
+    Matrix<double> res;
+    res = test * test2; // THE TEST
+    (res == test3) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+}
+
+void test_multiply_4() {
+    const int R = 100, K = 37, C = 81;     // odd sizes, padded
+    Matrix<double> test = Matrix<double>(R, K);
+    Matrix<double> test2 = Matrix<double>(K, C);
+    Matrix<long long> itest = Matrix<long long>(R, K);
+    Matrix<long long> itest2 = Matrix<long long>(K, C);
+    for (int r = 0; r < R; r++)
+        for (int k = 0; k < K; k++) {
+            test.set(r, k, (r * 7 + k * 3) % 11 / 8.0 - 0.5);
+            itest.set(r, k, (r * 7 + k * 3) % 11 - 5);
+        }
+    for (int k = 0; k < K; k++)
+        for (int c = 0; c < C; c++) {
+            test2.set(k, c, (k * 5 + c) % 13 / 3.0 - 2.0);
+            itest2.set(k, c, (k * 5 + c) % 13 - 6);
+        }
+    MatrixConfig::setStrassenCrossover(16);   // two levels
+
+    cout << "multiply_4 (Strassen-Winograd): ";
+    Matrix<double> res = Matrix<double>::multiply(test, test2, MultiplyAlgorithm::Strassen); // THE TEST
+    Matrix<double> exact = Matrix<double>::multiply(test, test2, MultiplyAlgorithm::Conventional);
+    double err = 0;
+    for (int r = 0; r < R; r++)
+        for (int c = 0; c < C; c++)
+            err = max(err, abs(res.get(r, c) - exact.get(r, c)));
+    bool same = Matrix<long long>::multiply(itest, itest2, MultiplyAlgorithm::Strassen) == itest * itest2;
+    (err < 1e-12 && same) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "multiply_4 (Strassen from operator*): ";
+    MatrixConfig::setStrassenThreshold(32);
+    Matrix<double> res2 = test * test2; // THE TEST
+    MatrixConfig::setStrassenThreshold(0);
+    Matrix<double> res3 = test * test2;
+    (res2 == res && res3 == exact) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    MatrixConfig::setStrassenThreshold(2048);
+    MatrixConfig::setStrassenCrossover(512);
+}
+
+void test_gemm_1() {
+    const int M = 45, K = 70, N = 33;
+    Matrix<double> a(M, K), at(K, M), b(K, N), bt(N, K), c(M, N);
+    for (int r = 0; r < M; r++)
+        for (int k = 0; k < K; k++) {
+            a.set(r, k, (r * 3 + k) % 7 - 3);
+            at.set(k, r, a.get(r, k));
+        }
+    for (int k = 0; k < K; k++)
+        for (int n = 0; n < N; n++) {
+            b.set(k, n, (k + n * 5) % 9 - 4);
+            bt.set(n, k, b.get(k, n));
+        }
+    for (int i = 0; i < M * N; i++)
+        c.data()[i] = i % 11;
+    Matrix<double> ab = a * b;
+
+    cout << "gemm_1 (c = 2*a*transpose(bt) + c, no allocations): ";
+    Matrix<double> res = c;
+    const std::uint64_t before = MatrixProfiler::snapshot().allocations;
+    Matrix<double>::gemm(2.0, a, Transpose::No, bt, Transpose::Yes, 1.0, res); // THE TEST
+    bool ok = MatrixProfiler::snapshot().allocations == before;
+    for (int i = 0; i < M * N; i++)
+        ok = ok && res.data()[i] == 2 * ab.data()[i] + c.data()[i];
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "gemm_1 (both transposed, beta -1 and 0): ";
+    res = c;
+    Matrix<double>::gemm(0.5, at, Transpose::Yes, bt, Transpose::Yes, -1.0, res); // THE TEST
+    Matrix<double> fresh(M, N);
+    fresh.data()[0] = NAN;      // not read with beta = 0
+    Matrix<double>::gemm(3.0, at, Transpose::Yes, b, Transpose::No, 0.0, fresh);
+    ok = true;
+    for (int i = 0; i < M * N; i++)
+        ok = ok && res.data()[i] == 0.5 * ab.data()[i] - c.data()[i] && fresh.data()[i] == 3 * ab.data()[i];
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "gemm_1 (c is an operand, views, wrong sizes): ";
+    Matrix<double> sq(K, K);
+    for (int i = 0; i < K * K; i++)
+        sq.data()[i] = i % 5 - 2;
+    Matrix<double> expect = sq * sq + sq;
+    Matrix<double>::gemm(1.0, sq, Transpose::No, sq, Transpose::No, 1.0, sq); // THE TEST
+    Matrix<double> big(M + 2, N + 3), wide(K + 1, M + 4);
+    wide.block(1, 4, K, M).assign(at.view());
+    Matrix<double>::gemm(1.0, wide.block(1, 4, K, M), Transpose::Yes, b.view(), Transpose::No,
+                         0.0, big.block(1, 2, M, N));
+    Matrix<double> block(big.block(1, 2, M, N));
+    bool thrown = false;
+    try {
+        Matrix<double> wrong(M, N + 1);
+        Matrix<double>::gemm(1.0, a, Transpose::No, b, Transpose::No, 1.0, wrong);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    (sq == expect && block == ab && thrown) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+}
+
+void test_gemv_1() {
+    const int M = 37, N = 3001;
+    Matrix<double> a(M, N), x(N, 1), xr(1, M), y(M, 1);
+    for (int r = 0; r < M; r++)
+        for (int c = 0; c < N; c++)
+            a.set(r, c, (r * 7 + c * 3) % 13 - 6);
+    for (int c = 0; c < N; c++)
+        x.set(c, 0, c % 5 - 2);
+    for (int r = 0; r < M; r++) {
+        xr.set(0, r, r % 4 - 1);
+        y.set(r, 0, r % 3);
+    }
+
+    cout << "gemv_1 (a*x, x'*a and x*y' through multiply): ";
+    Matrix<double> ax = a * x; // THE TEST
+    Matrix<double> xa = xr * a;
+    Matrix<double> outer = Matrix<double>::multiply(x, xr);
+    bool ok = ax.rows() == M && ax.cols() == 1 && xa.rows() == 1 && xa.cols() == N &&
+              outer.rows() == N && outer.cols() == M;
+    for (int r = 0; r < M && ok; r++) {
+        double sum = 0;
+        for (int c = 0; c < N; c++)
+            sum += a.get(r, c) * x.get(c, 0);
+        ok = ax.get(r, 0) == sum;
+    }
+    for (int c = 0; c < N && ok; c++) {
+        double sum = 0;
+        for (int r = 0; r < M; r++)
+            sum += xr.get(0, r) * a.get(r, c);
+        ok = xa.get(0, c) == sum;
+        for (int r = 0; r < M; r++)
+            ok = ok && outer.get(c, r) == x.get(c, 0) * xr.get(0, r);
+    }
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "gemv_1 (gemv, transposed, y aliased): ";
+    Matrix<double> res = y;
+    Matrix<double>::gemv(2.0, a, Transpose::No, x, -1.0, res); // THE TEST
+    Matrix<double> rest;
+    Matrix<double>::gemv(1.0, a, Transpose::Yes, xr, 0.0, rest);
+    Matrix<double> self(xr.transpose());
+    Matrix<double> square(M, M);
+    for (int i = 0; i < M * M; i++)
+        square.data()[i] = i % 6 - 2;
+    Matrix<double> expect = square * self;
+    Matrix<double>::gemv(1.0, square, Transpose::No, self, 0.0, self);
+    ok = rest.rows() == N && rest.cols() == 1 && self == expect;
+    for (int r = 0; r < M; r++)
+        ok = ok && res.get(r, 0) == 2 * ax.get(r, 0) - y.get(r, 0);
+    for (int c = 0; c < N; c++)
+        ok = ok && rest.get(c, 0) == xa.get(0, c);
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "gemv_1 (dot, axpy, ger, wrong sizes): ";
+    Matrix<int> u(1, 100), v(100, 1);
+    long check = 0;
+    for (int i = 0; i < 100; i++) {
+        u.set(0, i, i - 40);
+        v.set(i, 0, 3 * i % 17);
+        check += (i - 40) * (3 * i % 17);
+    }
+    int d = Matrix<int>::dot(u, v); // THE TEST
+    Matrix<int> w(u);
+    Matrix<int>::axpy(3, u, w);
+    Matrix<double> g = outer;
+    Matrix<double>::ger(0.5, x, xr, g);
+    ok = d == check;
+    for (int i = 0; i < 100; i++)
+        ok = ok && w.get(0, i) == 4 * u.get(0, i);
+    for (int c = 0; c < N; c++)
+        for (int r = 0; r < M; r++)
+            ok = ok && g.get(c, r) == 1.5 * outer.get(c, r);
+    int thrown = 0;
+    try {
+        Matrix<double>::gemv(1.0, a, Transpose::Yes, x, 0.0, res);
+    } catch (const std::invalid_argument&) {
+        thrown++;
+    }
+    try {
+        Matrix<int>::dot(u, Matrix<int>(2, 50));
+    } catch (const std::invalid_argument&) {
+        thrown++;
+    }
+    try {
+        Matrix<double>::ger(1.0, xr, x, g);
+    } catch (const std::invalid_argument&) {
+        thrown++;
+    }
+    (ok && thrown == 3) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+}
+
+// largest absolute element of a - b
+double maxDiff(const Matrix<double>& a, const Matrix<double>& b) {
+    double d = 0;
+    for (std::size_t i = 0; i < a.rows() * a.cols(); i++)
+        d = max(d, abs(a.data()[i] - b.data()[i]));
+    return d;
+}
+
+void test_solve_1() {
+    const int N = 150, NRHS = 7, M = 200;
+    unsigned int seed = 12345;
+    auto next = [&seed]() { seed = seed * 1103515245u + 12345u; return (double) ((seed >> 8) % 2001) / 1000.0 - 1.0; };
+    Matrix<double> a(N, N), b(N, NRHS), tall(M, 70), c(M, 3);
+    for (int i = 0; i < N * N; i++)
+        a.data()[i] = next();
+    for (int i = 0; i < N * NRHS; i++)
+        b.data()[i] = next();
+    for (int i = 0; i < M * 70; i++)
+        tall.data()[i] = next();
+    for (int i = 0; i < M * 3; i++)
+        c.data()[i] = next();
+    Matrix<double> eye(N, N);
+    for (int i = 0; i < N; i++)
+        eye.set(i, i, 1);
+
+    cout << "solve_1 (LU: solve, determinant, inverse, singular): ";
+    Matrix<double> x = solve(a, b); // THE TEST
+    LUDecomposition<double> lu(a);
+    Matrix<double> pa = a;
+    for (int i = 0; i < N; i++)
+        std::swap_ranges(pa.data() + i * N, pa.data() + (i + 1) * N, pa.data() + lu.pivots()[i] * N);
+    double k[] = { 4, 3, 0, 6, 3, 1, 2, 5, 7 };
+    double s[] = { 1, 2, 3, 2, 4, 6, 1, 0, 1 };
+    bool thrown = false;
+    try {
+        solve(Matrix<double>(3, 3, s), Matrix<double>(3, 1));
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    bool ok = maxDiff(a * x, b) < 1e-9 && maxDiff(lu.lower() * lu.upper(), pa) < 1e-12 &&
+              abs(determinant(Matrix<double>(3, 3, k)) + 56) < 1e-12 && maxDiff(a * inverse(a), eye) < 1e-9 &&
+              LUDecomposition<double>(Matrix<double>(3, 3, s)).isSingular() && thrown;
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "solve_1 (Cholesky, triangular solves): ";
+    Matrix<double> spd = a * a.transpose() + eye * N;
+    CholeskyDecomposition<double> chol(spd); // THE TEST
+    Matrix<double> l = chol.lower();
+    Matrix<double> y = b;
+    solveTriangular(l, y, Triangle::Lower);
+    solveTriangular(l, y, Triangle::Lower, Transpose::Yes);
+    thrown = false;
+    try {
+        CholeskyDecomposition<double> notPd(a);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    // the factorization itself leaves the upper triangle alone
+    Matrix<double> raw = spd;
+    matrix_detail::choleskyFactor<double>(N, raw.data(), N);
+    bool upper = true;
+    for (int i = 0; i < N; i++)
+        for (int j = i + 1; j < N; j++)
+            upper = upper && raw.get(i, j) == spd.get(i, j);
+    ok = maxDiff(l * l.transpose(), spd) < 1e-9 && maxDiff(spd * chol.solve(b), b) < 1e-9 &&
+         maxDiff(spd * y, b) < 1e-9 && abs(l.get(3, 100)) == 0 && thrown && upper;
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "solve_1 (QR, least squares): ";
+    QRDecomposition<double> qr(tall); // THE TEST
+    Matrix<double> q = qr.q(), r = qr.r();
+    Matrix<double> z = qr.solve(c);
+    Matrix<double> residual = tall * z;
+    for (int i = 0; i < M * 3; i++)
+        residual.data()[i] -= c.data()[i];
+    Matrix<double> normal = tall.transpose() * residual;   // 0 at the least squares solution
+    Matrix<double> eye70(70, 70);
+    for (int i = 0; i < 70; i++)
+        eye70.set(i, i, 1);
+    ok = q.rows() == M && q.cols() == 70 && r.rows() == 70 && maxDiff(q * r, tall) < 1e-12 &&
+         maxDiff(q.transpose() * q, eye70) < 1e-12 && maxDiff(normal, Matrix<double>(70, 3)) < 1e-10 &&
+         abs(r.get(5, 4)) == 0 && maxDiff(a * QRDecomposition<double>(a).solve(b), b) < 1e-9;
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+}
+
+void test_reduce_1() {
+    const int R = 100, C = 123;
+    Matrix<double> a(R, C);
+    Matrix<int> ia(R, C);
+    for (int r = 0; r < R; r++)
+        for (int c = 0; c < C; c++) {
+            a.set(r, c, ((r * 31 + c * 17) % 101 - 50) / 8.0);
+            ia.set(r, c, (r * 7 + c * 3) % 19 - 9);
+        }
+    a.set(57, 3, -100);
+    a.set(60, 2, 90);
+    a.set(99, 122, 90);
+
+    cout << "reduce_1 (sum, norms, min, max, trace): ";
+    double sum = a.sum(); // THE TEST
+    long double exact = 0, squares = 0, l1 = 0;
+    for (int i = 0; i < R * C; i++) {
+        exact += a.data()[i];
+        squares += a.data()[i] * a.data()[i];
+        l1 += abs(a.data()[i]);
+    }
+    std::array<std::size_t, 2> lo = a.argMin(), hi = a.argMax();
+    Matrix<double> nan(2, 3);
+    nan.set(0, 0, NAN);
+    nan.set(1, 2, -4);
+    bool ok = abs(sum - (double) exact) < 1e-9 && abs(a.normFrobenius() - sqrt((double) squares)) < 1e-9 &&
+              abs(a.normL1() - (double) l1) < 1e-9 && a.normMax() == 100 && a.minValue() == -100 &&
+              a.maxValue() == 90 && lo[0] == 57 && lo[1] == 3 && hi[0] == 60 && hi[1] == 2 &&
+              nan.minValue() == -4 && nan.maxValue() == 0 && Matrix<int>(0, 0).sum() == 0 &&
+              ia.trace() == ia.get(0, 0) + ia.get(1, 1) + ia.get(50, 50) + [&ia]() {
+                  int t = 0;
+                  for (int i = 0; i < R; i++)
+                      t += ia.get(i, i);
+                  return t - ia.get(0, 0) - ia.get(1, 1) - ia.get(50, 50);
+              }();
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "reduce_1 (row and column sums and means): ";
+    Matrix<int> rs = ia.rowSums(), cs = ia.colSums(); // THE TEST
+    Matrix<double> rm = ia.rowMeans(), cm = ia.colMeans();
+    ok = rs.rows() == R && rs.cols() == 1 && cs.rows() == 1 && cs.cols() == C;
+    for (int r = 0; r < R; r++) {
+        int t = 0;
+        for (int c = 0; c < C; c++)
+            t += ia.get(r, c);
+        ok = ok && rs.get(r, 0) == t && abs(rm.get(r, 0) - t / (double) C) < 1e-12;
+    }
+    for (int c = 0; c < C; c++) {
+        int t = 0;
+        for (int r = 0; r < R; r++)
+            t += ia.get(r, c);
+        ok = ok && cs.get(0, c) == t && abs(cm.get(0, c) - t / (double) R) < 1e-12;
+    }
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "reduce_1 (==, approxEqual, thread count independent): ";
+    Matrix<int> big(300, 400);
+    for (int i = 0; i < 300 * 400; i++)
+        big.data()[i] = i * 7;
+    Matrix<int> big2 = big;
+    bool same = big == big2; // THE TEST
+    big2.set(299, 399, 0);
+    Matrix<double> b = a, zero(1, 2), negZero(1, 2);
+    b.set(10, 10, b.get(10, 10) * (1 + 1e-12));
+    negZero.set(0, 1, -0.0);
+    Matrix<double> far = b;
+    far.set(20, 20, far.get(20, 20) + 1e-3);
+    ok = same && !(big == big2) && zero == negZero && !(nan == nan) &&
+         a.approxEqual(b, 1e-10) && !a.approxEqual(b, 0) && !a.approxEqual(far, 1e-10) &&
+         a.approxEqual(far, 0, 2e-3) && !nan.approxEqual(nan, 1, 1) && !a.approxEqual(Matrix<double>(R, C + 1), 1);
+    MatrixConfig::setThreadCount(4);
+    MatrixConfig::setParallelThreshold(1024);
+    ok = ok && a.sum() == sum && (big == big) && !(big == big2) && a.approxEqual(b, 1e-10) && big.colSums() == big.transpose().rowSums().transpose();
+    MatrixConfig::setThreadCount(0);
+    MatrixConfig::setParallelThreshold(1 << 16);
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+}
+
+void test_move_1() {
+    int a[] = { 2, 3, 4, 5, 6, 7 };
+    int b[] = { 9, 6, 8, 5, 7, 4 };
+    int c[] = { 70, 43, 142, 88 };  // c=a*b 
+
+    Matrix<int> test = Matrix<int>(2, 3, a);
+    Matrix<int> test2 = Matrix<int>(3, 2, b);
+    Matrix<int> test3 = Matrix<int>(2, 2, c);
+
+    cout << "move_1 (multiply into, buffer reused): ";
+    Matrix<int> res(2, 2);
+    int* before = res.data();
+    Matrix<int>::multiply(test, test2, res); // THE TEST
+    Matrix<int>::multiply(test, test2, res);
+    (res == test3 && res.data() == before) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "move_1 (move assignment): ";
+    Matrix<int> moved;
+    moved = std::move(res); // THE TEST
+    (moved == test3 && moved.data() == before && res.rows() == 0) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+}
+
+void test_cow_1() {
+    const size_t n = 200;
+    Matrix<double> a(n, n);
+    for (size_t i = 0; i < n * n; i++)
+        a.data()[i] = (double) (i % 11);
+    const Matrix<double> original = a;
+    auto elements = [](const Matrix<double>& x) { return x.data(); };
+
+    cout << "cow_1 (copies share until changed): ";
+    a.setStorage(MatrixStorage::CopyOnWrite);
+    Matrix<double> snap = a; // THE TEST
+    Matrix<double> snap2;
+    snap2 = snap;
+    bool ok = elements(snap) == elements(a) && elements(snap2) == elements(a) && a.sharesData() &&
+              snap2.storage() == MatrixStorage::CopyOnWrite && elements(original) != elements(a);
+    a.set(1, 2, -1);
+    ok = ok && elements(a) != elements(snap) && !a.sharesData() && snap.sharesData() &&
+         snap == original && snap2 == original && a.get(1, 2) == -1;
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "cow_1 (every change detaches): ";
+    Matrix<double> b1 = snap, b2 = snap, b3 = snap, b4 = snap, b5 = snap, b6 = snap, b7 = snap, b8 = snap;
+    b1[3][4] = 7; // THE TEST
+    b2.addInPlace(snap);
+    b3.multiplyInPlace(2);
+    b4.hadamardInPlace(snap);
+    b5.transposeInPlace();
+    b6 = b6 + snap;
+    b7.apply([](double x) { return x + 1; });
+    Matrix<double>::axpy(1, snap, b8);
+    Matrix<double> twice = original * 2, squared = hadamard(original, original);
+    ok = snap == original && b1.get(3, 4) == 7 && b2 == twice && b3 == twice && b4 == squared &&
+         b5 == original.transpose() && b6 == twice && b7 == original + Matrix<double>(n, n).map([](double) { return 1.0; }) &&
+         b8 == twice;
+    Matrix<double> b9 = snap;
+    b9.row(0).fill(5);
+    Matrix<double> b10 = snap;
+    original.convertTo(b10, ConvertMode::Cast);
+    snap.convertTo(snap, ConvertMode::Cast);
+    ok = ok && b9.get(0, 7) == 5 && snap.get(0, 7) == original.get(0, 7) && b10 == original && snap == original;
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "cow_1 (back to unique storage): ";
+    Matrix<double> c = snap;
+    c.setStorage(MatrixStorage::Unique); // THE TEST
+    const double* kept = elements(snap);
+    Matrix<double> d = snap;
+    snap.setStorage(MatrixStorage::Unique);
+    Matrix<double> e = snap;
+    ok = c.storage() == MatrixStorage::Unique && elements(c) != elements(snap) && !c.sharesData() && c == original &&
+         elements(snap) != elements(d) && d == original && elements(e) != elements(snap) && e == original &&
+         d.storage() == MatrixStorage::CopyOnWrite && !d.sharesData() && elements(d) == kept;
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+}
+
+void test_alloc_1() {
+    int a[] = { 2, 3, 4, 5, 6, 7 };
+    int b[] = { 9, 6, 8, 5, 7, 4 };
+    int c[] = { 70, 43, 142, 88 };  // c=a*b 
+
+    cout << "alloc_1 (aligned, zeroed): ";
+    Matrix<double> z(33, 17); // THE TEST
+    bool zero = ((std::size_t)z.data() % 64) == 0;
+    for (int r = 0; r < 33; r++)
+        for (int col = 0; col < 17; col++)
+            zero = zero && z.get(r, col) == 0;
+    zero ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "alloc_1 (pool allocator): ";
+    Matrix<int, PoolAllocator<int> > pa(2, 3, a);
+    Matrix<int, PoolAllocator<int> > pb(3, 2, b);
+    Matrix<int, PoolAllocator<int> > pc(2, 2, c);
+    int* first = NULL;
+    bool reused = true;
+    for (int i = 0; i < 3; i++) {
+        Matrix<int, PoolAllocator<int> > res = pa * pb; // THE TEST
+        if (first == NULL)
+            first = res.data();
+        reused = reused && res == pc && res.data() == first;
+    }
+    reused ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "alloc_1 (huge page allocator): ";
+    Matrix<float, HugePageAllocator<float> > big(1024, 1024, MatrixInit::Uninitialized);
+    Matrix<float, HugePageAllocator<float> > sum;
+    for (int r = 0; r < 1024; r++)
+        for (int col = 0; col < 1024; col++)
+            big[r][col] = (float)(r - col);
+    sum = big + big; // THE TEST
+    (sum.get(1000, 3) == 1994.0f && sum.get(3, 1000) == -1994.0f) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+}
+
+void test_fixed_1() {
+    int a[] = { 2, 3, 4, 5, 6, 7 };
+    int b[] = { 9, 6, 8, 5, 7, 4 };
+    int c[] = { 70, 43, 142, 88 };  // c=a*b 
+
+    FixedMatrix<int, 2, 3> test(a);
+    FixedMatrix<int, 3, 2> test2(b);
+    FixedMatrix<int, 2, 2> test3(c);
+
+    cout << "fixed_1 (multiply): ";
+    FixedMatrix<int, 2, 2> res = test * test2; // THE TEST
+    (res == test3) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "fixed_1 (add, transpose): ";
+    FixedMatrix<int, 2, 3> sum = test + test2.transpose(); // THE TEST
+    (sum.get(0, 0) == 11 && sum.get(0, 1) == 11 && sum.get(1, 2) == 11 && sum.get(1, 0) == 11) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "fixed_1 (with Matrix): ";
+    Matrix<int> dyn = Matrix<int>(2, 3, a);
+    Matrix<int> prod = dyn * test2;     // THE TEST
+    Matrix<int> twice = test + dyn;
+    FixedMatrix<int, 2, 2> back(prod);
+    (back == test3 && twice.get(1, 2) == 14 && test.toMatrix() == dyn) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+}
+
+void test_view_1() {
+    int a[] = { 1, 2, 3, 4,
+                5, 6, 7, 8,
+                9, 10, 11, 12 };
+    int b[] = { 6, 7, 10, 11 };     // block (1,1) 2x2 of a
+    int c[] = { 4, 8, 12 };         // column 3 of a
+
+    Matrix<int> test = Matrix<int>(3, 4, a);
+
+    cout << "view_1 (block, column): ";
+    Matrix<int> blk(test.block(1, 1, 2, 2)); // THE TEST
+    Matrix<int> col(test.col(3));
+    (blk == Matrix<int>(2, 2, b) && col == Matrix<int>(3, 1, c)) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "view_1 (add, hadamard into a block): ";
+    Matrix<int> res = test;
+    Matrix<int>::add(test.block(0, 0, 2, 2), test.block(1, 2, 2, 2), res.block(1, 0, 2, 2)); // THE TEST
+    test.row(2).hadamardInPlace(test.row(0));
+    (res.get(1, 0) == 8 && res.get(2, 1) == 18 && res.get(0, 0) == 1 && test.get(2, 3) == 48) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "view_1 (multiply, transpose blocks): ";
+    Matrix<int> sq(3, 3);
+    Matrix<int>::multiply(res.block(0, 0, 3, 2), res.block(0, 1, 2, 3), sq); // THE TEST
+    Matrix<int> ref = Matrix<int>(res.block(0, 0, 3, 2)) * Matrix<int>(res.block(0, 1, 2, 3));
+    Matrix<int> tr(4, 3);
+    res.view().transpose(tr);
+    // overlapping: the product of the first two columns written over them
+    Matrix<int> over = res;
+    Matrix<int>::multiply(over.block(0, 0, 2, 2), over.block(0, 0, 2, 2), over.block(0, 0, 2, 2));
+    Matrix<int> sq2 = Matrix<int>(res.block(0, 0, 2, 2)) * Matrix<int>(res.block(0, 0, 2, 2));
+    (sq == ref && tr == res.transpose() && Matrix<int>(over.block(0, 0, 2, 2)) == sq2) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "view_1 (assign, add a block one row down): ";
+    Matrix<int> orig(6, 4), big(300, 256);
+    for (std::size_t i = 0; i < 6; i++)
+        for (std::size_t j = 0; j < 4; j++)
+            orig.set(i, j, (int) (i * 4 + j));
+    for (std::size_t i = 0; i < 300; i++)
+        for (std::size_t j = 0; j < 256; j++)
+            big.set(i, j, (int) (i * 7 + j));
+    Matrix<int> shift = orig, sum = orig, bigShift = big;
+    shift.view().block(1, 0, 5, 3).assign(shift.view().block(0, 0, 5, 3)); // THE TEST
+    sum.view().block(1, 0, 5, 4).addInPlace(sum.view().block(0, 0, 5, 4));
+    bigShift.view().block(1, 0, 299, 256).assign(bigShift.view().block(0, 0, 299, 256));
+    bool shifted = true;
+    for (std::size_t i = 1; i < 6; i++)
+        for (std::size_t j = 0; j < 4; j++)
+            shifted = shifted && shift.get(i, j) == (j < 3 ? orig.get(i - 1, j) : orig.get(i, j)) &&
+                      sum.get(i, j) == orig.get(i, j) + orig.get(i - 1, j);
+    for (std::size_t i = 1; i < 300; i++)
+        for (std::size_t j = 0; j < 256; j++)
+            shifted = shifted && bigShift.get(i, j) == big.get(i - 1, j);
+    (shifted && shift.get(0, 0) == 0 && sum.get(0, 3) == 3) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+}
+
+void test_sparse_1() {
+    int a[] = { 0, 3, 0,
+                5, 0, 0 };
+    int b[] = { 9, 6, 8, 5, 7, 4 };
+    int c[] = { 24, 15, 45, 30 };   // c=a*b 
+    int d[] = { 0, 18, 0, 25, 0, 0 };  // d=hadamard(a, b as 2x3)
+
+    Matrix<int> test = Matrix<int>(2, 3, a);
+    Matrix<int> test2 = Matrix<int>(3, 2, b);
+    Matrix<int> test3 = Matrix<int>(2, 2, c);
+
+    cout << "sparse_1 (convert): ";
+    SparseMatrix<int> sp(test); // THE TEST
+    SparseMatrix<int> spc(test, SparseFormat::CSC);
+    (sp.nnz() == 2 && sp.toDense() == test && spc.toDense() == test && sp == spc) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "sparse_1 (sparse * dense, dense * sparse): ";
+    Matrix<int> res = sp * test2; // THE TEST
+    Matrix<int> res2 = test2.transpose() * spc.transpose();
+    (res == test3 && res2 == test3.transpose()) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "sparse_1 (SpMV): ";
+    vector<int> x(3);
+    x[0] = 1; x[1] = 2; x[2] = 3;
+    vector<int> y = sp.multiply(x); // THE TEST
+    vector<int> y2 = spc.multiply(x);
+    // large enough to be split over the threads
+    vector<SparseTriplet<int> > many;
+    for (std::size_t k = 0; k < 120000; k++) {
+        SparseTriplet<int> t = { (k * 7919) % 20000, (k * 104729) % 300, (int) (k % 9) - 4 };
+        many.push_back(t);
+    }
+    SparseMatrix<int> bigr(20000, 300, many), bigc(20000, 300, many, SparseFormat::CSC);
+    vector<int> xs(300);
+    for (std::size_t j = 0; j < 300; j++)
+        xs[j] = (int) (j % 5) - 2;
+    (y.size() == 2 && y[0] == 6 && y[1] == 5 && y == y2 && bigc.multiply(xs) == bigr.multiply(xs)) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "sparse_1 (add, hadamard): ";
+    Matrix<int> dense2 = Matrix<int>(2, 3, b);
+    SparseMatrix<int> sum = sp + spc; // THE TEST
+    SparseMatrix<int> had = sp.hadamard(dense2);
+    SparseMatrix<int> none = sp.hadamard(SparseMatrix<int>(Matrix<int>(test * -1)));
+    (sum.toDense() == Matrix<int>(test * 2) && had.toDense() == Matrix<int>(2, 3, d) && none.nnz() == 2 && (sp + SparseMatrix<int>(Matrix<int>(test * -1))).nnz() == 0)
+        ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+}
+
+void test_packed_1() {
+    // larger than one block of rows, so the blocked kernels are all used
+    const std::size_t N = 150, K = 70, C = 5;
+    Matrix<int> a(N, K), d(N, N), b(N, C), bc(N, C, MatrixLayout::ColumnMajor);
+    for (std::size_t i = 0; i < N; i++) {
+        for (std::size_t k = 0; k < K; k++)
+            a.set(i, k, (int) ((i * 7 + k * 3) % 11) - 5);
+        for (std::size_t j = 0; j < N; j++)
+            d.set(i, j, (int) ((i * 5 + j * 9) % 13) - 6);
+        for (std::size_t j = 0; j < C; j++) {
+            b.set(i, j, (int) ((i + j * 4) % 7) - 3);
+            bc.set(i, j, b.get(i, j));
+        }
+    }
+    Matrix<int> bt = b.transpose();
+
+    cout << "packed_1 (syrk, symmetric * dense): ";
+    SymmetricMatrix<int> s = syrk(a); // THE TEST
+    Matrix<int> full = a * a.transpose();
+    SymmetricMatrix<int> s2 = syrk(Matrix<int>(a.transpose()), Transpose::Yes);
+    SymmetricMatrix<int> s3 = s;
+    SymmetricMatrix<int>::syrk(2, a, Transpose::No, 1, s3);
+    (s.values().size() == N * (N + 1) / 2 && s.toDense() == full && s == s2 && SymmetricMatrix<int>(full) == s &&
+     s3.toDense() == Matrix<int>(full * 3) && s * b == full * b && s * bc == full * b && bt * s == bt * full)
+        ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "packed_1 (triangular * dense, dense * triangular): ";
+    TriangularMatrix<int> lower(d, Triangle::Lower), upper(d, Triangle::Upper); // THE TEST
+    Matrix<int> ld = d, ud = d;
+    for (std::size_t i = 0; i < N; i++)
+        for (std::size_t j = 0; j < N; j++) {
+            if (j > i)
+                ld.set(i, j, 0);
+            if (j < i)
+                ud.set(i, j, 0);
+        }
+    bool thrown = false;
+    try {
+        lower.set(0, 1, 1);
+    } catch (std::invalid_argument&) {
+        thrown = true;
+    }
+    lower.set(0, 1, 0);
+    (thrown && lower.toDense() == ld && upper.toDense() == ud && lower.get(0, 1) == 0 && !(lower == upper) &&
+     lower * b == ld * b && upper * bc == ud * b && bt * lower == bt * ld && bt * upper == bt * ud && lower + d == Matrix<int>(ld + d))
+        ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "packed_1 (band * dense, dense * band): ";
+    BandMatrix<int> tri(d, 1, 2), wide(d, 70, 3); // THE TEST
+    Matrix<int> td = d, wd = d;
+    for (std::size_t i = 0; i < N; i++)
+        for (std::size_t j = 0; j < N; j++) {
+            if (j + 1 < i || j > i + 2)
+                td.set(i, j, 0);
+            if (j + 70 < i || j > i + 3)
+                wd.set(i, j, 0);
+        }
+    BandMatrix<int> rect(Matrix<int>(d.block(0, 0, 40, N)), 1, 2);
+    (tri.values().size() == N * 4 && tri.toDense() == td && wide.toDense() == wd && tri == BandMatrix<int>(td, 1, 2) &&
+     tri * b == td * b && tri * bc == td * b && wide * b == wd * b && bt * tri == bt * td && bt * wide == bt * wd &&
+     rect * b == Matrix<int>(td.block(0, 0, 40, N)) * b && d + tri == Matrix<int>(d + td))
+        ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+}
+
+void test_batch_1() {
+    const std::size_t N = 37;              // not a whole number of groups
+    MatrixBatch<int> a(N, 3, 5), b(N, 5, 4), b2(N, 3, 5);
+    vector<Matrix<int> > ma, mb, mb2;
+    for (std::size_t i = 0; i < N; i++) {
+        Matrix<int> x(3, 5), y(5, 4), z(3, 5);
+        for (int e = 0; e < 15; e++) {
+            x.data()[e] = (int) (i * 3 + e) % 7 - 3;
+            z.data()[e] = (int) (i + e * 5) % 9 - 4;
+        }
+        for (int e = 0; e < 20; e++)
+            y.data()[e] = (int) (i * 5 + e) % 11 - 5;
+        a.setMatrix(i, x);
+        b.setMatrix(i, y);
+        b2.setMatrix(i, z);
+        ma.push_back(x);
+        mb.push_back(y);
+        mb2.push_back(z);
+    }
+
+    cout << "batch_1 (multiply, add, hadamard per matrix): ";
+    MatrixBatch<int> prod, sum, had;
+    MatrixBatch<int>::multiply(a, b, prod); // THE TEST
+    MatrixBatch<int>::add(a, b2, sum);
+    MatrixBatch<int>::hadamard(a, b2, had);
+    bool ok = prod.count() == N && prod.rows() == 3 && prod.cols() == 4;
+    for (std::size_t i = 0; i < N; i++)
+        ok = ok && prod.matrix(i) == ma[i] * mb[i] && sum.matrix(i) == ma[i] + mb2[i] &&
+             had.matrix(i) == Matrix<int>(ma[i].hadamard(mb2[i]));
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "batch_1 (transpose, in place and square): ";
+    MatrixBatch<int> t = b.transpose(); // THE TEST
+    MatrixBatch<int> sq(N, 4, 4);
+    for (std::size_t i = 0; i < N; i++)
+        for (std::size_t e = 0; e < 16; e++)
+            sq(i, e / 4, e % 4) = (int) (i * 16 + e);
+    MatrixBatch<int> sqt = sq.transpose();
+    sq.transposeInPlace();
+    ok = t.rows() == 4 && t.cols() == 5 && sq == sqt;
+    for (std::size_t i = 0; i < N; i++)
+        ok = ok && t.matrix(i) == mb[i].transpose() && sq.get(i, 1, 2) == (int) (i * 16 + 9);
+    t.transposeInPlace();
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "batch_1 (float products exactly those of Matrix): ";
+    MatrixBatch<float> f(N, 6, 6), g(N, 6, 6), fg;
+    for (std::size_t i = 0; i < N; i++)
+        for (std::size_t e = 0; e < 36; e++) {
+            f(i, e / 6, e % 6) = (float) ((i + e) % 13) / 7.0f;
+            g(i, e / 6, e % 6) = (float) ((i * 7 + e) % 5) / 3.0f;
+        }
+    MatrixBatch<float>::multiply(f, g, fg); // THE TEST
+    ok = t == b;
+    for (std::size_t i = 0; i < N; i++)
+        ok = ok && fg.matrix(i) == f.matrix(i) * g.matrix(i);
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "batch_1 (counts must match): ";
+    bool thrown = false;
+    try {
+        MatrixBatch<int> other(N + 1, 3, 5);
+        MatrixBatch<int>::add(a, other, sum); // THE TEST
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    thrown ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+}
+
+void test_io_1() {
+    const int R = 150, K = 130, C = 170;
+    Matrix<double> test = Matrix<double>(R, K);
+    Matrix<double> test2 = Matrix<double>(K, C);
+    for (int r = 0; r < R; r++)
+        for (int k = 0; k < K; k++)
+            test.set(r, k, (r * 7 + k * 3) % 11 / 8.0);
+    for (int k = 0; k < K; k++)
+        for (int c = 0; c < C; c++)
+            test2.set(k, c, (k * 5 + c) % 13 / 3.0);
+
+    cout << "io_1 (save, load, map): ";
+    saveMatrix("io_1_a.mat", test); // THE TEST
+    saveMatrix("io_1_b.mat", test2);
+    Matrix<double> loaded = loadMatrix<double>("io_1_a.mat");
+    Matrix<double> mapped = mapMatrix<double>("io_1_a.mat");
+    bool typeRefused = false;
+    try {
+        loadMatrix<float>("io_1_a.mat");
+    } catch (std::runtime_error&) {
+        typeRefused = true;
+    }
+    (loaded == test && mapped == test && !mapped.ownsData() && loaded.ownsData() && typeRefused)
+        ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "io_1 (streaming multiply, add): ";
+    MatrixStream::setMemoryBudget(1);   // smallest tiles, 3 x 3 x 3 of them
+    Matrix<double> mapped2 = mapMatrix<double>("io_1_b.mat");
+    Matrix<double> prod = createMatrixFile<double>("io_1_c.mat", R, C);
+    Matrix<double> sum = createMatrixFile<double>("io_1_d.mat", R, K);
+    MatrixStream::multiply(mapped, mapped2, prod); // THE TEST
+    MatrixStream::add(mapped, test, sum);
+    MatrixStream::setMemoryBudget(size_t(1) << 30);
+    prod = Matrix<double>(); // unmaps, so the file is complete
+    (loadMatrix<double>("io_1_c.mat") == test * test2 && sum == test * 2.0)
+        ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    remove("io_1_a.mat");
+    remove("io_1_b.mat");
+    remove("io_1_c.mat");
+    remove("io_1_d.mat");
+}
+
+void test_profile_1() {
+    Matrix<double> test = Matrix<double>(10, 20);
+    Matrix<double> test2 = Matrix<double>(20, 30);
+
+    cout << "profile_1 (counters): ";
+    MatrixProfiler::reset();
+    MatrixProfiler::enable();
+    Matrix<double> res = test * test2; // THE TEST
+    Matrix<double> res2 = res + res * 2.0;
+    res2.transposeInPlace();
+    MatrixProfiler::enable(false);
+    Matrix<double> notCounted = test * test2;
+    MatrixProfile p = MatrixProfiler::snapshot();
+    (p[MatrixOp::Multiply].calls == 1 && p[MatrixOp::Multiply].flops == 2 * 10 * 30 * 20 &&
+     p[MatrixOp::Multiply].bytesAllocated == 10 * 30 * sizeof(double) &&
+     p[MatrixOp::Add].calls == 1 && p[MatrixOp::Add].flops == 2 * 10 * 30 && p[MatrixOp::Scale].calls == 0 &&
+     p[MatrixOp::Transpose].bytesCopied == 10 * 30 * sizeof(double) &&
+     p[MatrixOp::Multiply].percentile(1.0) >= p[MatrixOp::Multiply].nanoseconds)
+        ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "profile_1 (live, peak memory): ";
+    std::uint64_t live = MatrixProfiler::snapshot().liveBytes;
+    MatrixProfiler::reset();
+    std::uint64_t peak;
+    {
+        Matrix<float> big(100, 100);    // THE TEST
+        peak = MatrixProfiler::snapshot().peakBytes;
+    }
+    (MatrixProfiler::snapshot().liveBytes == live && peak == live + 100 * 100 * sizeof(float))
+        ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+}
+
 void test_transpose_1() {
     int a[] = { 2, 3, 4, 5, 6, 7 };
     int b[] = { 2, 5, 3, 6, 4, 7 };  // b= transpose of a
@@ -111,6 +1060,233 @@ void test_transpose_1() {
     (test == test2) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
 }
 
+// true when b is the transpose of a
+template <class T>
+bool isTransposeOf(const Matrix<T>& a, const Matrix<T>& b) {
+    if (a.rows() != b.cols() || a.cols() != b.rows())
+        return false;
+    for (unsigned int r = 0; r < a.rows(); r++)
+        for (unsigned int c = 0; c < a.cols(); c++)
+            if (a.get(r, c) != b.get(c, r))
+                return false;
+    return true;
+}
+
+template <class T>
+bool transposeSizes() {
+    const int sizes[][2] = { { 1, 1 }, { 1, 9 }, { 8, 8 }, { 7, 13 }, { 33, 65 }, { 100, 100 }, { 131, 40 }, { 3, 300 } };
+    bool ok = true;
+    for (int i = 0; i < 8; i++) {
+        Matrix<T> test(sizes[i][0], sizes[i][1]);
+        for (int r = 0; r < sizes[i][0]; r++)
+            for (int c = 0; c < sizes[i][1]; c++)
+                test.set(r, c, (T)(r * 1000 + c));
+        Matrix<T> res = test.transpose();
+        Matrix<T> inplace = test;
+        inplace.transposeInPlace();
+        ok = ok && isTransposeOf(test, res) && inplace == res;
+    }
+    return ok;
+}
+
+void test_transpose_2() {
+    cout << "transpose_2 (tiled, float): ";
+    transposeSizes<float>() ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "transpose_2 (tiled, double): ";
+    transposeSizes<double>() ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "transpose_2 (tiled, short): ";
+    transposeSizes<short>() ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+}
+
+void test_layout_1() {
+    const size_t R = 150, K = 130, C = 90;
+    Matrix<double> a(R, K), b(R, K), c(K, C);
+    for (size_t r = 0; r < R; r++)
+        for (size_t k = 0; k < K; k++) {
+            a.set(r, k, (double) ((r * 7 + k * 3) % 11) - 5);
+            b.set(r, k, (double) ((r + k * 5) % 9) - 4);
+        }
+    for (size_t k = 0; k < K; k++)
+        for (size_t j = 0; j < C; j++)
+            c.set(k, j, (double) ((k * 3 + j) % 7) - 3);
+    Matrix<double> ac = a, bc = b, cc = c;
+    ac.setLayout(MatrixLayout::ColumnMajor);
+    bc.setLayout(MatrixLayout::ColumnMajor);
+    cc.setLayout(MatrixLayout::ColumnMajor);
+
+    cout << "layout_1 (mixed layouts, same results): ";
+    Matrix<double> sum = a + bc * 2.0; // THE TEST
+    Matrix<double> sum2 = ac;
+    sum2.addInPlace(b);
+    Matrix<double> had = bc;
+    had.hadamardInPlace(a);
+    Matrix<double> prod(R, C, MatrixLayout::ColumnMajor), prod2;
+    Matrix<double>::multiply(a, cc, prod);
+    Matrix<double>::multiply(ac, cc, prod2);
+    Matrix<float> f(R, K, MatrixLayout::ColumnMajor), f2;
+    a.convertTo(f);
+    ac.convertTo(f2);
+    Matrix<float> fr;
+    a.convertTo(fr);
+    bool ok = ac.get(3, 4) == a.get(3, 4) && ac == a && !(ac == b) && ac.approxEqual(a, 0.0) &&
+              sum == a + b * 2.0 && sum.layout() == MatrixLayout::RowMajor && sum2 == a + b && had == hadamard(a, b) &&
+              prod == a * c && prod2 == a * c && prod2.layout() == MatrixLayout::ColumnMajor &&
+              f == fr && f2 == fr && f2.layout() == MatrixLayout::ColumnMajor &&
+              ac.rowSums() == a.rowSums() && ac.colSums() == a.colSums() &&
+              ac.get(ac.argMax()[0], ac.argMax()[1]) == a.maxValue() &&
+              ac.trace() == a.trace() && ac.sum() == a.sum();
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "layout_1 (O(1) transpose): ";
+    Matrix<double> t = a;
+    const double* before = t.data();
+    t.transposeLayout(); // THE TEST
+    Matrix<double> aTc(K, C);
+    Matrix<double>::multiply(a.transposedView(), b.block(0, 0, R, C), aTc.view());
+    Matrix<double> g(K, C, MatrixLayout::ColumnMajor);
+    const Matrix<double> bb(bc.block(0, 0, R, C));
+    Matrix<double>::gemm(1.0, ac, Transpose::Yes, bb, Transpose::No, 0.0, g);
+    Matrix<double> x(K, 1), y, yc;
+    for (size_t k = 0; k < K; k++)
+        x.set(k, 0, (double) (k % 5));
+    Matrix<double>::gemv(1.0, a, Transpose::No, x, 0.0, y);
+    Matrix<double>::gemv(1.0, ac, Transpose::No, x, 0.0, yc);
+    Matrix<double> tc = ac;
+    tc.transposeInPlace();
+    const Matrix<double> expected = a.transpose() * Matrix<double>(b.block(0, 0, R, C));
+    ok = t.data() == before && t.layout() == MatrixLayout::ColumnMajor && t == a.transpose() &&
+         aTc == expected && g == expected && bb.layout() == MatrixLayout::ColumnMajor && y == yc && tc == a.transpose() && tc.layout() == MatrixLayout::ColumnMajor &&
+         ac.transpose() == a.transpose();
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "layout_1 (column-major files, solve): ";
+    saveMatrix("layout_1.mat", ac); // THE TEST
+    Matrix<double> loaded = loadMatrix<double>("layout_1.mat");
+    Matrix<double> mapped = mapMatrix<double>("layout_1.mat");
+    bool noRows = false;
+    try {
+        loaded[0];
+    } catch (std::invalid_argument&) {
+        noRows = true;
+    }
+    Matrix<double> s(K, K);
+    for (size_t i = 0; i < K; i++)
+        for (size_t j = 0; j < K; j++)
+            s.set(i, j, i == j ? (double) K : (double) ((i * 3 + j) % 5));
+    Matrix<double> sc = s, rhs = c, rhsc = cc;
+    sc.setLayout(MatrixLayout::ColumnMajor);
+    LUDecomposition<double>(sc).solveInPlace(rhsc);
+    ok = loaded.layout() == MatrixLayout::ColumnMajor && loaded == a && mapped == a && noRows &&
+         rhsc.approxEqual(solve(s, rhs), 1e-12, 1e-12) && solve(sc, c).approxEqual(solve(s, c), 1e-12, 1e-12);
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+    remove("layout_1.mat");
+}
+
+void test_parallel_1() {
+    const int R = 300, C = 200;
+    Matrix<double> test = Matrix<double>(R, C);
+    Matrix<double> test2 = Matrix<double>(C, R);
+    for (int r = 0; r < R; r++)
+        for (int c = 0; c < C; c++) {
+            test.set(r, c, (r + 2 * c) % 9 / 4.0);
+            test2.set(c, r, (3 * r + c) % 7 / 2.0);
+        }
+
+    // serial results first
+    MatrixConfig::setThreadCount(1);
+    Matrix<double> prod = test * test2;
+    Matrix<double> sum = test + test;
+    Matrix<double> trans = test.transpose();
+
+    MatrixConfig::setThreadCount(4);
+    MatrixConfig::setParallelThreshold(1024);
+    cout << "parallel_1 (4 threads, * + transpose): ";
+    Matrix<double> res = test * test2; // THE TEST
+    Matrix<double> res2 = test + test;
+    Matrix<double> res3 = test.transpose();
+    (res == prod && res2 == sum && res3 == trans) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    MatrixConfig::setThreadCount(0);
+    MatrixConfig::setParallelThreshold(1 << 16);
+}
+
+void test_async_1() {
+    const int N = 120;
+    Matrix<double> a(N, N), b(N, N);
+    for (int i = 0; i < N * N; i++) {
+        a.data()[i] = i % 7 - 3;
+        b.data()[i] = i % 5 - 2;
+    }
+    Matrix<double> bt = b.transpose();
+    Matrix<double> expect = a * b + Matrix<double>(a.hadamard(bt));
+
+    MatrixConfig::setThreadCount(4);
+    MatrixConfig::setParallelThreshold(1024);
+    cout << "async_1 (futures, independent branches): ";
+    MatrixFuture<Matrix<double> > fa = asyncValue(a), fb = asyncValue(b);
+    MatrixFuture<Matrix<double> > sum = asyncAdd(asyncMultiply(fa, fb), asyncHadamard(fa, asyncTranspose(fb))); // THE TEST
+    MatrixFuture<Matrix<float> > single = asyncConvert<float>(sum);
+    bool ok = sum.get() == expect && single.get().rows() == N && single.get().get(3, 4) == (float) expect.get(3, 4);
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "async_1 (graph: submit, wait, errors): ";
+    MatrixTaskGraph graph;
+    MatrixFuture<Matrix<double> > x = graph.value(a);
+    MatrixFuture<Matrix<double> > chain = x;
+    for (int i = 0; i < 50; i++)
+        chain = graph.add(chain, x);
+    MatrixFuture<Matrix<double> > bad = graph.multiply(x, graph.value(Matrix<double>(N + 1, 2)));
+    MatrixFuture<Matrix<double> > afterBad = graph.transpose(bad);
+    bool early = false;
+    try {
+        chain.get();
+    } catch (const std::logic_error&) {
+        early = !chain.ready() && graph.size() == 52;
+    }
+    graph.submit(); // THE TEST
+    int thrown = 0;
+    try {
+        graph.wait();
+    } catch (const std::invalid_argument&) {
+        thrown++;
+    }
+    try {
+        afterBad.get();
+    } catch (const std::invalid_argument&) {
+        thrown++;
+    }
+    ok = early && thrown == 2 && chain.ready() && graph.size() == 0;
+    for (int i = 0; i < N * N; i++)
+        ok = ok && chain.get().data()[i] == 51 * a.data()[i];
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "async_1 (one thread): ";
+    MatrixConfig::setThreadCount(1);
+    MatrixFuture<Matrix<double> > one = asyncMultiply(asyncValue(a), asyncValue(b)); // THE TEST
+    (one.ready() && one.get() == a * b) ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "async_1 (no operation): ";
+    MatrixFuture<Matrix<double> > none, moved = std::move(one);
+    int errors = 0;
+    try {
+        none.get(); // THE TEST
+    } catch (const std::logic_error&) {
+        errors++;
+    }
+    try {
+        one.wait();
+    } catch (const std::logic_error&) {
+        errors++;
+    }
+    (errors == 2 && !none.valid() && !one.valid() && moved.valid() && moved.get() == a * b)
+        ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    MatrixConfig::setThreadCount(0);
+    MatrixConfig::setParallelThreshold(1 << 16);
+}
+
 void test_convert_1() {
     int a[] = { 2, 3, 4, 5, 6, 7 };
     Matrix<int> test = Matrix<int>(2, 3, a);
@@ -123,6 +1299,92 @@ void test_convert_1() {
     fmat.debug();
 }
 
+void test_convert_2() {
+    float a[] = { -1.5f, -0.5f, 0.5f, 1.5f, 2.7f, -2.7f, 300.0f, -1e10f, 1e10f, 126.5f, -128.6f, 0.0f };
+    signed char cast[] = { -1, 0, 0, 1, 2, -2 };
+    signed char rounded[] = { -2, 0, 0, 2, 3, -3 };
+    signed char quantized[] = { -2, 0, 0, 2, 3, -3, 127, -128, 127, 126, -128, 0 };
+    Matrix<float> test = Matrix<float>(2, 6, a);
+
+    cout << "convert_2 (cast, round, round and saturate): ";
+    Matrix<signed char> small;
+    Matrix<float>(1, 6, a).convertTo(small);
+    Matrix<signed char> round;
+    Matrix<float>(1, 6, a).convertTo(round, ConvertMode::Round);
+    Matrix<signed char> q;
+    test.convertTo(q, ConvertMode::RoundSaturate); // THE TEST
+    Matrix<signed char> q2;
+    matrix_detail::setSimdLevel(matrix_detail::SIMD_SSE2);     // the loops without AVX2
+    test.convertTo(q2, ConvertMode::RoundSaturate);
+    matrix_detail::setSimdLevel(matrix_detail::SIMD_AVX512);
+    bool ok = small == Matrix<signed char>(1, 6, cast) && round == Matrix<signed char>(1, 6, rounded) &&
+              q == Matrix<signed char>(2, 6, quantized) && q2 == q;
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "convert_2 (saturating integers, output reused): ";
+    Matrix<long long> big(300, 300);
+    for (int i = 0; i < 300 * 300; i++)
+        big.data()[i] = (long long) (i - 45000) * 100000;
+    Matrix<int> narrow(300, 300);
+    int* before = narrow.data();
+    big.convertTo(narrow, ConvertMode::Saturate); // THE TEST
+    ok = narrow.data() == before && narrow.get(0, 0) == -2147483647 - 1 && narrow.get(299, 299) == 2147483647 &&
+         narrow.get(150, 0) == 0 && narrow.get(150, 1) == 100000;
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+}
+
+void test_quant_1() {
+    const int R = 70, K = 90, C = 50;
+    Matrix<std::int8_t> a(R, K), b(K, C);
+    Matrix<long long> a64(R, K), b64(K, C);
+    for (int i = 0; i < R * K; i++)
+        a64.data()[i] = a.data()[i] = (std::int8_t) (i * 37 % 255 - 127);
+    for (int i = 0; i < K * C; i++)
+        b64.data()[i] = b.data()[i] = (std::int8_t) (i * 11 % 256 - 128);
+
+    cout << "quant_1 (int8 product, int32 accumulators): ";
+    Matrix<std::int32_t> prod = multiplyQuantized(a, b); // THE TEST
+    Matrix<long long> exact = a64 * b64;
+    bool ok = prod.rows() == R && prod.cols() == C;
+    for (int i = 0; i < R * C && ok; i++)
+        ok = prod.data()[i] == exact.data()[i];
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "quant_1 (int16 product, int64 accumulators): ";
+    Matrix<std::int16_t> a16, b16;
+    a64.convertTo(a16);
+    b64.convertTo(b16);
+    a16.multiplyInPlace(250);
+    b16.multiplyInPlace(250);
+    Matrix<std::int64_t> prod16 = multiplyQuantized(a16, b16); // THE TEST
+    ok = true;
+    for (int i = 0; i < R * C && ok; i++)
+        ok = prod16.data()[i] == exact.data()[i] * 62500;
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+
+    cout << "quant_1 (quantized float product): ";
+    Matrix<float> f(R, K), g(K, C);
+    for (int i = 0; i < R * K; i++)
+        f.data()[i] = std::sin(i * 0.1f);
+    for (int i = 0; i < K * C; i++)
+        g.data()[i] = std::cos(i * 0.07f) * 3.0f;
+    QuantizedMatrix<std::int8_t> qf = quantizeMatrix<std::int8_t>(f);
+    QuantizedMatrix<std::int8_t> qg = quantizeMatrix<std::int8_t>(g);
+    Matrix<float> approx;
+    multiplyQuantized(qf, qg, approx); // THE TEST
+    Matrix<float> ref = Matrix<float>::multiply(f, g);
+    Matrix<float> back;
+    dequantizeMatrix(qg, back);
+    float err = 0, backErr = 0;
+    for (int i = 0; i < R * C; i++)
+        err = max(err, abs(approx.data()[i] - ref.data()[i]));
+    for (int i = 0; i < K * C; i++)
+        backErr = max(backErr, abs(back.data()[i] - g.data()[i]));
+    // about K * (|f| half a step of g + |g| half a step of f) at worst
+    ok = err < 0.05f * K / 10 && backErr <= (float) qg.scale * 0.5f + 1e-6f;
+    ok ? cout << "\033[32mpassed\033[0m" << endl : cout << "\033[31mFAILED!!\033[0m" << endl;
+}
+
 int main() {
 
     // Create matrix based on array
@@ -148,10 +1410,35 @@ int main() {
     cout << endl << flush;
 
     test_add_1();
+    test_add_2();
+    test_add_3();
+    test_map_1();
     test_multiply_1();
     test_multiply_2();
+    test_multiply_3();
+    test_multiply_4();
+    test_gemm_1();
+    test_gemv_1();
+    test_solve_1();
+    test_reduce_1();
+    test_move_1();
+    test_cow_1();
+    test_alloc_1();
+    test_fixed_1();
+    test_view_1();
+    test_sparse_1();
+    test_packed_1();
+    test_batch_1();
+    test_io_1();
+    test_profile_1();
     test_transpose_1();
+    test_transpose_2();
+    test_layout_1();
+    test_parallel_1();
+    test_async_1();
     test_convert_1();
+    test_convert_2();
+    test_quant_1();
 
     // now test some impossible situations
 
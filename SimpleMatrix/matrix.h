@@ -18,12 +18,32 @@
 #include <cstdlib>
 #include <iostream>
 #include <cstring>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <utility>
 
-//#define DEBUG
-
-#ifdef DEBUG
-int idcount = 0;
-#endif
+#include "matrix_alloc.h"
+#include "matrix_profile.h"
+#include "matrix_gemm.h"
+#include "matrix_simd.h"
+#include "matrix_parallel.h"
+#include "matrix_expr.h"
+#include "matrix_convert.h"
+#include "matrix_reduce.h"
+#include "matrix_transpose.h"
+#include "matrix_strassen.h"
+#include "matrix_gemv.h"
+#include "matrix_fixed.h"
+#include "matrix_view.h"
+#include "matrix_sparse.h"
+#include "matrix_batch.h"
+#include "matrix_quant.h"
+#include "matrix_io.h"
+#include "matrix_solve.h"
+#include "matrix_packed.h"
+#include "matrix_async.h"
 
 /*!
  * @class Matrix
@@ -44,16 +64,30 @@ int idcount = 0;
  * So for example a multiplication of Matrix<int> times Matrix<float> won't
  * compile. (With an exception for convertTo, naturally)
  * 
- * Class T must have * and + operators. ConvertTo uses only standard casting.
+ * Class T must have * and + operators. ConvertTo uses standard casting, or
+ * rounds and saturates (see ConvertMode).
+ *
+ * The optional second parameter is the allocator for the elements, by
+ * default AlignedAllocator (64 byte aligned). See matrix_alloc.h for the
+ * huge page and pool allocators:
+ * @code{.cpp}
+ * Matrix<double, PoolAllocator<double> > tmp;
+ * @endcode
  */
-template <class T>
+template <class T, class Alloc>
 class Matrix {
 
 private:
+    typedef std::allocator_traits<Alloc> AllocTraits;
+
     T* m;                    // The data of the matrix
-    int max_row, max_col;    // Matrix dimensions
+    std::size_t max_row, max_col;    // Matrix dimensions
+    Alloc alloc;             // Where m comes from
+    std::shared_ptr<void> external;  // Keeps m alive when it isn't from alloc (a mapped file), or
+                                     // counts the copy-on-write matrices that share m
+    bool cow;                // MatrixStorage::CopyOnWrite
+    MatrixLayout order;      // the order of the elements in m
 
-    int id;
 public:
     // ----------------------------------------------------------------------
     // constructors / destructors
@@ -69,11 +103,8 @@ public:
         m = NULL;
         max_col = 0;
         max_row = 0;
-        
-    #ifdef DEBUG 
-        id = ++idcount;
-        std::cout << "construct :" << max_row << "X" << max_col << "[" << id << "]" << std::endl;
-    #endif
+        cow = false;
+        order = MatrixLayout::RowMajor;
     };
 
     /*!
@@ -81,23 +112,46 @@ public:
      *
      * Create new matrix based on the parameter. The matrix given by the 
      * parameter will be (deep) copied, so you really end up having to separate 
-     * matrices.
+     * matrices. Unless it is a MatrixStorage::CopyOnWrite matrix, see
+     * setStorage(): then the copy shares its elements and is copy-on-write too.
      * @param[in] other the matrix to be copied from
      */
-    Matrix(const Matrix& other) {
+    Matrix(const Matrix& other) : alloc(other.alloc) {
         m = NULL;
         max_col = other.max_col;
         max_row = other.max_row;
-    #ifdef DEBUG     
-        id = ++idcount;
-        std::cout << "construct :" << max_row << "X" << max_col << "[" << id << "]" << std::endl;
-    #endif
+        cow = other.cow;
+        order = other.order;
+        if (cow) {
+            m = other.m;
+            external = other.external;
+            return;
+        }
+        matrix_detail::OpScope scope(MatrixOp::Copy, 0, max_row*max_col*sizeof(T));
         if (max_row*max_col > 0) {
-            m = (T*) calloc(max_row*max_col, sizeof(T));
+            m = allocate(max_row*max_col);
             memcpy(m,other.m,max_row*max_col*sizeof(T)); 
         }   
     };
 
+    /*!
+     * @brief Move construct
+     *
+     * Takes over the memory of 'other', which is left as an empty matrix.
+     * This is what makes returning matrices from functions cheap.
+     * @param[in] other the matrix to be moved from
+     */
+    Matrix(Matrix&& other) noexcept : alloc(std::move(other.alloc)), external(std::move(other.external)) {
+        m = other.m;
+        max_col = other.max_col;
+        max_row = other.max_row;
+        cow = other.cow;
+        order = other.order;
+        other.m = NULL;
+        other.max_col = 0;
+        other.max_row = 0;
+    };
+
     /*!
      * @brief Default constructor
      *
@@ -106,20 +160,102 @@ public:
      * @param[in] columns the number of columns of the matrix
      * @param[in] values  optional: an 1-dimensional array with the matrix values 
      *                    stored from left to right and top to bottom. 
-     *                    
+     *                    Without values all elements are 0.
+     */
+    Matrix(std::size_t rows, std::size_t columns, const T* values = NULL){
+        m = NULL;
+        max_col = columns;
+        max_row = rows;
+        cow = false;
+        order = MatrixLayout::RowMajor;
+        if (rows*columns > 0) {
+            m = allocate(rows*columns);
+            if (values != NULL) 
+                memcpy(m,values,rows*columns*sizeof(T));
+            else
+                memset(m,0,rows*columns*sizeof(T));
+        }
+    };
+
+    /*!
+     * @brief Construct with the given dimensions, zeroed or not
+     *
+     * Zeroing a big matrix that is overwritten right after costs a full pass
+     * over its memory, MatrixInit::Uninitialized skips it:
+     * @code{.cpp}
+     * Matrix<float> out(1000, 1000, MatrixInit::Uninitialized);
+     * Matrix<float>::multiply(a, b, out);
+     * @endcode
+     * @param[in] rows    the number of rows of the matrix
+     * @param[in] columns the number of columns of the matrix
+     * @param[in] init    MatrixInit::Zero or MatrixInit::Uninitialized
      */
-    Matrix(unsigned int rows, unsigned int columns, const T* values = NULL){
+    Matrix(std::size_t rows, std::size_t columns, MatrixInit init) {
         m = NULL;
         max_col = columns;
         max_row = rows;
-    #ifdef DEBUG 
-        id = ++idcount;
-        std::cout << "construct :" << max_row << "X" << max_col << "[" << id << "]" << std::endl;
-    #endif
-        if (rows*columns > 0)
-            m = (T*) calloc(rows*columns, sizeof(T));
-        if (values != NULL) 
-            memcpy(m,values,rows*columns*sizeof(T));
+        cow = false;
+        order = MatrixLayout::RowMajor;
+        if (rows*columns > 0) {
+            m = allocate(rows*columns);
+            if (init == MatrixInit::Zero)
+                memset(m,0,rows*columns*sizeof(T));
+        }
+    };
+
+    /*!
+     * @brief Construct with the given dimensions and order of the elements in memory
+     *
+     * A matrix is row-major unless made otherwise; that only matters for
+     * data(), operator[] and speed, every operation takes matrices of
+     * either layout, mixed too. See layout().
+     * @code{.cpp}
+     * Matrix<double> a(1000, 500, MatrixLayout::ColumnMajor);
+     * @endcode
+     * @param[in] rows    the number of rows of the matrix
+     * @param[in] columns the number of columns of the matrix
+     * @param[in] layout  MatrixLayout::RowMajor or MatrixLayout::ColumnMajor
+     * @param[in] init    MatrixInit::Zero or MatrixInit::Uninitialized
+     */
+    Matrix(std::size_t rows, std::size_t columns, MatrixLayout layout, MatrixInit init = MatrixInit::Zero)
+        : Matrix(rows, columns, init) {
+        order = layout;
+    };
+
+    /*!
+     * @brief Copy the elements a view refers to into a new matrix, with the
+     *        layout of the view
+     *
+     * @param[in] view a matrix, or a row, column or block of one (see matrix_view.h)
+     */
+    explicit Matrix(const ConstMatrixView<T>& view) {
+        m = NULL;
+        max_row = 0;
+        max_col = 0;
+        cow = false;
+        order = view.layout();
+        matrix_detail::OpScope scope(MatrixOp::Copy, 0, view.rows()*view.cols()*sizeof(T));
+        resize(view.rows(), view.cols());
+        matrix_detail::viewCopy(view, this->view());
+    };
+
+    /*!
+     * @brief Construct from an expression
+     *
+     * Evaluates an expression like A + B * 2 in a single pass, see matrix_expr.h.
+     * The matrix gets the layout of the first matrix in the expression.
+     * @param[in] expr the expression to evaluate
+     */
+    template <class E>
+    Matrix(const MatrixExpr<E>& expr) {
+        m = NULL;
+        max_row = expr.rows();
+        max_col = expr.cols();
+        cow = false;
+        order = expr.self().layout();
+        matrix_detail::OpScope scope(matrix_detail::ExprProfile<E>::op, max_row*max_col*matrix_detail::ExprProfile<E>::flops);
+        resize(max_row, max_col);   // every element gets written
+        evaluate(expr.self());
     };
 
     /*!
@@ -128,14 +264,154 @@ public:
      * Free the memory in use by this matrix
      */
     ~Matrix(){
-        if ( m != NULL)
-            free(m);
-        m = NULL;
-    #ifdef DEBUG 
-        std::cout << "destroy :" << max_row << "X" << max_col << "[" << id << "]" << std::endl;
-    #endif
+        release();
     };
 
+    /*!
+     * @brief A matrix on memory that belongs to something else
+     *
+     * No copy is made: the matrix reads and writes data directly. 'keeper'
+     * is whatever owns that memory (a memory mapped file, see matrix_io.h);
+     * the matrix holds on to it until it no longer uses the memory, i.e.
+     * until it is destroyed, resized to another number of elements or
+     * moved from. Copies of the matrix get their own memory.
+     * @param[in] data   rows*columns elements, stored row by row (column by column
+     *                   for MatrixLayout::ColumnMajor)
+     * @param[in] rows   the number of rows of the matrix
+     * @param[in] columns the number of columns of the matrix
+     * @param[in] keeper keeps data alive
+     * @param[in] layout the order of the elements in data
+     */
+    static Matrix adopt(T* data, std::size_t rows, std::size_t columns, std::shared_ptr<void> keeper,
+                        MatrixLayout layout = MatrixLayout::RowMajor) {
+        Matrix ret;
+        ret.m = data;
+        ret.max_row = rows;
+        ret.max_col = columns;
+        ret.external = std::move(keeper);
+        ret.order = layout;
+        return ret;
+    }
+
+    /*!
+     * @brief false for a matrix made by adopt(), whose memory belongs to something else
+     */
+    bool ownsData() const { return !external || cow; }
+
+    /*!
+     * @brief Choose what copies of this matrix do with its elements
+     *
+     * With MatrixStorage::CopyOnWrite a copy (copy constructor or
+     * assignment) only shares the elements, under an atomic reference
+     * count; copies of copies too, and they are all copy-on-write. The
+     * first change to one of them gives it its own copy: set(), operator[],
+     * the non-const data() and view(), the *InPlace methods and
+     * being the result of an operation. So keeping a snapshot of a large
+     * matrix, or passing one by value, costs nothing until it is changed:
+     * @code{.cpp}
+     * Matrix<double> weights(4096, 4096);
+     * weights.setStorage(MatrixStorage::CopyOnWrite);
+     * Matrix<double> snapshot = weights;    // nothing is copied
+     * weights.set(0, 0, 1.0);               // now weights gets a copy, snapshot keeps the old elements
+     * @endcode
+     * Pointers from data(), operator[] and views of a copy-on-write matrix
+     * are only good until the matrix is copied; get them again after that.
+     * An adopted matrix (see adopt()) gets its own memory when it becomes
+     * copy-on-write. MatrixStorage::Unique (the default) gives this matrix
+     * its own elements again, if it shares them.
+     */
+    void setStorage(MatrixStorage storage) {
+        if (storage == MatrixStorage::Unique) {
+            if (!cow)
+                return;
+            detach();
+            // the only owner now: keep m, but let the allocator take it back
+            if (external)
+                std::get_deleter<SharedRelease>(external)->armed = false;
+            external.reset();
+            cow = false;
+        } else if (!cow) {
+            if (external)
+                *this = Matrix(*this);
+            cow = true;
+            if (m != NULL)
+                shareBuffer(max_row*max_col);
+        }
+    }
+
+    /*!
+     * @brief See setStorage()
+     */
+    MatrixStorage storage() const { return cow ? MatrixStorage::CopyOnWrite : MatrixStorage::Unique; }
+
+    /*!
+     * @brief Whether other copy-on-write matrices share the elements of this one
+     */
+    bool sharesData() const { return cow && external.use_count() > 1; }
+
+    // ----------------------------------------------------------------------
+    // layout
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief The order of the elements in memory, MatrixLayout::RowMajor
+     *        unless the matrix was made or set otherwise
+     *
+     * Every operation takes matrices of either layout and any mix of them,
+     * with the same results. Mixed operands cost a little: element-wise
+     * operations transpose one of them a tile at a time on the way and
+     * products walk the memory of an operand in the other order (see
+     * matrix_view.h). The result of an operation keeps the layout of the
+     * matrix it is stored in; a new or resized one gets the layout of the
+     * (first) operand.
+     */
+    MatrixLayout layout() const { return order; }
+
+    /*!
+     * @brief The distance in elements from one row to the next, or from one
+     *        column to the next for a column-major matrix
+     */
+    std::size_t stride() const { return order == MatrixLayout::RowMajor ? max_col : max_row; }
+
+    /*!
+     * @brief Change the order of the elements in memory, the matrix itself
+     *        (get(r, c)) stays the same. Moves all elements, through a
+     *        second buffer.
+     */
+    void setLayout(MatrixLayout layout) {
+        if (layout == order)
+            return;
+        if (!isVector() && m != NULL) {
+            matrix_detail::OpScope scope(MatrixOp::Transpose, 0, max_row*max_col*sizeof(T));
+            const std::size_t n = max_row*max_col;
+            T* p = allocate(n);
+            // the lines of memory of one layout are the other's transposed
+            if (order == MatrixLayout::RowMajor)
+                matrix_detail::transpose(m, max_row, max_col, p);
+            else
+                matrix_detail::transpose(m, max_col, max_row, p);
+            release();
+            m = p;
+            if (cow)
+                shareBuffer(n);
+        }
+        order = layout;
+    }
+
+    /*!
+     * @brief Transpose in O(1): the elements stay where they are, only the
+     *        dimensions and the layout are swapped
+     *
+     * So a row-major matrix becomes its column-major transpose. Use
+     * transposeInPlace() to keep the layout.
+     */
+    void transposeLayout() {
+        std::size_t tmp = max_col;
+        max_col = max_row;
+        max_row = tmp;
+        order = order == MatrixLayout::RowMajor ? MatrixLayout::ColumnMajor : MatrixLayout::RowMajor;
+    }
+
     // ----------------------------------------------------------------------
     // setters &  getters
     // ----------------------------------------------------------------------
@@ -148,9 +424,11 @@ public:
      * @param[in] val the value the element must be set to.
      * @exception invalid_argument thrown when row or col is out of bounds.
      */
-    void set(unsigned int row, unsigned int col, T val) {
-        if (row < max_row && col < max_col)
-            m[(row*max_col)+col] = val;
+    void set(std::size_t row, std::size_t col, T val) {
+        if (row < max_row && col < max_col) {
+            detach();
+            m[index(row, col)] = val;
+        }
         else
             throw std::invalid_argument( "Set: out of bounds" );
     }
@@ -163,9 +441,9 @@ public:
      * @return    the value of the requested element.
      * @exception invalid_argument thrown when row or col is out of bounds.
      */
-    T get(unsigned int row, unsigned int col) const {    
+    T get(std::size_t row, std::size_t col) const {    
         if (row < max_row && col < max_col)
-            return m[(row*max_col)+col];
+            return m[index(row, col)];
         else
             throw std::invalid_argument( "Get: out of bounds" );
 
@@ -191,10 +469,16 @@ public:
      * 
      * @param i the first (row) index
      * @return a pointer to the requested row
+     * @exception invalid_argument thrown when i is out of bounds, or for a
+     *            column-major matrix (which has no rows in memory).
      */
-    T* operator [] (unsigned int i) {
-        if (i < max_row)
+    T* operator [] (std::size_t i) {
+        if (order != MatrixLayout::RowMajor && !isVector())
+            throw std::invalid_argument( "[]: a column-major matrix has no row pointers" );
+        if (i < max_row) {
+            detach();
             return &m[i*max_col];
+        }
 
         throw std::invalid_argument( "[]: out of bounds" );
         return NULL;
@@ -202,15 +486,96 @@ public:
 
     /*!
      * @brief Return the size of the matrix
-     * @return an pointer to an int[2] array with the { row, col } value.
+     *
+     * Returned by value, so it's safe to call from several threads at once.
+     * @return an array with the { row, col } value.
      */
-    int* size() const {
-        static int s[2];
-        s[0] = max_row;
-        s[1] = max_col;
+    std::array<std::size_t, 2> size() const {
+        std::array<std::size_t, 2> s = { { max_row, max_col } };
         return s;
     };  
 
+    /*!
+     * @brief The number of rows
+     */
+    std::size_t rows() const { return max_row; }
+
+    /*!
+     * @brief The number of columns
+     */
+    std::size_t cols() const { return max_col; }
+
+    /*!
+     * @brief Whether the matrix is a vector: it has one row or one column
+     */
+    bool isVector() const { return max_row == 1 || max_col == 1; }
+
+    /*!
+     * @brief The matrix elements, stored from left to right and top to bottom
+     *        (top to bottom and left to right for a column-major matrix, see layout()).
+     *
+     * Same warning as for operator[]: don't free or reallocate it.
+     */
+    T* data() {
+        detach();
+        return m;
+    }
+
+    /*!
+     * @brief The matrix elements, read only.
+     */
+    const T* data() const { return m; }
+
+    // ----------------------------------------------------------------------
+    // views
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief A view on the whole matrix, see matrix_view.h
+     */
+    MatrixView<T> view() {
+        detach();
+        return MatrixView<T>(m, max_row, max_col, stride(), order);
+    }
+    ConstMatrixView<T> view() const { return ConstMatrixView<T>(m, max_row, max_col, stride(), order); }
+
+    /*!
+     * @brief A view on the transpose of the matrix, in O(1): the same
+     *        elements with the other layout
+     *
+     * Any operation on views takes it, e.g. transpose(A)*B without a copy of A:
+     * @code{.cpp}
+     * Matrix<double>::multiply(A.transposedView(), B, C);
+     * @endcode
+     */
+    MatrixView<T> transposedView() { return view().transposed(); }
+    ConstMatrixView<T> transposedView() const { return view().transposed(); }
+
+    /*!
+     * @brief A view on row i, a 1 x cols matrix
+     * @exception invalid_argument thrown when i is out of bounds.
+     */
+    MatrixView<T> row(std::size_t i) { return view().row(i); }
+    ConstMatrixView<T> row(std::size_t i) const { return view().row(i); }
+
+    /*!
+     * @brief A view on column j, a rows x 1 matrix
+     * @exception invalid_argument thrown when j is out of bounds.
+     */
+    MatrixView<T> col(std::size_t j) { return view().col(j); }
+    ConstMatrixView<T> col(std::size_t j) const { return view().col(j); }
+
+    /*!
+     * @brief A view on the rows x cols block that starts at (row, col)
+     * @exception invalid_argument thrown when the block doesn't fit in the matrix.
+     */
+    MatrixView<T> block(std::size_t row, std::size_t col, std::size_t rows, std::size_t cols) {
+        return view().block(row, col, rows, cols);
+    }
+    ConstMatrixView<T> block(std::size_t row, std::size_t col, std::size_t rows, std::size_t cols) const {
+        return view().block(row, col, rows, cols);
+    }
+
     // ----------------------------------------------------------------------
     // addition
     // ----------------------------------------------------------------------
@@ -219,18 +584,26 @@ public:
      * @brief Inplace addition, add 'other' to current matrix.
      *
      * Matrices must have he same dimensions for an addition.
+     * Runs on the widest SIMD unit the CPU has, see matrix_simd.h.
      * 
      * @param[in] other the matrix to add.
      * @exception invalid_argument thrown matrix dimension don't match.
      */
-    void addInPlace(const Matrix<T>& other) {
+    void addInPlace(const Matrix& other) {
         if ( (max_row != other.max_row) || (max_col != other.max_col) ) {
             throw std::invalid_argument( "Addition: matrices must have the same size." );
         }
-        for (int r=0; r<max_row; r++) 
-            for (int c=0; c<max_col; c++) {
-                m[(r*max_col)+c] += other.m[(r*max_col)+c];
-            }
+        matrix_detail::OpScope scope(MatrixOp::Add, max_row*max_col);
+        if (!sameLayout(other)) {
+            matrix_detail::viewAdd(view(), other.view(), view());
+            return;
+        }
+        detach();
+        T* dst = m;
+        const T* src = other.m;
+        matrix_detail::parallelElements(max_row*max_col, sizeof(T), [=](std::size_t b, std::size_t e) {
+            matrix_detail::addTo(dst + b, src + b, e - b);
+        });
     };
     /*!
      * @brief addition, add 'other' to current matrix, and return new result-matrix.
@@ -242,23 +615,51 @@ public:
      * @return The new result-matrix
      * @exception invalid_argument thrown matrix dimension don't match.
      */    
-    static Matrix<T> add(const Matrix<T>& first, const Matrix<T>& second) {
-        Matrix<T> nieuw(first);
-        nieuw.addInPlace(second);
-        return nieuw;
+    static Matrix add(const Matrix& first, const Matrix& second) {
+        return Matrix(first + second);
     };
 
     /*!
-     * @brief addition operator
+     * @brief addition into an existing matrix: out = first + second
      *
-     * For convenience calls 
-     * @code{.cpp}
-     * Matrix::add(first, second)
-     * @endcode
+     * 'out' is resized when needed, its memory is reused when it already
+     * has the right size, so a loop doing this allocates nothing. 'out' may
+     * be first or second.
+     * 
+     * @param[in]  first the first matrix to add.
+     * @param[in]  second the second matrix to add.
+     * @param[out] out the result.
+     * @exception invalid_argument thrown matrix dimension don't match.
      */    
-    Matrix<T> operator+ (const Matrix<T>& other) {
-        return Matrix::add( (*this), other);
-    }
+    static void add(const Matrix& first, const Matrix& second, Matrix& out) {
+        out = first + second;
+    };
+
+    /*!
+     * @brief addition of views (see matrix_view.h): out = first + second
+     *
+     * Adds rows, columns or blocks of matrices without copying them.
+     * 'out' must have the right size already, it may be first or second.
+     * @exception invalid_argument thrown matrix dimension don't match.
+     */    
+    static void add(const ConstMatrixView<T>& first, const ConstMatrixView<T>& second, const MatrixView<T>& out) {
+        matrix_detail::OpScope scope(MatrixOp::Add, out.rows()*out.cols());
+        matrix_detail::viewAdd(first, second, out);
+    };
+
+    /*!
+     * @brief addition of views (see matrix_view.h) into a new matrix
+     * @exception invalid_argument thrown matrix dimension don't match.
+     */    
+    static Matrix add(const ConstMatrixView<T>& first, const ConstMatrixView<T>& second) {
+        matrix_detail::OpScope scope(MatrixOp::Add, first.rows()*first.cols());
+        Matrix ret(first.rows(), first.cols(), first.layout(), MatrixInit::Uninitialized);
+        matrix_detail::viewAdd(first, second, ret.view());
+        return ret;
+    };
+
+    // The addition operator is a free function (see matrix_expr.h), it
+    // returns an expression that is evaluated when assigned to a matrix.
 
     // ----------------------------------------------------------------------
     // multiplication
@@ -271,10 +672,12 @@ public:
      * @param[in] scalar the multiplication factor
     */
     void multiplyInPlace(T scalar) {
-        for (int r=0; r<max_row; r++) 
-            for (int c=0; c<max_col; c++) {
-                m[(r*max_col)+c] *= scalar;
-            }
+        matrix_detail::OpScope scope(MatrixOp::Scale, max_row*max_col);
+        detach();
+        T* dst = m;
+        matrix_detail::parallelElements(max_row*max_col, sizeof(T), [=](std::size_t b, std::size_t e) {
+            matrix_detail::scaleBy(dst + b, scalar, e - b);
+        });
     };
 
      /*!
@@ -285,53 +688,298 @@ public:
      * @param[in] scalar the multiplication factor
      * @return Return new matrix with the result of first*scalar
     */   
-    static Matrix<T> multiply(const Matrix<T>& first, T scalar) {
-        Matrix<T> nieuw(first);
-        nieuw.multiplyInPlace(scalar);
-        return nieuw;
+    static Matrix multiply(const Matrix& first, T scalar) {
+        return Matrix(first * scalar);
+    }
+
+     /*!
+     * @brief multiplication with scalar into an existing matrix: out = first*scalar
+     *
+     * @param[in]  first  the matrix to multiply
+     * @param[in]  scalar the multiplication factor
+     * @param[out] out    the result, its memory is reused when it has the right size
+    */   
+    static void multiply(const Matrix& first, T scalar, Matrix& out) {
+        out = first * scalar;
     }
 
      /*!
      * @brief multiplication of two matrices
      *
      * Multiplication of two matrices: first*second
+     * 
+     * Uses a cache blocked kernel (see matrix_gemm.h), or the matrix-vector
+     * kernels of matrix_gemv.h when a dimension is 1; the result is exactly
+     * the same as the one of the textbook triple loop. Except for large
+     * floating point products, which by default use Strassen-Winograd; see
+     * matrix_strassen.h for its rounding errors, and MultiplyAlgorithm.
      * @param[in] first  the first matrix to multiply
      * @param[in] second the second matrix to multiply
+     * @param[in] algorithm MultiplyAlgorithm::Conventional for the exact result
      * @return Return new matrix with the result of first*second
     */ 
-    static Matrix<T> multiply(const Matrix<T>& first, const Matrix<T>& second) {
+    static Matrix multiply(const Matrix& first, const Matrix& second, MultiplyAlgorithm algorithm = MultiplyAlgorithm::Auto) {
+        if ( first.max_col != second.max_row ) {
+            throw std::invalid_argument( "Multiplication: matrices sizes don't alow multiplication." );
+        }
+
+        Matrix ret;
+        multiply(first, second, ret, algorithm);
+        return ret;
+    };
+
+     /*!
+     * @brief multiplication of two matrices into an existing matrix: out = first*second
+     *
+     * The memory of 'out' is reused when it already has the right size.
+     * 'out' may be first or second, the product then goes through a
+     * temporary (a product can't be computed in place). The operands and
+     * 'out' may have any layouts; Strassen is only used when they are all
+     * the same.
+     * @param[in]  first  the first matrix to multiply
+     * @param[in]  second the second matrix to multiply
+     * @param[out] out    the result
+     * @param[in]  algorithm see multiply(first, second, algorithm)
+    */ 
+    static void multiply(const Matrix& first, const Matrix& second, Matrix& out,
+                         MultiplyAlgorithm algorithm = MultiplyAlgorithm::Auto) {
         if ( first.max_col != second.max_row ) {
             throw std::invalid_argument( "Multiplication: matrices sizes don't alow multiplication." );
         }
+        matrix_detail::OpScope scope(MatrixOp::Multiply, 2 * first.max_row * second.max_col * first.max_col);
+        if (&out == &first || &out == &second) {
+            Matrix tmp;
+            if (out.max_row == first.max_row && out.max_col == second.max_col)
+                tmp = Matrix(out.max_row, out.max_col, out.order, MatrixInit::Uninitialized);
+            multiply(first, second, tmp, algorithm);
+            out = std::move(tmp);
+            return;
+        }
 
-        Matrix<T> ret(first.max_row, second.max_col);
-        for (int r=0; r < ret.max_row; r++) 
-            for (int c=0; c < ret.max_col; c++) {
-                T temp = 0;
-                for ( int i=0; i < first.max_col; i++)
-                    temp += first.m[r*first.max_col+i] * second.m[i*second.max_col+c];
-                ret.m[(r*ret.max_col)+c] = temp;
-            } 
+        out.reshape(first.max_row, second.max_col, first.order);
+        // mixed layouts: the kernel reads each operand with its own strides
+        if (first.order != out.order || second.order != out.order) {
+            matrix_detail::gemmStrided<T>(out.max_row, out.max_col, first.max_col,
+                                          first.m, first.rowStep(), first.colStep(),
+                                          second.m, second.rowStep(), second.colStep(),
+                                          out.m, out.rowStep(), out.colStep());
+            return;
+        }
+        // one layout for all three: row-major as it is; column-major as
+        // transpose(out) = transpose(second)*transpose(first), a row-major product
+        const bool rm = out.order == MatrixLayout::RowMajor;
+        const std::size_t rows = rm ? out.max_row : out.max_col, cols = rm ? out.max_col : out.max_row;
+        const std::size_t k = first.max_col;
+        const T* a = rm ? first.m : second.m;
+        const T* b = rm ? second.m : first.m;
+        if (matrix_detail::multiplyVector<T>(rows, cols, k, a, b, out.m))
+            return;
+        if (matrix_detail::useStrassen<T>(algorithm, rows, k, cols))
+            matrix_detail::strassen<T>(rows, cols, k, a, k, b, cols, out.m, cols);
+        else
+            matrix_detail::gemmParallel<T>(rows, cols, k,
+                                   a, k, 1,
+                                   b, cols, 1,
+                                   out.m, cols, 1);
+    };
+
+     /*!
+     * @brief multiplication of views (see matrix_view.h): out = first*second
+     *
+     * Multiplies blocks of matrices without copying them. 'out' must have
+     * the right size already. When it shares memory with first or second
+     * the product goes through a temporary.
+     * @exception invalid_argument thrown when the sizes don't fit.
+    */ 
+    static void multiply(const ConstMatrixView<T>& first, const ConstMatrixView<T>& second, const MatrixView<T>& out) {
+        matrix_detail::OpScope scope(MatrixOp::Multiply, 2 * first.rows() * second.cols() * first.cols());
+        matrix_detail::viewMultiply(first, second, out);
+    };
+
+     /*!
+     * @brief multiplication of views (see matrix_view.h) into a new matrix
+     * @exception invalid_argument thrown when the sizes don't fit.
+    */ 
+    static Matrix multiply(const ConstMatrixView<T>& first, const ConstMatrixView<T>& second) {
+        if (first.cols() != second.rows())
+            throw std::invalid_argument( "Multiplication: matrices sizes don't alow multiplication." );
+        matrix_detail::OpScope scope(MatrixOp::Multiply, 2 * first.rows() * second.cols() * first.cols());
+        Matrix ret(first.rows(), second.cols(), first.layout(), MatrixInit::Uninitialized);
+        matrix_detail::viewMultiply(first, second, ret.view());
         return ret;
     };
 
     /*!
-     * @brief inplace multiplication operator
+     * @brief c = alpha*op(a)*op(b) + beta*c, the gemm of BLAS
      *
-     * See multiplyInPlace()
+     * op(x) is x or its transpose (see Transpose). Nothing is copied: a
+     * transposed operand is read in the transposed order by the kernel,
+     * alpha is multiplied into op(a) as it goes into the kernel and the
+     * product is added to c in place, so
+     * @code{.cpp}
+     * Matrix<double>::gemm(2.0, a, Transpose::No, b, Transpose::Yes, 1.0, c);   // c += 2*a*transpose(b)
+     * @endcode
+     * allocates nothing. With beta = 0 the old contents of c aren't read
+     * (NaNs in it don't show up in the result) and c is resized when
+     * needed; otherwise it must have the size of the product already.
+     * When c is a or b the product goes through a temporary. Unlike
+     * multiply() this never uses Strassen.
+     * @exception invalid_argument thrown when the sizes don't fit.
+     */
+    static void gemm(T alpha, const Matrix& a, Transpose transA, const Matrix& b, Transpose transB,
+                     T beta, Matrix& c) {
+        const std::size_t m = transA == Transpose::Yes ? a.max_col : a.max_row;
+        const std::size_t k = transA == Transpose::Yes ? a.max_row : a.max_col;
+        const std::size_t n = transB == Transpose::Yes ? b.max_row : b.max_col;
+        if (k != (transB == Transpose::Yes ? b.max_col : b.max_row))
+            throw std::invalid_argument("gemm: matrices sizes don't alow multiplication.");
+        if (&c == &a || &c == &b) {
+            Matrix tmp;
+            if (beta != T(0))
+                tmp = c;
+            else if (c.max_row == m && c.max_col == n)
+                tmp = Matrix(m, n, c.order, MatrixInit::Uninitialized);
+            gemm(alpha, a, transA, b, transB, beta, tmp);
+            c = std::move(tmp);
+            return;
+        }
+        if (beta == T(0))
+            c.reshape(m, n, a.order);
+        else if (c.max_row != m || c.max_col != n)
+            throw std::invalid_argument("gemm: the result has the wrong size.");
+        matrix_detail::OpScope scope(MatrixOp::Multiply, 2 * m * n * k);
+        matrix_detail::viewGemm(alpha, a.view(), transA, b.view(), transB, beta, c.view());
+    }
+
+    /*!
+     * @brief gemm() on views (see matrix_view.h), c must have the size of the product
+     * @exception invalid_argument thrown when the sizes don't fit.
+     */
+    static void gemm(T alpha, const ConstMatrixView<T>& a, Transpose transA, const ConstMatrixView<T>& b,
+                     Transpose transB, T beta, const MatrixView<T>& c) {
+        matrix_detail::OpScope scope(MatrixOp::Multiply, 2 * c.rows() * c.cols() * (transA == Transpose::Yes ? a.rows() : a.cols()));
+        matrix_detail::viewGemm(alpha, a, transA, b, transB, beta, c);
+    }
+
+    /*!
+     * @brief y = alpha*op(a)*x + beta*y, the gemv of BLAS
+     *
+     * op(a) is a or its transpose (see Transpose); x and y are vectors, rows
+     * or columns. Uses the matrix-vector kernels of matrix_gemv.h, the
+     * result is exactly that of the textbook loop. With beta = 0 the old
+     * contents of y aren't read and y becomes a column of the right length
+     * unless it is a vector of that length already; otherwise it must have
+     * that length. When y is a or x the product goes through a temporary.
+     * @exception invalid_argument thrown when the sizes don't fit.
+     */
+    static void gemv(T alpha, const Matrix& a, Transpose trans, const Matrix& x, T beta, Matrix& y) {
+        const std::size_t m = trans == Transpose::Yes ? a.max_col : a.max_row;
+        const std::size_t n = trans == Transpose::Yes ? a.max_row : a.max_col;
+        if (!x.isVector() || x.max_row * x.max_col != n)
+            throw std::invalid_argument("gemv: x must be a vector with the length of a row of op(a).");
+        if (&y == &a || &y == &x) {
+            Matrix tmp;
+            if (beta != T(0))
+                tmp = y;
+            gemv(alpha, a, trans, x, beta, tmp);
+            y = std::move(tmp);
+            return;
+        }
+        if (!y.isVector() || y.max_row * y.max_col != m) {
+            if (beta != T(0))
+                throw std::invalid_argument("gemv: y must be a vector with the length of a column of op(a).");
+            y.resize(m, 1);
+        }
+        matrix_detail::OpScope scope(MatrixOp::Multiply, 2 * m * n);
+        if (m == 0)
+            return;
+        y.detach();
+        // the memory of a column-major a is transpose(a), row-major
+        const bool rm = a.order == MatrixLayout::RowMajor;
+        const std::size_t rows = rm ? a.max_row : a.max_col, cols = rm ? a.max_col : a.max_row;
+        if ((trans == Transpose::Yes) == rm)
+            matrix_detail::gemvCols<T>(rows, cols, alpha, a.m, cols, x.m, beta, y.m);
+        else
+            matrix_detail::gemvRows<T>(rows, cols, alpha, a.m, cols, x.m, beta, y.m);
+    }
+
+    /*!
+     * @brief The dot product of two vectors (rows or columns) of the same length
+     *
+     * The sum is split over 16 partial sums for speed, so for floating point
+     * it may differ in the last bits from the sum in order (multiply() of a
+     * row and a column gives that one).
+     * @exception invalid_argument thrown when x or y isn't a vector or the lengths differ.
+     */
+    static T dot(const Matrix& x, const Matrix& y) {
+        if (!x.isVector() || !y.isVector() || x.max_row * x.max_col != y.max_row * y.max_col)
+            throw std::invalid_argument("dot: needs two vectors of the same length.");
+        matrix_detail::OpScope scope(MatrixOp::Multiply, 2 * x.max_row * x.max_col);
+        return matrix_detail::dotKernel<T>(x.max_row * x.max_col, x.m, y.m);
+    }
+
+    /*!
+     * @brief y += alpha*x, the axpy of BLAS, for matrices of the same size
+     * @exception invalid_argument thrown when the sizes differ.
+     */
+    static void axpy(T alpha, const Matrix& x, Matrix& y) {
+        if (x.max_row != y.max_row || x.max_col != y.max_col)
+            throw std::invalid_argument("axpy: matrices must have the same size.");
+        matrix_detail::OpScope scope(MatrixOp::Add, 2 * x.max_row * x.max_col);
+        if (!y.sameLayout(x)) {
+            matrix_detail::forEachLinePair(y.view(), x.view(), [alpha](T* d, const T* s, std::size_t n) {
+                matrix_detail::axpy<T>(n, alpha, s, d);
+            });
+            return;
+        }
+        y.detach();
+        matrix_detail::axpy<T>(x.max_row * x.max_col, alpha, x.m, y.m);
+    }
+
+    /*!
+     * @brief a += alpha*x*transpose(y), the rank-1 update (ger) of BLAS
+     *
+     * x and y are vectors (rows or columns); a must have as many rows as x
+     * has elements and as many columns as y. For the outer product x*y'
+     * alone, multiply() a column by a row.
+     * @exception invalid_argument thrown when the sizes don't fit.
+     */
+    static void ger(T alpha, const Matrix& x, const Matrix& y, Matrix& a) {
+        if (!x.isVector() || !y.isVector() || a.max_row != x.max_row * x.max_col || a.max_col != y.max_row * y.max_col)
+            throw std::invalid_argument("ger: a must be length(x) x length(y).");
+        if (&a == &x || &a == &y) {
+            Matrix tmp = a;
+            ger(alpha, x, y, tmp);
+            a = std::move(tmp);
+            return;
+        }
+        matrix_detail::OpScope scope(MatrixOp::Multiply, 2 * a.max_row * a.max_col);
+        a.detach();
+        // column-major: transpose(a) += alpha*y*transpose(x)
+        if (a.order == MatrixLayout::RowMajor)
+            matrix_detail::ger<T>(a.max_row, a.max_col, alpha, x.m, y.m, a.m, a.max_col);
+        else
+            matrix_detail::ger<T>(a.max_col, a.max_row, alpha, y.m, x.m, a.m, a.max_row);
+    }
+
+    /*!
+     * @brief multiplication with scalar operator
+     *
+     * Returns an expression, evaluated when assigned to a matrix (see matrix_expr.h).
     */
-    Matrix<T> operator* (const T scalar) {
-        return Matrix::multiply((*this), scalar);
+    matrix_detail::ScaleExpr<matrix_detail::MatrixLeaf<T> > operator* (const T scalar) const {
+        return matrix_detail::ScaleExpr<matrix_detail::MatrixLeaf<T> >(matrix_detail::MatrixLeaf<T>(*this), scalar);
     }
 
     /*!
      * @brief multiplication operator
      *
-     * Multiplication of two matrices: this*other
+     * Multiplication of two matrices: this*other. Large floating point
+     * products use Strassen-Winograd, see multiply().
      * @param[in] other the second matrix to multiply
      * @return Return new matrix with the result of this*other
     */
-    Matrix<T> operator* (const Matrix<T>& other) {
+    Matrix operator* (const Matrix& other) const {
         return Matrix::multiply((*this), other);
     }
 
@@ -341,29 +989,105 @@ public:
      * Hadamard (element-wise) product. Executed inplace.
      * @param[in] other the second matrix to multiply
     */
-    void hadamardInPlace(const Matrix<T>& other) {
+    void hadamardInPlace(const Matrix& other) {
         if ( (max_row != other.max_row) || (max_col != other.max_col) ) {
             throw std::invalid_argument( "hadamard: matrices must have the same size." );
         }
-        for (int r=0; r<max_row; r++) 
-            for (int c=0; c<max_col; c++) {
-                m[(r*max_col)+c] *= other.m[(r*max_col)+c];
-            }
+        matrix_detail::OpScope scope(MatrixOp::Hadamard, max_row*max_col);
+        if (!sameLayout(other)) {
+            matrix_detail::viewHadamard(view(), other.view(), view());
+            return;
+        }
+        detach();
+        T* dst = m;
+        const T* src = other.m;
+        matrix_detail::parallelElements(max_row*max_col, sizeof(T), [=](std::size_t b, std::size_t e) {
+            matrix_detail::multiplyTo(dst + b, src + b, e - b);
+        });
     };
 
     /*!
      * @brief Hadamard operation
      *
-     * Hadamard (element-wise) product. Returns new result matrix.
+     * Hadamard (element-wise) product. Returns an expression, that is
+     * evaluated when assigned to a matrix (see matrix_expr.h).
      * @param[in] other the second matrix to multiply
-     * @return Return new matrix with the result of the hadamard product of this*other
+     * @return Expression for the hadamard product of this*other
     */
-    Matrix<T> hadamard(const Matrix<T>& other) {
-        Matrix nieuw((*this));
-        nieuw.hadamardInPlace(other);
-        return nieuw; 
+    matrix_detail::HadamardExpr<matrix_detail::MatrixLeaf<T>, matrix_detail::MatrixLeaf<T> >
+    hadamard(const Matrix& other) const {
+        return ::hadamard(*this, other);
     };
 
+    /*!
+     * @brief Hadamard operation into an existing matrix: out = hadamard(first, second)
+     *
+     * @param[in]  first  the first matrix to multiply
+     * @param[in]  second the second matrix to multiply
+     * @param[out] out    the result, its memory is reused when it has the right size
+    */
+    static void hadamard(const Matrix& first, const Matrix& second, Matrix& out) {
+        out = ::hadamard(first, second);
+    };
+
+    /*!
+     * @brief Hadamard operation on views (see matrix_view.h): out = hadamard(first, second)
+     *
+     * 'out' must have the right size already, it may be first or second.
+    */
+    static void hadamard(const ConstMatrixView<T>& first, const ConstMatrixView<T>& second, const MatrixView<T>& out) {
+        matrix_detail::OpScope scope(MatrixOp::Hadamard, out.rows()*out.cols());
+        matrix_detail::viewHadamard(first, second, out);
+    };
+
+    // ----------------------------------------------------------------------
+    // element-wise functions
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief f applied to every element
+     *
+     * Returns an expression, evaluated in one pass when assigned to a matrix
+     * (see matrix_expr.h), so it combines with +, * and hadamard and with
+     * zip() without temporaries. The type of the result is the one f returns.
+     * @param[in] f function of one element, called concurrently
+     * @return Expression for f(this[i])
+    */
+    template <class F>
+    matrix_detail::MapExpr<F, matrix_detail::MatrixLeaf<T> > map(F f) const {
+        return matrix_detail::MapExpr<F, matrix_detail::MatrixLeaf<T> >(matrix_detail::MatrixLeaf<T>(*this), f);
+    }
+
+    /*!
+     * @brief Inplace map: every element is replaced by f(element)
+     * @param[in] f function of one element, called concurrently
+    */
+    template <class F>
+    void apply(F f) {
+        *this = map(f);
+    }
+
+    /*!
+     * @brief Inplace zip: every element is replaced by f(element, other's element)
+     * @param[in] other matrix or expression of the same size
+     * @param[in] f     function of two elements, called concurrently
+     * @exception invalid_argument thrown matrix dimension don't match.
+    */
+    template <class B, class F>
+    void apply(const B& other, F f) {
+        *this = ::zip(*this, other, f);
+    }
+
+    /*!
+     * @brief Inplace zip of three: every element is replaced by
+     *        f(element, second's element, third's element)
+     * @exception invalid_argument thrown matrix dimension don't match.
+    */
+    template <class B, class C, class F>
+    void apply(const B& second, const C& third, F f) {
+        *this = ::zip(*this, second, third, f);
+    }
+
     // ----------------------------------------------------------------------
     // Transpose
     // ----------------------------------------------------------------------
@@ -371,20 +1095,25 @@ public:
     /*!
      * @brief Inplace transpose
      *
-     * transposes the current matrix.
+     * transposes the current matrix, without a second copy of it; the
+     * layout stays the same. transposeLayout() is a lot cheaper when the
+     * layout may change.
+     * A square matrix is transposed tile by tile and in parallel. Any other
+     * shape is permuted along the cycles of the transposition, which needs
+     * one bit of extra memory per element but is a lot slower than
+     * transpose(), so only use it when memory is tight.
      */
     void transposeInPlace() {
-        T* nieuw = (T*) calloc(max_row*max_col, sizeof(T));
-        int tmp = 0;
-        for (int c=0; c < max_col; c++) 
-            for (int r=0; r < max_row; r++) {
-                nieuw[tmp++] = get(r,c); 
-            }
-        tmp = max_col;
+        matrix_detail::OpScope scope(MatrixOp::Transpose, 0, max_row*max_col*sizeof(T));
+        detach();
+        // a column-major matrix is its row-major transpose in memory
+        if (order == MatrixLayout::RowMajor)
+            matrix_detail::transposeInPlace(m, max_row, max_col);
+        else
+            matrix_detail::transposeInPlace(m, max_col, max_row);
+        std::size_t tmp = max_col;
         max_col = max_row;
         max_row = tmp;
-        free(m);
-        m = nieuw;
     };
 
     /*!
@@ -392,62 +1121,293 @@ public:
      *
      * @return A new matrix with the transposed values.
      */
-    Matrix<T> transpose() {
-        Matrix<T> ret(max_col, max_row);
-        for (int r=0; r < max_row; r++) 
-            for (int c=0; c < max_col; c++) {
-                ret.set(c,r, get(r,c)); 
-            }
-
+    Matrix transpose() const {
+        Matrix ret;
+        transpose(ret);
         return ret;
     };
 
+    /*!
+     * @brief Transpose the current matrix into an existing matrix
+     *
+     * Tiled and cache-oblivious, with SIMD for 4 and 8 byte elements
+     * (see matrix_transpose.h). When ret has the other layout it is just a
+     * copy.
+     *
+     * @param[out] ret the transposed values, its memory is reused when it
+     *                 has the right number of elements.
+     */
+    void transpose(Matrix& ret) const {
+        if (&ret == this) {
+            ret.transposeInPlace();
+            return;
+        }
+        matrix_detail::OpScope scope(MatrixOp::Transpose, 0, max_row*max_col*sizeof(T));
+        ret.reshape(max_col, max_row, order);
+        matrix_detail::viewCopy(view().transposed(), ret.view());
+    };
+
     // ----------------------------------------------------------------------
     // Other operations
     // ----------------------------------------------------------------------
 
     /*! @brief assignment operator
      *
+     *  The memory of this matrix is reused when it has the right size.
+     *  A copy-on-write 'other' is shared instead, see setStorage().
      *  @param[in] other the matrix to copy into this
      */
-    void operator= (const Matrix<T>& other) {
-    #ifdef DEBUG 
-        std::cout << " operator = (free " << max_row << "X" << max_col << "[" << id << "])" << 
-          "-> (" << other.max_row << "X" << other.max_col << "[" << other.id << "])" << std::endl;
-    #endif
-        if (m != NULL) 
-            free(m);
-        m = NULL;
+    Matrix& operator= (const Matrix& other) {
+        if (&other == this)
+            return *this;
+        if (other.cow) {
+            // share, like the copy constructor
+            std::shared_ptr<void> keep = other.external;
+            release();
+            external = std::move(keep);
+            m = other.m;
+            max_row = other.max_row;
+            max_col = other.max_col;
+            cow = true;
+            order = other.order;
+            return *this;
+        }
+        matrix_detail::OpScope scope(MatrixOp::Copy, 0, other.max_row*other.max_col*sizeof(T));
+        resize(other.max_row, other.max_col);
+        order = other.order;
+        if (max_row*max_col > 0)
+            memcpy(m, other.m, max_row*max_col*sizeof(T));
+        return *this;
+    };
+
+    /*! @brief move assignment operator
+     *
+     *  Takes over the memory of 'other' (a temporary, usually), nothing is copied.
+     *  @param[in] other the matrix to move from, left as an empty matrix
+     */
+    Matrix& operator= (Matrix&& other) noexcept {
+        if (&other == this)
+            return *this;
+        release();
+        alloc = std::move(other.alloc);
+        external = std::move(other.external);
+        m = other.m;
         max_row = other.max_row;
         max_col = other.max_col;
-        if (max_row*max_col > 0) {
-            m = (T*) calloc(max_row*max_col, sizeof(T));
-            memcpy(m, other.m, max_row*max_col*sizeof(T));
-        }
+        cow = other.cow;
+        order = other.order;
+        other.m = NULL;
+        other.max_row = 0;
+        other.max_col = 0;
+        return *this;
+    };
+
+    /*! @brief assignment from an expression
+     *
+     *  The expression is evaluated in one pass, straight into this matrix.
+     *  The memory is reused when the dimensions don't change, so A = A + B
+     *  is an in place addition; the layout is kept then too. Otherwise the
+     *  matrix gets the layout of the first matrix in the expression.
+     *  @param[in] expr the expression to evaluate
+     */
+    template <class E>
+    Matrix& operator= (const MatrixExpr<E>& expr) {
+        matrix_detail::OpScope scope(matrix_detail::ExprProfile<E>::op, expr.rows()*expr.cols()*matrix_detail::ExprProfile<E>::flops);
+        // when the size differs the expression can't refer to this matrix; nor
+        // can it refer to new memory for a matrix that shared its elements, the
+        // other sharers keep the old ones alive
+        reshape(expr.rows(), expr.cols(), expr.self().layout());
+        evaluate(expr.self());
+        return *this;
     };
 
     /*! @brief equality operator
      * 
+     * Integer matrices are compared with memcmp, others element by element
+     * (so 0.0 == -0.0 and NaN != NaN); both stop at the first block with a
+     * difference, see matrix_reduce.h.
      * @param[in] other the matrix to compare to
      * @return true is matrices are equal
      */
-    bool operator== (const Matrix<T>& other){
+    bool operator== (const Matrix& other) const {
         if ( (max_col != other.max_col) || (max_row != other.max_row) )
             return false;
-        for (int r=0; r < max_row; r++) {
-            for (int c=0;  c <max_col; c++) {
-                if (get(r,c) != other.get(r,c))
-                    return false;
-            }
-        };
-        return true;
+        matrix_detail::OpScope scope(MatrixOp::Compare, max_row*max_col);
+        if (!sameLayout(other))
+            return matrix_detail::viewEqual(view(), other.view());
+        return matrix_detail::equalElements(m, other.m, max_row*max_col);
+    }
+
+    /*!
+     * @brief Whether every element is within tolerance of the one of other:
+     *        |a - b| <= max(absTol, relTol * max(|a|, |b|))
+     *
+     * False when the sizes differ or an element is NaN.
+     * @param[in] other  the matrix to compare to
+     * @param[in] relTol tolerance relative to the larger of the two elements
+     * @param[in] absTol tolerance for elements near 0, where a relative one is too strict
+     */
+    bool approxEqual(const Matrix& other, typename MatrixReal<T>::type relTol,
+                     typename MatrixReal<T>::type absTol = 0) const {
+        if ( (max_col != other.max_col) || (max_row != other.max_row) )
+            return false;
+        matrix_detail::OpScope scope(MatrixOp::Compare, 3*max_row*max_col);
+        if (!sameLayout(other)) {
+            std::atomic<bool> far(false);
+            matrix_detail::forEachLinePair(view(), other.view(), [&](const T* x, const T* y, std::size_t n) {
+                if (!far.load(std::memory_order_relaxed) && !matrix_detail::closeElements(x, y, n, relTol, absTol))
+                    far.store(true, std::memory_order_relaxed);
+            });
+            return !far.load(std::memory_order_relaxed);
+        }
+        return matrix_detail::closeElements(m, other.m, max_row*max_col, relTol, absTol);
+    }
+
+    /*!
+     * @brief The sum of all elements, 0 for an empty matrix
+     *
+     * Vectorized and split over threads; the rounding of a floating point
+     * sum differs from that of a plain loop, see matrix_reduce.h.
+     */
+    T sum() const {
+        matrix_detail::OpScope scope(MatrixOp::Reduce, max_row*max_col);
+        return matrix_detail::reduceSum<T>(m, max_row*max_col, [](T x) { return x; });
+    }
+
+    /*!
+     * @brief The Frobenius norm: the square root of the sum of the squares
+     *        of the elements
+     */
+    typename MatrixReal<T>::type normFrobenius() const {
+        typedef typename matrix_detail::NormAccumulator<T>::type A;
+        matrix_detail::OpScope scope(MatrixOp::Reduce, 2*max_row*max_col);
+        return (typename MatrixReal<T>::type) std::sqrt(
+            matrix_detail::reduceSum<A>(m, max_row*max_col, [](T x) { return A(x) * A(x); }));
+    }
+
+    /*!
+     * @brief The sum of the absolute values of the elements (the L1 norm of
+     *        the elements, not the largest column sum)
+     */
+    typename MatrixReal<T>::type normL1() const {
+        typedef typename matrix_detail::NormAccumulator<T>::type A;
+        matrix_detail::OpScope scope(MatrixOp::Reduce, max_row*max_col);
+        return (typename MatrixReal<T>::type)
+            matrix_detail::reduceSum<A>(m, max_row*max_col, [](T x) { return matrix_detail::absolute(A(x)); });
+    }
+
+    /*!
+     * @brief The largest absolute value of an element, 0 for an empty matrix
+     */
+    typename MatrixReal<T>::type normMax() const {
+        if (max_row*max_col == 0)
+            return 0;
+        matrix_detail::OpScope scope(MatrixOp::Reduce, 2*max_row*max_col);
+        typedef typename MatrixReal<T>::type R;
+        const R lo = R(matrix_detail::extremeElement(m, max_row*max_col, true));
+        const R hi = R(matrix_detail::extremeElement(m, max_row*max_col, false));
+        return (std::max)(matrix_detail::absolute(lo), matrix_detail::absolute(hi));
+    }
+
+    /*!
+     * @brief The smallest element; NaNs are skipped
+     * @exception invalid_argument thrown when the matrix is empty.
+     */
+    T minValue() const {
+        if (max_row*max_col == 0)
+            throw std::invalid_argument("minValue: the matrix is empty.");
+        matrix_detail::OpScope scope(MatrixOp::Reduce, max_row*max_col);
+        return matrix_detail::extremeElement(m, max_row*max_col, true);
+    }
+
+    /*!
+     * @brief The largest element; NaNs are skipped
+     * @exception invalid_argument thrown when the matrix is empty.
+     */
+    T maxValue() const {
+        if (max_row*max_col == 0)
+            throw std::invalid_argument("maxValue: the matrix is empty.");
+        matrix_detail::OpScope scope(MatrixOp::Reduce, max_row*max_col);
+        return matrix_detail::extremeElement(m, max_row*max_col, false);
+    }
+
+    /*!
+     * @brief { row, col } of the first smallest element (in storage order, see layout())
+     * @exception invalid_argument thrown when the matrix is empty.
+     */
+    std::array<std::size_t, 2> argMin() const {
+        return position(minValue());
+    }
+
+    /*!
+     * @brief { row, col } of the first largest element (in storage order, see layout())
+     * @exception invalid_argument thrown when the matrix is empty.
+     */
+    std::array<std::size_t, 2> argMax() const {
+        return position(maxValue());
+    }
+
+    /*!
+     * @brief The sum of every row, as a rows x 1 matrix
+     */
+    Matrix rowSums() const {
+        matrix_detail::OpScope scope(MatrixOp::Reduce, max_row*max_col);
+        Matrix ret(max_row, 1, MatrixInit::Uninitialized);
+        lineSums<T>(ret.m, true);
+        return ret;
+    }
+
+    /*!
+     * @brief The sum of every column, as a 1 x cols matrix
+     */
+    Matrix colSums() const {
+        matrix_detail::OpScope scope(MatrixOp::Reduce, max_row*max_col);
+        Matrix ret(1, max_col, MatrixInit::Uninitialized);
+        lineSums<T>(ret.m, false);
+        return ret;
+    }
+
+    /*!
+     * @brief The mean of every row, as a rows x 1 matrix (of double for integer matrices)
+     */
+    Matrix<typename MatrixReal<T>::type> rowMeans() const {
+        typedef typename MatrixReal<T>::type R;
+        matrix_detail::OpScope scope(MatrixOp::Reduce, max_row*max_col);
+        Matrix<R> ret(max_row, 1, MatrixInit::Uninitialized);
+        lineSums<R>(ret.data(), true);
+        for (std::size_t r = 0; r < max_row; r++)
+            ret.data()[r] /= R(max_col);
+        return ret;
+    }
+
+    /*!
+     * @brief The mean of every column, as a 1 x cols matrix (of double for integer matrices)
+     */
+    Matrix<typename MatrixReal<T>::type> colMeans() const {
+        typedef typename MatrixReal<T>::type R;
+        matrix_detail::OpScope scope(MatrixOp::Reduce, max_row*max_col);
+        Matrix<R> ret(1, max_col, MatrixInit::Uninitialized);
+        lineSums<R>(ret.data(), false);
+        for (std::size_t c = 0; c < max_col; c++)
+            ret.data()[c] /= R(max_row);
+        return ret;
+    }
+
+    /*!
+     * @brief The sum of the diagonal (of the min(rows, cols) elements on it)
+     */
+    T trace() const {
+        T s = T(0);
+        for (std::size_t i = 0; i < max_row && i < max_col; i++)
+            s += m[index(i, i)];
+        return s;
     }
 
     /*! @brief print matrix to cout, for debug purposes.
      */
     void debug() const {
-        for (int r=0; r < max_row; r++) {
-            for (int c=0;  c <max_col; c++) {
+        for (std::size_t r=0; r < max_row; r++) {
+            for (std::size_t c=0;  c <max_col; c++) {
                 std::cout << get(r,c) << " ";
             }
             std::cout << std::endl;
@@ -460,20 +1420,191 @@ public:
      * convert int matrices to float matrices 
      * usage: matrixa.convertTo(matrixOut), where matrixOut
      * is the matrix where the data is copied to.
-     * Type conversion is just done by typecasting!! (No rounding)
+     * By default type conversion is just done by typecasting (no rounding),
+     * see ConvertMode for rounding and saturating. One pass straight into
+     * 'out', whose memory is reused when it already has the right size
+     * (and which keeps its layout then, otherwise it gets this one's).
      * 
      * @param[out] out the new matrix
+     * @param[in]  mode how every element is converted
      */
     
-    template <class To>
-    void convertTo(Matrix<To>& out) {
-        // Not very efficient method, but create a new matrix first.
-        // The inefficiency is that 'out=tmp' will copy it again!        
-        Matrix<To> tmp = Matrix<To>(max_row, max_col);
-        for (int r=0; r<max_row; r++) 
-            for (int c=0; c<max_col; c++) {
-                tmp.set(r,c, (To) get(r,c));
+    template <class To, class ToAlloc>
+    void convertTo(Matrix<To, ToAlloc>& out, ConvertMode mode = ConvertMode::Cast) const {
+        matrix_detail::OpScope scope(MatrixOp::Convert, 0, max_row*max_col*sizeof(To));
+        // m first: resize gives out new memory when out is this matrix and it's shared
+        const T* src = m;
+        out.reshape(max_row, max_col, order);
+        if (out.order != order && !isVector()) {
+            matrix_detail::forEachLinePair(out.view(), ConstMatrixView<T>(src, max_row, max_col, stride(), order),
+                                           [mode](To* y, const T* x, std::size_t n) {
+                matrix_detail::convertElements(x, y, n, mode);
+            });
+            return;
+        }
+        To* dst = out.m;
+        matrix_detail::parallelElements(max_row*max_col, sizeof(T) + sizeof(To), [=](std::size_t b, std::size_t e) {
+            matrix_detail::convertElements(src + b, dst + b, e - b, mode);
+        });
+    }
+
+private:
+    template <class, class> friend class Matrix;
+
+    // n elements from the allocator, not initialised
+    T* allocate(std::size_t n) {
+        T* p = AllocTraits::allocate(alloc, n);
+        if (p == NULL)
+            throw std::bad_alloc();
+        matrix_detail::profileAllocate(n*sizeof(T));
+        return p;
+    }
+
+    // deleter of the elements of a copy-on-write matrix, disarmed when it becomes unique again
+    struct SharedRelease {
+        Alloc alloc;
+        std::size_t n;
+        bool armed;
+        void operator()(T* p) {
+            if (!armed)
+                return;
+            AllocTraits::deallocate(alloc, p, n);
+            matrix_detail::profileRelease(n*sizeof(T));
+        }
+    };
+
+    // let external own m (n elements from alloc), so copy-on-write copies can share it
+    void shareBuffer(std::size_t n) {
+        try {
+            external = std::shared_ptr<void>(m, SharedRelease{ alloc, n, true });
+        } catch (...) {
+            // the deleter has given m back already
+            m = NULL;
+            max_row = 0;
+            max_col = 0;
+            throw;
+        }
+    }
+
+    // give this matrix its own copy of the elements when it shares them
+    void detach() {
+        if (!sharesData())
+            return;
+        const std::size_t n = max_row*max_col;
+        matrix_detail::OpScope scope(MatrixOp::Copy, 0, n*sizeof(T));
+        T* p = allocate(n);
+        memcpy(p, m, n*sizeof(T));
+        external.reset();
+        m = p;
+        shareBuffer(n);
+    }
+
+    // give m back to the allocator, or let go of the external memory
+    void release() {
+        if (external)
+            external.reset();
+        else if (m != NULL) {
+            AllocTraits::deallocate(alloc, m, max_row*max_col);
+            matrix_detail::profileRelease(max_row*max_col*sizeof(T));
+        }
+        m = NULL;
+    }
+
+    // Give the matrix the dimensions rows x cols. The memory is only
+    // reallocated when the number of elements changes, or when it is shared
+    // with other copy-on-write matrices; the contents are undefined afterwards.
+    void resize(std::size_t rows, std::size_t cols) {
+        if (rows*cols != max_row*max_col || m == NULL || sharesData()) {
+            release();
+            if (rows*cols > 0) {
+                m = allocate(rows*cols);
+                if (cow)
+                    shareBuffer(rows*cols);
             }
-        out = tmp;    
+        }
+        max_row = rows;
+        max_col = cols;
+    }
+
+    // where element (row, col) is in m
+    std::size_t index(std::size_t row, std::size_t col) const {
+        return order == MatrixLayout::RowMajor ? row*max_col + col : col*max_row + row;
+    }
+
+    // the distance between rows and between columns in m
+    std::ptrdiff_t rowStep() const { return order == MatrixLayout::RowMajor ? (std::ptrdiff_t)max_col : 1; }
+    std::ptrdiff_t colStep() const { return order == MatrixLayout::RowMajor ? 1 : (std::ptrdiff_t)max_row; }
+
+    // whether the elements of other are in m's order: the same layout, or vectors
+    template <class U, class UAlloc>
+    bool sameLayout(const Matrix<U, UAlloc>& other) const {
+        return order == other.order || isVector();
+    }
+
+    // the sums of the rows (rows = true) or columns into out, in A
+    template <class A>
+    void lineSums(A* out, bool rows) const {
+        // the rows of a column-major matrix are the columns of its memory
+        const bool rm = order == MatrixLayout::RowMajor;
+        const std::size_t lines = rm ? max_row : max_col, len = rm ? max_col : max_row;
+        if (rows == rm)
+            matrix_detail::rowSums<A>(m, lines, len, out);
+        else
+            matrix_detail::colSums<A>(m, lines, len, out);
+    }
+
+    // resize() for a result: a matrix that gets new dimensions (or had no
+    // elements) gets the layout of the operands as well
+    void reshape(std::size_t rows, std::size_t cols, MatrixLayout layout) {
+        if (m == NULL || rows != max_row || cols != max_col)
+            order = layout;
+        resize(rows, cols);
+    }
+
+    // { row, col } of the first element equal to v, { 0, 0 } for a NaN
+    std::array<std::size_t, 2> position(T v) const {
+        std::size_t i = matrix_detail::findElement(m, max_row*max_col, v);
+        if (i == max_row*max_col)
+            i = 0;
+        std::array<std::size_t, 2> rc = { { i / max_col, i % max_col } };
+        if (order == MatrixLayout::ColumnMajor) {
+            rc[0] = i % max_row;
+            rc[1] = i / max_row;
+        }
+        return rc;
+    }
+
+    // write the expression into m, split over the thread pool for big ones;
+    // operands in another layout than this matrix are read a tile at a time
+    template <class E>
+    void evaluate(const E& expr) {
+        T* dst = m;
+        if (isVector() || expr.uniform(order)) {
+            matrix_detail::parallelElements(max_row*max_col, sizeof(T), [&](std::size_t b, std::size_t e) {
+                matrix_detail::evaluate(dst, expr, b, e);
+            });
+            return;
+        }
+        const std::size_t lines = order == MatrixLayout::RowMajor ? max_row : max_col;
+        const std::size_t tile = matrix_detail::EXPR_TILE;
+        matrix_detail::parallelFor(0, (lines + tile - 1) / tile, 1, max_row*max_col, [&](std::size_t b, std::size_t e) {
+            matrix_detail::evaluateTiled(dst, expr, max_row, max_col, order, b * tile, (std::min)(lines, e * tile));
+        });
     }
 };
+
+/*!
+ * @brief Matrix product of an expression and a matrix, the expression is evaluated first.
+ */
+template <class E, class T, class Alloc>
+Matrix<T, Alloc> operator* (const MatrixExpr<E>& first, const Matrix<T, Alloc>& second) {
+    return Matrix<T, Alloc>::multiply(Matrix<T, Alloc>(first), second);
+}
+
+/*!
+ * @brief Matrix product of a matrix and an expression, the expression is evaluated first.
+ */
+template <class T, class Alloc, class E>
+Matrix<T, Alloc> operator* (const Matrix<T, Alloc>& first, const MatrixExpr<E>& second) {
+    return Matrix<T, Alloc>::multiply(first, Matrix<T, Alloc>(second));
+}
@@ -0,0 +1,346 @@
+/*!
+ * @file matrix_alloc.h
+ * @author Tony Andrioli, The Hague University of Applied Sciences
+ * @date June 2022
+ *
+ * Allocators for the storage of Matrix.
+ *
+ * Matrix takes the allocator as its second template parameter:
+ * @code{.cpp}
+ * Matrix<float> a;                                  // AlignedAllocator, 64 byte aligned
+ * Matrix<float, HugePageAllocator<float> > big;     // 2MB pages for very large matrices
+ * Matrix<float, PoolAllocator<float> > temp;        // recycles memory per thread
+ * @endcode
+ * They are ordinary C++ allocators, so any other allocator works as well.
+ * None of them zero the memory, Matrix does that only when asked to.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <atomic>
+#include <new>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace matrix_detail {
+
+    /*!
+     * @brief malloc with a given alignment (a power of two)
+     */
+    inline void* alignedAlloc(std::size_t bytes, std::size_t alignment) {
+        if (bytes == 0)
+            return NULL;
+        // aligned_alloc wants the size to be a multiple of the alignment
+        bytes = ((bytes + alignment - 1) / alignment) * alignment;
+    #if defined(_MSC_VER)
+        void* p = _aligned_malloc(bytes, alignment);
+    #else
+        void* p = std::aligned_alloc(alignment, bytes);
+    #endif
+        if (p == NULL)
+            throw std::bad_alloc();
+        return p;
+    }
+
+    inline void alignedFree(void* p) {
+    #if defined(_MSC_VER)
+        _aligned_free(p);
+    #else
+        std::free(p);
+    #endif
+    }
+
+    // ----------------------------------------------------------------------
+    // per thread arena
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief Per thread cache of freed blocks, sorted in power of two size classes.
+     *
+     * A block freed on another thread than it was allocated on simply goes into
+     * the cache of that other thread, all blocks come from alignedAlloc(). The
+     * cache holds at most maxCached bytes, blocks beyond that are freed.
+     */
+    class ThreadArena {
+    public:
+        static constexpr std::size_t ALIGNMENT = 64;
+        static constexpr int CLASSES = 40;         // 64 bytes .. 32 TB
+
+        static ThreadArena& local() {
+            static thread_local ThreadArena arena;
+            return arena;
+        }
+
+        void* allocate(std::size_t bytes) {
+            int cls = sizeClass(bytes);
+            std::vector<void*>& list = lists[cls];
+            if (!list.empty()) {
+                void* p = list.back();
+                list.pop_back();
+                cached -= classBytes(cls);
+                return p;
+            }
+            return alignedAlloc(classBytes(cls), ALIGNMENT);
+        }
+
+        void deallocate(void* p, std::size_t bytes) {
+            if (p == NULL)
+                return;
+            int cls = sizeClass(bytes);
+            if (cached + classBytes(cls) > maxCached()) {
+                alignedFree(p);
+                return;
+            }
+            lists[cls].push_back(p);
+            cached += classBytes(cls);
+        }
+
+        /*!
+         * @brief Set the bytes each thread may keep cached; safe while other
+         *        threads allocate and free.
+         */
+        static void setMaxCached(std::size_t bytes) {
+            maxCachedRef().store(bytes, std::memory_order_relaxed);
+        }
+
+        /*!
+         * @brief See setMaxCached(), 256MB by default.
+         */
+        static std::size_t maxCached() {
+            return maxCachedRef().load(std::memory_order_relaxed);
+        }
+
+        /*!
+         * @brief Free everything this thread has cached.
+         */
+        void release() {
+            for (int i = 0; i < CLASSES; i++) {
+                for (std::size_t j = 0; j < lists[i].size(); j++)
+                    alignedFree(lists[i][j]);
+                lists[i].clear();
+            }
+            cached = 0;
+        }
+
+        ~ThreadArena() {
+            release();
+        }
+
+    private:
+        ThreadArena() : cached(0) {}
+
+        static std::atomic<std::size_t>& maxCachedRef() {
+            static std::atomic<std::size_t> bytes(std::size_t(256) << 20);
+            return bytes;
+        }
+
+        static int sizeClass(std::size_t bytes) {
+            int cls = 0;
+            std::size_t size = ALIGNMENT;
+            while (size < bytes && cls < CLASSES - 1) {
+                size <<= 1;
+                cls++;
+            }
+            return cls;
+        }
+
+        static std::size_t classBytes(int cls) {
+            return ALIGNMENT << cls;
+        }
+
+        std::vector<void*> lists[CLASSES];
+        std::size_t cached;
+    };
+
+    /*!
+     * @brief Scratch buffer for the kernels (packed panels and such), from the thread arena.
+     */
+    template <class T>
+    class ScratchBuffer {
+    public:
+        explicit ScratchBuffer(std::size_t n) : p(NULL), bytes(n * sizeof(T)) {
+            if (n > 0)
+                p = (T*) ThreadArena::local().allocate(bytes);
+        }
+        ~ScratchBuffer() {
+            ThreadArena::local().deallocate(p, bytes);
+        }
+        T* data() { return p; }
+
+    private:
+        ScratchBuffer(const ScratchBuffer&);
+        ScratchBuffer& operator=(const ScratchBuffer&);
+        T* p;
+        std::size_t bytes;
+    };
+
+} // namespace matrix_detail
+
+/*!
+ * @class AlignedAllocator
+ * @brief The default allocator of Matrix: memory aligned to Alignment bytes.
+ *
+ * 64 bytes is a cache line and the width of an AVX-512 register, so rows
+ * never share a cache line with another allocation and aligned loads work
+ * from the first element on.
+ */
+template <class T, std::size_t Alignment = 64>
+class AlignedAllocator {
+public:
+    typedef T value_type;
+    template <class U> struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+    AlignedAllocator() {}
+    template <class U> AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+    T* allocate(std::size_t n) {
+        return (T*) matrix_detail::alignedAlloc(n * sizeof(T), Alignment);
+    }
+    void deallocate(T* p, std::size_t) {
+        matrix_detail::alignedFree(p);
+    }
+
+    template <class U> bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+    template <class U> bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+/*!
+ * @class HugePageAllocator
+ * @brief Backs large matrices with 2MB pages.
+ *
+ * Blocks of at least 2MB are mapped directly from the operating system. On
+ * Linux explicit huge pages (MAP_HUGETLB) are tried first, when none are
+ * reserved the mapping is advised to use transparent huge pages. On Windows
+ * large pages need the "Lock pages in memory" privilege, without it normal
+ * pages are used. Smaller blocks come from the AlignedAllocator.
+ *
+ * Huge pages cut the TLB misses of walking a matrix of several GB by a
+ * large factor, for small matrices they only waste memory.
+ */
+template <class T>
+class HugePageAllocator {
+public:
+    typedef T value_type;
+    template <class U> struct rebind { typedef HugePageAllocator<U> other; };
+
+    static constexpr std::size_t HUGE_PAGE = 2 * 1024 * 1024;
+
+    HugePageAllocator() {}
+    template <class U> HugePageAllocator(const HugePageAllocator<U>&) {}
+
+    T* allocate(std::size_t n) {
+        std::size_t bytes = n * sizeof(T);
+        if (bytes < HUGE_PAGE)
+            return (T*) matrix_detail::alignedAlloc(bytes, 64);
+        bytes = roundUp(bytes);
+    #if defined(_WIN32)
+        void* p = VirtualAlloc(NULL, bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (p == NULL)
+            p = VirtualAlloc(NULL, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if (p == NULL)
+            throw std::bad_alloc();
+    #else
+        void* p = MAP_FAILED;
+    #ifdef MAP_HUGETLB
+        p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    #endif
+        if (p == MAP_FAILED) {
+            p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED)
+                throw std::bad_alloc();
+        #ifdef MADV_HUGEPAGE
+            madvise(p, bytes, MADV_HUGEPAGE);
+        #endif
+        }
+    #endif
+        return (T*) p;
+    }
+
+    void deallocate(T* p, std::size_t n) {
+        if (p == NULL)
+            return;
+        std::size_t bytes = n * sizeof(T);
+        if (bytes < HUGE_PAGE) {
+            matrix_detail::alignedFree(p);
+            return;
+        }
+    #if defined(_WIN32)
+        VirtualFree(p, 0, MEM_RELEASE);
+    #else
+        munmap(p, roundUp(bytes));
+    #endif
+    }
+
+    template <class U> bool operator==(const HugePageAllocator<U>&) const { return true; }
+    template <class U> bool operator!=(const HugePageAllocator<U>&) const { return false; }
+
+private:
+    static std::size_t roundUp(std::size_t bytes) {
+        return ((bytes + HUGE_PAGE - 1) / HUGE_PAGE) * HUGE_PAGE;
+    }
+};
+
+/*!
+ * @class PoolAllocator
+ * @brief Recycles freed blocks through a per thread arena.
+ *
+ * Meant for the short-lived results of add, multiply and transpose in a
+ * loop: after the first iteration every allocation is a pop from a free
+ * list instead of a trip to malloc (and for big blocks, to the kernel).
+ * Sizes are rounded up to a power of two. See matrix_detail::ThreadArena.
+ */
+template <class T>
+class PoolAllocator {
+public:
+    typedef T value_type;
+    template <class U> struct rebind { typedef PoolAllocator<U> other; };
+
+    PoolAllocator() {}
+    template <class U> PoolAllocator(const PoolAllocator<U>&) {}
+
+    T* allocate(std::size_t n) {
+        return (T*) matrix_detail::ThreadArena::local().allocate(n * sizeof(T));
+    }
+    void deallocate(T* p, std::size_t n) {
+        matrix_detail::ThreadArena::local().deallocate(p, n * sizeof(T));
+    }
+
+    template <class U> bool operator==(const PoolAllocator<U>&) const { return true; }
+    template <class U> bool operator!=(const PoolAllocator<U>&) const { return false; }
+};
+
+/*!
+ * @brief How a new matrix is initialised, see Matrix(rows, columns, MatrixInit)
+ */
+enum class MatrixInit {
+    Zero,           //!< all elements 0
+    Uninitialized   //!< leave the memory as it is, for matrices that are overwritten anyway
+};
+
+/*!
+ * @brief Order of the elements in memory
+ */
+enum class MatrixLayout {
+    RowMajor,       //!< row by row, the default of Matrix
+    ColumnMajor     //!< column by column
+};
+
+/*!
+ * @brief What copies of a matrix do with its elements, see Matrix::setStorage()
+ */
+enum class MatrixStorage {
+    Unique,         //!< every copy gets its own elements
+    CopyOnWrite     //!< copies share the elements until one of them is changed
+};
+
+template <class T, class Alloc = AlignedAllocator<T> > class Matrix;
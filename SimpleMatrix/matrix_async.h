@@ -0,0 +1,544 @@
+/*!
+ * @file matrix_async.h
+ * @author Tony Andrioli, The Hague University of Applied Sciences
+ * @date June 2022
+ *
+ * Asynchronous matrix operations: futures and a dependency graph on top of
+ * the thread pool of matrix_parallel.h.
+ *
+ * An asynchronous operation takes futures and returns one. It runs on the
+ * pool as soon as the futures it takes are ready, so operations that don't
+ * depend on each other run at the same time, while the caller goes on:
+ * @code{.cpp}
+ * MatrixFuture<Matrix<double> > a = asyncValue(std::move(A)), b = asyncValue(std::move(B));
+ * MatrixFuture<Matrix<double> > ab = asyncMultiply(a, b);       // these two run side by side
+ * MatrixFuture<Matrix<double> > bt = asyncTranspose(b);
+ * MatrixFuture<Matrix<double> > sum = asyncAdd(ab, bt);         // runs when both are done
+ * readRequest();                                                // overlaps with the above
+ * const Matrix<double>& result = sum.get();                     // waits
+ * @endcode
+ * A MatrixTaskGraph collects operations without starting them, submit()
+ * starts them all at once and wait() waits for the whole graph:
+ * @code{.cpp}
+ * MatrixTaskGraph graph;
+ * MatrixFuture<Matrix<float> > x = graph.value(X);
+ * MatrixFuture<Matrix<float> > y = graph.hadamard(graph.multiply(x, x), x);
+ * graph.submit();
+ * ...
+ * graph.wait();                 // rethrows the first error of the graph
+ * @endcode
+ * An error in an operation (matrices whose sizes don't fit, say) is kept in
+ * its future and in the futures of everything that depends on it, and
+ * rethrown by get(). Futures share their result: get() returns a reference
+ * that stays valid as long as one copy of the future does.
+ *
+ * Waiting from a worker of the pool (in an operation that runs on the pool)
+ * runs other queued work meanwhile, as parallelFor does, so it can't
+ * deadlock the pool. With MatrixConfig::setThreadCount(1) an operation runs
+ * on the thread that starts it, when it starts.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <chrono>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "matrix_alloc.h"
+#include "matrix_convert.h"
+#include "matrix_parallel.h"
+#include "matrix_profile.h"
+#include "matrix_strassen.h"
+
+class MatrixTaskGraph;
+
+namespace matrix_detail {
+
+    struct AsyncLaunch;
+
+    /*!
+     * @brief One operation of the graph: the work, the operations it waits
+     *        for and the ones that wait for it.
+     *
+     * pending counts the inputs that aren't done plus one for start(), the
+     * node runs when it drops to 0.
+     */
+    class AsyncNode : public std::enable_shared_from_this<AsyncNode> {
+    public:
+        AsyncNode() : pending(1), started(false), done(false) {}
+        virtual ~AsyncNode() {}
+
+        /*!
+         * @brief Make this node wait for 'input'; only before start()
+         */
+        void dependOn(const std::shared_ptr<AsyncNode>& input) {
+            inputs.push_back(input);
+            std::lock_guard<std::mutex> lock(input->mutex);
+            if (!input->done) {
+                pending.fetch_add(1, std::memory_order_relaxed);
+                input->dependents.push_back(shared_from_this());
+            }
+        }
+
+        /*!
+         * @brief Let the node run once its inputs are done; only once
+         */
+        void start() {
+            started.store(true, std::memory_order_release);
+            release();
+        }
+
+        /*!
+         * @brief Mark a node without inputs done without running it
+         */
+        void complete() {
+            started.store(true, std::memory_order_release);
+            pending.store(0, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+        }
+
+        bool isStarted() const {
+            return started.load(std::memory_order_acquire);
+        }
+
+        bool isDone() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return done;
+        }
+
+        /*!
+         * @brief Wait until the node is done; its error, if any, is in failure()
+         * @exception logic_error thrown when the node wasn't started.
+         */
+        void wait() {
+            if (!isStarted())
+                throw std::logic_error("MatrixFuture: waiting for an operation that wasn't submitted.");
+            ThreadPool& pool = ThreadPool::instance();
+            for (;;) {
+                if (isDone())
+                    return;
+                if (pool.runOne())
+                    continue;
+                // a worker must keep taking work, another thread can sleep: the workers do it
+                std::unique_lock<std::mutex> lock(mutex);
+                if (pool.onWorker())
+                    wakeUp.wait_for(lock, std::chrono::microseconds(100), [this]() { return done; });
+                else
+                    wakeUp.wait(lock, [this]() { return done; });
+            }
+        }
+
+        /*!
+         * @brief The error of the node or of one of its inputs, once it's done
+         */
+        std::exception_ptr failure() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return error;
+        }
+
+    protected:
+        // compute the result, the inputs are done and have no error
+        virtual void run() = 0;
+
+        // drop the work (and with it the references to the inputs' results)
+        virtual void clear() = 0;
+
+    private:
+        AsyncNode(const AsyncNode&);
+        AsyncNode& operator=(const AsyncNode&);
+
+        void release() {
+            if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                schedule(shared_from_this());
+        }
+
+        void execute() {
+            std::exception_ptr err;
+            for (std::size_t i = 0; i < inputs.size() && !err; i++)
+                err = inputs[i]->failure();
+            if (!err) {
+                // the operation is counted on its own, also when it runs
+                // while this thread waits inside another one
+                OpScope* outer = currentOp();
+                currentOp() = NULL;
+                try {
+                    run();
+                } catch (...) {
+                    err = std::current_exception();
+                }
+                currentOp() = outer;
+            }
+            inputs.clear();
+            clear();
+            std::vector<std::shared_ptr<AsyncNode> > next;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                error = err;
+                done = true;
+                next.swap(dependents);
+            }
+            wakeUp.notify_all();
+            for (std::size_t i = 0; i < next.size(); i++)
+                next[i]->release();
+        }
+
+        // run a node whose inputs are done: on the pool, or without workers
+        // right here, nodes that become ready meanwhile queued instead of
+        // recursing down a long chain
+        static void schedule(const std::shared_ptr<AsyncNode>& node) {
+            ThreadPool& pool = ThreadPool::instance();
+            if (pool.threadCount() > 1) {
+                std::shared_ptr<AsyncNode> keep = node;
+                pool.submit([keep]() { keep->execute(); });
+                return;
+            }
+            static thread_local std::deque<std::shared_ptr<AsyncNode> > ready;
+            static thread_local bool running = false;
+            ready.push_back(node);
+            if (running)
+                return;
+            running = true;
+            while (!ready.empty()) {
+                std::shared_ptr<AsyncNode> n = ready.front();
+                ready.pop_front();
+                n->execute();
+            }
+            running = false;
+        }
+
+        std::atomic<std::size_t> pending;
+        std::atomic<bool> started;
+        std::vector<std::shared_ptr<AsyncNode> > inputs;
+        mutable std::mutex mutex;
+        std::condition_variable wakeUp;
+        bool done;
+        std::exception_ptr error;
+        std::vector<std::shared_ptr<AsyncNode> > dependents;
+    };
+
+    /*!
+     * @brief A node with a result of type M, computed by work(result)
+     */
+    template <class M>
+    class AsyncValue : public AsyncNode {
+    public:
+        explicit AsyncValue(std::function<void(M&)> work) : work(std::move(work)) {}
+
+        M value;
+
+    protected:
+        void run() { work(value); }
+        void clear() { work = std::function<void(M&)>(); }
+
+    private:
+        std::function<void(M&)> work;
+    };
+
+} // namespace matrix_detail
+
+/*!
+ * @class MatrixFuture
+ * @brief The result of an asynchronous operation, see matrix_async.h
+ *
+ * Copies share the result. A default constructed future is not valid().
+ */
+template <class M>
+class MatrixFuture {
+public:
+    MatrixFuture() {}
+
+    /*!
+     * @brief Whether the future belongs to an operation
+     */
+    bool valid() const { return (bool) node; }
+
+    /*!
+     * @brief Whether the operation is done (successfully or not), doesn't wait
+     */
+    bool ready() const { return node && node->isDone(); }
+
+    /*!
+     * @brief Wait until the operation is done, without rethrowing its error
+     * @exception logic_error thrown when the future isn't valid() or the
+     *            operation wasn't submitted.
+     */
+    void wait() const { state().wait(); }
+
+    /*!
+     * @brief Wait for the result
+     *
+     * The reference stays valid as long as a copy of this future exists.
+     * @exception logic_error thrown when the future isn't valid() or the
+     *            operation wasn't submitted.
+     * Rethrows the error of the operation or of an operation it depends on.
+     */
+    const M& get() const {
+        state().wait();
+        std::exception_ptr err = node->failure();
+        if (err)
+            std::rethrow_exception(err);
+        return node->value;
+    }
+
+private:
+    explicit MatrixFuture(std::shared_ptr<matrix_detail::AsyncValue<M> > node) : node(std::move(node)) {}
+
+    // the operation, like std::future's no_state error when there is none
+    matrix_detail::AsyncValue<M>& state() const {
+        if (!node)
+            throw std::logic_error("MatrixFuture: the future has no operation (default constructed or moved from).");
+        return *node;
+    }
+
+    template <class> friend class MatrixFuture;
+    friend class MatrixTaskGraph;
+
+    std::shared_ptr<matrix_detail::AsyncValue<M> > node;
+};
+
+/*!
+ * @class MatrixTaskGraph
+ * @brief Asynchronous operations that start together, see matrix_async.h
+ *
+ * Operations added to the graph wait for submit(). The free functions
+ * asyncMultiply() and friends start theirs right away; both kinds of
+ * futures can be mixed. Build a graph on one thread. The destructor waits
+ * for what was submitted (and submits the rest first), ignoring errors.
+ */
+class MatrixTaskGraph {
+public:
+    MatrixTaskGraph() : immediate(false) {}
+
+    ~MatrixTaskGraph() {
+        try {
+            wait();
+        } catch (...) {
+        }
+    }
+
+    /*!
+     * @brief A future that is ready with 'matrix' as its result
+     */
+    template <class T, class Alloc>
+    static MatrixFuture<Matrix<T, Alloc> > ready(Matrix<T, Alloc> matrix) {
+        MatrixFuture<Matrix<T, Alloc> > ret = make<Matrix<T, Alloc> >(std::function<void(Matrix<T, Alloc>&)>());
+        ret.node->value = std::move(matrix);
+        ret.node->complete();
+        return ret;
+    }
+
+    /*!
+     * @brief A future with 'matrix' as its result, ready right away
+     */
+    template <class T, class Alloc>
+    MatrixFuture<Matrix<T, Alloc> > value(Matrix<T, Alloc> matrix) {
+        return ready(std::move(matrix));
+    }
+
+    /*!
+     * @brief first * second, see Matrix::multiply()
+     */
+    template <class T, class Alloc>
+    MatrixFuture<Matrix<T, Alloc> > multiply(const MatrixFuture<Matrix<T, Alloc> >& first,
+                                             const MatrixFuture<Matrix<T, Alloc> >& second,
+                                             MultiplyAlgorithm algorithm = MultiplyAlgorithm::Auto) {
+        typedef Matrix<T, Alloc> M;
+        std::shared_ptr<matrix_detail::AsyncValue<M> > a = first.node, b = second.node;
+        return link(make<M>([a, b, algorithm](M& out) { M::multiply(a->value, b->value, out, algorithm); }), a, b);
+    }
+
+    /*!
+     * @brief first + second, see Matrix::add()
+     */
+    template <class T, class Alloc>
+    MatrixFuture<Matrix<T, Alloc> > add(const MatrixFuture<Matrix<T, Alloc> >& first,
+                                        const MatrixFuture<Matrix<T, Alloc> >& second) {
+        typedef Matrix<T, Alloc> M;
+        std::shared_ptr<matrix_detail::AsyncValue<M> > a = first.node, b = second.node;
+        return link(make<M>([a, b](M& out) { M::add(a->value, b->value, out); }), a, b);
+    }
+
+    /*!
+     * @brief The element-wise product of first and second, see Matrix::hadamard()
+     */
+    template <class T, class Alloc>
+    MatrixFuture<Matrix<T, Alloc> > hadamard(const MatrixFuture<Matrix<T, Alloc> >& first,
+                                             const MatrixFuture<Matrix<T, Alloc> >& second) {
+        typedef Matrix<T, Alloc> M;
+        std::shared_ptr<matrix_detail::AsyncValue<M> > a = first.node, b = second.node;
+        return link(make<M>([a, b](M& out) { M::hadamard(a->value, b->value, out); }), a, b);
+    }
+
+    /*!
+     * @brief The transpose of matrix, see Matrix::transpose()
+     */
+    template <class T, class Alloc>
+    MatrixFuture<Matrix<T, Alloc> > transpose(const MatrixFuture<Matrix<T, Alloc> >& matrix) {
+        typedef Matrix<T, Alloc> M;
+        std::shared_ptr<matrix_detail::AsyncValue<M> > a = matrix.node;
+        return link(make<M>([a](M& out) { a->value.transpose(out); }), a);
+    }
+
+    /*!
+     * @brief matrix converted to To, see Matrix::convertTo()
+     */
+    template <class To, class T, class Alloc>
+    MatrixFuture<Matrix<To> > convertTo(const MatrixFuture<Matrix<T, Alloc> >& matrix,
+                                        ConvertMode mode = ConvertMode::Cast) {
+        std::shared_ptr<matrix_detail::AsyncValue<Matrix<T, Alloc> > > a = matrix.node;
+        return link(make<Matrix<To> >([a, mode](Matrix<To>& out) { a->value.convertTo(out, mode); }), a);
+    }
+
+    /*!
+     * @brief Start the operations added since the last submit()
+     */
+    void submit() {
+        for (std::size_t i = 0; i < added.size(); i++) {
+            added[i]->start();
+            submitted.push_back(std::move(added[i]));
+        }
+        added.clear();
+    }
+
+    /*!
+     * @brief submit(), then wait for every operation of the graph
+     *
+     * Rethrows the first error (in the order the operations were added).
+     */
+    void wait() {
+        submit();
+        std::exception_ptr err;
+        for (std::size_t i = 0; i < submitted.size(); i++) {
+            submitted[i]->wait();
+            if (!err)
+                err = submitted[i]->failure();
+        }
+        submitted.clear();
+        if (err)
+            std::rethrow_exception(err);
+    }
+
+    /*!
+     * @brief The number of operations added and not yet waited for by wait()
+     */
+    std::size_t size() const { return added.size() + submitted.size(); }
+
+private:
+    friend struct matrix_detail::AsyncLaunch;
+
+    // a graph that starts its operations when they're added and forgets them
+    explicit MatrixTaskGraph(bool immediate) : immediate(immediate) {}
+
+    MatrixTaskGraph(const MatrixTaskGraph&);
+    MatrixTaskGraph& operator=(const MatrixTaskGraph&);
+
+    template <class M, class F>
+    static MatrixFuture<M> make(F work) {
+        return MatrixFuture<M>(std::make_shared<matrix_detail::AsyncValue<M> >(std::function<void(M&)>(work)));
+    }
+
+    template <class M, class In>
+    MatrixFuture<M> link(MatrixFuture<M> ret, const std::shared_ptr<In>& a) {
+        if (!a)
+            throw std::invalid_argument("MatrixTaskGraph: an operand is not a valid future.");
+        ret.node->dependOn(a);
+        return record(ret);
+    }
+
+    template <class M, class In>
+    MatrixFuture<M> link(MatrixFuture<M> ret, const std::shared_ptr<In>& a, const std::shared_ptr<In>& b) {
+        if (!a || !b)
+            throw std::invalid_argument("MatrixTaskGraph: an operand is not a valid future.");
+        ret.node->dependOn(a);
+        ret.node->dependOn(b);
+        return record(ret);
+    }
+
+    template <class M>
+    MatrixFuture<M> record(const MatrixFuture<M>& ret) {
+        if (immediate)
+            ret.node->start();
+        else
+            added.push_back(ret.node);
+        return ret;
+    }
+
+    bool immediate;
+    std::vector<std::shared_ptr<matrix_detail::AsyncNode> > added, submitted;
+};
+
+namespace matrix_detail {
+
+    // build one operation on a graph that starts it right away
+    struct AsyncLaunch {
+        template <class F>
+        static auto now(const F& build) {
+            MatrixTaskGraph graph(true);
+            return build(graph);
+        }
+    };
+
+} // namespace matrix_detail
+
+/*!
+ * @brief A future that is ready with 'matrix' as its result
+ */
+template <class T, class Alloc>
+MatrixFuture<Matrix<T, Alloc> > asyncValue(Matrix<T, Alloc> matrix) {
+    return MatrixTaskGraph::ready(std::move(matrix));
+}
+
+/*!
+ * @brief first * second on the thread pool, see Matrix::multiply()
+ */
+template <class T, class Alloc>
+MatrixFuture<Matrix<T, Alloc> > asyncMultiply(const MatrixFuture<Matrix<T, Alloc> >& first,
+                                              const MatrixFuture<Matrix<T, Alloc> >& second,
+                                              MultiplyAlgorithm algorithm = MultiplyAlgorithm::Auto) {
+    return matrix_detail::AsyncLaunch::now([&](MatrixTaskGraph& g) { return g.multiply(first, second, algorithm); });
+}
+
+/*!
+ * @brief first + second on the thread pool, see Matrix::add()
+ */
+template <class T, class Alloc>
+MatrixFuture<Matrix<T, Alloc> > asyncAdd(const MatrixFuture<Matrix<T, Alloc> >& first,
+                                         const MatrixFuture<Matrix<T, Alloc> >& second) {
+    return matrix_detail::AsyncLaunch::now([&](MatrixTaskGraph& g) { return g.add(first, second); });
+}
+
+/*!
+ * @brief The element-wise product on the thread pool, see Matrix::hadamard()
+ */
+template <class T, class Alloc>
+MatrixFuture<Matrix<T, Alloc> > asyncHadamard(const MatrixFuture<Matrix<T, Alloc> >& first,
+                                              const MatrixFuture<Matrix<T, Alloc> >& second) {
+    return matrix_detail::AsyncLaunch::now([&](MatrixTaskGraph& g) { return g.hadamard(first, second); });
+}
+
+/*!
+ * @brief The transpose on the thread pool, see Matrix::transpose()
+ */
+template <class T, class Alloc>
+MatrixFuture<Matrix<T, Alloc> > asyncTranspose(const MatrixFuture<Matrix<T, Alloc> >& matrix) {
+    return matrix_detail::AsyncLaunch::now([&](MatrixTaskGraph& g) { return g.transpose(matrix); });
+}
+
+/*!
+ * @brief The conversion to To on the thread pool, see Matrix::convertTo()
+ */
+template <class To, class T, class Alloc>
+MatrixFuture<Matrix<To> > asyncConvert(const MatrixFuture<Matrix<T, Alloc> >& matrix,
+                                       ConvertMode mode = ConvertMode::Cast) {
+    return matrix_detail::AsyncLaunch::now([&](MatrixTaskGraph& g) { return g.template convertTo<To>(matrix, mode); });
+}
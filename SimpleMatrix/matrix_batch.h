@@ -0,0 +1,501 @@
+/*!
+ * @file matrix_batch.h
+ * @author Tony Andrioli, The Hague University of Applied Sciences
+ * @date June 2022
+ *
+ * Many small matrices of the same size, stored and processed together.
+ *
+ * A MatrixBatch of N matrices of R x C stores them in groups of LANES
+ * matrices (64 bytes of elements: 16 floats, 8 doubles). Within a group
+ * element (r, c) of its LANES matrices are next to each other: first
+ * element (0,0) of all of them, then element (0,1), and so on (structure of
+ * arrays per group). Every operation then works on LANES matrices at once,
+ * one vector register, which vectorizes across the batch no matter how
+ * small the matrices are, and a group is one contiguous block for the cache:
+ * @code{.cpp}
+ * MatrixBatch<float> a(10000, 4, 4), b(10000, 4, 4), c;
+ * a(i, r, col) = 1.0f;                 // element (r, col) of matrix i
+ * MatrixBatch<float>::multiply(a, b, c);   // 10000 products of 4x4 matrices
+ * @endcode
+ * Element (r, c) of matrix i is data()[((i / LANES) * R * C + r * C + c) * LANES + i % LANES].
+ * The groups are split over the thread pool.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+#include "matrix_alloc.h"
+#include "matrix_expr.h"
+#include "matrix_parallel.h"
+#include "matrix_profile.h"
+#include "matrix_simd.h"
+#include "matrix_view.h"
+
+namespace matrix_detail {
+
+    /*!
+     * @brief Products of one group of W matrices, R x K times K x C, stored
+     *        as in MatrixBatch: element (r, c) of lane w at (r * C + c) * W + w.
+     *
+     * Two columns at a time in 2 * W accumulators, which stay in registers.
+     * Every element is summed in the order k = 0, 1, 2, ...
+     */
+    template <class T, std::size_t W>
+    void batchMultiplyGroup(std::size_t R, std::size_t K, std::size_t C, const T* a, const T* b, T* c) {
+        for (std::size_t r = 0; r < R; r++) {
+            const T* x = a + r * K * W;
+            std::size_t j = 0;
+            for (; j + 2 <= C; j += 2) {
+                T acc0[W], acc1[W];
+                for (std::size_t w = 0; w < W; w++)
+                    acc0[w] = acc1[w] = T(0);
+                for (std::size_t k = 0; k < K; k++) {
+                    const T* xk = x + k * W;
+                    const T* y = b + (k * C + j) * W;
+                    MATRIX_IVDEP
+                    for (std::size_t w = 0; w < W; w++) {
+                        acc0[w] += xk[w] * y[w];
+                        acc1[w] += xk[w] * y[W + w];
+                    }
+                }
+                T* o = c + (r * C + j) * W;
+                for (std::size_t w = 0; w < W; w++) {
+                    o[w] = acc0[w];
+                    o[W + w] = acc1[w];
+                }
+            }
+            if (j < C) {
+                T acc[W];
+                for (std::size_t w = 0; w < W; w++)
+                    acc[w] = T(0);
+                for (std::size_t k = 0; k < K; k++) {
+                    const T* xk = x + k * W;
+                    const T* y = b + (k * C + j) * W;
+                    MATRIX_IVDEP
+                    for (std::size_t w = 0; w < W; w++)
+                        acc[w] += xk[w] * y[w];
+                }
+                T* o = c + (r * C + j) * W;
+                for (std::size_t w = 0; w < W; w++)
+                    o[w] = acc[w];
+            }
+        }
+    }
+
+} // namespace matrix_detail
+
+/*!
+ * @class MatrixBatch
+ * @brief N matrices of the same size in one interleaved buffer, see matrix_batch.h
+ *
+ * Operations are on all matrices of a batch at once; batches in one
+ * operation must have the same count. The count is rounded up to whole
+ * groups of LANES matrices, the matrices of the last group that aren't part
+ * of the batch stay 0.
+ */
+template <class T, class Alloc = AlignedAllocator<T> >
+class MatrixBatch {
+private:
+    typedef std::allocator_traits<Alloc> AllocTraits;
+
+    T* m;                       // the elements, group by group
+    std::size_t n;              // number of matrices
+    std::size_t ng;             // number of groups of LANES matrices
+    std::size_t max_row, max_col;
+    Alloc alloc;
+
+public:
+    typedef T value_type;
+
+    // matrices per group: the elements of 64 bytes
+    static constexpr std::size_t LANES = 64 / sizeof(T) > 0 ? 64 / sizeof(T) : 1;
+
+    // ----------------------------------------------------------------------
+    // constructors / destructors
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief Constructs an empty batch
+     */
+    MatrixBatch() : m(NULL), n(0), ng(0), max_row(0), max_col(0) {}
+
+    /*!
+     * @brief A batch of 'count' matrices of rows x columns
+     * @param[in] init MatrixInit::Zero (all elements 0) or MatrixInit::Uninitialized
+     */
+    MatrixBatch(std::size_t count, std::size_t rows, std::size_t columns, MatrixInit init = MatrixInit::Zero)
+        : m(NULL), n(0), ng(0), max_row(0), max_col(0) {
+        resize(count, rows, columns);
+        if (init == MatrixInit::Zero)
+            zero();
+    }
+
+    MatrixBatch(const MatrixBatch& other) : m(NULL), n(0), ng(0), max_row(0), max_col(0), alloc(other.alloc) {
+        matrix_detail::OpScope scope(MatrixOp::Copy, 0, other.elements() * sizeof(T));
+        resize(other.n, other.max_row, other.max_col);
+        if (elements() > 0)
+            std::memcpy(m, other.m, elements() * sizeof(T));
+    }
+
+    MatrixBatch(MatrixBatch&& other) noexcept
+        : m(other.m), n(other.n), ng(other.ng), max_row(other.max_row), max_col(other.max_col),
+          alloc(std::move(other.alloc)) {
+        other.m = NULL;
+        other.n = other.ng = other.max_row = other.max_col = 0;
+    }
+
+    ~MatrixBatch() {
+        release();
+    }
+
+    MatrixBatch& operator= (const MatrixBatch& other) {
+        if (&other == this)
+            return *this;
+        matrix_detail::OpScope scope(MatrixOp::Copy, 0, other.elements() * sizeof(T));
+        resize(other.n, other.max_row, other.max_col);
+        if (elements() > 0)
+            std::memcpy(m, other.m, elements() * sizeof(T));
+        return *this;
+    }
+
+    MatrixBatch& operator= (MatrixBatch&& other) noexcept {
+        if (&other == this)
+            return *this;
+        release();
+        alloc = std::move(other.alloc);
+        m = other.m;
+        n = other.n;
+        ng = other.ng;
+        max_row = other.max_row;
+        max_col = other.max_col;
+        other.m = NULL;
+        other.n = other.ng = other.max_row = other.max_col = 0;
+        return *this;
+    }
+
+    // ----------------------------------------------------------------------
+    // setters & getters
+    // ----------------------------------------------------------------------
+
+    std::size_t count() const { return n; }
+    std::size_t rows() const { return max_row; }
+    std::size_t cols() const { return max_col; }
+
+    /*!
+     * @brief Number of groups of LANES matrices, count() rounded up
+     */
+    std::size_t groups() const { return ng; }
+
+    /*!
+     * @brief The rows() x cols() x LANES elements of group g, see matrix_batch.h
+     */
+    T* group(std::size_t g) { return m + g * max_row * max_col * LANES; }
+    const T* group(std::size_t g) const { return m + g * max_row * max_col * LANES; }
+
+    T* data() { return m; }
+    const T* data() const { return m; }
+
+    /*!
+     * @brief Element (row, col) of matrix i, unchecked
+     */
+    T& operator() (std::size_t i, std::size_t row, std::size_t col) { return m[index(i, row, col)]; }
+    const T& operator() (std::size_t i, std::size_t row, std::size_t col) const { return m[index(i, row, col)]; }
+
+    /*!
+     * @brief Set element (row, col) of matrix i
+     * @exception invalid_argument thrown when i, row or col is out of bounds.
+     */
+    void set(std::size_t i, std::size_t row, std::size_t col, T val) {
+        if (i < n && row < max_row && col < max_col)
+            (*this)(i, row, col) = val;
+        else
+            throw std::invalid_argument("Set: out of bounds");
+    }
+
+    /*!
+     * @brief Get element (row, col) of matrix i
+     * @exception invalid_argument thrown when i, row or col is out of bounds.
+     */
+    T get(std::size_t i, std::size_t row, std::size_t col) const {
+        if (i < n && row < max_row && col < max_col)
+            return (*this)(i, row, col);
+        throw std::invalid_argument("Get: out of bounds");
+    }
+
+    /*!
+     * @brief A copy of matrix i
+     * @exception invalid_argument thrown when i is out of bounds.
+     */
+    Matrix<T> matrix(std::size_t i) const {
+        if (i >= n)
+            throw std::invalid_argument("matrix: out of bounds");
+        Matrix<T> ret(max_row, max_col, MatrixInit::Uninitialized);
+        const T* src = m + index(i, 0, 0);
+        for (std::size_t e = 0; e < max_row * max_col; e++)
+            ret.data()[e] = src[e * LANES];
+        return ret;
+    }
+
+    /*!
+     * @brief Overwrite matrix i with a copy of 'mat'
+     * @exception invalid_argument thrown when i is out of bounds or mat has another size.
+     */
+    template <class MatAlloc>
+    void setMatrix(std::size_t i, const Matrix<T, MatAlloc>& mat) {
+        if (i >= n)
+            throw std::invalid_argument("setMatrix: out of bounds");
+        if (mat.rows() != max_row || mat.cols() != max_col)
+            throw std::invalid_argument("setMatrix: matrices must have the same size.");
+        T* dst = m + index(i, 0, 0);
+        Matrix<T, MatAlloc> copy;
+        const T* src = matrix_detail::rowMajor(mat, copy).data();
+        for (std::size_t e = 0; e < max_row * max_col; e++)
+            dst[e * LANES] = src[e];
+    }
+
+    // ----------------------------------------------------------------------
+    // operations
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief Inplace addition of every matrix of 'other' to the same matrix of this batch.
+     * @exception invalid_argument thrown when the batches differ in count or size.
+     */
+    void addInPlace(const MatrixBatch& other) {
+        add(*this, other, *this);
+    }
+
+    /*!
+     * @brief Inplace hadamard (element-wise) product, matrix by matrix.
+     * @exception invalid_argument thrown when the batches differ in count or size.
+     */
+    void hadamardInPlace(const MatrixBatch& other) {
+        hadamard(*this, other, *this);
+    }
+
+    /*!
+     * @brief Inplace multiplication of every matrix with a scalar
+     */
+    void multiplyInPlace(T scalar) {
+        matrix_detail::OpScope scope(MatrixOp::Scale, n * max_row * max_col);
+        T* dst = m;
+        matrix_detail::parallelElements(elements(), sizeof(T), [=](std::size_t b, std::size_t e) {
+            matrix_detail::scaleBy(dst + b, scalar, e - b);
+        });
+    }
+
+    /*!
+     * @brief out[i] = first[i] + second[i] for every matrix i
+     *
+     * 'out' is resized when needed and may be first or second.
+     * @exception invalid_argument thrown when the batches differ in count or size.
+     */
+    static void add(const MatrixBatch& first, const MatrixBatch& second, MatrixBatch& out) {
+        checkSameSize(first, second, "Addition: matrices must have the same size.");
+        matrix_detail::OpScope scope(MatrixOp::Add, first.n * first.max_row * first.max_col);
+        elementwise(first, second, out, false);
+    }
+
+    /*!
+     * @brief out[i] = hadamard(first[i], second[i]) for every matrix i
+     *
+     * 'out' is resized when needed and may be first or second.
+     * @exception invalid_argument thrown when the batches differ in count or size.
+     */
+    static void hadamard(const MatrixBatch& first, const MatrixBatch& second, MatrixBatch& out) {
+        checkSameSize(first, second, "hadamard: matrices must have the same size.");
+        matrix_detail::OpScope scope(MatrixOp::Hadamard, first.n * first.max_row * first.max_col);
+        elementwise(first, second, out, true);
+    }
+
+    /*!
+     * @brief out[i] = first[i] * second[i] for every matrix i
+     *
+     * Every element is summed in the order k = 0, 1, 2, ..., so each product
+     * is exactly that of Matrix::multiply(). 'out' is resized when needed,
+     * when it is first or second the products go through a temporary.
+     * @exception invalid_argument thrown when the counts differ or the sizes
+     *            don't allow multiplication.
+     */
+    static void multiply(const MatrixBatch& first, const MatrixBatch& second, MatrixBatch& out) {
+        if (first.n != second.n)
+            throw std::invalid_argument("Multiplication: batches must have the same count.");
+        if (first.max_col != second.max_row)
+            throw std::invalid_argument("Multiplication: matrices sizes don't alow multiplication.");
+        if (&out == &first || &out == &second) {
+            MatrixBatch tmp;
+            multiply(first, second, tmp);
+            out = std::move(tmp);
+            return;
+        }
+        const std::size_t R = first.max_row, K = first.max_col, C = second.max_col;
+        matrix_detail::OpScope scope(MatrixOp::Multiply, 2 * first.n * R * C * K);
+        out.resize(first.n, R, C);
+        if (K == 0) {
+            out.zero();
+            return;
+        }
+        const T* a = first.m;
+        const T* b = second.m;
+        T* c = out.m;
+        matrix_detail::parallelFor(0, out.ng, 1, first.n * R * C * K, [=](std::size_t g0, std::size_t g1) {
+            for (std::size_t g = g0; g < g1; g++)
+                matrix_detail::batchMultiplyGroup<T, LANES>(R, K, C, a + g * R * K * LANES,
+                                                           b + g * K * C * LANES, c + g * R * C * LANES);
+        });
+    }
+
+    /*!
+     * @brief Transpose every matrix into 'out', which is resized when needed.
+     *
+     * Only whole rows of LANES elements move, so this is a copy of the batch
+     * in another order.
+     */
+    void transpose(MatrixBatch& out) const {
+        if (&out == this) {
+            out.transposeInPlace();
+            return;
+        }
+        matrix_detail::OpScope scope(MatrixOp::Transpose, 0, n * max_row * max_col * sizeof(T));
+        out.resize(n, max_col, max_row);
+        const T* src = m;
+        T* dst = out.m;
+        const std::size_t R = max_row, C = max_col;
+        matrix_detail::parallelFor(0, ng, 1, elements(), [=](std::size_t g0, std::size_t g1) {
+            for (std::size_t g = g0; g < g1; g++) {
+                const T* x = src + g * R * C * LANES;
+                T* y = dst + g * R * C * LANES;
+                for (std::size_t r = 0; r < R; r++)
+                    for (std::size_t c = 0; c < C; c++)
+                        std::memcpy(y + (c * R + r) * LANES, x + (r * C + c) * LANES, LANES * sizeof(T));
+            }
+        });
+    }
+
+    MatrixBatch transpose() const {
+        MatrixBatch ret;
+        transpose(ret);
+        return ret;
+    }
+
+    /*!
+     * @brief Transpose every matrix in place
+     *
+     * Square matrices swap rows of LANES elements, other shapes go through a copy.
+     */
+    void transposeInPlace() {
+        if (max_row != max_col) {
+            MatrixBatch tmp;
+            transpose(tmp);
+            *this = std::move(tmp);
+            return;
+        }
+        matrix_detail::OpScope scope(MatrixOp::Transpose, 0, n * max_row * max_col * sizeof(T));
+        T* p = m;
+        const std::size_t N = max_row;
+        matrix_detail::parallelFor(0, ng, 1, elements(), [=](std::size_t g0, std::size_t g1) {
+            for (std::size_t g = g0; g < g1; g++) {
+                T* x = p + g * N * N * LANES;
+                for (std::size_t r = 0; r < N; r++)
+                    for (std::size_t c = r + 1; c < N; c++)
+                        std::swap_ranges(x + (r * N + c) * LANES, x + (r * N + c + 1) * LANES, x + (c * N + r) * LANES);
+            }
+        });
+    }
+
+    /*! @brief equality operator: same count, same size and all matrices equal
+     */
+    bool operator== (const MatrixBatch& other) const {
+        if (n != other.n || max_row != other.max_row || max_col != other.max_col)
+            return false;
+        matrix_detail::OpScope scope(MatrixOp::Compare, n * max_row * max_col);
+        // the matrices past count() are 0 in both
+        return matrix_detail::equalElements(m, other.m, elements());
+    }
+
+    bool operator!= (const MatrixBatch& other) const {
+        return !(*this == other);
+    }
+
+private:
+    std::size_t elements() const { return max_row * max_col * ng * LANES; }
+
+    std::size_t index(std::size_t i, std::size_t row, std::size_t col) const {
+        return ((i / LANES) * max_row * max_col + row * max_col + col) * LANES + i % LANES;
+    }
+
+    void zero() {
+        if (elements() > 0)
+            std::memset(m, 0, elements() * sizeof(T));
+    }
+
+    void release() {
+        if (m != NULL) {
+            AllocTraits::deallocate(alloc, m, elements());
+            matrix_detail::profileRelease(elements() * sizeof(T));
+        }
+        m = NULL;
+    }
+
+    // count matrices of rows x cols; contents undefined, except that the
+    // matrices past count in the last group are 0
+    void resize(std::size_t count, std::size_t rows, std::size_t cols) {
+        const std::size_t g = (count + LANES - 1) / LANES;
+        const std::size_t total = rows * cols * g * LANES;
+        if (total != elements() || m == NULL) {
+            release();
+            if (total > 0) {
+                m = AllocTraits::allocate(alloc, total);
+                if (m == NULL)
+                    throw std::bad_alloc();
+                matrix_detail::profileAllocate(total * sizeof(T));
+            }
+        }
+        if (count % LANES != 0) {
+            T* last = m + (g - 1) * rows * cols * LANES;
+            for (std::size_t e = 0; e < rows * cols; e++)
+                std::fill(last + e * LANES + count % LANES, last + (e + 1) * LANES, T(0));
+        }
+        n = count;
+        ng = g;
+        max_row = rows;
+        max_col = cols;
+    }
+
+    static void checkSameSize(const MatrixBatch& a, const MatrixBatch& b, const char* what) {
+        if (a.n != b.n)
+            throw std::invalid_argument("batches must have the same count.");
+        if (a.max_row != b.max_row || a.max_col != b.max_col)
+            throw std::invalid_argument(what);
+    }
+
+    // out = first + second, or first * second element-wise; the matrices
+    // past count() stay 0
+    static void elementwise(const MatrixBatch& first, const MatrixBatch& second, MatrixBatch& out, bool product) {
+        const MatrixBatch* x = &first;
+        const MatrixBatch* y = &second;
+        if (&out == y)      // both operations commute
+            std::swap(x, y);
+        if (&out != x)
+            out.resize(first.n, first.max_row, first.max_col);
+        const T* src = x->m;
+        const T* add = y->m;
+        T* dst = out.m;
+        const bool copy = &out != x;
+        matrix_detail::parallelElements(out.elements(), sizeof(T), [=](std::size_t b, std::size_t e) {
+            if (copy)
+                std::memcpy(dst + b, src + b, (e - b) * sizeof(T));
+            if (product)
+                matrix_detail::multiplyTo(dst + b, add + b, e - b);
+            else
+                matrix_detail::addTo(dst + b, add + b, e - b);
+        });
+    }
+};
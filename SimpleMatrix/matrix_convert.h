@@ -0,0 +1,162 @@
+/*!
+ * @file matrix_convert.h
+ * @author Tony Andrioli, The Hague University of Applied Sciences
+ * @date June 2022
+ *
+ * Element type conversion for Matrix::convertTo().
+ *
+ * A conversion is one pass from the source into the destination buffer,
+ * split over the thread pool for big matrices. The loops have no branches
+ * the compiler can't turn into selects, so they vectorize also with the
+ * rounding and saturating modes (rounding from AVX2 on, chosen at runtime):
+ * @code{.cpp}
+ * Matrix<float> f = ...;
+ * Matrix<std::int8_t> q;
+ * f.convertTo(q, ConvertMode::RoundSaturate);   // -1.5 -> -2, 300.0 -> 127
+ * @endcode
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+#include "matrix_expr.h"
+#include "matrix_simd.h"
+
+/*!
+ * @brief How Matrix::convertTo() converts an element
+ */
+enum class ConvertMode {
+    Cast,           //!< a plain cast, as static_cast does: floating point to integer truncates
+    Round,          //!< floating point to integer rounds to nearest, ties to even
+    Saturate,       //!< values outside the range of the target type become its smallest or largest value, NaN becomes 0
+    RoundSaturate   //!< Round, then Saturate: the conversion for quantizing
+};
+
+namespace matrix_detail {
+
+    // x rounded to the nearest integer, ties to even (in the default
+    // rounding mode); integers are rounded already
+    template <class F>
+    inline F roundNearest(F x, std::true_type) {
+        return std::nearbyint(x);
+    }
+
+    template <class F>
+    inline F roundNearest(F x, std::false_type) {
+        return x;
+    }
+
+    // the cases of saturateCast()
+    enum SaturateKind {
+        SATURATE_NONE,          // every value fits: integer to floating point, float to double
+        SATURATE_FLOAT,         // floating point to a narrower floating point type
+        SATURATE_FLOAT_INT,     // floating point to integer
+        SATURATE_INT            // integer to integer
+    };
+
+    template <class To, class From>
+    struct SaturateKindOf {
+        static constexpr SaturateKind value =
+            std::is_floating_point<To>::value ?
+                (std::is_floating_point<From>::value && std::numeric_limits<From>::max() > std::numeric_limits<To>::max() ?
+                     SATURATE_FLOAT : SATURATE_NONE) :
+                (std::is_floating_point<From>::value ? SATURATE_FLOAT_INT : SATURATE_INT);
+    };
+
+    template <class To, class From>
+    inline To saturateCast(From x, std::integral_constant<SaturateKind, SATURATE_NONE>) {
+        return (To) x;
+    }
+
+    template <class To, class From>
+    inline To saturateCast(From x, std::integral_constant<SaturateKind, SATURATE_FLOAT>) {
+        const From hi = (From) std::numeric_limits<To>::max();
+        return (To) (x > hi ? hi : (x < -hi ? -hi : x));
+    }
+
+    template <class To, class From>
+    inline To saturateCast(From x, std::integral_constant<SaturateKind, SATURATE_FLOAT_INT>) {
+        typedef std::numeric_limits<To> L;
+        // lo is -2^n (or 0) and hi 2^n or 2^n - 1 in From, both exact; x >= 2^n doesn't fit
+        const From lo = (From) L::min();
+        const From hi = (From) L::max();
+        const To r = x > lo && x < hi ? (To) x : To(0);
+        return x != x ? To(0) : (x <= lo ? L::min() : (x >= hi ? L::max() : r));
+    }
+
+    template <class To, class From>
+    inline To saturateCast(From x, std::integral_constant<SaturateKind, SATURATE_INT>) {
+        typedef std::numeric_limits<To> LT;
+        typedef std::numeric_limits<From> LF;
+        // the limits of To are only converted to From where they fit in it
+        const bool checkLow = LF::is_signed && (!LT::is_signed || LF::digits > LT::digits);
+        const bool checkHigh = LF::digits > LT::digits;
+        if (checkLow && x < (LT::is_signed ? (From) LT::min() : From(0)))
+            return LT::min();
+        if (checkHigh && x > (From) LT::max())
+            return LT::max();
+        return (To) x;
+    }
+
+    /*!
+     * @brief x converted to To, clamped to the range of To; NaN becomes 0
+     */
+    template <class To, class From>
+    inline To saturateCast(From x) {
+        return saturateCast<To>(x, std::integral_constant<SaturateKind, SaturateKindOf<To, From>::value>());
+    }
+
+    // the conversion loops, see convertElements()
+    template <class To, class From>
+    inline void convertLoop(const From* src, To* dst, std::size_t n, bool round, bool saturate) {
+        std::is_floating_point<From> isFloat;
+        if (round && saturate) {
+            MATRIX_IVDEP
+            for (std::size_t i = 0; i < n; i++)
+                dst[i] = saturateCast<To>(roundNearest(src[i], isFloat));
+        } else if (round) {
+            MATRIX_IVDEP
+            for (std::size_t i = 0; i < n; i++)
+                dst[i] = (To) roundNearest(src[i], isFloat);
+        } else if (saturate) {
+            MATRIX_IVDEP
+            for (std::size_t i = 0; i < n; i++)
+                dst[i] = saturateCast<To>(src[i]);
+        } else {
+            MATRIX_IVDEP
+            for (std::size_t i = 0; i < n; i++)
+                dst[i] = (To) src[i];
+        }
+    }
+
+#ifdef MATRIX_X86
+    // the same loops compiled for AVX2: SSE2 has no instruction to round
+    // to an integer value, so the rounding loops only vectorize here
+    template <class To, class From>
+    MATRIX_TARGET("avx2") void convertLoopAvx2(const From* src, To* dst, std::size_t n, bool round, bool saturate) {
+        convertLoop(src, dst, n, round, saturate);
+    }
+#endif
+
+    /*!
+     * @brief dst[i] = src[i] converted to To, for i in [0, n)
+     */
+    template <class To, class From>
+    void convertElements(const From* src, To* dst, std::size_t n, ConvertMode mode) {
+        const bool round = std::is_floating_point<From>::value && std::is_integral<To>::value &&
+                           (mode == ConvertMode::Round || mode == ConvertMode::RoundSaturate);
+        const bool saturate = mode == ConvertMode::Saturate || mode == ConvertMode::RoundSaturate;
+    #ifdef MATRIX_X86
+        if (round && simdLevel() >= SIMD_AVX2) {
+            convertLoopAvx2(src, dst, n, round, saturate);
+            return;
+        }
+    #endif
+        convertLoop(src, dst, n, round, saturate);
+    }
+
+} // namespace matrix_detail
@@ -0,0 +1,434 @@
+/*!
+ * @file matrix_expr.h
+ * @author Tony Andrioli, The Hague University of Applied Sciences
+ * @date June 2022
+ *
+ * Expression templates for the element-wise operations of Matrix.
+ *
+ * A + B, A * scalar and A.hadamard(B) don't compute anything, they return a
+ * small node that remembers its operands. Only when a node is assigned to a
+ * Matrix the whole tree is evaluated, element by element in one loop, so
+ * @code{.cpp}
+ * D = A + B + C * 2;
+ * @endcode
+ * reads A, B and C once, writes D once and allocates no temporaries.
+ *
+ * map() and zip() turn any function of one, two or three elements into a
+ * node, so a whole per-element pipeline is one pass as well:
+ * @code{.cpp}
+ * Y = (W + B).map([](float x) { return x > 0 ? x : 0.0f; });   // relu(W + B)
+ * Y = zip(X, Lo, Hi, [](float x, float lo, float hi) { return x < lo ? lo : hi < x ? hi : x; });
+ * X.apply([](float x) { return std::exp(x); });                 // in place
+ * @endcode
+ * The function is inlined into the evaluation loop, which the compiler
+ * vectorizes when it can (no calls to non-inline functions, no branches it
+ * can't turn into selects). Large matrices are evaluated in parallel, so the
+ * function is called from several threads at once and in no particular
+ * order: it should only depend on its arguments.
+ *
+ * Operands may have different layouts (see Matrix::layout()). When they all
+ * have the layout of the result, or are vectors, it is the flat loop over
+ * the elements above; otherwise the result is written a tile at a time,
+ * so the operands of the other layout are still read from cache.
+ *
+ * Nodes keep pointers to the matrices they were built from, so don't store
+ * an expression in a variable (auto e = A + B) when an operand is a
+ * temporary, assign it to a Matrix instead.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "matrix_alloc.h"
+#include "matrix_profile.h"
+
+// Tells the compiler the evaluation loop has no loop-carried dependencies,
+// element i of the result only reads element i of the operands.
+#if defined(__clang__)
+#define MATRIX_IVDEP _Pragma("clang loop vectorize(assume_safety)")
+#elif defined(__GNUC__)
+#define MATRIX_IVDEP _Pragma("GCC ivdep")
+#elif defined(_MSC_VER)
+#define MATRIX_IVDEP __pragma(loop(ivdep))
+#else
+#define MATRIX_IVDEP
+#endif
+
+namespace matrix_detail {
+    template <class F, class E> class MapExpr;
+}
+
+/*!
+ * @class MatrixExpr
+ * @brief Base of all expression nodes (CRTP).
+ *
+ * A node E has a value_type, rows(), cols(), coeff(r, c), the element
+ * (r, c) of the result, and coeff(i), the i-th element in memory when all
+ * matrices in it have one layout. layout() is the layout of the first
+ * matrix, uniform(l) whether they all have layout l (or are vectors, which
+ * are stored the same in both).
+ */
+template <class E>
+class MatrixExpr {
+public:
+    const E& self() const { return static_cast<const E&>(*this); }
+    std::size_t rows() const { return self().rows(); }
+    std::size_t cols() const { return self().cols(); }
+
+    /*!
+     * @brief f applied to every element of this expression, see matrix_expr.h
+     */
+    template <class F>
+    matrix_detail::MapExpr<F, E> map(F f) const { return matrix_detail::MapExpr<F, E>(self(), f); }
+};
+
+namespace matrix_detail {
+
+    /*!
+     * @brief Leaf node, refers to the data of a Matrix.
+     */
+    template <class T>
+    class MatrixLeaf : public MatrixExpr<MatrixLeaf<T> > {
+    public:
+        typedef T value_type;
+        template <class Alloc>
+        explicit MatrixLeaf(const Matrix<T, Alloc>& mat)
+            : p(mat.data()), r(mat.rows()), c(mat.cols()), lay(mat.layout()),
+              rs(mat.layout() == MatrixLayout::RowMajor ? mat.cols() : 1),
+              cs(mat.layout() == MatrixLayout::RowMajor ? 1 : mat.rows()) {}
+        std::size_t rows() const { return r; }
+        std::size_t cols() const { return c; }
+        MatrixLayout layout() const { return lay; }
+        bool uniform(MatrixLayout l) const { return lay == l || r == 1 || c == 1; }
+        T coeff(std::size_t i) const { return p[i]; }
+        T coeff(std::size_t row, std::size_t col) const { return p[row * rs + col * cs]; }
+    private:
+        const T* p;
+        std::size_t r, c;
+        MatrixLayout lay;
+        std::size_t rs, cs;
+    };
+
+    /*!
+     * @brief How an operand is stored inside a node: nodes by value, matrices as a leaf.
+     */
+    template <class E>
+    struct ExprOperand {
+        typedef E type;
+        static const E& wrap(const E& e) { return e; }
+    };
+
+    template <class T, class Alloc>
+    struct ExprOperand<Matrix<T, Alloc> > {
+        typedef MatrixLeaf<T> type;
+        static MatrixLeaf<T> wrap(const Matrix<T, Alloc>& m) { return MatrixLeaf<T>(m); }
+    };
+
+    template <class A, class B>
+    void checkSameSize(const A& a, const B& b, const char* msg) {
+        if (a.rows() != b.rows() || a.cols() != b.cols())
+            throw std::invalid_argument(msg);
+    }
+
+    /*!
+     * @brief l + r
+     */
+    template <class L, class R>
+    class SumExpr : public MatrixExpr<SumExpr<L, R> > {
+    public:
+        typedef typename L::value_type value_type;
+        SumExpr(const L& left, const R& right) : l(left), r(right) {
+            checkSameSize(l, r, "Addition: matrices must have the same size.");
+        }
+        std::size_t rows() const { return l.rows(); }
+        std::size_t cols() const { return l.cols(); }
+        MatrixLayout layout() const { return l.layout(); }
+        bool uniform(MatrixLayout lay) const { return l.uniform(lay) && r.uniform(lay); }
+        value_type coeff(std::size_t i) const { return l.coeff(i) + r.coeff(i); }
+        value_type coeff(std::size_t row, std::size_t col) const { return l.coeff(row, col) + r.coeff(row, col); }
+    private:
+        L l;
+        R r;
+    };
+
+    /*!
+     * @brief l * r element-wise (hadamard product)
+     */
+    template <class L, class R>
+    class HadamardExpr : public MatrixExpr<HadamardExpr<L, R> > {
+    public:
+        typedef typename L::value_type value_type;
+        HadamardExpr(const L& left, const R& right) : l(left), r(right) {
+            checkSameSize(l, r, "hadamard: matrices must have the same size.");
+        }
+        std::size_t rows() const { return l.rows(); }
+        std::size_t cols() const { return l.cols(); }
+        MatrixLayout layout() const { return l.layout(); }
+        bool uniform(MatrixLayout lay) const { return l.uniform(lay) && r.uniform(lay); }
+        value_type coeff(std::size_t i) const { return l.coeff(i) * r.coeff(i); }
+        value_type coeff(std::size_t row, std::size_t col) const { return l.coeff(row, col) * r.coeff(row, col); }
+    private:
+        L l;
+        R r;
+    };
+
+    /*!
+     * @brief e * scalar
+     */
+    template <class E>
+    class ScaleExpr : public MatrixExpr<ScaleExpr<E> > {
+    public:
+        typedef typename E::value_type value_type;
+        ScaleExpr(const E& expr, value_type scalar) : e(expr), s(scalar) {}
+        std::size_t rows() const { return e.rows(); }
+        std::size_t cols() const { return e.cols(); }
+        MatrixLayout layout() const { return e.layout(); }
+        bool uniform(MatrixLayout l) const { return e.uniform(l); }
+        value_type coeff(std::size_t i) const { return e.coeff(i) * s; }
+        value_type coeff(std::size_t row, std::size_t col) const { return e.coeff(row, col) * s; }
+    private:
+        E e;
+        value_type s;
+    };
+
+    /*!
+     * @brief f(e) element-wise
+     */
+    template <class F, class E>
+    class MapExpr : public MatrixExpr<MapExpr<F, E> > {
+    public:
+        typedef typename std::decay<decltype(std::declval<const F&>()(
+            std::declval<typename E::value_type>()))>::type value_type;
+        MapExpr(const E& expr, const F& fn) : e(expr), f(fn) {}
+        std::size_t rows() const { return e.rows(); }
+        std::size_t cols() const { return e.cols(); }
+        MatrixLayout layout() const { return e.layout(); }
+        bool uniform(MatrixLayout l) const { return e.uniform(l); }
+        value_type coeff(std::size_t i) const { return f(e.coeff(i)); }
+        value_type coeff(std::size_t row, std::size_t col) const { return f(e.coeff(row, col)); }
+    private:
+        E e;
+        F f;
+    };
+
+    /*!
+     * @brief f(a, b) element-wise
+     */
+    template <class F, class A, class B>
+    class ZipExpr : public MatrixExpr<ZipExpr<F, A, B> > {
+    public:
+        typedef typename std::decay<decltype(std::declval<const F&>()(
+            std::declval<typename A::value_type>(), std::declval<typename B::value_type>()))>::type value_type;
+        ZipExpr(const A& first, const B& second, const F& fn) : a(first), b(second), f(fn) {
+            checkSameSize(a, b, "zip: matrices must have the same size.");
+        }
+        std::size_t rows() const { return a.rows(); }
+        std::size_t cols() const { return a.cols(); }
+        MatrixLayout layout() const { return a.layout(); }
+        bool uniform(MatrixLayout l) const { return a.uniform(l) && b.uniform(l); }
+        value_type coeff(std::size_t i) const { return f(a.coeff(i), b.coeff(i)); }
+        value_type coeff(std::size_t row, std::size_t col) const { return f(a.coeff(row, col), b.coeff(row, col)); }
+    private:
+        A a;
+        B b;
+        F f;
+    };
+
+    /*!
+     * @brief f(a, b, c) element-wise
+     */
+    template <class F, class A, class B, class C>
+    class Zip3Expr : public MatrixExpr<Zip3Expr<F, A, B, C> > {
+    public:
+        typedef typename std::decay<decltype(std::declval<const F&>()(
+            std::declval<typename A::value_type>(), std::declval<typename B::value_type>(),
+            std::declval<typename C::value_type>()))>::type value_type;
+        Zip3Expr(const A& first, const B& second, const C& third, const F& fn) : a(first), b(second), c(third), f(fn) {
+            checkSameSize(a, b, "zip: matrices must have the same size.");
+            checkSameSize(a, c, "zip: matrices must have the same size.");
+        }
+        std::size_t rows() const { return a.rows(); }
+        std::size_t cols() const { return a.cols(); }
+        MatrixLayout layout() const { return a.layout(); }
+        bool uniform(MatrixLayout l) const { return a.uniform(l) && b.uniform(l) && c.uniform(l); }
+        value_type coeff(std::size_t i) const { return f(a.coeff(i), b.coeff(i), c.coeff(i)); }
+        value_type coeff(std::size_t row, std::size_t col) const {
+            return f(a.coeff(row, col), b.coeff(row, col), c.coeff(row, col));
+        }
+    private:
+        A a;
+        B b;
+        C c;
+        F f;
+    };
+
+    // operations per element of an expression, and what it is counted as (see matrix_profile.h)
+    template <class E>
+    struct ExprProfile {
+        static constexpr std::size_t flops = 0;
+        static constexpr MatrixOp op = MatrixOp::Expression;
+    };
+
+    template <class L, class R>
+    struct ExprProfile<SumExpr<L, R> > {
+        static constexpr std::size_t flops = ExprProfile<L>::flops + ExprProfile<R>::flops + 1;
+        static constexpr MatrixOp op = MatrixOp::Add;
+    };
+
+    template <class L, class R>
+    struct ExprProfile<HadamardExpr<L, R> > {
+        static constexpr std::size_t flops = ExprProfile<L>::flops + ExprProfile<R>::flops + 1;
+        static constexpr MatrixOp op = MatrixOp::Hadamard;
+    };
+
+    template <class E>
+    struct ExprProfile<ScaleExpr<E> > {
+        static constexpr std::size_t flops = ExprProfile<E>::flops + 1;
+        static constexpr MatrixOp op = MatrixOp::Scale;
+    };
+
+    // a call of the function of a map or zip counts as one operation
+    template <class F, class E>
+    struct ExprProfile<MapExpr<F, E> > {
+        static constexpr std::size_t flops = ExprProfile<E>::flops + 1;
+        static constexpr MatrixOp op = MatrixOp::Expression;
+    };
+
+    template <class F, class A, class B>
+    struct ExprProfile<ZipExpr<F, A, B> > {
+        static constexpr std::size_t flops = ExprProfile<A>::flops + ExprProfile<B>::flops + 1;
+        static constexpr MatrixOp op = MatrixOp::Expression;
+    };
+
+    template <class F, class A, class B, class C>
+    struct ExprProfile<Zip3Expr<F, A, B, C> > {
+        static constexpr std::size_t flops = ExprProfile<A>::flops + ExprProfile<B>::flops + ExprProfile<C>::flops + 1;
+        static constexpr MatrixOp op = MatrixOp::Expression;
+    };
+
+    template <class X>
+    struct IsExprOperand : std::is_base_of<MatrixExpr<X>, X> {};
+
+    template <class T, class Alloc>
+    struct IsExprOperand<Matrix<T, Alloc> > : std::true_type {};
+
+    /*!
+     * @brief Whether A and B are both operands with the same element type;
+     *        + and hadamard don't mix types (zip and map do).
+     */
+    template <class A, class B, bool = IsExprOperand<A>::value && IsExprOperand<B>::value>
+    struct IsSameTypeOperands : std::false_type {};
+
+    template <class A, class B>
+    struct IsSameTypeOperands<A, B, true>
+        : std::is_same<typename ExprOperand<A>::type::value_type, typename ExprOperand<B>::type::value_type> {};
+
+    /*!
+     * @brief dst[i] = e.coeff(i) for i in [b, end)
+     */
+    template <class T, class E>
+    void evaluate(T* dst, const E& e, std::size_t b, std::size_t end) {
+        MATRIX_IVDEP
+        for (std::size_t i = b; i < end; i++)
+            dst[i] = e.coeff(i);
+    }
+
+    // lines (rows, or columns when layout is column-major) per tile of evaluateTiled()
+    const std::size_t EXPR_TILE = 32;
+
+    /*!
+     * @brief The lines [b, end) of the rows x cols result of e, stored in
+     *        dst with the given layout, EXPR_TILE x EXPR_TILE elements at a
+     *        time so operands of either layout are read from cache
+     */
+    template <class T, class E>
+    void evaluateTiled(T* dst, const E& e, std::size_t rows, std::size_t cols, MatrixLayout layout,
+                       std::size_t b, std::size_t end) {
+        const bool rm = layout == MatrixLayout::RowMajor;
+        const std::size_t len = rm ? cols : rows;
+        for (std::size_t i0 = b; i0 < end; i0 += EXPR_TILE) {
+            const std::size_t i1 = i0 + EXPR_TILE < end ? i0 + EXPR_TILE : end;
+            for (std::size_t j0 = 0; j0 < len; j0 += EXPR_TILE) {
+                const std::size_t j1 = j0 + EXPR_TILE < len ? j0 + EXPR_TILE : len;
+                for (std::size_t i = i0; i < i1; i++) {
+                    T* d = dst + i * len;
+                    if (rm)
+                        for (std::size_t j = j0; j < j1; j++)
+                            d[j] = e.coeff(i, j);
+                    else
+                        for (std::size_t j = j0; j < j1; j++)
+                            d[j] = e.coeff(j, i);
+                }
+            }
+        }
+    }
+
+} // namespace matrix_detail
+
+/*!
+ * @brief Addition of two matrices or expressions, see matrix_expr.h
+ */
+template <class A, class B,
+          class = typename std::enable_if<matrix_detail::IsSameTypeOperands<A, B>::value>::type>
+matrix_detail::SumExpr<typename matrix_detail::ExprOperand<A>::type, typename matrix_detail::ExprOperand<B>::type>
+operator+ (const A& a, const B& b) {
+    return matrix_detail::SumExpr<typename matrix_detail::ExprOperand<A>::type,
+                                  typename matrix_detail::ExprOperand<B>::type>(
+        matrix_detail::ExprOperand<A>::wrap(a), matrix_detail::ExprOperand<B>::wrap(b));
+}
+
+/*!
+ * @brief Multiplication of an expression with a scalar
+ */
+template <class E>
+matrix_detail::ScaleExpr<E> operator* (const MatrixExpr<E>& e, typename E::value_type scalar) {
+    return matrix_detail::ScaleExpr<E>(e.self(), scalar);
+}
+
+/*!
+ * @brief Hadamard (element-wise) product of two matrices or expressions
+ */
+template <class A, class B,
+          class = typename std::enable_if<matrix_detail::IsSameTypeOperands<A, B>::value>::type>
+matrix_detail::HadamardExpr<typename matrix_detail::ExprOperand<A>::type, typename matrix_detail::ExprOperand<B>::type>
+hadamard(const A& a, const B& b) {
+    return matrix_detail::HadamardExpr<typename matrix_detail::ExprOperand<A>::type,
+                                       typename matrix_detail::ExprOperand<B>::type>(
+        matrix_detail::ExprOperand<A>::wrap(a), matrix_detail::ExprOperand<B>::wrap(b));
+}
+
+/*!
+ * @brief f(a[i], b[i]) for every element of two matrices or expressions of
+ *        the same size, see matrix_expr.h
+ */
+template <class A, class B, class F,
+          class = typename std::enable_if<matrix_detail::IsExprOperand<A>::value &&
+                                          matrix_detail::IsExprOperand<B>::value>::type>
+matrix_detail::ZipExpr<F, typename matrix_detail::ExprOperand<A>::type, typename matrix_detail::ExprOperand<B>::type>
+zip(const A& a, const B& b, F f) {
+    return matrix_detail::ZipExpr<F, typename matrix_detail::ExprOperand<A>::type,
+                                  typename matrix_detail::ExprOperand<B>::type>(
+        matrix_detail::ExprOperand<A>::wrap(a), matrix_detail::ExprOperand<B>::wrap(b), f);
+}
+
+/*!
+ * @brief f(a[i], b[i], c[i]) for every element of three matrices or
+ *        expressions of the same size, see matrix_expr.h
+ */
+template <class A, class B, class C, class F,
+          class = typename std::enable_if<matrix_detail::IsExprOperand<A>::value &&
+                                          matrix_detail::IsExprOperand<B>::value &&
+                                          matrix_detail::IsExprOperand<C>::value>::type>
+matrix_detail::Zip3Expr<F, typename matrix_detail::ExprOperand<A>::type, typename matrix_detail::ExprOperand<B>::type,
+                        typename matrix_detail::ExprOperand<C>::type>
+zip(const A& a, const B& b, const C& c, F f) {
+    return matrix_detail::Zip3Expr<F, typename matrix_detail::ExprOperand<A>::type,
+                                   typename matrix_detail::ExprOperand<B>::type,
+                                   typename matrix_detail::ExprOperand<C>::type>(
+        matrix_detail::ExprOperand<A>::wrap(a), matrix_detail::ExprOperand<B>::wrap(b),
+        matrix_detail::ExprOperand<C>::wrap(c), f);
+}
@@ -0,0 +1,300 @@
+/*!
+ * @file matrix_fixed.h
+ * @author Tony Andrioli, The Hague University of Applied Sciences
+ * @date June 2022
+ *
+ * Matrices with their dimensions fixed at compile time.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <array>
+#include <initializer_list>
+#include <iostream>
+#include <stdexcept>
+
+#include "matrix_alloc.h"
+#include "matrix_convert.h"
+#include "matrix_expr.h"
+#include "matrix_gemm.h"
+
+/*!
+ * @class FixedMatrix
+ * @brief Matrix of R rows and C columns, both known at compile time.
+ *
+ * Meant for the many small matrices (3x3 and 4x4 transforms and such):
+ * the elements are stored inside the object, so a FixedMatrix on the stack
+ * never allocates, and every loop has a constant trip count and is unrolled.
+ * @code{.cpp}
+ * FixedMatrix<float, 3, 3> rot = { 0, -1, 0,
+ *                                  1,  0, 0,
+ *                                  0,  0, 1 };
+ * FixedMatrix<float, 3, 1> p = { 1, 2, 3 };
+ * FixedMatrix<float, 3, 1> q = rot * p;
+ * @endcode
+ * Multiplying or adding matrices of the wrong dimensions doesn't compile,
+ * there is nothing to throw std::invalid_argument for.
+ *
+ * A FixedMatrix is also an expression (see matrix_expr.h), so it can be
+ * assigned to a Matrix and mixed with matrices in +, * and hadamard; those
+ * dimensions are checked at run time, like any other Matrix operation.
+ */
+template <class T, unsigned int R, unsigned int C>
+class FixedMatrix : public MatrixExpr<FixedMatrix<T, R, C> > {
+    static_assert(R > 0 && C > 0, "FixedMatrix: dimensions must be at least 1");
+
+private:
+    std::array<T, R * C> m;     // The data of the matrix, row by row
+
+public:
+    typedef T value_type;
+
+    // ----------------------------------------------------------------------
+    // constructors
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief Constructs a matrix with all elements 0
+     */
+    FixedMatrix() : m() {}
+
+    /*!
+     * @brief Construct from R*C values, stored from left to right and top to bottom.
+     */
+    explicit FixedMatrix(const T* values) {
+        memcpy(m.data(), values, sizeof(T) * R * C);
+    }
+
+    /*!
+     * @brief Construct from a list of R*C values, stored from left to right and top to bottom.
+     * @exception invalid_argument thrown when the list doesn't have R*C values.
+     */
+    FixedMatrix(std::initializer_list<T> values) {
+        if (values.size() != (std::size_t)R * C)
+            throw std::invalid_argument("FixedMatrix: wrong number of values.");
+        std::size_t i = 0;
+        for (typename std::initializer_list<T>::const_iterator it = values.begin(); it != values.end(); ++it)
+            m[i++] = *it;
+    }
+
+    /*!
+     * @brief Copy a dynamic matrix of the same dimensions
+     * @exception invalid_argument thrown when other isn't R x C.
+     */
+    template <class Alloc>
+    explicit FixedMatrix(const Matrix<T, Alloc>& other) {
+        if (other.rows() != R || other.cols() != C)
+            throw std::invalid_argument("FixedMatrix: matrices must have the same size.");
+        if (other.layout() == MatrixLayout::RowMajor)
+            memcpy(m.data(), other.data(), sizeof(T) * R * C);
+        else
+            for (unsigned int r = 0; r < R; r++)
+                for (unsigned int c = 0; c < C; c++)
+                    m[r * C + c] = other.get(r, c);
+    }
+
+    // ----------------------------------------------------------------------
+    // setters & getters
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief Set one matrix element
+     * @exception invalid_argument thrown when row or col is out of bounds.
+     */
+    void set(unsigned int row, unsigned int col, T val) {
+        if (row < R && col < C)
+            m[row * C + col] = val;
+        else
+            throw std::invalid_argument("Set: out of bounds");
+    }
+
+    /*!
+     * @brief Get one matrix element
+     * @exception invalid_argument thrown when row or col is out of bounds.
+     */
+    T get(unsigned int row, unsigned int col) const {
+        if (row < R && col < C)
+            return m[row * C + col];
+        throw std::invalid_argument("Get: out of bounds");
+    }
+
+    /*!
+     * @brief Index operator, returns the row, unchecked. A[1][2] equals A.get(1,2)
+     */
+    T* operator[] (unsigned int i) { return &m[i * C]; }
+    const T* operator[] (unsigned int i) const { return &m[i * C]; }
+
+    /*!
+     * @brief Return the size of the matrix as { rows, cols }
+     */
+    static std::array<std::size_t, 2> size() {
+        std::array<std::size_t, 2> s = { { R, C } };
+        return s;
+    }
+
+    static constexpr std::size_t rows() { return R; }
+    static constexpr std::size_t cols() { return C; }
+
+    T* data() { return m.data(); }
+    const T* data() const { return m.data(); }
+
+    // element i in row-major order, makes this an expression
+    T coeff(std::size_t i) const { return m[i]; }
+    T coeff(std::size_t row, std::size_t col) const { return m[row * C + col]; }
+    static constexpr MatrixLayout layout() { return MatrixLayout::RowMajor; }
+    static constexpr bool uniform(MatrixLayout l) { return l == MatrixLayout::RowMajor || R == 1 || C == 1; }
+
+    /*!
+     * @brief A dynamic copy of this matrix
+     */
+    Matrix<T> toMatrix() const {
+        return Matrix<T>(R, C, m.data());
+    }
+
+    // ----------------------------------------------------------------------
+    // operations
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief Inplace addition, add 'other' to current matrix.
+     */
+    void addInPlace(const FixedMatrix& other) {
+        MATRIX_UNROLL
+        for (std::size_t i = 0; i < R * C; i++)
+            m[i] += other.m[i];
+    }
+
+    /*!
+     * @brief Inplace multiplication with a scalar
+     */
+    void multiplyInPlace(T scalar) {
+        MATRIX_UNROLL
+        for (std::size_t i = 0; i < R * C; i++)
+            m[i] *= scalar;
+    }
+
+    /*!
+     * @brief Inplace hadamard (element-wise) product
+     */
+    void hadamardInPlace(const FixedMatrix& other) {
+        MATRIX_UNROLL
+        for (std::size_t i = 0; i < R * C; i++)
+            m[i] *= other.m[i];
+    }
+
+    /*!
+     * @brief Hadamard (element-wise) product
+     */
+    FixedMatrix hadamard(const FixedMatrix& other) const {
+        FixedMatrix ret(*this);
+        ret.hadamardInPlace(other);
+        return ret;
+    }
+
+    /*!
+     * @brief multiplication with a scalar
+     */
+    FixedMatrix operator* (const T scalar) const {
+        FixedMatrix ret(*this);
+        ret.multiplyInPlace(scalar);
+        return ret;
+    }
+
+    /*!
+     * @brief Transpose the current matrix
+     */
+    FixedMatrix<T, C, R> transpose() const {
+        FixedMatrix<T, C, R> ret;
+        T* dst = ret.data();
+        MATRIX_UNROLL
+        for (std::size_t r = 0; r < R; r++) {
+            MATRIX_UNROLL
+            for (std::size_t c = 0; c < C; c++)
+                dst[c * R + r] = m[r * C + c];
+        }
+        return ret;
+    }
+
+    /*!
+     * @brief Inplace transpose, only for square matrices
+     */
+    void transposeInPlace() {
+        static_assert(R == C, "transposeInPlace: only a square FixedMatrix keeps its type, use transpose()");
+        for (std::size_t r = 0; r < R; r++)
+            for (std::size_t c = r + 1; c < C; c++) {
+                T tmp = m[r * C + c];
+                m[r * C + c] = m[c * C + r];
+                m[c * C + r] = tmp;
+            }
+    }
+
+    /*! @brief equality operator
+     */
+    bool operator== (const FixedMatrix& other) const {
+        for (std::size_t i = 0; i < R * C; i++)
+            if (m[i] != other.m[i])
+                return false;
+        return true;
+    }
+
+    bool operator!= (const FixedMatrix& other) const {
+        return !(*this == other);
+    }
+
+    /*! @brief print matrix to cout, for debug purposes.
+     */
+    void debug() const {
+        for (std::size_t r = 0; r < R; r++) {
+            for (std::size_t c = 0; c < C; c++)
+                std::cout << m[r * C + c] << " ";
+            std::cout << std::endl;
+        }
+    }
+
+    /*! @brief copy into a matrix with a different element type, by
+     *         typecasting or as 'mode' says (see ConvertMode)
+     */
+    template <class To>
+    void convertTo(FixedMatrix<To, R, C>& out, ConvertMode mode = ConvertMode::Cast) const {
+        matrix_detail::convertElements(m.data(), out.data(), R * C, mode);
+    }
+};
+
+/*!
+ * @brief Addition of two fixed matrices, their dimensions must match.
+ */
+template <class T, unsigned int R1, unsigned int C1, unsigned int R2, unsigned int C2>
+FixedMatrix<T, R1, C1> operator+ (const FixedMatrix<T, R1, C1>& first, const FixedMatrix<T, R2, C2>& second) {
+    static_assert(R1 == R2 && C1 == C2, "Addition: matrices must have the same size.");
+    FixedMatrix<T, R1, C1> ret(first);
+    ret.addInPlace(second);
+    return ret;
+}
+
+/*!
+ * @brief Product of two fixed matrices, first must have as many columns as second has rows.
+ *
+ * Every element is summed in the order k = 0, 1, 2, ..., same as Matrix::multiply().
+ */
+template <class T, unsigned int R, unsigned int K1, unsigned int K2, unsigned int C>
+FixedMatrix<T, R, C> operator* (const FixedMatrix<T, R, K1>& first, const FixedMatrix<T, K2, C>& second) {
+    static_assert(K1 == K2, "Multiplication: matrices sizes don't alow multiplication.");
+    FixedMatrix<T, R, C> ret;
+    T* c = ret.data();
+    const T* a = first.data();
+    const T* b = second.data();
+    // row i of the result is a linear combination of the rows of second,
+    // the inner loop over the columns vectorizes
+    MATRIX_UNROLL
+    for (std::size_t i = 0; i < R; i++) {
+        MATRIX_UNROLL
+        for (std::size_t k = 0; k < K1; k++) {
+            MATRIX_UNROLL
+            for (std::size_t j = 0; j < C; j++)
+                c[i * C + j] += a[i * K1 + k] * b[k * C + j];
+        }
+    }
+    return ret;
+}
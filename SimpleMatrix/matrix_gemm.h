@@ -0,0 +1,430 @@
+/*!
+ * @file matrix_gemm.h
+ * @author Tony Andrioli, The Hague University of Applied Sciences
+ * @date June 2022
+ *
+ * Cache-blocked matrix product used by Matrix::multiply().
+ *
+ * The product C = A*B is computed the way most BLAS libraries do it: B is cut
+ * into KC x NC panels that stay in L3, A into MC x KC blocks that stay in L2,
+ * and both are packed into contiguous buffers so the register tiled
+ * micro-kernel (MR x NR) only ever streams through memory in order.
+ *
+ * Every element of C is accumulated in the same order as the textbook
+ * triple loop (k = 0, 1, 2, ...), so the results are bit-for-bit equal to
+ * the naive implementation, also for float and double.
+ *
+ * A and B may have a narrower element type than C (int8_t operands with an
+ * int32_t result, say): packing widens them, the micro-kernel only sees the
+ * type of C. Memory is then read in the narrow type, which is the point of
+ * quantized products, see matrix_quant.h.
+ *
+ * The kernel computes C = alpha*A*B or C += alpha*A*B, as BLAS does: alpha
+ * is multiplied into A while it is packed, op(A) and op(B) (transposed or
+ * not) only change the strides the packing walks, see Matrix::gemm().
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <algorithm>
+#include <type_traits>
+
+#include "matrix_alloc.h"
+#include "matrix_parallel.h"
+
+/*!
+ * @brief Whether Matrix::gemm() uses an operand as it is or transposed
+ */
+enum class Transpose {
+    No,     //!< op(A) = A
+    Yes     //!< op(A) = transpose(A), without making the transposed copy
+};
+
+// Loops over the register tile must be fully unrolled, else the accumulators
+// end up on the stack.
+#if defined(__clang__)
+#define MATRIX_UNROLL _Pragma("unroll")
+#elif defined(__GNUC__)
+#define MATRIX_UNROLL _Pragma("GCC unroll 16")
+#else
+#define MATRIX_UNROLL
+#endif
+
+// GCC and clang have portable vector types, we use them for the micro-kernel.
+// The width follows the instruction set the code is compiled for.
+#if defined(__GNUC__) || defined(__clang__)
+#define MATRIX_VECTOR_EXT 1
+#if defined(__AVX512F__)
+#define MATRIX_VECTOR_BYTES 64
+#elif defined(__AVX__)
+#define MATRIX_VECTOR_BYTES 32
+#else
+#define MATRIX_VECTOR_BYTES 16
+#endif
+#endif
+
+namespace matrix_detail {
+
+    // ----------------------------------------------------------------------
+    // blocking parameters
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief True if the micro-kernel can use compiler vector types for T.
+     */
+    template <class T>
+    struct GemmVectorize {
+    #ifdef MATRIX_VECTOR_EXT
+        static constexpr bool value = std::is_arithmetic<T>::value && !std::is_same<T, bool>::value &&
+                                  sizeof(T) <= 8 && (MATRIX_VECTOR_BYTES % sizeof(T)) == 0;
+    #else
+        static constexpr bool value = false;
+    #endif
+    };
+
+    /*!
+     * @brief Register tile and cache block sizes for type T.
+     *
+     * The register tile is MR rows by two vectors (NR = 2 * lanes). KC is
+     * chosen so a KC x NR sliver of B fits in L1, MC so an MC x KC block of A
+     * fits in L2 and NC so a KC x NC panel of B fits in L3. Specialise this
+     * template to tune for a particular machine.
+     */
+    template <class T>
+    struct GemmBlocking {
+    #ifdef MATRIX_VECTOR_EXT
+        static constexpr int VB = MATRIX_VECTOR_BYTES;
+    #else
+        static constexpr int VB = 32;
+    #endif
+        static constexpr int NR = GemmVectorize<T>::value ? 2 * (VB / (int)sizeof(T)) : 4;
+        static constexpr int MR = GemmVectorize<T>::value ? 6 : 4;
+        static constexpr std::size_t KC = 256;
+        static constexpr std::size_t MC = (256 * 1024) / (KC * sizeof(T)) < (std::size_t)MR ? MR :
+                                      ((256 * 1024) / (KC * sizeof(T)) / MR) * MR;
+        static constexpr std::size_t NC = (4 * 1024 * 1024) / (KC * sizeof(T)) < (std::size_t)NR ? NR :
+                                      ((4 * 1024 * 1024) / (KC * sizeof(T)) / NR) * NR;
+    };
+
+    /*!
+     * @brief Products smaller than this (m*n*k) skip packing altogether.
+     */
+    const std::size_t GEMM_SMALL = 32 * 32 * 32;
+
+    // ----------------------------------------------------------------------
+    // packing
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief Pack an mc x kc block of A into row panels of MR.
+     *
+     * Panel p holds rows p*MR .. p*MR+MR-1, stored k by k, so the
+     * micro-kernel reads MR consecutive values per k. Rows past mc are
+     * padded with zeros. The elements are converted from S to T and
+     * multiplied by alpha.
+     */
+    template <class T, int MR, class S>
+    void packA(std::size_t mc, std::size_t kc, const S* a, std::ptrdiff_t rsa, std::ptrdiff_t csa, T* buf, T alpha) {
+        for (std::size_t ir = 0; ir < mc; ir += MR) {
+            std::size_t mr = std::min<std::size_t>(MR, mc - ir);
+            const S* ap = a + ir * rsa;
+            for (std::size_t k = 0; k < kc; k++) {
+                for (std::size_t i = 0; i < mr; i++)
+                    buf[i] = alpha * (T) ap[i * rsa + k * csa];
+                for (std::size_t i = mr; i < (std::size_t)MR; i++)
+                    buf[i] = T(0);
+                buf += MR;
+            }
+        }
+    }
+
+    /*!
+     * @brief Pack a kc x nc panel of B into column panels of NR.
+     */
+    template <class T, int NR, class S>
+    void packB(std::size_t kc, std::size_t nc, const S* b, std::ptrdiff_t rsb, std::ptrdiff_t csb, T* buf) {
+        for (std::size_t jr = 0; jr < nc; jr += NR) {
+            std::size_t nr = std::min<std::size_t>(NR, nc - jr);
+            const S* bp = b + jr * csb;
+            for (std::size_t k = 0; k < kc; k++) {
+                const S* row = bp + k * rsb;
+                if (csb == 1 && nr == (std::size_t)NR) {
+                    for (int j = 0; j < NR; j++)
+                        buf[j] = (T) row[j];
+                } else {
+                    for (std::size_t j = 0; j < nr; j++)
+                        buf[j] = (T) row[j * csb];
+                    for (std::size_t j = nr; j < (std::size_t)NR; j++)
+                        buf[j] = T(0);
+                }
+                buf += NR;
+            }
+        }
+    }
+
+    // ----------------------------------------------------------------------
+    // micro-kernel
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief MR x NR register tile: C = (accumulate ? C : 0) + A*B
+     *
+     * a and b point into packed panels. All loop bounds are compile time
+     * constants, so the compiler can keep the whole tile in registers. This
+     * is the portable version, used for types without vector support.
+     */
+    template <class T, int MR, int NR>
+    inline void gemmMicroFull(std::size_t kc, const T* a, const T* b, T* c, std::ptrdiff_t rsc, std::ptrdiff_t csc,
+                              bool accumulate, std::false_type) {
+        T ab[MR][NR];
+        MATRIX_UNROLL
+        for (int i = 0; i < MR; i++)
+            MATRIX_UNROLL
+            for (int j = 0; j < NR; j++)
+                ab[i][j] = accumulate ? c[i * rsc + j * csc] : T(0);
+
+        for (std::size_t k = 0; k < kc; k++) {
+            MATRIX_UNROLL
+            for (int i = 0; i < MR; i++) {
+                const T ai = a[i];
+                MATRIX_UNROLL
+                for (int j = 0; j < NR; j++)
+                    ab[i][j] += ai * b[j];
+            }
+            a += MR;
+            b += NR;
+        }
+
+        MATRIX_UNROLL
+        for (int i = 0; i < MR; i++)
+            MATRIX_UNROLL
+            for (int j = 0; j < NR; j++)
+                c[i * rsc + j * csc] = ab[i][j];
+    }
+
+#ifdef MATRIX_VECTOR_EXT
+    /*!
+     * @brief Vector version of the register tile, each row is two vectors.
+     *
+     * Element-wise it does exactly what the portable version does.
+     */
+    template <class T, int MR, int NR>
+    inline void gemmMicroFull(std::size_t kc, const T* a, const T* b, T* c, std::ptrdiff_t rsc, std::ptrdiff_t csc,
+                              bool accumulate, std::true_type) {
+        const int VB = GemmBlocking<T>::VB;
+        const int L = VB / (int)sizeof(T);
+        const int NV = NR / L;
+        typedef T V __attribute__((vector_size(VB)));
+
+        V ab[MR][NV];
+        if (accumulate && csc == 1) {
+            MATRIX_UNROLL
+            for (int i = 0; i < MR; i++)
+                MATRIX_UNROLL
+                for (int v = 0; v < NV; v++)
+                    std::memcpy(&ab[i][v], c + i * rsc + v * L, VB);
+        } else {
+            MATRIX_UNROLL
+            for (int i = 0; i < MR; i++)
+                MATRIX_UNROLL
+                for (int v = 0; v < NV; v++)
+                    ab[i][v] = V{};
+            if (accumulate) {
+                for (int i = 0; i < MR; i++)
+                    for (int j = 0; j < NR; j++)
+                        ab[i][j / L][j % L] = c[i * rsc + j * csc];
+            }
+        }
+
+        for (std::size_t k = 0; k < kc; k++) {
+            V bv[NV];
+            MATRIX_UNROLL
+            for (int v = 0; v < NV; v++)
+                std::memcpy(&bv[v], b + v * L, VB);
+            MATRIX_UNROLL
+            for (int i = 0; i < MR; i++) {
+                const V ai = a[i] - V{};    // broadcast
+                MATRIX_UNROLL
+                for (int v = 0; v < NV; v++)
+                    ab[i][v] += ai * bv[v];
+            }
+            a += MR;
+            b += NR;
+        }
+
+        if (csc == 1) {
+            MATRIX_UNROLL
+            for (int i = 0; i < MR; i++)
+                MATRIX_UNROLL
+                for (int v = 0; v < NV; v++)
+                    std::memcpy(c + i * rsc + v * L, &ab[i][v], VB);
+        } else {
+            for (int i = 0; i < MR; i++)
+                for (int j = 0; j < NR; j++)
+                    c[i * rsc + j * csc] = ab[i][j / L][j % L];
+        }
+    }
+#endif
+
+    /*!
+     * @brief Micro-kernel for any tile, also the partial ones at the edges of C.
+     *
+     * Edge tiles go through a small local tile, only the top-left mr x nr part
+     * of it is stored back into C, the rest is zero padding.
+     */
+    template <class T, int MR, int NR>
+    inline void gemmMicro(std::size_t kc, const T* a, const T* b, T* c, std::ptrdiff_t rsc, std::ptrdiff_t csc,
+                          std::size_t mr, std::size_t nr, bool accumulate) {
+        if (mr == (std::size_t)MR && nr == (std::size_t)NR) {
+            gemmMicroFull<T, MR, NR>(kc, a, b, c, rsc, csc, accumulate,
+                                     std::integral_constant<bool, GemmVectorize<T>::value>());
+            return;
+        }
+        T tile[MR * NR];
+        for (int i = 0; i < MR * NR; i++)
+            tile[i] = T(0);
+        if (accumulate) {
+            for (std::size_t i = 0; i < mr; i++)
+                for (std::size_t j = 0; j < nr; j++)
+                    tile[i * NR + j] = c[i * rsc + j * csc];
+        }
+        gemmMicroFull<T, MR, NR>(kc, a, b, tile, NR, 1, accumulate,
+                                 std::integral_constant<bool, GemmVectorize<T>::value>());
+        for (std::size_t i = 0; i < mr; i++)
+            for (std::size_t j = 0; j < nr; j++)
+                c[i * rsc + j * csc] = tile[i * NR + j];
+    }
+
+    // ----------------------------------------------------------------------
+    // drivers
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief Unpacked product for small sizes, loop order r-i-c.
+     *
+     * Each C[r][c] still receives its terms in order of i, the loop order only
+     * makes B and C be walked along their rows. alpha is multiplied into A.
+     */
+    template <class T, class S>
+    void gemmSmall(std::size_t m, std::size_t n, std::size_t k,
+                   const S* a, std::ptrdiff_t rsa, std::ptrdiff_t csa,
+                   const S* b, std::ptrdiff_t rsb, std::ptrdiff_t csb,
+                   T* c, std::ptrdiff_t rsc, std::ptrdiff_t csc, bool accumulate = false, T alpha = T(1)) {
+        for (std::size_t r = 0; r < m; r++) {
+            T* crow = c + r * rsc;
+            if (!accumulate)
+                for (std::size_t j = 0; j < n; j++)
+                    crow[j * csc] = T(0);
+            for (std::size_t i = 0; i < k; i++) {
+                const T ari = alpha * (T) a[r * rsa + i * csa];
+                const S* brow = b + i * rsb;
+                for (std::size_t j = 0; j < n; j++)
+                    crow[j * csc] += ari * (T) brow[j * csb];
+            }
+        }
+    }
+
+    /*!
+     * @brief C = A*B, with A m x k, B k x n and C m x n.
+     *
+     * All operands are described by a pointer plus a row and a column stride,
+     * so transposed operands and sub-blocks need no copy. C must not overlap
+     * with A or B. The elements of A and B (type S) are converted to T
+     * before they are multiplied.
+     *
+     * With accumulate the product is added to C (C += A*B), every element
+     * continuing its sum in order of k. Splitting k in pieces and
+     * accumulating them one after the other thus gives exactly the same
+     * result as one call.
+     *
+     * alpha scales A (C = alpha*A*B): every product is (alpha*a)*b, as in
+     * the reference BLAS. alpha = 1 changes nothing.
+     */
+    template <class T, class S>
+    void gemm(std::size_t m, std::size_t n, std::size_t k,
+              const S* a, std::ptrdiff_t rsa, std::ptrdiff_t csa,
+              const S* b, std::ptrdiff_t rsb, std::ptrdiff_t csb,
+              T* c, std::ptrdiff_t rsc, std::ptrdiff_t csc, bool accumulate = false, T alpha = T(1)) {
+        typedef GemmBlocking<T> B;
+        const int MR = B::MR;
+        const int NR = B::NR;
+
+        if (m == 0 || n == 0)
+            return;
+        if (k == 0 || m * n * k <= GEMM_SMALL) {
+            gemmSmall<T>(m, n, k, a, rsa, csa, b, rsb, csb, c, rsc, csc, accumulate, alpha);
+            return;
+        }
+
+        const std::size_t kcMax = std::min<std::size_t>(B::KC, k);
+        const std::size_t mcMax = std::min<std::size_t>(B::MC, ((m + MR - 1) / MR) * MR);
+        const std::size_t ncMax = std::min<std::size_t>(B::NC, ((n + NR - 1) / NR) * NR);
+        ScratchBuffer<T> bufA(mcMax * kcMax);
+        ScratchBuffer<T> bufB(kcMax * ncMax);
+
+        for (std::size_t jc = 0; jc < n; jc += B::NC) {
+            const std::size_t nc = std::min<std::size_t>(B::NC, n - jc);
+            for (std::size_t pc = 0; pc < k; pc += B::KC) {
+                const std::size_t kc = std::min<std::size_t>(B::KC, k - pc);
+                packB<T, NR>(kc, nc, b + pc * rsb + jc * csb, rsb, csb, bufB.data());
+                for (std::size_t ic = 0; ic < m; ic += B::MC) {
+                    const std::size_t mc = std::min<std::size_t>(B::MC, m - ic);
+                    packA<T, MR>(mc, kc, a + ic * rsa + pc * csa, rsa, csa, bufA.data(), alpha);
+                    for (std::size_t jr = 0; jr < nc; jr += NR) {
+                        const std::size_t nr = std::min<std::size_t>(NR, nc - jr);
+                        for (std::size_t ir = 0; ir < mc; ir += MR) {
+                            const std::size_t mr = std::min<std::size_t>(MR, mc - ir);
+                            gemmMicro<T, MR, NR>(kc, bufA.data() + ir * kc, bufB.data() + jr * kc,
+                                                 c + (ic + ir) * rsc + (jc + jr) * csc, rsc, csc,
+                                                 mr, nr, accumulate || pc > 0);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /*!
+     * @brief gemm() split over the thread pool.
+     *
+     * Every thread computes its own band of rows (or columns, for wide
+     * short products) of C with the serial kernel, so the result does not
+     * depend on the number of threads.
+     */
+    template <class T, class S>
+    void gemmParallel(std::size_t m, std::size_t n, std::size_t k,
+                      const S* a, std::ptrdiff_t rsa, std::ptrdiff_t csa,
+                      const S* b, std::ptrdiff_t rsb, std::ptrdiff_t csb,
+                      T* c, std::ptrdiff_t rsc, std::ptrdiff_t csc, bool accumulate = false, T alpha = T(1)) {
+        typedef GemmBlocking<T> B;
+        const std::size_t work = m * n * k / 16;
+        if (work < MatrixConfig::parallelThreshold() || MatrixConfig::threadCount() == 1) {
+            gemm<T>(m, n, k, a, rsa, csa, b, rsb, csb, c, rsc, csc, accumulate, alpha);
+            return;
+        }
+        const std::size_t threads = MatrixConfig::threadCount();
+        if (m >= n) {
+            // bands of whole MR panels
+            const std::size_t panels = (m + B::MR - 1) / B::MR;
+            const std::size_t grain = (std::max<std::size_t>)(1, panels / (threads * 2));
+            parallelFor(0, panels, grain, work, [&](std::size_t p0, std::size_t p1) {
+                const std::size_t r0 = p0 * B::MR;
+                const std::size_t r1 = (std::min)(m, p1 * B::MR);
+                gemm<T>(r1 - r0, n, k, a + r0 * rsa, rsa, csa, b, rsb, csb, c + r0 * rsc, rsc, csc, accumulate, alpha);
+            });
+        } else {
+            const std::size_t panels = (n + B::NR - 1) / B::NR;
+            const std::size_t grain = (std::max<std::size_t>)(1, panels / (threads * 2));
+            parallelFor(0, panels, grain, work, [&](std::size_t p0, std::size_t p1) {
+                const std::size_t c0 = p0 * B::NR;
+                const std::size_t c1 = (std::min)(n, p1 * B::NR);
+                gemm<T>(m, c1 - c0, k, a, rsa, csa, b + c0 * csb, rsb, csb, c + c0 * csc, rsc, csc, accumulate, alpha);
+            });
+        }
+    }
+
+} // namespace matrix_detail
@@ -0,0 +1,209 @@
+/*!
+ * @file matrix_gemv.h
+ * @author Tony Andrioli, The Hague University of Applied Sciences
+ * @date June 2022
+ *
+ * Matrix-vector kernels: the product of a matrix and a vector (gemv), the
+ * dot product, axpy (y += alpha*x) and the rank-1 update (ger, A +=
+ * alpha*x*y'). Vectors are matrices with one row or one column.
+ *
+ * A product with a vector reads every element of the matrix once and does
+ * one multiply-add with it, so it is limited by memory bandwidth, not by
+ * arithmetic. The cache-blocked kernel of matrix_gemm.h would pack the
+ * whole matrix first and fill its register tiles with zeros;
+ * Matrix::multiply() sends products with a dimension of 1 here instead.
+ *
+ * - A*x walks 8 rows of A at once, each with its own accumulator, so the
+ *   rows stream from memory side by side and every element still gets its
+ *   terms in order of k.
+ * - x'*A (and transpose(A)*x) adds x[i] times row i of A to y for 4 rows
+ *   per pass, vectorized along the row. Each thread owns a band of y.
+ * Both give exactly the result of the textbook loop, the same as the
+ * conventional kernel (MultiplyAlgorithm::Conventional); products with a
+ * vector never go through Strassen. Only dot() reorders its sum, see there.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <algorithm>
+
+#include "matrix_expr.h"
+#include "matrix_gemm.h"
+#include "matrix_parallel.h"
+
+namespace matrix_detail {
+
+    // rows of A*x per accumulator block
+    const std::size_t GEMV_ROWS = 8;
+
+    // columns of y per band of x'*A: a band of y stays in L1
+    const std::size_t GEMV_BAND_BYTES = 16 * 1024;
+
+    /*!
+     * @brief y = alpha*A*x + beta*y, A m x n with row stride lda.
+     *
+     * Row i is summed in order of j, then multiplied by alpha. With beta = 0
+     * y isn't read. y must not overlap with A or x.
+     */
+    template <class T>
+    void gemvRows(std::size_t m, std::size_t n, T alpha, const T* a, std::size_t lda,
+                  const T* x, T beta, T* y) {
+        const std::size_t R = GEMV_ROWS;
+        const std::size_t blocks = (m + R - 1) / R;
+        const std::size_t grain = (std::max<std::size_t>)(1, (16 * 1024) / (R * n + 1));
+        parallelFor(0, blocks, grain, m * n, [=](std::size_t b0, std::size_t b1) {
+            for (std::size_t blk = b0; blk < b1; blk++) {
+                const std::size_t i0 = blk * R;
+                const std::size_t rows = (std::min)(R, m - i0);
+                T acc[GEMV_ROWS];
+                for (std::size_t r = 0; r < R; r++)
+                    acc[r] = T(0);
+                const T* row = a + i0 * lda;
+                if (rows == R) {
+                    for (std::size_t j = 0; j < n; j++) {
+                        const T xj = x[j];
+                        MATRIX_UNROLL
+                        for (std::size_t r = 0; r < GEMV_ROWS; r++)
+                            acc[r] += row[r * lda + j] * xj;
+                    }
+                } else {
+                    for (std::size_t r = 0; r < rows; r++)
+                        for (std::size_t j = 0; j < n; j++)
+                            acc[r] += row[r * lda + j] * x[j];
+                }
+                for (std::size_t r = 0; r < rows; r++) {
+                    const T v = alpha == T(1) ? acc[r] : alpha * acc[r];
+                    y[i0 + r] = beta == T(0) ? v : beta * y[i0 + r] + v;
+                }
+            }
+        });
+    }
+
+    /*!
+     * @brief y = alpha*transpose(A)*x + beta*y, A m x n with row stride lda,
+     *        so y has n elements and x m.
+     *
+     * y[j] gets (alpha*x[i])*A[i][j] added in order of i, as the reference
+     * BLAS does. With beta = 0 y isn't read. y must not overlap with A or x.
+     */
+    template <class T>
+    void gemvCols(std::size_t m, std::size_t n, T alpha, const T* a, std::size_t lda,
+                  const T* x, T beta, T* y) {
+        const std::size_t band = (std::max<std::size_t>)(64, GEMV_BAND_BYTES / sizeof(T));
+        const std::size_t bands = (n + band - 1) / band;
+        parallelFor(0, bands, 1, m * n, [=](std::size_t b0, std::size_t b1) {
+            for (std::size_t b = b0; b < b1; b++) {
+                const std::size_t j0 = b * band;
+                const std::size_t j1 = (std::min)(n, j0 + band);
+                T* yb = y + j0;
+                const std::size_t w = j1 - j0;
+                if (beta == T(0))
+                    std::fill(yb, yb + w, T(0));
+                else if (beta != T(1))
+                    for (std::size_t j = 0; j < w; j++)
+                        yb[j] *= beta;
+                std::size_t i = 0;
+                // four rows per pass over the band, the additions stay in order of i
+                for (; i + 4 <= m; i += 4) {
+                    const T s0 = alpha * x[i], s1 = alpha * x[i + 1], s2 = alpha * x[i + 2], s3 = alpha * x[i + 3];
+                    const T* r0 = a + i * lda + j0;
+                    const T* r1 = r0 + lda;
+                    const T* r2 = r1 + lda;
+                    const T* r3 = r2 + lda;
+                    MATRIX_IVDEP
+                    for (std::size_t j = 0; j < w; j++)
+                        yb[j] = (((yb[j] + s0 * r0[j]) + s1 * r1[j]) + s2 * r2[j]) + s3 * r3[j];
+                }
+                for (; i < m; i++) {
+                    const T s = alpha * x[i];
+                    const T* r = a + i * lda + j0;
+                    MATRIX_IVDEP
+                    for (std::size_t j = 0; j < w; j++)
+                        yb[j] += s * r[j];
+                }
+            }
+        });
+    }
+
+    /*!
+     * @brief A = (accumulate ? A : 0) + alpha*x*transpose(y), A m x n with
+     *        row stride lda: the rank-1 update (ger) and the outer product.
+     */
+    template <class T>
+    void ger(std::size_t m, std::size_t n, T alpha, const T* x, const T* y, T* a, std::size_t lda,
+             bool accumulate = true) {
+        const std::size_t grain = (std::max<std::size_t>)(1, (16 * 1024) / (n + 1));
+        parallelFor(0, m, grain, m * n, [=](std::size_t i0, std::size_t i1) {
+            for (std::size_t i = i0; i < i1; i++) {
+                const T s = alpha * x[i];
+                T* row = a + i * lda;
+                if (accumulate) {
+                    MATRIX_IVDEP
+                    for (std::size_t j = 0; j < n; j++)
+                        row[j] += s * y[j];
+                } else {
+                    MATRIX_IVDEP
+                    for (std::size_t j = 0; j < n; j++)
+                        row[j] = T(0) + s * y[j];
+                }
+            }
+        });
+    }
+
+    /*!
+     * @brief y += alpha*x, n elements
+     */
+    template <class T>
+    void axpy(std::size_t n, T alpha, const T* x, T* y) {
+        parallelElements(n, 2 * sizeof(T), [=](std::size_t b, std::size_t e) {
+            MATRIX_IVDEP
+            for (std::size_t i = b; i < e; i++)
+                y[i] += alpha * x[i];
+        });
+    }
+
+    /*!
+     * @brief The sum of x[i]*y[i] in 16 interleaved partial sums (which
+     *        vectorize), added together at the end.
+     */
+    template <class T>
+    T dotKernel(std::size_t n, const T* x, const T* y) {
+        const std::size_t W = 16;
+        T acc[W];
+        for (std::size_t q = 0; q < W; q++)
+            acc[q] = T(0);
+        std::size_t i = 0;
+        for (; i + W <= n; i += W) {
+            MATRIX_UNROLL
+            for (std::size_t q = 0; q < W; q++)
+                acc[q] += x[i + q] * y[i + q];
+        }
+        T sum = T(0);
+        for (std::size_t q = 0; q < W; q++)
+            sum += acc[q];
+        for (; i < n; i++)
+            sum += x[i] * y[i];
+        return sum;
+    }
+
+    /*!
+     * @brief C = A*B through the kernels above when m, n or k is 1, with
+     *        the same result as gemm(); false (and nothing done) otherwise.
+     *
+     * A is m x k, B k x n and C m x n, all contiguous and row major.
+     */
+    template <class T>
+    bool multiplyVector(std::size_t m, std::size_t n, std::size_t k, const T* a, const T* b, T* c) {
+        if (n == 1)
+            gemvRows(m, k, T(1), a, k, b, T(0), c);         // A*x, also x'*y
+        else if (m == 1)
+            gemvCols(k, n, T(1), b, n, a, T(0), c);         // x'*B
+        else if (k == 1)
+            ger(m, n, T(1), a, b, c, n, false);             // x*y'
+        else
+            return false;
+        return true;
+    }
+
+} // namespace matrix_detail
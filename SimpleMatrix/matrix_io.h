@@ -0,0 +1,558 @@
+/*!
+ * @file matrix_io.h
+ * @author Tony Andrioli, The Hague University of Applied Sciences
+ * @date June 2022
+ *
+ * Matrices in binary files, memory mapped, and products and sums of
+ * matrices that don't fit in memory.
+ *
+ * A matrix file is a 64 byte header (see MatrixFileHeader) followed by the
+ * elements. The data starts at a multiple of 64 bytes, so a mapped matrix
+ * is as well aligned as an allocated one.
+ * @code{.cpp}
+ * saveMatrix("a.mat", A);
+ * Matrix<float> B = loadMatrix<float>("a.mat");                          // a copy
+ * Matrix<float> C = mapMatrix<float>("a.mat");                           // no copy, pages come in when used
+ * Matrix<float> D = createMatrixFile<float>("d.mat", A.rows(), A.cols()); // writes go to d.mat
+ * MatrixStream::multiply(C, C, D);                                       // tile by tile
+ * @endcode
+ * Files are written in the byte order of the machine, a file of the other
+ * byte order is refused.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "matrix_alloc.h"
+#include "matrix_gemm.h"
+#include "matrix_profile.h"
+#include "matrix_view.h"
+
+/*!
+ * @brief Element type of a matrix file
+ */
+enum class MatrixDType : std::uint32_t {
+    Int8 = 1, UInt8, Int16, UInt16, Int32, UInt32, Int64, UInt64, Float32, Float64
+};
+
+/*!
+ * @brief The header at the start of a matrix file, 64 bytes.
+ */
+struct MatrixFileHeader {
+    char magic[8];              //!< "SMATRIX1"
+    std::uint32_t version;      //!< 1
+    std::uint32_t dtype;        //!< a MatrixDType
+    std::uint32_t elementSize;  //!< bytes per element
+    std::uint32_t layout;       //!< a MatrixLayout
+    std::uint32_t byteOrder;    //!< 0x01020304, as written by the machine that wrote the file
+    std::uint32_t reserved0;
+    std::uint64_t rows;
+    std::uint64_t cols;
+    std::uint64_t dataOffset;   //!< where the elements start, from the start of the file
+    std::uint64_t reserved1;
+};
+
+static_assert(sizeof(MatrixFileHeader) == 64, "MatrixFileHeader must be 64 bytes");
+
+/*!
+ * @brief How mapMatrix() maps a file
+ */
+enum class MatrixMapMode {
+    Private,    //!< changes stay in memory, the file is opened read only
+    Shared      //!< changes are written to the file
+};
+
+namespace matrix_detail {
+
+    static constexpr std::uint32_t MATRIX_FILE_VERSION = 1;
+    static constexpr std::uint32_t MATRIX_BYTE_ORDER = 0x01020304;
+
+    // the MatrixDType of T
+    template <class T>
+    constexpr MatrixDType dtypeOf() {
+        static_assert(std::is_arithmetic<T>::value && !std::is_same<T, bool>::value,
+                      "matrix files hold integer or floating point elements");
+        static_assert(!std::is_floating_point<T>::value || sizeof(T) == 4 || sizeof(T) == 8,
+                      "matrix files hold 32 or 64 bit floating point elements");
+        return std::is_floating_point<T>::value ? (sizeof(T) == 4 ? MatrixDType::Float32 : MatrixDType::Float64) :
+               sizeof(T) == 1 ? (std::is_signed<T>::value ? MatrixDType::Int8 : MatrixDType::UInt8) :
+               sizeof(T) == 2 ? (std::is_signed<T>::value ? MatrixDType::Int16 : MatrixDType::UInt16) :
+               sizeof(T) == 4 ? (std::is_signed<T>::value ? MatrixDType::Int32 : MatrixDType::UInt32) :
+                                (std::is_signed<T>::value ? MatrixDType::Int64 : MatrixDType::UInt64);
+    }
+
+    inline std::runtime_error ioError(const std::string& what, const std::string& path) {
+    #if defined(_WIN32)
+        return std::runtime_error(what + " '" + path + "' (error " + std::to_string(GetLastError()) + ")");
+    #else
+        return std::runtime_error(what + " '" + path + "': " + std::strerror(errno));
+    #endif
+    }
+
+    template <class T>
+    MatrixFileHeader makeHeader(std::size_t rows, std::size_t cols, MatrixLayout layout = MatrixLayout::RowMajor) {
+        MatrixFileHeader h;
+        std::memset(&h, 0, sizeof(h));
+        std::memcpy(h.magic, "SMATRIX1", 8);
+        h.version = MATRIX_FILE_VERSION;
+        h.dtype = (std::uint32_t) dtypeOf<T>();
+        h.elementSize = sizeof(T);
+        h.layout = (std::uint32_t) layout;
+        h.byteOrder = MATRIX_BYTE_ORDER;
+        h.rows = rows;
+        h.cols = cols;
+        h.dataOffset = sizeof(MatrixFileHeader);
+        return h;
+    }
+
+    // throws when the header isn't one of ours, for T, or the file is too short
+    template <class T>
+    void checkHeader(const MatrixFileHeader& h, std::uint64_t fileSize, const std::string& path) {
+        if (fileSize < sizeof(MatrixFileHeader) || std::memcmp(h.magic, "SMATRIX1", 8) != 0)
+            throw std::runtime_error("'" + path + "' is not a matrix file");
+        if (h.byteOrder != MATRIX_BYTE_ORDER)
+            throw std::runtime_error("'" + path + "' was written in another byte order");
+        if (h.version != MATRIX_FILE_VERSION)
+            throw std::runtime_error("'" + path + "' has an unknown version");
+        if (h.dtype != (std::uint32_t) dtypeOf<T>() || h.elementSize != sizeof(T))
+            throw std::runtime_error("'" + path + "' holds another element type");
+        if (h.layout > (std::uint32_t) MatrixLayout::ColumnMajor || h.dataOffset % 64 != 0 ||
+            h.dataOffset < sizeof(MatrixFileHeader))
+            throw std::runtime_error("'" + path + "' has a damaged header");
+        if (h.cols != 0 && h.rows > (UINT64_MAX / sizeof(T)) / h.cols)
+            throw std::runtime_error("'" + path + "' is too large");
+        const std::uint64_t bytes = h.rows * h.cols * sizeof(T);
+        if (fileSize < h.dataOffset || fileSize - h.dataOffset < bytes)
+            throw std::runtime_error("'" + path + "' is shorter than its header says");
+        if (bytes > (std::uint64_t) SIZE_MAX)
+            throw std::runtime_error("'" + path + "' doesn't fit in the address space");
+    }
+
+    /*!
+     * @brief A file mapped in memory, unmapped when the last owner lets go.
+     */
+    class FileMapping {
+    public:
+        /*!
+         * @brief Map the whole of an existing file. Shared mappings write
+         *        to the file, private ones are copy-on-write.
+         */
+        FileMapping(const std::string& path, bool shared) : p(NULL), bytes(0) {
+            open(path, shared, 0);
+        }
+
+        /*!
+         * @brief Create (or truncate) a file of 'size' zero bytes and map it shared.
+         */
+        FileMapping(const std::string& path, std::uint64_t size) : p(NULL), bytes(0) {
+            open(path, true, size);
+        }
+
+        ~FileMapping() {
+            if (p == NULL)
+                return;
+        #if defined(_WIN32)
+            UnmapViewOfFile(p);
+        #else
+            munmap(p, bytes);
+        #endif
+        }
+
+        unsigned char* data() const { return p; }
+        std::uint64_t size() const { return bytes; }
+
+    private:
+        FileMapping(const FileMapping&);
+        FileMapping& operator=(const FileMapping&);
+
+        void open(const std::string& path, bool shared, std::uint64_t create);
+
+        unsigned char* p;
+        std::uint64_t bytes;
+    };
+
+#if defined(_WIN32)
+    inline void FileMapping::open(const std::string& path, bool shared, std::uint64_t create) {
+        HANDLE file = CreateFileA(path.c_str(), shared ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+                                  FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                                  create ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            throw ioError("cannot open", path);
+        LARGE_INTEGER size;
+        size.QuadPart = (LONGLONG) create;
+        if (!create && !GetFileSizeEx(file, &size)) {
+            CloseHandle(file);
+            throw ioError("cannot read the size of", path);
+        }
+        bytes = (std::uint64_t) size.QuadPart;
+        if (bytes == 0) {
+            CloseHandle(file);
+            throw std::runtime_error("'" + path + "' is empty");
+        }
+        // the view keeps the mapping, and the mapping the file, open
+        HANDLE mapping = CreateFileMappingA(file, NULL, shared ? PAGE_READWRITE : PAGE_WRITECOPY,
+                                            size.HighPart, size.LowPart, NULL);
+        CloseHandle(file);
+        if (mapping == NULL)
+            throw ioError("cannot map", path);
+        p = (unsigned char*) MapViewOfFile(mapping, shared ? FILE_MAP_WRITE : FILE_MAP_COPY, 0, 0, 0);
+        CloseHandle(mapping);
+        if (p == NULL)
+            throw ioError("cannot map", path);
+    }
+#else
+    inline void FileMapping::open(const std::string& path, bool shared, std::uint64_t create) {
+        int flags = shared ? O_RDWR : O_RDONLY;
+        if (create)
+            flags |= O_CREAT | O_TRUNC;
+        int fd = ::open(path.c_str(), flags, 0644);
+        if (fd < 0)
+            throw ioError("cannot open", path);
+        if (create) {
+            if (ftruncate(fd, (off_t) create) != 0) {
+                std::runtime_error e = ioError("cannot resize", path);
+                ::close(fd);
+                throw e;
+            }
+            bytes = create;
+        } else {
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                std::runtime_error e = ioError("cannot read the size of", path);
+                ::close(fd);
+                throw e;
+            }
+            bytes = (std::uint64_t) st.st_size;
+        }
+        if (bytes == 0 || bytes > (std::uint64_t) SIZE_MAX) {
+            ::close(fd);
+            throw std::runtime_error("'" + path + "' is empty or too large to map");
+        }
+        // the mapping keeps the file open
+        void* q = mmap(NULL, (std::size_t) bytes, PROT_READ | PROT_WRITE, shared ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+        if (q == MAP_FAILED) {
+            std::runtime_error e = ioError("cannot map", path);
+            ::close(fd);
+            throw e;
+        }
+        ::close(fd);
+        p = (unsigned char*) q;
+    }
+#endif
+
+    /*!
+     * @brief Ask the operating system to start reading rows [0, rows) of a
+     *        view from disk, so they are in memory by the time they are used.
+     *
+     * Only a hint, it returns at once and does nothing for memory that
+     * isn't a mapped file.
+     */
+    template <class T>
+    void prefetch(const T* p, std::size_t rows, std::size_t cols, std::size_t stride) {
+        if (rows == 0 || cols == 0)
+            return;
+        const std::size_t rowBytes = cols * sizeof(T);
+        const std::size_t strideBytes = stride * sizeof(T);
+        // rows closer together than a page are fetched as one range
+        const bool oneRange = strideBytes - rowBytes < 4096;
+        const std::size_t n = oneRange ? 1 : rows;
+        const std::size_t len = oneRange ? (rows - 1) * strideBytes + rowBytes : rowBytes;
+    #if defined(_WIN32)
+    #if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0602
+        for (std::size_t i = 0; i < n; i++) {
+            WIN32_MEMORY_RANGE_ENTRY range;
+            range.VirtualAddress = (PVOID) ((const char*) p + i * strideBytes);
+            range.NumberOfBytes = len;
+            PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+        }
+    #else
+        (void) n;
+        (void) len;
+    #endif
+    #else
+        const std::uintptr_t page = (std::uintptr_t) sysconf(_SC_PAGESIZE);
+        for (std::size_t i = 0; i < n; i++) {
+            const std::uintptr_t b = (std::uintptr_t) ((const char*) p + i * strideBytes);
+            const std::uintptr_t start = b & ~(page - 1);
+            madvise((void*) start, b + len - start, MADV_WILLNEED);
+        }
+    #endif
+    }
+
+    // prefetch() of the elements of a view, in either layout
+    template <class T>
+    void prefetch(const ConstMatrixView<T>& v) {
+        const ConstMatrixView<T> lines = rowMajorView(v);
+        prefetch(lines.data(), lines.rows(), lines.cols(), lines.stride());
+    }
+
+} // namespace matrix_detail
+
+// --------------------------------------------------------------------------
+// files
+// --------------------------------------------------------------------------
+
+/*!
+ * @brief Write a matrix (or a view on one) to a file, in its layout
+ *        (row major or column major).
+ * @exception runtime_error thrown when the file can't be written.
+ */
+template <class T>
+void saveMatrix(const std::string& path, const ConstMatrixView<T>& matrix) {
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out)
+        throw matrix_detail::ioError("cannot create", path);
+    MatrixFileHeader h = matrix_detail::makeHeader<T>(matrix.rows(), matrix.cols(), matrix.layout());
+    out.write((const char*) &h, sizeof(h));
+    // rows, or columns for column major
+    const ConstMatrixView<T> lines = matrix_detail::rowMajorView(matrix);
+    if (lines.contiguous())
+        out.write((const char*) lines.data(), (std::streamsize) (lines.rows() * lines.cols() * sizeof(T)));
+    else
+        for (std::size_t r = 0; r < lines.rows() && out; r++)
+            out.write((const char*) (lines.data() + r * lines.stride()), (std::streamsize) (lines.cols() * sizeof(T)));
+    out.flush();
+    if (!out)
+        throw matrix_detail::ioError("cannot write", path);
+}
+
+template <class T, class Alloc>
+void saveMatrix(const std::string& path, const Matrix<T, Alloc>& matrix) {
+    saveMatrix(path, ConstMatrixView<T>(matrix));
+}
+
+/*!
+ * @brief Read a matrix file into memory.
+ *
+ * A column major file gives a column-major matrix (see Matrix::layout()).
+ * @exception runtime_error thrown when the file can't be read, isn't a matrix
+ *            file or holds another element type than T.
+ */
+template <class T>
+Matrix<T> loadMatrix(const std::string& path) {
+    matrix_detail::FileMapping file(path, false);
+    MatrixFileHeader h;
+    std::memcpy(&h, file.data(), std::min<std::uint64_t>(sizeof(h), file.size()));
+    matrix_detail::checkHeader<T>(h, file.size(), path);
+    const T* src = (const T*) (file.data() + h.dataOffset);
+    Matrix<T> ret((std::size_t) h.rows, (std::size_t) h.cols, (MatrixLayout) h.layout, MatrixInit::Uninitialized);
+    if (h.rows * h.cols > 0)
+        std::memcpy(ret.data(), src, (std::size_t) (h.rows * h.cols * sizeof(T)));
+    return ret;
+}
+
+/*!
+ * @brief A matrix on a memory mapped file, nothing is read until it is used.
+ *
+ * The returned matrix uses the file as its memory (see Matrix::adopt()), so
+ * a matrix larger than the physical memory is fine: the operating system
+ * reads the pages it touches and drops them again when memory runs short.
+ * With MatrixMapMode::Shared every change is written to the file, with
+ * MatrixMapMode::Private changes stay in memory. Resizing the matrix to
+ * another number of elements detaches it from the file. A column major
+ * file gives a column-major matrix.
+ * @exception runtime_error thrown when the file can't be mapped, isn't a
+ *            matrix file or holds another element type than T.
+ */
+template <class T>
+Matrix<T> mapMatrix(const std::string& path, MatrixMapMode mode = MatrixMapMode::Private) {
+    std::shared_ptr<matrix_detail::FileMapping> file =
+        std::make_shared<matrix_detail::FileMapping>(path, mode == MatrixMapMode::Shared);
+    MatrixFileHeader h;
+    std::memcpy(&h, file->data(), std::min<std::uint64_t>(sizeof(h), file->size()));
+    matrix_detail::checkHeader<T>(h, file->size(), path);
+    T* data = h.rows * h.cols > 0 ? (T*) (file->data() + h.dataOffset) : NULL;
+    return Matrix<T>::adopt(data, (std::size_t) h.rows, (std::size_t) h.cols, file, (MatrixLayout) h.layout);
+}
+
+/*!
+ * @brief Create a matrix file of rows x columns zeros and map it shared.
+ *
+ * Everything written to the returned matrix ends up in the file, which
+ * makes it the place for the result of MatrixStream::multiply() and
+ * MatrixStream::add(). An existing file is overwritten.
+ * @exception runtime_error thrown when the file can't be created or mapped.
+ */
+template <class T>
+Matrix<T> createMatrixFile(const std::string& path, std::size_t rows, std::size_t columns) {
+    if (columns != 0 && rows > (SIZE_MAX / sizeof(T)) / columns)
+        throw std::invalid_argument("createMatrixFile: the matrix is too large.");
+    const MatrixFileHeader h = matrix_detail::makeHeader<T>(rows, columns);
+    std::shared_ptr<matrix_detail::FileMapping> file =
+        std::make_shared<matrix_detail::FileMapping>(path, h.dataOffset + (std::uint64_t) rows * columns * sizeof(T));
+    std::memcpy(file->data(), &h, sizeof(h));
+    T* data = rows * columns > 0 ? (T*) (file->data() + h.dataOffset) : NULL;
+    return Matrix<T>::adopt(data, rows, columns, file);
+}
+
+// --------------------------------------------------------------------------
+// out-of-core operations
+// --------------------------------------------------------------------------
+
+/*!
+ * @class MatrixStream
+ * @brief Product and sum of matrices larger than memory, tile by tile.
+ *
+ * Meant for operands from mapMatrix() and a result from createMatrixFile().
+ * The work is done in tiles that together take about memoryBudget() bytes;
+ * while a tile is computed the operating system is asked to read the next
+ * tiles in the background. Each tile is an ordinary parallel product, and
+ * the tiles along the inner dimension are accumulated in order, so the
+ * result is exactly that of Matrix::multiply(..., MultiplyAlgorithm::Conventional)
+ * (the default Auto may use Strassen at these sizes, see matrix_strassen.h).
+ * @code{.cpp}
+ * MatrixStream::setMemoryBudget(size_t(4) << 30);   // 4GB of tiles
+ * Matrix<double> A = mapMatrix<double>("a.mat");
+ * Matrix<double> B = mapMatrix<double>("b.mat");
+ * Matrix<double> C = createMatrixFile<double>("c.mat", A.rows(), B.cols());
+ * MatrixStream::multiply(A, B, C);
+ * @endcode
+ * Works for matrices in memory too, but then it is only slower than multiply().
+ */
+class MatrixStream {
+public:
+    /*!
+     * @brief Set the memory the tiles of one operation may take, in bytes (default 1GB).
+     */
+    static void setMemoryBudget(std::size_t bytes) {
+        budgetRef().store(bytes, std::memory_order_relaxed);
+    }
+
+    /*!
+     * @brief See setMemoryBudget()
+     */
+    static std::size_t memoryBudget() {
+        return budgetRef().load(std::memory_order_relaxed);
+    }
+
+    /*!
+     * @brief out = a * b, out must already have the right size.
+     * @exception invalid_argument thrown when the sizes don't match or out
+     *            shares memory with a or b.
+     */
+    template <class T>
+    static void multiply(const ConstMatrixView<T>& a, const ConstMatrixView<T>& b, const MatrixView<T>& out) {
+        if (a.cols() != b.rows())
+            throw std::invalid_argument("Multiplication: matrices sizes don't alow multiplication.");
+        if (out.rows() != a.rows() || out.cols() != b.cols())
+            throw std::invalid_argument("Multiplication: the result has the wrong size.");
+        if (matrix_detail::overlaps(a, out) || matrix_detail::overlaps(b, out))
+            throw std::invalid_argument("MatrixStream: the result can't share memory with an operand.");
+        const std::size_t m = a.rows(), n = b.cols(), k = a.cols();
+        matrix_detail::OpScope scope(MatrixOp::Multiply, 2 * m * n * k);
+        if (m == 0 || n == 0)
+            return;
+        if (k == 0) {
+            out.fill(T(0));
+            return;
+        }
+        const std::size_t t = tile<T>();
+        for (std::size_t i0 = 0; i0 < m; i0 += t) {
+            const std::size_t mb = (std::min)(t, m - i0);
+            for (std::size_t j0 = 0; j0 < n; j0 += t) {
+                const std::size_t nb = (std::min)(t, n - j0);
+                for (std::size_t k0 = 0; k0 < k; k0 += t) {
+                    const std::size_t kb = (std::min)(t, k - k0);
+                    // the tiles after this one, in the order of the loops
+                    std::size_t ni = i0, nj = j0, nk = k0 + t;
+                    if (nk >= k) {
+                        nk = 0;
+                        nj += t;
+                        if (nj >= n) {
+                            nj = 0;
+                            ni += t;
+                        }
+                    }
+                    if (ni < m) {
+                        matrix_detail::prefetch(a.block(ni, nk, (std::min)(t, m - ni), (std::min)(t, k - nk)));
+                        matrix_detail::prefetch(b.block(nk, nj, (std::min)(t, k - nk), (std::min)(t, n - nj)));
+                        if (nk == 0)
+                            matrix_detail::prefetch<T>(out.block(ni, nj, (std::min)(t, m - ni), (std::min)(t, n - nj)));
+                    }
+                    const ConstMatrixView<T> at = a.block(i0, k0, mb, kb), bt = b.block(k0, j0, kb, nb);
+                    const MatrixView<T> ot = out.block(i0, j0, mb, nb);
+                    matrix_detail::gemmStrided<T>(mb, nb, kb,
+                                                  at.data(), matrix_detail::rowStep(at), matrix_detail::colStep(at),
+                                                  bt.data(), matrix_detail::rowStep(bt), matrix_detail::colStep(bt),
+                                                  ot.data(), matrix_detail::rowStep<T>(ot), matrix_detail::colStep<T>(ot),
+                                                  k0 > 0);
+                }
+            }
+        }
+    }
+
+    template <class T, class A1, class A2, class A3>
+    static void multiply(const Matrix<T, A1>& a, const Matrix<T, A2>& b, Matrix<T, A3>& out) {
+        multiply(ConstMatrixView<T>(a), ConstMatrixView<T>(b), MatrixView<T>(out));
+    }
+
+    /*!
+     * @brief out = a + b, out must already have the right size and may be a or b.
+     * @exception invalid_argument thrown when the sizes don't match.
+     */
+    template <class T>
+    static void add(const ConstMatrixView<T>& a, const ConstMatrixView<T>& b, const MatrixView<T>& out) {
+        if (a.rows() != b.rows() || a.cols() != b.cols() || a.rows() != out.rows() || a.cols() != out.cols())
+            throw std::invalid_argument("Addition: matrices must have the same size.");
+        if (a.cols() == 0)
+            return;
+        matrix_detail::OpScope scope(MatrixOp::Add, a.rows() * a.cols());
+        // three panels of whole rows
+        const std::size_t rowBytes = 3 * a.cols() * sizeof(T);
+        const std::size_t panel = (std::max<std::size_t>)(1, memoryBudget() / rowBytes);
+        for (std::size_t r0 = 0; r0 < a.rows(); r0 += panel) {
+            const std::size_t rows = (std::min)(panel, a.rows() - r0);
+            const std::size_t next = r0 + panel;
+            if (next < a.rows()) {
+                const std::size_t nr = (std::min)(panel, a.rows() - next);
+                matrix_detail::prefetch(a.block(next, 0, nr, a.cols()));
+                matrix_detail::prefetch(b.block(next, 0, nr, b.cols()));
+                matrix_detail::prefetch<T>(out.block(next, 0, nr, out.cols()));
+            }
+            matrix_detail::viewAdd(a.block(r0, 0, rows, a.cols()), b.block(r0, 0, rows, b.cols()),
+                                   out.block(r0, 0, rows, out.cols()));
+        }
+    }
+
+    template <class T, class A1, class A2, class A3>
+    static void add(const Matrix<T, A1>& a, const Matrix<T, A2>& b, Matrix<T, A3>& out) {
+        add(ConstMatrixView<T>(a), ConstMatrixView<T>(b), MatrixView<T>(out));
+    }
+
+private:
+    static std::atomic<std::size_t>& budgetRef() {
+        static std::atomic<std::size_t> budget(std::size_t(1) << 30);
+        return budget;
+    }
+
+    // side of the square tiles: three of them fit in the budget, a multiple of 64
+    template <class T>
+    static std::size_t tile() {
+        const std::size_t t = (std::size_t) std::sqrt((double) memoryBudget() / (3 * sizeof(T)));
+        return (std::max<std::size_t>)(64, t / 64 * 64);
+    }
+};
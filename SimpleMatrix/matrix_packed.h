@@ -0,0 +1,886 @@
+/*!
+ * @file matrix_packed.h
+ * @author Tony Andrioli, The Hague University of Applied Sciences
+ * @date June 2022
+ *
+ * Packed storage for structured matrices: symmetric, upper or lower
+ * triangular and banded.
+ *
+ * Only the elements that can be non-zero (or, for a symmetric matrix, one
+ * triangle) are stored, so a symmetric or triangular n x n matrix takes
+ * n(n+1)/2 elements instead of n*n, and a banded one kl+ku+1 per row.
+ * @code{.cpp}
+ * SymmetricMatrix<double> g = syrk(a);              // a*transpose(a), only one triangle computed
+ * TriangularMatrix<double> l(dense, Triangle::Lower);
+ * BandMatrix<double> t(dense, 1, 1);                // tridiagonal
+ * Matrix<double> c = g * b, d = b * l, e = t * b;   // packed x dense, dense x packed
+ * Matrix<double> full = g.toDense();
+ * @endcode
+ * Products with a dense matrix go by blocks of PACKED_BLOCK rows (or
+ * columns): the block is unpacked, without the columns (rows) that are zero
+ * anyway, and multiplied with the cache blocked, multithreaded kernel of
+ * matrix_gemm.h. A triangular product so costs about half a dense one.
+ * Narrow bands are multiplied directly, element by element of the band.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "matrix_alloc.h"
+#include "matrix_gemm.h"
+#include "matrix_parallel.h"
+#include "matrix_profile.h"
+#include "matrix_view.h"
+#include "matrix_solve.h"
+
+namespace matrix_detail {
+
+    // rows (columns) of a packed matrix unpacked at a time for a product
+    const std::size_t PACKED_BLOCK = 64;
+
+    template <class T, class P, class Alloc>
+    Matrix<T> packedTimesDense(const P& packed, const Matrix<T, Alloc>& dense);
+
+} // namespace matrix_detail
+
+/*!
+ * @class SymmetricMatrix
+ * @brief Symmetric n x n matrix, of which only the lower triangle is stored.
+ *
+ * The triangle is packed row by row: element (i, j), j <= i, is at
+ * i*(i+1)/2 + j of values(). That is the order of LAPACK's upper packed
+ * storage ('U', column major). Element (i, j) and (j, i) are the same
+ * element, setting one sets the other.
+ */
+template <class T>
+class SymmetricMatrix {
+public:
+    typedef T value_type;
+
+    // ----------------------------------------------------------------------
+    // constructors
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief Constructs an empty (0 x 0) matrix
+     */
+    SymmetricMatrix() : n(0) {}
+
+    /*!
+     * @brief An n x n matrix with only zeros
+     */
+    explicit SymmetricMatrix(std::size_t size) : n(size), val(size * (size + 1) / 2, T(0)) {}
+
+    /*!
+     * @brief Convert a dense matrix, only its lower triangle is read.
+     * @exception invalid_argument thrown when dense isn't square.
+     */
+    template <class Alloc>
+    explicit SymmetricMatrix(const Matrix<T, Alloc>& dense) : n(dense.rows()) {
+        if (dense.rows() != dense.cols())
+            throw std::invalid_argument("SymmetricMatrix: the matrix must be square.");
+        Matrix<T, Alloc> copy;
+        const T* d = matrix_detail::rowMajor(dense, copy).data();
+        val.resize(n * (n + 1) / 2);
+        for (std::size_t i = 0; i < n; i++)
+            std::copy(d + i * n, d + i * n + i + 1, val.begin() + start(i));
+    }
+
+    // ----------------------------------------------------------------------
+    // getters and setters
+    // ----------------------------------------------------------------------
+
+    std::size_t rows() const { return n; }
+    std::size_t cols() const { return n; }
+
+    /*!
+     * @brief The packed lower triangle, n(n+1)/2 elements
+     */
+    const std::vector<T>& values() const { return val; }
+
+    /*!
+     * @brief Get one element
+     * @exception invalid_argument thrown when row or col is out of bounds.
+     */
+    T get(std::size_t row, std::size_t col) const {
+        if (row >= n || col >= n)
+            throw std::invalid_argument("Get: out of bounds");
+        return row >= col ? val[start(row) + col] : val[start(col) + row];
+    }
+
+    /*!
+     * @brief Set element (row, col) and (col, row)
+     * @exception invalid_argument thrown when row or col is out of bounds.
+     */
+    void set(std::size_t row, std::size_t col, T value) {
+        if (row >= n || col >= n)
+            throw std::invalid_argument("Set: out of bounds");
+        val[row >= col ? start(row) + col : start(col) + row] = value;
+    }
+
+    /*!
+     * @brief Columns [c0, c1) are the ones rows [r0, r1) can have non-zeros
+     *        in, and the other way around; for the products.
+     */
+    void nonZeroColumns(std::size_t, std::size_t, std::size_t& c0, std::size_t& c1) const { c0 = 0; c1 = n; }
+    void nonZeroRows(std::size_t, std::size_t, std::size_t& r0, std::size_t& r1) const { r0 = 0; r1 = n; }
+
+    /*!
+     * @brief Unpack rows [r0, r1) x columns [c0, c1) into dst, row major
+     *        with ld elements per row.
+     */
+    void copyBlock(std::size_t r0, std::size_t r1, std::size_t c0, std::size_t c1, T* dst, std::size_t ld) const {
+        for (std::size_t i = r0; i < r1; i++) {
+            const T* src = val.data() + start(i);
+            T* d = dst + (i - r0) * ld;
+            for (std::size_t j = c0; j < c1 && j <= i; j++)
+                d[j - c0] = src[j];
+        }
+        // above the diagonal: row j of the stored triangle is column j
+        for (std::size_t j = (std::max)(c0, r0 + 1); j < c1; j++) {
+            const T* src = val.data() + start(j);
+            T* d = dst + (j - c0);
+            for (std::size_t i = r0; i < r1 && i < j; i++)
+                d[(i - r0) * ld] = src[i];
+        }
+    }
+
+    /*!
+     * @brief A dense copy, both triangles filled in
+     */
+    Matrix<T> toDense() const {
+        Matrix<T> ret(n, n, MatrixInit::Uninitialized);
+        copyBlock(0, n, 0, n, ret.data(), n);
+        return ret;
+    }
+
+    // ----------------------------------------------------------------------
+    // operations
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief c = alpha*op(a)*transpose(op(a)) + beta*c, the syrk of BLAS
+     *
+     * op(a) is a (n x k, the result is n x n) or its transpose (see
+     * Transpose), read in place. Only the lower triangle of the product is
+     * computed, by blocks of PACKED_BLOCK rows with the kernel of
+     * matrix_gemm.h, so it costs about half of a*transpose(a). With beta = 0
+     * the old contents of c aren't read and c is resized when needed;
+     * otherwise it must have the size of the product already.
+     * @exception invalid_argument thrown when c has the wrong size.
+     */
+    template <class Alloc>
+    static void syrk(T alpha, const Matrix<T, Alloc>& a, Transpose trans, T beta, SymmetricMatrix& c) {
+        const bool t = trans == Transpose::Yes;
+        const std::size_t size = t ? a.cols() : a.rows();
+        const std::size_t k = t ? a.rows() : a.cols();
+        if (beta == T(0)) {
+            if (c.n != size)
+                c = SymmetricMatrix(size);
+        } else if (c.n != size) {
+            throw std::invalid_argument("syrk: the result has the wrong size.");
+        }
+        const ConstMatrixView<T> v = a.view();
+        const std::ptrdiff_t rs = t ? matrix_detail::colStep(v) : matrix_detail::rowStep(v);
+        const std::ptrdiff_t cs = t ? matrix_detail::rowStep(v) : matrix_detail::colStep(v);
+        matrix_detail::OpScope scope(MatrixOp::Multiply, size * (size + 1) * k);
+        const std::size_t nb = matrix_detail::PACKED_BLOCK;
+        matrix_detail::ScratchBuffer<T> panel((std::min)(nb, size) * size);
+        T* w = panel.data();
+        for (std::size_t i0 = 0; i0 < size; i0 += nb) {
+            // rows [i0, i1) of the product, up to the diagonal block
+            const std::size_t i1 = (std::min)(size, i0 + nb);
+            if (k == 0 || alpha == T(0))
+                std::fill(w, w + (i1 - i0) * i1, T(0));
+            else
+                matrix_detail::gemmStrided<T>(i1 - i0, i1, k, v.data() + i0 * rs, rs, cs, v.data(), cs, rs,
+                                              w, (std::ptrdiff_t)i1, 1, false, alpha);
+            for (std::size_t i = i0; i < i1; i++) {
+                T* row = c.val.data() + start(i);
+                const T* src = w + (i - i0) * i1;
+                if (beta == T(0)) {
+                    std::copy(src, src + i + 1, row);
+                } else {
+                    MATRIX_IVDEP
+                    for (std::size_t j = 0; j <= i; j++)
+                        row[j] = beta * row[j] + src[j];
+                }
+            }
+        }
+    }
+
+    /*!
+     * @brief Symmetric times dense: this * dense, see matrix_packed.h
+     * @exception invalid_argument thrown when the sizes don't fit.
+     */
+    template <class Alloc>
+    Matrix<T> multiply(const Matrix<T, Alloc>& dense) const {
+        return matrix_detail::packedTimesDense(*this, dense);
+    }
+
+    /*!
+     * @brief Multiply every element with a scalar, inplace
+     */
+    void multiplyInPlace(T scalar) {
+        for (std::size_t k = 0; k < val.size(); k++)
+            val[k] *= scalar;
+    }
+
+    /*! @brief equality operator
+     */
+    bool operator== (const SymmetricMatrix& other) const {
+        return n == other.n && val == other.val;
+    }
+
+    /*! @brief print the matrix to cout, for debug purposes.
+     */
+    void debug() const {
+        for (std::size_t r = 0; r < n; r++) {
+            for (std::size_t c = 0; c < n; c++)
+                std::cout << get(r, c) << " ";
+            std::cout << std::endl;
+        }
+    }
+
+private:
+    std::size_t n;
+    std::vector<T> val;     // the lower triangle, row by row
+
+    // where row i of the triangle starts
+    static std::size_t start(std::size_t i) { return i * (i + 1) / 2; }
+};
+
+/*!
+ * @class TriangularMatrix
+ * @brief Upper or lower triangular n x n matrix, only the triangle (with
+ *        the diagonal) is stored.
+ *
+ * The triangle is packed row by row: row i of a lower matrix holds columns
+ * 0 .. i, of an upper one columns i .. n-1. The elements on the other side
+ * of the diagonal are zero and can't be set.
+ */
+template <class T>
+class TriangularMatrix {
+public:
+    typedef T value_type;
+
+    // ----------------------------------------------------------------------
+    // constructors
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief Constructs an empty (0 x 0) matrix
+     */
+    TriangularMatrix() : n(0), uplo(Triangle::Lower) {}
+
+    /*!
+     * @brief An n x n matrix with only zeros
+     */
+    TriangularMatrix(std::size_t size, Triangle triangle)
+        : n(size), uplo(triangle), val(size * (size + 1) / 2, T(0)) {}
+
+    /*!
+     * @brief Convert a dense matrix, the elements outside the triangle are
+     *        left out.
+     * @exception invalid_argument thrown when dense isn't square.
+     */
+    template <class Alloc>
+    TriangularMatrix(const Matrix<T, Alloc>& dense, Triangle triangle) : n(dense.rows()), uplo(triangle) {
+        if (dense.rows() != dense.cols())
+            throw std::invalid_argument("TriangularMatrix: the matrix must be square.");
+        Matrix<T, Alloc> copy;
+        const T* d = matrix_detail::rowMajor(dense, copy).data();
+        val.resize(n * (n + 1) / 2);
+        for (std::size_t i = 0; i < n; i++) {
+            const std::size_t lo = uplo == Triangle::Lower ? 0 : i, hi = uplo == Triangle::Lower ? i + 1 : n;
+            std::copy(d + i * n + lo, d + i * n + hi, val.begin() + offset(i, lo));
+        }
+    }
+
+    // ----------------------------------------------------------------------
+    // getters and setters
+    // ----------------------------------------------------------------------
+
+    std::size_t rows() const { return n; }
+    std::size_t cols() const { return n; }
+
+    Triangle triangle() const { return uplo; }
+
+    /*!
+     * @brief The packed triangle, n(n+1)/2 elements
+     */
+    const std::vector<T>& values() const { return val; }
+
+    /*!
+     * @brief Get one element, zero outside the triangle
+     * @exception invalid_argument thrown when row or col is out of bounds.
+     */
+    T get(std::size_t row, std::size_t col) const {
+        if (row >= n || col >= n)
+            throw std::invalid_argument("Get: out of bounds");
+        return inside(row, col) ? val[offset(row, col)] : T(0);
+    }
+
+    /*!
+     * @brief Set one element; outside the triangle only zero can be set
+     *        (which changes nothing).
+     * @exception invalid_argument thrown when row or col is out of bounds,
+     *            or a non-zero is set outside the triangle.
+     */
+    void set(std::size_t row, std::size_t col, T value) {
+        if (row >= n || col >= n)
+            throw std::invalid_argument("Set: out of bounds");
+        if (inside(row, col))
+            val[offset(row, col)] = value;
+        else if (value != T(0))
+            throw std::invalid_argument("Set: outside the triangle");
+    }
+
+    /*!
+     * @brief Columns [c0, c1) are the ones rows [r0, r1) can have non-zeros
+     *        in, and the other way around; for the products.
+     */
+    void nonZeroColumns(std::size_t r0, std::size_t r1, std::size_t& c0, std::size_t& c1) const {
+        c0 = uplo == Triangle::Lower ? 0 : r0;
+        c1 = uplo == Triangle::Lower ? r1 : n;
+    }
+    void nonZeroRows(std::size_t c0, std::size_t c1, std::size_t& r0, std::size_t& r1) const {
+        r0 = uplo == Triangle::Lower ? c0 : 0;
+        r1 = uplo == Triangle::Lower ? n : c1;
+    }
+
+    /*!
+     * @brief Unpack rows [r0, r1) x columns [c0, c1) into dst, row major
+     *        with ld elements per row.
+     */
+    void copyBlock(std::size_t r0, std::size_t r1, std::size_t c0, std::size_t c1, T* dst, std::size_t ld) const {
+        for (std::size_t i = r0; i < r1; i++) {
+            T* d = dst + (i - r0) * ld;
+            std::fill(d, d + (c1 - c0), T(0));
+            const std::size_t lo = (std::max)(c0, uplo == Triangle::Lower ? 0 : i);
+            const std::size_t hi = (std::min)(c1, uplo == Triangle::Lower ? i + 1 : n);
+            if (lo < hi)
+                std::copy(val.begin() + offset(i, lo), val.begin() + offset(i, lo) + (hi - lo), d + (lo - c0));
+        }
+    }
+
+    /*!
+     * @brief A dense copy, with the zeros
+     */
+    Matrix<T> toDense() const {
+        Matrix<T> ret(n, n, MatrixInit::Uninitialized);
+        copyBlock(0, n, 0, n, ret.data(), n);
+        return ret;
+    }
+
+    // ----------------------------------------------------------------------
+    // operations
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief Triangular times dense: this * dense, about half the work of
+     *        a dense product, see matrix_packed.h
+     * @exception invalid_argument thrown when the sizes don't fit.
+     */
+    template <class Alloc>
+    Matrix<T> multiply(const Matrix<T, Alloc>& dense) const {
+        return matrix_detail::packedTimesDense(*this, dense);
+    }
+
+    /*!
+     * @brief Multiply every element with a scalar, inplace
+     */
+    void multiplyInPlace(T scalar) {
+        for (std::size_t k = 0; k < val.size(); k++)
+            val[k] *= scalar;
+    }
+
+    /*! @brief equality operator, an upper and a lower matrix are only equal
+     *         when both are diagonal
+     */
+    bool operator== (const TriangularMatrix& other) const {
+        if (n != other.n)
+            return false;
+        if (uplo == other.uplo)
+            return val == other.val;
+        for (std::size_t i = 0; i < n; i++)
+            for (std::size_t j = 0; j < n; j++)
+                if (get(i, j) != other.get(i, j))
+                    return false;
+        return true;
+    }
+
+    /*! @brief print the matrix to cout, for debug purposes.
+     */
+    void debug() const {
+        for (std::size_t r = 0; r < n; r++) {
+            for (std::size_t c = 0; c < n; c++)
+                std::cout << get(r, c) << " ";
+            std::cout << std::endl;
+        }
+    }
+
+private:
+    std::size_t n;
+    Triangle uplo;
+    std::vector<T> val;     // the triangle, row by row
+
+    bool inside(std::size_t row, std::size_t col) const {
+        return uplo == Triangle::Lower ? col <= row : col >= row;
+    }
+
+    // position of (row, col), inside the triangle
+    std::size_t offset(std::size_t row, std::size_t col) const {
+        if (uplo == Triangle::Lower)
+            return row * (row + 1) / 2 + col;
+        return row * (2 * n - row + 1) / 2 + (col - row);
+    }
+};
+
+/*!
+ * @class BandMatrix
+ * @brief rows x cols matrix with kl diagonals below the main diagonal and
+ *        ku above it; the elements outside the band are zero.
+ *
+ * Every row stores kl+ku+1 elements, columns i-kl .. i+ku of row i, so
+ * element (i, j) is at i*(kl+ku+1) + j-i+kl of values(). Positions that
+ * fall outside the matrix (at the top and bottom) are kept zero. This is
+ * LAPACK's band storage, by rows instead of by columns.
+ */
+template <class T>
+class BandMatrix {
+public:
+    typedef T value_type;
+
+    // ----------------------------------------------------------------------
+    // constructors
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief Constructs an empty (0 x 0) matrix
+     */
+    BandMatrix() : r(0), c(0), kl(0), ku(0) {}
+
+    /*!
+     * @brief A rows x columns matrix with only zeros
+     * @param lower the number of diagonals below the main diagonal
+     * @param upper the number of diagonals above it
+     */
+    BandMatrix(std::size_t rows, std::size_t columns, std::size_t lower, std::size_t upper)
+        : r(rows), c(columns), kl(lower), ku(upper), val(rows * (lower + upper + 1), T(0)) {}
+
+    /*!
+     * @brief Convert a dense matrix, the elements outside the band are left out.
+     */
+    template <class Alloc>
+    BandMatrix(const Matrix<T, Alloc>& dense, std::size_t lower, std::size_t upper)
+        : r(dense.rows()), c(dense.cols()), kl(lower), ku(upper), val(r * (lower + upper + 1), T(0)) {
+        Matrix<T, Alloc> copy;
+        const T* d = matrix_detail::rowMajor(dense, copy).data();
+        for (std::size_t i = 0; i < r; i++) {
+            std::size_t lo, hi;
+            span(i, lo, hi);
+            std::copy(d + i * c + lo, d + i * c + hi, val.begin() + offset(i, lo));
+        }
+    }
+
+    // ----------------------------------------------------------------------
+    // getters and setters
+    // ----------------------------------------------------------------------
+
+    std::size_t rows() const { return r; }
+    std::size_t cols() const { return c; }
+
+    /*!
+     * @brief The number of diagonals below (lower()) and above (upper())
+     *        the main diagonal
+     */
+    std::size_t lower() const { return kl; }
+    std::size_t upper() const { return ku; }
+
+    /*!
+     * @brief The band, row by row, rows*(kl+ku+1) elements
+     */
+    const std::vector<T>& values() const { return val; }
+
+    /*!
+     * @brief Get one element, zero outside the band
+     * @exception invalid_argument thrown when row or col is out of bounds.
+     */
+    T get(std::size_t row, std::size_t col) const {
+        if (row >= r || col >= c)
+            throw std::invalid_argument("Get: out of bounds");
+        return inside(row, col) ? val[offset(row, col)] : T(0);
+    }
+
+    /*!
+     * @brief Set one element; outside the band only zero can be set
+     *        (which changes nothing).
+     * @exception invalid_argument thrown when row or col is out of bounds,
+     *            or a non-zero is set outside the band.
+     */
+    void set(std::size_t row, std::size_t col, T value) {
+        if (row >= r || col >= c)
+            throw std::invalid_argument("Set: out of bounds");
+        if (inside(row, col))
+            val[offset(row, col)] = value;
+        else if (value != T(0))
+            throw std::invalid_argument("Set: outside the band");
+    }
+
+    /*!
+     * @brief Columns [c0, c1) are the ones rows [r0, r1) can have non-zeros
+     *        in, and the other way around; for the products.
+     */
+    void nonZeroColumns(std::size_t r0, std::size_t r1, std::size_t& c0, std::size_t& c1) const {
+        c0 = r0 > kl ? r0 - kl : 0;
+        c1 = (std::min)(c, r1 + ku);
+    }
+    void nonZeroRows(std::size_t c0, std::size_t c1, std::size_t& r0, std::size_t& r1) const {
+        r0 = c0 > ku ? c0 - ku : 0;
+        r1 = (std::min)(r, c1 + kl);
+    }
+
+    /*!
+     * @brief Unpack rows [r0, r1) x columns [c0, c1) into dst, row major
+     *        with ld elements per row.
+     */
+    void copyBlock(std::size_t r0, std::size_t r1, std::size_t c0, std::size_t c1, T* dst, std::size_t ld) const {
+        for (std::size_t i = r0; i < r1; i++) {
+            T* d = dst + (i - r0) * ld;
+            std::fill(d, d + (c1 - c0), T(0));
+            std::size_t lo, hi;
+            span(i, lo, hi);
+            lo = (std::max)(lo, c0);
+            hi = (std::min)(hi, c1);
+            if (lo < hi)
+                std::copy(val.begin() + offset(i, lo), val.begin() + offset(i, lo) + (hi - lo), d + (lo - c0));
+        }
+    }
+
+    /*!
+     * @brief A dense copy, with the zeros
+     */
+    Matrix<T> toDense() const {
+        Matrix<T> ret(r, c, MatrixInit::Uninitialized);
+        copyBlock(0, r, 0, c, ret.data(), c);
+        return ret;
+    }
+
+    // ----------------------------------------------------------------------
+    // operations
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief Band times dense: this * dense, O(rows * (kl+ku+1) * dense.cols())
+     *
+     * Row i of the result adds the rows of dense the band of row i picks
+     * out, the rows are split over the thread pool. Bands of PACKED_BLOCK
+     * diagonals or more go through the blocked kernel, see matrix_packed.h.
+     * @exception invalid_argument thrown when the sizes don't fit.
+     */
+    template <class Alloc>
+    Matrix<T> multiply(const Matrix<T, Alloc>& dense) const {
+        if (kl + ku + 1 >= matrix_detail::PACKED_BLOCK)
+            return matrix_detail::packedTimesDense(*this, dense);
+        if (c != dense.rows())
+            throw std::invalid_argument("Multiplication: matrices sizes don't alow multiplication.");
+        const std::size_t n = dense.cols(), w = kl + ku + 1;
+        Matrix<T> ret(r, n);
+        T* out = ret.data();
+        Matrix<T, Alloc> copy;
+        const T* b = matrix_detail::rowMajor(dense, copy).data();
+        const T* v = val.data();
+        matrix_detail::OpScope scope(MatrixOp::Multiply, 2 * val.size() * n);
+        const std::size_t grain = (std::max)((std::size_t)1, (std::size_t)4096 / (w * n + 1));
+        matrix_detail::parallelFor(0, r, grain, val.size() * n / 16, [=](std::size_t lo, std::size_t hi) {
+            for (std::size_t i = lo; i < hi; i++) {
+                T* crow = out + i * n;
+                std::size_t j0, j1;
+                span(i, j0, j1);
+                for (std::size_t j = j0; j < j1; j++) {
+                    const T a = v[i * w + j + kl - i];
+                    const T* brow = b + j * n;
+                    MATRIX_IVDEP
+                    for (std::size_t q = 0; q < n; q++)
+                        crow[q] += a * brow[q];
+                }
+            }
+        });
+        return ret;
+    }
+
+    /*!
+     * @brief Multiply every element with a scalar, inplace
+     */
+    void multiplyInPlace(T scalar) {
+        for (std::size_t k = 0; k < val.size(); k++)
+            val[k] *= scalar;
+    }
+
+    /*! @brief equality operator, compares the elements, not the width of the band
+     */
+    bool operator== (const BandMatrix& other) const {
+        if (r != other.r || c != other.c)
+            return false;
+        if (kl == other.kl && ku == other.ku)
+            return val == other.val;
+        for (std::size_t i = 0; i < r; i++)
+            for (std::size_t j = 0; j < c; j++)
+                if (get(i, j) != other.get(i, j))
+                    return false;
+        return true;
+    }
+
+    /*! @brief print the matrix to cout, for debug purposes.
+     */
+    void debug() const {
+        for (std::size_t i = 0; i < r; i++) {
+            for (std::size_t j = 0; j < c; j++)
+                std::cout << get(i, j) << " ";
+            std::cout << std::endl;
+        }
+    }
+
+private:
+    std::size_t r, c;
+    std::size_t kl, ku;     // diagonals below and above the main diagonal
+    std::vector<T> val;     // kl+ku+1 elements per row
+
+    bool inside(std::size_t row, std::size_t col) const {
+        return col + kl >= row && col <= row + ku;
+    }
+
+    // position of (row, col), inside the band
+    std::size_t offset(std::size_t row, std::size_t col) const {
+        return row * (kl + ku + 1) + col + kl - row;
+    }
+
+    // the columns [lo, hi) of row i inside the band and the matrix
+    void span(std::size_t i, std::size_t& lo, std::size_t& hi) const {
+        lo = (std::min)(c, i > kl ? i - kl : 0);
+        hi = (std::max)(lo, (std::min)(c, i + ku + 1));
+    }
+
+    template <class U, class Alloc>
+    friend Matrix<U> operator* (const Matrix<U, Alloc>& dense, const BandMatrix<U>& band);
+};
+
+namespace matrix_detail {
+
+    /*!
+     * @brief packed * dense for the packed types of matrix_packed.h.
+     *
+     * By blocks of PACKED_BLOCK rows of the packed matrix: the columns of
+     * the block that can hold non-zeros are unpacked and multiplied with
+     * the matching rows of dense, straight into the result.
+     */
+    template <class T, class P, class Alloc>
+    Matrix<T> packedTimesDense(const P& packed, const Matrix<T, Alloc>& dense) {
+        if (packed.cols() != dense.rows())
+            throw std::invalid_argument("Multiplication: matrices sizes don't alow multiplication.");
+        const std::size_t m = packed.rows(), n = dense.cols(), nb = PACKED_BLOCK;
+        Matrix<T> ret(m, n);
+        const ConstMatrixView<T> b = dense.view();
+        const std::ptrdiff_t rsb = rowStep(b), csb = colStep(b);
+        std::size_t flops = 0;
+        for (std::size_t i0 = 0; i0 < m; i0 += nb) {
+            std::size_t c0, c1;
+            packed.nonZeroColumns(i0, (std::min)(m, i0 + nb), c0, c1);
+            flops += 2 * ((std::min)(m, i0 + nb) - i0) * (c1 - c0) * n;
+        }
+        OpScope scope(MatrixOp::Multiply, flops);
+        if (n == 0)
+            return ret;
+        ScratchBuffer<T> panel((std::min)(nb, m) * packed.cols());
+        for (std::size_t i0 = 0; i0 < m; i0 += nb) {
+            const std::size_t i1 = (std::min)(m, i0 + nb);
+            std::size_t c0, c1;
+            packed.nonZeroColumns(i0, i1, c0, c1);
+            if (c0 >= c1)
+                continue;
+            packed.copyBlock(i0, i1, c0, c1, panel.data(), c1 - c0);
+            gemmStrided<T>(i1 - i0, n, c1 - c0, panel.data(), (std::ptrdiff_t)(c1 - c0), 1,
+                           b.data() + c0 * rsb, rsb, csb, ret.data() + i0 * n, (std::ptrdiff_t)n, 1);
+        }
+        return ret;
+    }
+
+    /*!
+     * @brief dense * packed for the packed types of matrix_packed.h, by
+     *        blocks of PACKED_BLOCK columns, see packedTimesDense()
+     */
+    template <class T, class Alloc, class P>
+    Matrix<T> denseTimesPacked(const Matrix<T, Alloc>& dense, const P& packed) {
+        if (dense.cols() != packed.rows())
+            throw std::invalid_argument("Multiplication: matrices sizes don't alow multiplication.");
+        const std::size_t m = dense.rows(), n = packed.cols(), nb = PACKED_BLOCK;
+        Matrix<T> ret(m, n);
+        const ConstMatrixView<T> a = dense.view();
+        const std::ptrdiff_t rsa = rowStep(a), csa = colStep(a);
+        std::size_t flops = 0;
+        for (std::size_t j0 = 0; j0 < n; j0 += nb) {
+            std::size_t r0, r1;
+            packed.nonZeroRows(j0, (std::min)(n, j0 + nb), r0, r1);
+            flops += 2 * m * (r1 - r0) * ((std::min)(n, j0 + nb) - j0);
+        }
+        OpScope scope(MatrixOp::Multiply, flops);
+        if (m == 0)
+            return ret;
+        ScratchBuffer<T> panel(packed.rows() * (std::min)(nb, n));
+        for (std::size_t j0 = 0; j0 < n; j0 += nb) {
+            const std::size_t j1 = (std::min)(n, j0 + nb);
+            std::size_t r0, r1;
+            packed.nonZeroRows(j0, j1, r0, r1);
+            if (r0 >= r1)
+                continue;
+            packed.copyBlock(r0, r1, j0, j1, panel.data(), j1 - j0);
+            gemmStrided<T>(m, j1 - j0, r1 - r0, a.data() + r0 * csa, rsa, csa,
+                           panel.data(), (std::ptrdiff_t)(j1 - j0), 1, ret.data() + j0, (std::ptrdiff_t)n, 1);
+        }
+        return ret;
+    }
+
+    // ret = packed + dense, the sizes checked
+    template <class T, class Alloc, class P>
+    Matrix<T, Alloc> addPacked(const P& packed, const Matrix<T, Alloc>& dense) {
+        if (packed.rows() != dense.rows() || packed.cols() != dense.cols())
+            throw std::invalid_argument("Addition: matrices must have the same size.");
+        Matrix<T, Alloc> ret(dense.rows(), dense.cols(), MatrixInit::Uninitialized);
+        packed.copyBlock(0, ret.rows(), 0, ret.cols(), ret.data(), ret.cols());
+        ret.addInPlace(dense);
+        return ret;
+    }
+
+} // namespace matrix_detail
+
+/*!
+ * @brief a*transpose(a) (Transpose::No) or transpose(a)*a (Transpose::Yes),
+ *        see SymmetricMatrix::syrk()
+ */
+template <class T, class Alloc>
+SymmetricMatrix<T> syrk(const Matrix<T, Alloc>& a, Transpose trans = Transpose::No) {
+    SymmetricMatrix<T> ret;
+    SymmetricMatrix<T>::syrk(T(1), a, trans, T(0), ret);
+    return ret;
+}
+
+/*!
+ * @brief Symmetric times dense, see SymmetricMatrix::multiply()
+ */
+template <class T, class Alloc>
+Matrix<T> operator* (const SymmetricMatrix<T>& packed, const Matrix<T, Alloc>& dense) {
+    return packed.multiply(dense);
+}
+
+/*!
+ * @brief Dense times symmetric
+ * @exception invalid_argument thrown when the sizes don't fit.
+ */
+template <class T, class Alloc>
+Matrix<T> operator* (const Matrix<T, Alloc>& dense, const SymmetricMatrix<T>& packed) {
+    return matrix_detail::denseTimesPacked(dense, packed);
+}
+
+/*!
+ * @brief Triangular times dense, see TriangularMatrix::multiply()
+ */
+template <class T, class Alloc>
+Matrix<T> operator* (const TriangularMatrix<T>& packed, const Matrix<T, Alloc>& dense) {
+    return packed.multiply(dense);
+}
+
+/*!
+ * @brief Dense times triangular, about half the work of a dense product
+ * @exception invalid_argument thrown when the sizes don't fit.
+ */
+template <class T, class Alloc>
+Matrix<T> operator* (const Matrix<T, Alloc>& dense, const TriangularMatrix<T>& packed) {
+    return matrix_detail::denseTimesPacked(dense, packed);
+}
+
+/*!
+ * @brief Band times dense, see BandMatrix::multiply()
+ */
+template <class T, class Alloc>
+Matrix<T> operator* (const BandMatrix<T>& band, const Matrix<T, Alloc>& dense) {
+    return band.multiply(dense);
+}
+
+/*!
+ * @brief Dense times band, O(dense.rows() * band.rows() * (kl+ku+1))
+ *
+ * Row i of the result adds, for every k, dense(i,k) times the band of row
+ * k. Rows are split over the thread pool.
+ * @exception invalid_argument thrown when the sizes don't fit.
+ */
+template <class T, class Alloc>
+Matrix<T> operator* (const Matrix<T, Alloc>& dense, const BandMatrix<T>& band) {
+    const std::size_t w = band.kl + band.ku + 1;
+    if (w >= matrix_detail::PACKED_BLOCK)
+        return matrix_detail::denseTimesPacked(dense, band);
+    if (dense.cols() != band.r)
+        throw std::invalid_argument("Multiplication: matrices sizes don't alow multiplication.");
+    const std::size_t m = dense.rows(), k = dense.cols(), n = band.c;
+    Matrix<T> ret(m, n);
+    T* out = ret.data();
+    Matrix<T, Alloc> copy;
+    const T* a = matrix_detail::rowMajor(dense, copy).data();
+    const T* v = band.val.data();
+    const std::size_t kl = band.kl;
+    matrix_detail::OpScope scope(MatrixOp::Multiply, 2 * m * band.val.size());
+    matrix_detail::parallelFor(0, m, 1, m * band.val.size() / 16, [=, &band](std::size_t lo, std::size_t hi) {
+        for (std::size_t i = lo; i < hi; i++) {
+            T* crow = out + i * n;
+            for (std::size_t kk = 0; kk < k; kk++) {
+                const T aik = a[i * k + kk];
+                std::size_t j0, j1;
+                band.span(kk, j0, j1);
+                const T* brow = v + kk * w + kl - kk;
+                MATRIX_IVDEP
+                for (std::size_t j = j0; j < j1; j++)
+                    crow[j] += aik * brow[j];
+            }
+        }
+    });
+    return ret;
+}
+
+/*!
+ * @brief Packed plus dense (symmetric, triangular or band), a dense result
+ * @exception invalid_argument thrown matrix dimension don't match.
+ */
+template <class T, class Alloc>
+Matrix<T, Alloc> operator+ (const SymmetricMatrix<T>& packed, const Matrix<T, Alloc>& dense) {
+    return matrix_detail::addPacked(packed, dense);
+}
+
+template <class T, class Alloc>
+Matrix<T, Alloc> operator+ (const Matrix<T, Alloc>& dense, const SymmetricMatrix<T>& packed) {
+    return matrix_detail::addPacked(packed, dense);
+}
+
+template <class T, class Alloc>
+Matrix<T, Alloc> operator+ (const TriangularMatrix<T>& packed, const Matrix<T, Alloc>& dense) {
+    return matrix_detail::addPacked(packed, dense);
+}
+
+template <class T, class Alloc>
+Matrix<T, Alloc> operator+ (const Matrix<T, Alloc>& dense, const TriangularMatrix<T>& packed) {
+    return matrix_detail::addPacked(packed, dense);
+}
+
+template <class T, class Alloc>
+Matrix<T, Alloc> operator+ (const BandMatrix<T>& packed, const Matrix<T, Alloc>& dense) {
+    return matrix_detail::addPacked(packed, dense);
+}
+
+template <class T, class Alloc>
+Matrix<T, Alloc> operator+ (const Matrix<T, Alloc>& dense, const BandMatrix<T>& packed) {
+    return matrix_detail::addPacked(packed, dense);
+}
@@ -0,0 +1,394 @@
+/*!
+ * @file matrix_parallel.h
+ * @author Tony Andrioli, The Hague University of Applied Sciences
+ * @date June 2022
+ *
+ * Work-stealing thread pool that the Matrix operations split their work over.
+ *
+ * Every worker owns a deque of tasks. A worker pushes and pops at the back of
+ * its own deque, idle workers steal from the front of the others. A thread
+ * that waits for a parallelFor keeps running tasks itself, so nested parallel
+ * calls can't deadlock the pool.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*!
+ * @class MatrixConfig
+ * @brief Global settings of the Matrix library.
+ *
+ * @code{.cpp}
+ * MatrixConfig::setThreadCount(16);          // 16 threads, caller included
+ * MatrixConfig::setParallelThreshold(1<<20); // keep smaller work serial
+ * MatrixConfig::setStrassenThreshold(0);      // never multiply with Strassen automatically
+ * @endcode
+ * Change these while no matrix operation is running.
+ */
+class MatrixConfig {
+public:
+    /*!
+     * @brief Set the number of threads an operation may use, the calling
+     *        thread included. 0 means one per hardware thread, 1 runs
+     *        everything on the calling thread.
+     */
+    static void setThreadCount(unsigned int n);
+
+    /*!
+     * @brief The number of threads an operation may use.
+     */
+    static unsigned int threadCount();
+
+    /*!
+     * @brief Operations on fewer elements than this stay on one thread.
+     *
+     * For element-wise operations and transpose this is the number of
+     * elements. A product counts its multiply-adds divided by 16.
+     */
+    static void setParallelThreshold(std::size_t elements) {
+        thresholdRef().store(elements, std::memory_order_relaxed);
+    }
+
+    /*!
+     * @brief See setParallelThreshold()
+     */
+    static std::size_t parallelThreshold() {
+        return thresholdRef().load(std::memory_order_relaxed);
+    }
+
+    /*!
+     * @brief Products of floating point matrices whose dimensions are all at
+     *        least this large use Strassen-Winograd (see matrix_strassen.h)
+     *        when multiplied with MultiplyAlgorithm::Auto. 0 switches that off.
+     */
+    static void setStrassenThreshold(std::size_t n) {
+        strassenThresholdRef().store(n, std::memory_order_relaxed);
+    }
+
+    /*!
+     * @brief See setStrassenThreshold(), 2048 by default.
+     */
+    static std::size_t strassenThreshold() {
+        return strassenThresholdRef().load(std::memory_order_relaxed);
+    }
+
+    /*!
+     * @brief Strassen-Winograd splits a product in quadrants as long as all
+     *        dimensions are larger than this, smaller products use the
+     *        conventional kernel.
+     */
+    static void setStrassenCrossover(std::size_t n) {
+        strassenCrossoverRef().store(n < 16 ? 16 : n, std::memory_order_relaxed);
+    }
+
+    /*!
+     * @brief See setStrassenCrossover(), 512 by default.
+     */
+    static std::size_t strassenCrossover() {
+        return strassenCrossoverRef().load(std::memory_order_relaxed);
+    }
+
+private:
+    static std::atomic<std::size_t>& thresholdRef() {
+        static std::atomic<std::size_t> threshold(1 << 16);
+        return threshold;
+    }
+
+    static std::atomic<std::size_t>& strassenThresholdRef() {
+        static std::atomic<std::size_t> threshold(2048);
+        return threshold;
+    }
+
+    static std::atomic<std::size_t>& strassenCrossoverRef() {
+        static std::atomic<std::size_t> crossover(512);
+        return crossover;
+    }
+};
+
+namespace matrix_detail {
+
+    /*!
+     * @brief The pool itself, one per process.
+     */
+    class ThreadPool {
+    public:
+        typedef std::function<void()> Task;
+
+        static ThreadPool& instance() {
+            static ThreadPool pool;
+            return pool;
+        }
+
+        ~ThreadPool() {
+            stop();
+        }
+
+        /*!
+         * @brief Threads available to one operation, the caller included.
+         */
+        unsigned int threadCount() const {
+            return (unsigned int)workers.size() + 1;
+        }
+
+        /*!
+         * @brief Whether the calling thread is one of the workers of the pool.
+         */
+        bool onWorker() const {
+            return current() >= 0;
+        }
+
+        /*!
+         * @brief Restart the pool with n threads (caller included).
+         */
+        void resize(unsigned int n) {
+            if (n == 0)
+                n = std::thread::hardware_concurrency();
+            if (n == 0)
+                n = 1;
+            std::lock_guard<std::mutex> lock(resizeMutex);
+            stop();
+            start(n - 1);
+        }
+
+        /*!
+         * @brief Queue a task. From a worker it goes onto its own deque,
+         *        from any other thread it's spread over the workers.
+         */
+        void submit(Task task) {
+            if (workers.empty()) {
+                task();
+                return;
+            }
+            std::size_t w = current() >= 0 ? (std::size_t)current()
+                                            : next.fetch_add(1, std::memory_order_relaxed) % workers.size();
+            queued.fetch_add(1, std::memory_order_release);
+            {
+                std::lock_guard<std::mutex> lock(workers[w]->mutex);
+                workers[w]->tasks.push_back(std::move(task));
+            }
+            // a worker between its check and its wait would miss a bare notify
+            { std::lock_guard<std::mutex> lock(sleepMutex); }
+            wakeUp.notify_one();
+        }
+
+        /*!
+         * @brief Run one queued task on the calling thread, if there is one.
+         * @return false when all deques are empty
+         */
+        bool runOne() {
+            Task task;
+            if (!take(current(), task))
+                return false;
+            task();
+            return true;
+        }
+
+        /*!
+         * @brief Call fn(b, e) on sub-ranges of [begin, end) in parallel.
+         *
+         * Ranges are split in halves down to at most grain elements, the split
+         * off halves can be stolen by idle workers. Returns when everything is
+         * done; the first exception thrown by fn is rethrown here.
+         */
+        template <class F>
+        void parallelFor(std::size_t begin, std::size_t end, std::size_t grain, const F& fn) {
+            if (grain == 0)
+                grain = 1;
+            if (end <= begin)
+                return;
+            if (workers.empty() || end - begin <= grain) {
+                fn(begin, end);
+                return;
+            }
+            Job<F> job(fn, end - begin, grain);
+            split(&job, begin, end);
+            while (job.remaining.load(std::memory_order_acquire) != 0) {
+                if (!runOne())
+                    std::this_thread::yield();
+            }
+            if (job.error)
+                std::rethrow_exception(job.error);
+        }
+
+    private:
+        struct Worker {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        template <class F>
+        struct Job {
+            Job(const F& f, std::size_t n, std::size_t g) : fn(f), remaining(n), grain(g) {}
+            const F& fn;
+            std::atomic<std::size_t> remaining;
+            std::size_t grain;
+            std::mutex errorMutex;
+            std::exception_ptr error;
+        };
+
+        template <class F>
+        void split(Job<F>* job, std::size_t b, std::size_t e) {
+            while (e - b > job->grain) {
+                std::size_t mid = b + (e - b) / 2;
+                std::size_t hi = e;
+                submit([this, job, mid, hi]() { split(job, mid, hi); });
+                e = mid;
+            }
+            try {
+                job->fn(b, e);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(job->errorMutex);
+                if (!job->error)
+                    job->error = std::current_exception();
+            }
+            job->remaining.fetch_sub(e - b, std::memory_order_acq_rel);
+        }
+
+        ThreadPool() : queued(0), next(0), stopping(false) {
+            unsigned int n = std::thread::hardware_concurrency();
+            start(n > 1 ? n - 1 : 0);
+        }
+
+        // index of the worker the calling thread is, -1 for other threads
+        static int& current() {
+            static thread_local int index = -1;
+            return index;
+        }
+
+        bool take(int self, Task& task) {
+            const std::size_t n = workers.size();
+            if (n == 0 || queued.load(std::memory_order_acquire) == 0)
+                return false;
+            // own deque first, newest task (LIFO)
+            if (self >= 0) {
+                Worker& w = *workers[self];
+                std::lock_guard<std::mutex> lock(w.mutex);
+                if (!w.tasks.empty()) {
+                    task = std::move(w.tasks.back());
+                    w.tasks.pop_back();
+                    queued.fetch_sub(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+            // steal the oldest task of somebody else (FIFO)
+            std::size_t start = self >= 0 ? (std::size_t)self + 1 : 0;
+            for (std::size_t i = 0; i < n; i++) {
+                Worker& w = *workers[(start + i) % n];
+                std::lock_guard<std::mutex> lock(w.mutex);
+                if (!w.tasks.empty()) {
+                    task = std::move(w.tasks.front());
+                    w.tasks.pop_front();
+                    queued.fetch_sub(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void loop(int self) {
+            current() = self;
+            Task task;
+            for (;;) {
+                if (take(self, task)) {
+                    task();
+                    task = Task();
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(sleepMutex);
+                wakeUp.wait(lock, [this]() {
+                    return stopping || queued.load(std::memory_order_acquire) != 0;
+                });
+                if (stopping && queued.load(std::memory_order_acquire) == 0)
+                    return;
+            }
+        }
+
+        void start(unsigned int n) {
+            stopping = false;
+            for (unsigned int i = 0; i < n; i++)
+                workers.push_back(std::unique_ptr<Worker>(new Worker()));
+            for (unsigned int i = 0; i < n; i++)
+                threads.push_back(std::thread(&ThreadPool::loop, this, (int)i));
+        }
+
+        void stop() {
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                stopping = true;
+            }
+            wakeUp.notify_all();
+            for (std::size_t i = 0; i < threads.size(); i++)
+                threads[i].join();
+            threads.clear();
+            workers.clear();
+        }
+
+        std::vector<std::unique_ptr<Worker> > workers;
+        std::vector<std::thread> threads;
+        std::atomic<std::size_t> queued;
+        std::atomic<std::size_t> next;
+        std::mutex sleepMutex;
+        std::condition_variable wakeUp;
+        bool stopping;
+        std::mutex resizeMutex;
+    };
+
+    /*!
+     * @brief parallelFor on the global pool, serial below the threshold.
+     *
+     * @param work  the size of the whole job, compared to the threshold
+     * @param grain the smallest piece fn is called on
+     */
+    template <class F>
+    void parallelFor(std::size_t begin, std::size_t end, std::size_t grain, std::size_t work, const F& fn) {
+        if (end <= begin)
+            return;
+        if (work < MatrixConfig::parallelThreshold() || end - begin <= grain) {
+            fn(begin, end);
+            return;
+        }
+        ThreadPool::instance().parallelFor(begin, end, grain, fn);
+    }
+
+    /*!
+     * @brief fn(b, e) over the n elements of a flat buffer.
+     *
+     * Chunks are at least 16KB and there are about four per thread, so
+     * stealing can even out the load without false sharing at the borders.
+     */
+    template <class F>
+    void parallelElements(std::size_t n, std::size_t elementSize, const F& fn) {
+        if (n == 0)
+            return;
+        if (n < MatrixConfig::parallelThreshold()) {
+            fn(0, n);
+            return;
+        }
+        ThreadPool& pool = ThreadPool::instance();
+        std::size_t threads = pool.threadCount();
+        std::size_t grain = n / (threads * 4) + 1;
+        std::size_t minimum = (16 * 1024) / (elementSize ? elementSize : 1);
+        grain = ((std::max)(grain, minimum) + 63) / 64 * 64;
+        pool.parallelFor(0, n, grain, fn);
+    }
+
+} // namespace matrix_detail
+
+inline void MatrixConfig::setThreadCount(unsigned int n) {
+    matrix_detail::ThreadPool::instance().resize(n);
+}
+
+inline unsigned int MatrixConfig::threadCount() {
+    return matrix_detail::ThreadPool::instance().threadCount();
+}
@@ -0,0 +1,300 @@
+/*!
+ * @file matrix_profile.h
+ * @author Tony Andrioli, The Hague University of Applied Sciences
+ * @date June 2022
+ *
+ * Counters of where the matrix time and memory go, switched on at run time.
+ *
+ * @code{.cpp}
+ * MatrixProfiler::enable();
+ * ... // the program
+ * MatrixProfile p = MatrixProfiler::snapshot();
+ * std::cout << p[MatrixOp::Multiply].calls << " products, "
+ *           << p[MatrixOp::Multiply].seconds() << " s" << std::endl;
+ * p.print(std::cout);
+ * @endcode
+ * Per kind of operation (MatrixOp) it counts the calls, floating point
+ * operations, bytes allocated and copied and the time spent, plus a
+ * histogram of the latencies. An operation that calls another one (a
+ * product through a temporary, say) counts once, as the outer one.
+ *
+ * Switched off (the default) an operation costs one relaxed atomic load
+ * extra. Switched on it costs two clock reads and a few atomic additions,
+ * which only shows on the smallest matrices. The live and peak memory of
+ * matrices is counted always, it costs an atomic addition per allocation.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <ostream>
+
+/*!
+ * @brief The kinds of operations that are counted separately
+ */
+enum class MatrixOp {
+    Multiply,       //!< matrix products
+    Add,            //!< additions, also A + B expressions
+    Hadamard,       //!< element-wise products, also hadamard() expressions
+    Scale,          //!< multiplication by a scalar, also A * s expressions
+    Expression,     //!< any other expression
+    Transpose,      //!< transpose and transposeInPlace
+    Convert,        //!< convertTo
+    Compare,        //!< operator==
+    Copy,           //!< copy construction and assignment, copies of views
+    Solve,          //!< factorizations and triangular solves (matrix_solve.h)
+    Reduce,         //!< sums, norms, minimum and maximum (matrix_reduce.h)
+    Count           //!< the number of kinds, not a kind
+};
+
+/*!
+ * @brief What one kind of operation has done, see MatrixProfile
+ */
+struct MatrixOpStats {
+    static constexpr int BUCKETS = 40;  //!< latency[i] counts calls of [2^i, 2^(i+1)) ns
+
+    std::uint64_t calls;
+    std::uint64_t flops;            //!< floating point (or integer) operations, multiply-add counts as two
+    std::uint64_t bytesAllocated;   //!< matrix memory allocated during the calls
+    std::uint64_t bytesCopied;      //!< elements copied, transposed or converted, in bytes
+    std::uint64_t nanoseconds;      //!< time spent in the calls
+    std::array<std::uint64_t, BUCKETS> latency;
+
+    double seconds() const { return nanoseconds * 1e-9; }
+
+    /*!
+     * @brief Latency under which fraction p (0..1) of the calls stay, in
+     *        nanoseconds; the upper bound of a histogram bucket.
+     */
+    std::uint64_t percentile(double p) const {
+        if (calls == 0)
+            return 0;
+        const double target = p * (double) calls;
+        std::uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+            seen += latency[i];
+            if (seen > 0 && (double) seen >= target)
+                return std::uint64_t(1) << (i + 1);
+        }
+        return std::uint64_t(1) << BUCKETS;
+    }
+};
+
+/*!
+ * @brief Name of a MatrixOp, for printing
+ */
+inline const char* matrixOpName(MatrixOp op) {
+    static const char* const names[] = { "multiply", "add", "hadamard", "scale", "expression",
+                                         "transpose", "convert", "compare", "copy", "solve", "reduce" };
+    return op < MatrixOp::Count ? names[(int) op] : "?";
+}
+
+/*!
+ * @brief A copy of all counters at one moment, see MatrixProfiler::snapshot()
+ */
+struct MatrixProfile {
+    std::array<MatrixOpStats, (std::size_t) MatrixOp::Count> ops;
+    std::uint64_t liveBytes;        //!< matrix memory in use now
+    std::uint64_t peakBytes;        //!< the most matrix memory in use at any moment
+    std::uint64_t allocations;      //!< matrix allocations, in or outside operations
+    std::uint64_t bytesAllocated;   //!< bytes of all those allocations together
+
+    const MatrixOpStats& operator[](MatrixOp op) const { return ops[(std::size_t) op]; }
+
+    /*!
+     * @brief Print a table of the counters
+     */
+    void print(std::ostream& out) const {
+        out << std::left << std::setw(12) << "op" << std::right << std::setw(12) << "calls"
+            << std::setw(12) << "ms" << std::setw(10) << "GFLOP/s" << std::setw(12) << "alloc MB"
+            << std::setw(12) << "copied MB" << std::setw(12) << "p50 us" << std::setw(12) << "p99 us" << "\n";
+        for (std::size_t i = 0; i < ops.size(); i++) {
+            const MatrixOpStats& s = ops[i];
+            if (s.calls == 0)
+                continue;
+            out << std::left << std::setw(12) << matrixOpName((MatrixOp) i) << std::right
+                << std::setw(12) << s.calls
+                << std::setw(12) << std::fixed << std::setprecision(3) << s.nanoseconds * 1e-6
+                << std::setw(10) << std::setprecision(2) << (s.nanoseconds ? (double) s.flops / s.nanoseconds : 0.0)
+                << std::setw(12) << s.bytesAllocated / 1048576.0
+                << std::setw(12) << s.bytesCopied / 1048576.0
+                << std::setw(12) << s.percentile(0.5) * 1e-3
+                << std::setw(12) << s.percentile(0.99) * 1e-3 << "\n";
+        }
+        out << "live " << liveBytes / 1048576.0 << " MB, peak " << peakBytes / 1048576.0 << " MB, "
+            << allocations << " allocations of " << bytesAllocated / 1048576.0 << " MB in total\n";
+        out.unsetf(std::ios::floatfield);
+    }
+};
+
+namespace matrix_detail {
+
+    // the counters of one kind of operation, on a cache line of their own
+    struct alignas(64) OpCounters {
+        std::atomic<std::uint64_t> calls, flops, bytesAllocated, bytesCopied, nanoseconds;
+        std::atomic<std::uint64_t> latency[MatrixOpStats::BUCKETS];
+    };
+
+    struct ProfileCounters {
+        std::atomic<bool> enabled;
+        OpCounters ops[(std::size_t) MatrixOp::Count];
+        alignas(64) std::atomic<std::uint64_t> liveBytes;
+        std::atomic<std::uint64_t> peakBytes, allocations, bytesAllocated;
+
+        static ProfileCounters& instance() {
+            // zero initialised: a static of a type without constructor
+            static ProfileCounters counters;
+            return counters;
+        }
+    };
+
+    class OpScope;
+
+    // the outermost operation running on this thread, NULL for none
+    inline OpScope*& currentOp() {
+        static thread_local OpScope* op = NULL;
+        return op;
+    }
+
+    /*!
+     * @brief Counts one operation, from construction to destruction.
+     *
+     * Does nothing when profiling is off, or when another operation is
+     * already being counted on this thread.
+     */
+    class OpScope {
+    public:
+        OpScope(MatrixOp op, std::uint64_t flops, std::uint64_t bytesCopied = 0)
+            : op(op), flops(flops), copied(bytesCopied), allocated(0), active(false) {
+            if (!ProfileCounters::instance().enabled.load(std::memory_order_relaxed) || currentOp() != NULL)
+                return;
+            active = true;
+            currentOp() = this;
+            start = std::chrono::steady_clock::now();
+        }
+
+        ~OpScope() {
+            if (!active)
+                return;
+            const std::uint64_t ns = (std::uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            currentOp() = NULL;
+            OpCounters& c = ProfileCounters::instance().ops[(std::size_t) op];
+            c.calls.fetch_add(1, std::memory_order_relaxed);
+            c.flops.fetch_add(flops, std::memory_order_relaxed);
+            c.bytesCopied.fetch_add(copied, std::memory_order_relaxed);
+            c.bytesAllocated.fetch_add(allocated, std::memory_order_relaxed);
+            c.nanoseconds.fetch_add(ns, std::memory_order_relaxed);
+            int bucket = 0;
+            while (bucket < MatrixOpStats::BUCKETS - 1 && (ns >> (bucket + 1)) != 0)
+                bucket++;
+            c.latency[bucket].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void addAllocated(std::uint64_t bytes) { allocated += bytes; }
+
+    private:
+        OpScope(const OpScope&);
+        OpScope& operator=(const OpScope&);
+
+        MatrixOp op;
+        std::uint64_t flops, copied, allocated;
+        bool active;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    /*!
+     * @brief Count an allocation of matrix memory
+     */
+    inline void profileAllocate(std::uint64_t bytes) {
+        ProfileCounters& p = ProfileCounters::instance();
+        p.allocations.fetch_add(1, std::memory_order_relaxed);
+        p.bytesAllocated.fetch_add(bytes, std::memory_order_relaxed);
+        const std::uint64_t live = p.liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        std::uint64_t peak = p.peakBytes.load(std::memory_order_relaxed);
+        while (live > peak && !p.peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+            ;
+        if (currentOp() != NULL)
+            currentOp()->addAllocated(bytes);
+    }
+
+    /*!
+     * @brief Count the release of matrix memory
+     */
+    inline void profileRelease(std::uint64_t bytes) {
+        ProfileCounters::instance().liveBytes.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+} // namespace matrix_detail
+
+/*!
+ * @class MatrixProfiler
+ * @brief Switches the counters on and off and reads them, see matrix_profile.h
+ */
+class MatrixProfiler {
+public:
+    /*!
+     * @brief Start (or stop) counting operations. Safe at any moment,
+     *        from any thread.
+     */
+    static void enable(bool on = true) {
+        matrix_detail::ProfileCounters::instance().enabled.store(on, std::memory_order_relaxed);
+    }
+
+    static bool enabled() {
+        return matrix_detail::ProfileCounters::instance().enabled.load(std::memory_order_relaxed);
+    }
+
+    /*!
+     * @brief A copy of the counters.
+     *
+     * Operations that are running while it is taken may be partly in it.
+     */
+    static MatrixProfile snapshot() {
+        matrix_detail::ProfileCounters& p = matrix_detail::ProfileCounters::instance();
+        MatrixProfile ret;
+        for (std::size_t i = 0; i < ret.ops.size(); i++) {
+            const matrix_detail::OpCounters& c = p.ops[i];
+            MatrixOpStats& s = ret.ops[i];
+            s.calls = c.calls.load(std::memory_order_relaxed);
+            s.flops = c.flops.load(std::memory_order_relaxed);
+            s.bytesAllocated = c.bytesAllocated.load(std::memory_order_relaxed);
+            s.bytesCopied = c.bytesCopied.load(std::memory_order_relaxed);
+            s.nanoseconds = c.nanoseconds.load(std::memory_order_relaxed);
+            for (int b = 0; b < MatrixOpStats::BUCKETS; b++)
+                s.latency[b] = c.latency[b].load(std::memory_order_relaxed);
+        }
+        ret.liveBytes = p.liveBytes.load(std::memory_order_relaxed);
+        ret.peakBytes = p.peakBytes.load(std::memory_order_relaxed);
+        ret.allocations = p.allocations.load(std::memory_order_relaxed);
+        ret.bytesAllocated = p.bytesAllocated.load(std::memory_order_relaxed);
+        return ret;
+    }
+
+    /*!
+     * @brief Set the operation counters to 0, and the peak memory to what
+     *        is in use now. The live memory stays, it is still in use.
+     */
+    static void reset() {
+        matrix_detail::ProfileCounters& p = matrix_detail::ProfileCounters::instance();
+        for (std::size_t i = 0; i < (std::size_t) MatrixOp::Count; i++) {
+            matrix_detail::OpCounters& c = p.ops[i];
+            c.calls.store(0, std::memory_order_relaxed);
+            c.flops.store(0, std::memory_order_relaxed);
+            c.bytesAllocated.store(0, std::memory_order_relaxed);
+            c.bytesCopied.store(0, std::memory_order_relaxed);
+            c.nanoseconds.store(0, std::memory_order_relaxed);
+            for (int b = 0; b < MatrixOpStats::BUCKETS; b++)
+                c.latency[b].store(0, std::memory_order_relaxed);
+        }
+        p.peakBytes.store(p.liveBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        p.allocations.store(0, std::memory_order_relaxed);
+        p.bytesAllocated.store(0, std::memory_order_relaxed);
+    }
+};
@@ -0,0 +1,242 @@
+/*!
+ * @file matrix_quant.h
+ * @author Tony Andrioli, The Hague University of Applied Sciences
+ * @date June 2022
+ *
+ * Quantized matrices: floating point matrices stored as 8 or 16 bit
+ * integers plus one scale factor per matrix, and their products.
+ *
+ * @code{.cpp}
+ * Matrix<float> w = ..., x = ...;
+ * QuantizedMatrix<std::int8_t> qw = quantizeMatrix<std::int8_t>(w);   // 4x less memory
+ * QuantizedMatrix<std::int8_t> qx = quantizeMatrix<std::int8_t>(x);
+ * Matrix<float> y;
+ * multiplyQuantized(qw, qx, y);        // y ~ w * x
+ * @endcode
+ * Quantizing is symmetric: the scale is the largest absolute element over
+ * the largest value of the integer type, every element is divided by it
+ * and rounded to nearest. The product of two quantized matrices is computed
+ * exactly in integers with a wider accumulator (QuantAccumulator), then
+ * multiplied by both scales. The integer product reads its operands in
+ * their own type, so a product of int8_t matrices moves a quarter of the
+ * memory of a float product.
+ *
+ * Accumulators don't overflow as long as k * max|a| * max|b| fits: with
+ * int8_t and int32_t that is k <= 133144 for values from quantize(), which
+ * stay in [-127, 127], but only k <= 131071 once -128 appears (values set
+ * by hand); with int16_t and int64_t any k
+ * that fits in memory. int16_t with an int32_t accumulator (possible with
+ * the multiplyQuantized() overload that takes the output matrix) is only
+ * safe for small values or short sums.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "matrix_alloc.h"
+#include "matrix_convert.h"
+#include "matrix_gemm.h"
+#include "matrix_parallel.h"
+#include "matrix_profile.h"
+#include "matrix_simd.h"
+#include "matrix_view.h"
+
+/*!
+ * @brief The accumulator type of products of quantized Q matrices:
+ *        int32_t for 8 bit integers, int64_t for wider ones.
+ */
+template <class Q>
+struct QuantAccumulator {
+    typedef typename std::conditional<sizeof(Q) == 1, std::int32_t, std::int64_t>::type type;
+};
+
+/*!
+ * @class QuantizedMatrix
+ * @brief A floating point matrix stored as integers Q: element (r, c) stands
+ *        for scale * values(r, c). See matrix_quant.h.
+ */
+template <class Q>
+struct QuantizedMatrix {
+    static_assert(std::is_integral<Q>::value && std::is_signed<Q>::value,
+                  "QuantizedMatrix: Q must be a signed integer type");
+
+    Matrix<Q> values;   //!< the quantized elements
+    double scale;       //!< what one unit of values stands for
+
+    QuantizedMatrix() : scale(1) {}
+    QuantizedMatrix(Matrix<Q> values, double scale) : values(std::move(values)), scale(scale) {}
+
+    std::size_t rows() const { return values.rows(); }
+    std::size_t cols() const { return values.cols(); }
+};
+
+namespace matrix_detail {
+
+    // dst[i] = src[i] * inverse, rounded to nearest and saturated to Q
+    template <class Q, class F>
+    inline void quantizeLoop(const F* src, Q* dst, std::size_t n, F inverse) {
+        MATRIX_IVDEP
+        for (std::size_t i = 0; i < n; i++)
+            dst[i] = saturateCast<Q>(roundNearest(src[i] * inverse, std::true_type()));
+    }
+
+#ifdef MATRIX_X86
+    // vectorized rounding needs AVX2, as in convertElements()
+    template <class Q, class F>
+    MATRIX_TARGET("avx2") void quantizeLoopAvx2(const F* src, Q* dst, std::size_t n, F inverse) {
+        quantizeLoop(src, dst, n, inverse);
+    }
+#endif
+
+    template <class Q, class F>
+    void quantizeElements(const F* src, Q* dst, std::size_t n, F inverse) {
+    #ifdef MATRIX_X86
+        if (simdLevel() >= SIMD_AVX2) {
+            quantizeLoopAvx2(src, dst, n, inverse);
+            return;
+        }
+    #endif
+        quantizeLoop(src, dst, n, inverse);
+    }
+
+    // dst[i] = src[i] * scale
+    template <class F, class A>
+    void dequantizeElements(const A* src, F* dst, std::size_t n, double scale) {
+        MATRIX_IVDEP
+        for (std::size_t i = 0; i < n; i++)
+            dst[i] = (F) ((double) src[i] * scale);
+    }
+
+    // give 'out' the size rows x cols and the layout, keeping its memory when it has them
+    template <class T, class Alloc>
+    void reshapeOutput(Matrix<T, Alloc>& out, std::size_t rows, std::size_t cols,
+                       MatrixLayout layout = MatrixLayout::RowMajor) {
+        if (out.rows() != rows || out.cols() != cols || out.layout() != layout)
+            out = Matrix<T, Alloc>(rows, cols, layout, MatrixInit::Uninitialized);
+    }
+
+} // namespace matrix_detail
+
+/*!
+ * @brief Quantize a floating point matrix into 'out', see matrix_quant.h
+ *
+ * NaN elements become 0; the scale of a matrix of zeros is 1.
+ */
+template <class Q, class F, class Alloc>
+void quantizeMatrix(const Matrix<F, Alloc>& matrix, QuantizedMatrix<Q>& out) {
+    static_assert(std::is_floating_point<F>::value, "quantizeMatrix: F must be a floating point type");
+    const std::size_t n = matrix.rows() * matrix.cols();
+    matrix_detail::OpScope scope(MatrixOp::Convert, 0, n * sizeof(Q));
+    const F* src = matrix.data();
+    F largest = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        const F a = src[i] < F(0) ? -src[i] : src[i];
+        largest = a > largest ? a : largest;
+    }
+    out.scale = largest > F(0) ? (double) largest / (double) std::numeric_limits<Q>::max() : 1.0;
+    matrix_detail::reshapeOutput(out.values, matrix.rows(), matrix.cols(), matrix.layout());
+    const F inverse = (F) (1.0 / out.scale);
+    Q* dst = out.values.data();
+    matrix_detail::parallelElements(n, sizeof(F) + sizeof(Q), [=](std::size_t b, std::size_t e) {
+        matrix_detail::quantizeElements(src + b, dst + b, e - b, inverse);
+    });
+}
+
+template <class Q, class F, class Alloc>
+QuantizedMatrix<Q> quantizeMatrix(const Matrix<F, Alloc>& matrix) {
+    QuantizedMatrix<Q> ret;
+    quantizeMatrix(matrix, ret);
+    return ret;
+}
+
+/*!
+ * @brief The floating point matrix a quantized matrix stands for
+ */
+template <class F, class Alloc, class Q>
+void dequantizeMatrix(const QuantizedMatrix<Q>& matrix, Matrix<F, Alloc>& out) {
+    const std::size_t n = matrix.rows() * matrix.cols();
+    matrix_detail::OpScope scope(MatrixOp::Convert, 0, n * sizeof(F));
+    matrix_detail::reshapeOutput(out, matrix.rows(), matrix.cols(), matrix.values.layout());
+    const Q* src = matrix.values.data();
+    F* dst = out.data();
+    const double scale = matrix.scale;
+    matrix_detail::parallelElements(n, sizeof(F) + sizeof(Q), [=](std::size_t b, std::size_t e) {
+        matrix_detail::dequantizeElements(src + b, dst + b, e - b, scale);
+    });
+}
+
+/*!
+ * @brief Integer product out = first * second, accumulated in the type of
+ *        'out' (int32_t or int64_t, say).
+ *
+ * The result is exact unless a sum overflows Acc, see matrix_quant.h.
+ * 'out' is resized when needed, it then gets the layout of first.
+ * @exception invalid_argument thrown when the sizes don't allow multiplication.
+ */
+template <class Acc, class AccAlloc, class Q, class Alloc>
+void multiplyQuantized(const Matrix<Q, Alloc>& first, const Matrix<Q, Alloc>& second, Matrix<Acc, AccAlloc>& out) {
+    static_assert(std::is_integral<Q>::value && std::is_integral<Acc>::value && sizeof(Acc) >= sizeof(Q),
+                  "multiplyQuantized: needs integer operands and an at least as wide integer result");
+    if (first.cols() != second.rows())
+        throw std::invalid_argument("Multiplication: matrices sizes don't alow multiplication.");
+    const std::size_t m = first.rows(), n = second.cols(), k = first.cols();
+    matrix_detail::OpScope scope(MatrixOp::Multiply, 2 * m * n * k);
+    if (out.rows() != m || out.cols() != n)
+        matrix_detail::reshapeOutput(out, m, n, first.layout());
+    matrix_detail::gemmStrided<Acc>(m, n, k, first.data(), matrix_detail::rowStep(first.view()), matrix_detail::colStep(first.view()),
+                                    second.data(), matrix_detail::rowStep(second.view()), matrix_detail::colStep(second.view()),
+                                    out.data(), matrix_detail::rowStep(out.view()), matrix_detail::colStep(out.view()));
+}
+
+template <class Q, class Alloc>
+Matrix<typename QuantAccumulator<Q>::type> multiplyQuantized(const Matrix<Q, Alloc>& first, const Matrix<Q, Alloc>& second) {
+    Matrix<typename QuantAccumulator<Q>::type> ret;
+    multiplyQuantized(first, second, ret);
+    return ret;
+}
+
+/*!
+ * @brief Product of two quantized matrices as a floating point matrix:
+ *        out = first.scale * second.scale * (first.values * second.values)
+ *
+ * The integer product is accumulated in QuantAccumulator<Q>, a band of rows
+ * at a time, and scaled while the band is still in the cache. 'out' is
+ * resized when needed, and made row-major.
+ * @exception invalid_argument thrown when the sizes don't allow multiplication.
+ */
+template <class F, class FAlloc, class Q>
+void multiplyQuantized(const QuantizedMatrix<Q>& first, const QuantizedMatrix<Q>& second, Matrix<F, FAlloc>& out) {
+    typedef typename QuantAccumulator<Q>::type Acc;
+    if (first.cols() != second.rows())
+        throw std::invalid_argument("Multiplication: matrices sizes don't alow multiplication.");
+    const std::size_t m = first.rows(), n = second.cols(), k = first.cols();
+    matrix_detail::OpScope scope(MatrixOp::Multiply, 2 * m * n * k);
+    matrix_detail::reshapeOutput(out, m, n);
+    if (m == 0 || n == 0)
+        return;
+    // the values may be column-major, the kernel takes any strides
+    const std::ptrdiff_t rsa = matrix_detail::rowStep(first.values.view()), csa = matrix_detail::colStep(first.values.view());
+    const std::ptrdiff_t rsb = matrix_detail::rowStep(second.values.view()), csb = matrix_detail::colStep(second.values.view());
+    // bands of at least 64 rows, so packing B is a small part of the work
+    const std::size_t band = (std::max)((std::size_t) 64, (256 * 1024 / sizeof(Acc)) / n);
+    matrix_detail::ScratchBuffer<Acc> acc((std::min)(band, m) * n);
+    const double scale = first.scale * second.scale;
+    const Q* a = first.values.data();
+    const Q* b = second.values.data();
+    for (std::size_t r0 = 0; r0 < m; r0 += band) {
+        const std::size_t rows = (std::min)(band, m - r0);
+        matrix_detail::gemmParallel<Acc>(rows, n, k, a + r0 * rsa, rsa, csa, b, rsb, csb, acc.data(), n, 1);
+        const Acc* src = acc.data();
+        F* dst = out.data() + r0 * n;
+        matrix_detail::parallelElements(rows * n, sizeof(Acc) + sizeof(F), [=](std::size_t i, std::size_t e) {
+            matrix_detail::dequantizeElements(src + i, dst + i, e - i, scale);
+        });
+    }
+}
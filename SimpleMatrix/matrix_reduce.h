@@ -0,0 +1,293 @@
+/*!
+ * @file matrix_reduce.h
+ * @author Tony Andrioli, The Hague University of Applied Sciences
+ * @date June 2022
+ *
+ * Reductions (sum, norms, minimum and maximum, row and column sums) and
+ * comparisons (operator==, approxEqual) of whole matrices.
+ *
+ * @code{.cpp}
+ * Matrix<float> a = ..., b = ...;
+ * float s = a.sum();
+ * float f = a.normFrobenius();
+ * std::array<std::size_t, 2> rc = a.argMax();     // { row, col } of the largest element
+ * Matrix<float> means = a.colMeans();             // 1 x cols
+ * bool close = a.approxEqual(b, 1e-5f);           // relative tolerance
+ * @endcode
+ * The buffer is reduced in blocks of REDUCE_BLOCK elements, split over the
+ * thread pool; every block is summed in 16 interleaved partial sums (so the
+ * loop vectorizes) and the blocks are combined in order. The result only
+ * depends on the size of the matrix, not on the number of threads, but a
+ * floating point sum is not the one of a plain loop from the first element
+ * to the last (it's usually closer to the exact sum).
+ *
+ * Comparisons stop at the first block with a difference. Types whose
+ * values are equal exactly when their bytes are (integers) are compared
+ * with memcmp.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <type_traits>
+#include <vector>
+
+#include "matrix_expr.h"
+#include "matrix_gemm.h"
+#include "matrix_parallel.h"
+
+/*!
+ * @brief The type of norms and means of a Matrix<T>: T for floating point
+ *        types, double for integers.
+ */
+template <class T>
+struct MatrixReal {
+    typedef typename std::conditional<std::is_floating_point<T>::value, T, double>::type type;
+};
+
+namespace matrix_detail {
+
+    // elements per block of a reduction
+    const std::size_t REDUCE_BLOCK = 4096;
+
+    // partial sums per block
+    const std::size_t REDUCE_LANES = 16;
+
+    // what norms of T are accumulated in: at least double, so float sums of squares don't overflow
+    template <class T>
+    struct NormAccumulator {
+        typedef typename MatrixReal<T>::type Real;
+        typedef typename std::conditional<(sizeof(Real) < sizeof(double)), double, Real>::type type;
+    };
+
+    /*!
+     * @brief fn(b, e) on the blocks of REDUCE_BLOCK elements of [0, n), in
+     *        parallel; the block results are combined in order.
+     */
+    template <class R, class F, class C>
+    R reduceBlocks(std::size_t n, R init, const F& fn, const C& combine) {
+        const std::size_t blocks = (n + REDUCE_BLOCK - 1) / REDUCE_BLOCK;
+        if (blocks <= 1)
+            return n == 0 ? init : combine(init, fn(0, n));
+        std::vector<R> partial(blocks);
+        R* out = partial.data();
+        parallelFor(0, blocks, 1, n, [=, &fn](std::size_t b0, std::size_t b1) {
+            for (std::size_t blk = b0; blk < b1; blk++)
+                out[blk] = fn(blk * REDUCE_BLOCK, (std::min)(n, (blk + 1) * REDUCE_BLOCK));
+        });
+        R r = init;
+        for (std::size_t blk = 0; blk < blocks; blk++)
+            r = combine(r, out[blk]);
+        return r;
+    }
+
+    /*!
+     * @brief The sum of f(p[i]) for i in [0, n), accumulated in A
+     */
+    template <class A, class T, class F>
+    A sumElements(const T* p, std::size_t n, const F& f) {
+        A acc[REDUCE_LANES];
+        for (std::size_t q = 0; q < REDUCE_LANES; q++)
+            acc[q] = A(0);
+        std::size_t i = 0;
+        for (; i + REDUCE_LANES <= n; i += REDUCE_LANES) {
+            MATRIX_UNROLL
+            for (std::size_t q = 0; q < REDUCE_LANES; q++)
+                acc[q] += f(p[i + q]);
+        }
+        for (std::size_t q = 0; i < n; i++, q++)
+            acc[q] += f(p[i]);
+        A sum = A(0);
+        for (std::size_t q = 0; q < REDUCE_LANES; q++)
+            sum += acc[q];
+        return sum;
+    }
+
+    // the absolute value of x without std::abs, which has no overloads for unsigned types
+    template <class T>
+    inline T absolute(T x) {
+        return x < T(0) ? T(0) - x : x;
+    }
+
+    /*!
+     * @brief The sum of f(p[i]) over the n elements of a buffer, see matrix_reduce.h
+     */
+    template <class A, class T, class F>
+    A reduceSum(const T* p, std::size_t n, const F& f) {
+        return reduceBlocks<A>(n, A(0), [p, &f](std::size_t b, std::size_t e) { return sumElements<A>(p + b, e - b, f); },
+                               [](A x, A y) { return x + y; });
+    }
+
+    // y when it's smaller (less = true) or larger than x, or x is NaN
+    template <class T>
+    inline T pickExtreme(T x, T y, bool less) {
+        return (less ? y < x : x < y) || x != x ? y : x;
+    }
+
+    /*!
+     * @brief The smallest (less = true) or largest element of p[0, n), n > 0.
+     *        NaNs are skipped, the result is NaN only when all elements are.
+     */
+    template <class T>
+    T extremeElement(const T* p, std::size_t n, bool less) {
+        const auto pick = [less](T x, T y) { return pickExtreme(x, y, less); };
+        return reduceBlocks<T>(n, p[0], [p, less](std::size_t b, std::size_t e) {
+            T acc[REDUCE_LANES];
+            for (std::size_t q = 0; q < REDUCE_LANES; q++)
+                acc[q] = p[b];
+            std::size_t i = b;
+            // one loop per direction, so each is a plain select the compiler vectorizes
+            if (less) {
+                for (; i + REDUCE_LANES <= e; i += REDUCE_LANES) {
+                    MATRIX_UNROLL
+                    for (std::size_t q = 0; q < REDUCE_LANES; q++)
+                        acc[q] = p[i + q] < acc[q] || acc[q] != acc[q] ? p[i + q] : acc[q];
+                }
+            } else {
+                for (; i + REDUCE_LANES <= e; i += REDUCE_LANES) {
+                    MATRIX_UNROLL
+                    for (std::size_t q = 0; q < REDUCE_LANES; q++)
+                        acc[q] = acc[q] < p[i + q] || acc[q] != acc[q] ? p[i + q] : acc[q];
+                }
+            }
+            T r = acc[0];
+            for (std::size_t q = 1; q < REDUCE_LANES; q++)
+                r = pickExtreme(r, acc[q], less);
+            for (; i < e; i++)
+                r = pickExtreme(r, p[i], less);
+            return r;
+        }, pick);
+    }
+
+    /*!
+     * @brief The index of the first element equal to v, n if there is none
+     */
+    template <class T>
+    std::size_t findElement(const T* p, std::size_t n, T v) {
+        for (std::size_t b = 0; b < n; b += REDUCE_BLOCK) {
+            const std::size_t e = (std::min)(n, b + REDUCE_BLOCK);
+            // test a whole block first, branch free
+            bool found = false;
+            for (std::size_t i = b; i < e; i++)
+                found |= p[i] == v;
+            if (found)
+                for (std::size_t i = b; i < e; i++)
+                    if (p[i] == v)
+                        return i;
+        }
+        return n;
+    }
+
+    /*!
+     * @brief out[r] = the sum of row r of the rows x cols matrix p, in A
+     */
+    template <class A, class T>
+    void rowSums(const T* p, std::size_t rows, std::size_t cols, A* out) {
+        const std::size_t grain = (std::max<std::size_t>)(1, REDUCE_BLOCK / (cols + 1));
+        parallelFor(0, rows, grain, rows * cols, [=](std::size_t r0, std::size_t r1) {
+            for (std::size_t r = r0; r < r1; r++)
+                out[r] = sumElements<A>(p + r * cols, cols, [](T x) { return A(x); });
+        });
+    }
+
+    /*!
+     * @brief out[c] = the sum of column c of the rows x cols matrix p, in A,
+     *        added up from the first row down
+     */
+    template <class A, class T>
+    void colSums(const T* p, std::size_t rows, std::size_t cols, A* out) {
+        // bands of columns that stay in L1, vectorized along the rows
+        const std::size_t band = (std::max<std::size_t>)(64, 4096 / sizeof(A));
+        parallelFor(0, (cols + band - 1) / band, 1, rows * cols, [=](std::size_t b0, std::size_t b1) {
+            for (std::size_t b = b0; b < b1; b++) {
+                const std::size_t c0 = b * band, w = (std::min)(cols, c0 + band) - c0;
+                A* o = out + c0;
+                for (std::size_t c = 0; c < w; c++)
+                    o[c] = A(0);
+                for (std::size_t r = 0; r < rows; r++) {
+                    const T* row = p + r * cols + c0;
+                    MATRIX_IVDEP
+                    for (std::size_t c = 0; c < w; c++)
+                        o[c] += A(row[c]);
+                }
+            }
+        });
+    }
+
+    /*!
+     * @brief Whether a[0, n) and b[0, n) are equal element by element.
+     *
+     * Blocks are compared in parallel without branches inside, the other
+     * blocks are skipped once one differs.
+     */
+    template <class Same>
+    bool allElements(std::size_t n, const Same& same) {
+        std::atomic<bool> differ(false);
+        std::atomic<bool>* flag = &differ;
+        const std::size_t blocks = (n + REDUCE_BLOCK - 1) / REDUCE_BLOCK;
+        parallelFor(0, blocks, 1, n, [=, &same](std::size_t b0, std::size_t b1) {
+            for (std::size_t blk = b0; blk < b1; blk++) {
+                if (flag->load(std::memory_order_relaxed))
+                    return;
+                const std::size_t b = blk * REDUCE_BLOCK;
+                if (!same(b, (std::min)(n, b + REDUCE_BLOCK)))
+                    flag->store(true, std::memory_order_relaxed);
+            }
+        });
+        return !differ.load(std::memory_order_relaxed);
+    }
+
+    // equal bytes are equal values: compare memory
+    template <class T>
+    bool equalElements(const T* a, const T* b, std::size_t n, std::true_type) {
+        return allElements(n, [a, b](std::size_t i, std::size_t e) {
+            return std::memcmp(a + i, b + i, (e - i) * sizeof(T)) == 0;
+        });
+    }
+
+    // floating point (0.0 == -0.0, NaN != NaN): compare values
+    template <class T>
+    bool equalElements(const T* a, const T* b, std::size_t n, std::false_type) {
+        return allElements(n, [a, b](std::size_t i, std::size_t e) {
+            bool differ = false;
+            for (; i < e; i++)
+                differ |= !(a[i] == b[i]);
+            return !differ;
+        });
+    }
+
+    /*!
+     * @brief a[i] == b[i] for all i in [0, n)
+     */
+    template <class T>
+    bool equalElements(const T* a, const T* b, std::size_t n) {
+        if (a == b && std::is_integral<T>::value)
+            return true;
+        return equalElements(a, b, n, std::integral_constant<bool,
+                             std::is_integral<T>::value && std::has_unique_object_representations<T>::value>());
+    }
+
+    /*!
+     * @brief |a[i] - b[i]| <= max(absTol, relTol * max(|a[i]|, |b[i]|)) for
+     *        all i in [0, n); NaNs are never close
+     */
+    template <class T, class R>
+    bool closeElements(const T* a, const T* b, std::size_t n, R relTol, R absTol) {
+        return allElements(n, [a, b, relTol, absTol](std::size_t i, std::size_t e) {
+            bool far = false;
+            for (; i < e; i++) {
+                const R xi = R(a[i]), yi = R(b[i]);
+                const R d = xi < yi ? yi - xi : xi - yi;
+                const R ax = xi < R(0) ? -xi : xi, ay = yi < R(0) ? -yi : yi;
+                const R rel = relTol * (ax < ay ? ay : ax);
+                far |= !(d <= (rel < absTol ? absTol : rel));
+            }
+            return !far;
+        });
+    }
+
+} // namespace matrix_detail
@@ -0,0 +1,500 @@
+/*!
+ * @file matrix_simd.h
+ * @author Tony Andrioli, The Hague University of Applied Sciences
+ * @date June 2022
+ *
+ * SIMD kernels for the element-wise operations of Matrix (addInPlace,
+ * multiplyInPlace and hadamardInPlace).
+ *
+ * There are SSE2, AVX2 and AVX-512 versions for float, double and 32 and
+ * 64 bit integers. Which one runs is decided at runtime from the CPU
+ * features, so one binary runs on every x86-64 host. All other types (and
+ * all other platforms) use the plain loops at the bottom of this file.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MATRIX_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// GCC and clang only emit instructions for the ISA a function is marked for,
+// MSVC emits any intrinsic anywhere.
+#if defined(__GNUC__) || defined(__clang__)
+#define MATRIX_TARGET(isa) __attribute__((target(isa)))
+#else
+#define MATRIX_TARGET(isa)
+#endif
+
+namespace matrix_detail {
+
+    // ----------------------------------------------------------------------
+    // cpu feature detection
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief Instruction set levels the kernels are available for.
+     */
+    enum SimdLevel {
+        SIMD_SCALAR = 0,
+        SIMD_SSE2 = 1,
+        SIMD_AVX2 = 2,
+        SIMD_AVX512 = 3
+    };
+
+#ifdef MATRIX_X86
+    inline void cpuid(unsigned int leaf, unsigned int sub, unsigned int r[4]) {
+    #if defined(_MSC_VER) && !defined(__clang__)
+        int regs[4];
+        __cpuidex(regs, (int)leaf, (int)sub);
+        for (int i = 0; i < 4; i++)
+            r[i] = (unsigned int)regs[i];
+    #else
+        __cpuid_count(leaf, sub, r[0], r[1], r[2], r[3]);
+    #endif
+    }
+
+    inline unsigned long long xgetbv0() {
+    #if defined(_MSC_VER) && !defined(__clang__)
+        return _xgetbv(0);
+    #else
+        unsigned int eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return ((unsigned long long)edx << 32) | eax;
+    #endif
+    }
+#endif
+
+    /*!
+     * @brief Highest level both the CPU and the operating system support.
+     *
+     * AVX and AVX-512 also need the OS to save the wider registers, that
+     * is what the XCR0 check is for.
+     */
+    inline int detectSimdLevel() {
+    #ifdef MATRIX_X86
+        unsigned int r[4];
+        cpuid(0, 0, r);
+        const unsigned int maxLeaf = r[0];
+        cpuid(1, 0, r);
+        int level = (r[3] & (1u << 26)) ? SIMD_SSE2 : SIMD_SCALAR;
+        const bool osxsave = (r[2] & (1u << 27)) != 0;
+        if (!osxsave || maxLeaf < 7)
+            return level;
+        const unsigned long long xcr0 = xgetbv0();
+        cpuid(7, 0, r);
+        if ((xcr0 & 0x6) == 0x6 && (r[1] & (1u << 5)))
+            level = SIMD_AVX2;
+        if ((xcr0 & 0xE6) == 0xE6 && (r[1] & (1u << 16)) && (r[1] & (1u << 17)))
+            level = SIMD_AVX512;
+        return level;
+    #else
+        return SIMD_SCALAR;
+    #endif
+    }
+
+    inline std::atomic<int>& simdLevelRef() {
+        static std::atomic<int> level(detectSimdLevel());
+        return level;
+    }
+
+    /*!
+     * @brief The level the kernels currently run at.
+     */
+    inline int simdLevel() {
+        return simdLevelRef().load(std::memory_order_relaxed);
+    }
+
+    /*!
+     * @brief Force a lower level (for testing), capped to what the CPU supports.
+     */
+    inline void setSimdLevel(int level) {
+        static const int detected = detectSimdLevel();
+        simdLevelRef().store(level < detected ? level : detected, std::memory_order_relaxed);
+    }
+
+    // ----------------------------------------------------------------------
+    // lane types
+    // ----------------------------------------------------------------------
+
+    enum SimdKind { KIND_NONE, KIND_F32, KIND_F64, KIND_I32, KIND_I64 };
+
+    /*!
+     * @brief Which set of kernels T can use. Integers only need the right
+     *        size, addition and (low half) multiplication are sign agnostic.
+     */
+    template <class T>
+    struct SimdKindOf {
+        static const int value =
+            std::is_same<T, float>::value ? KIND_F32 :
+            std::is_same<T, double>::value ? KIND_F64 :
+            (std::is_integral<T>::value && !std::is_same<T, bool>::value && sizeof(T) == 4) ? KIND_I32 :
+            (std::is_integral<T>::value && !std::is_same<T, bool>::value && sizeof(T) == 8) ? KIND_I64 :
+            KIND_NONE;
+    };
+
+#ifdef MATRIX_X86
+
+    // Every ISA gets the same three loops, these are stamped out per target
+    // below. I is one of the *Ops structs, with V the register type and L the
+    // number of lanes. The destination is aligned first, the source may be
+    // unaligned, the tail is done one element at a time.
+    #define MATRIX_SIMD_ELEMENTWISE(TARGET)                                                     \
+        template <class I>                                                                      \
+        TARGET void add(typename I::T* d, const typename I::T* s, std::size_t n) {              \
+            const std::size_t L = I::L;                                                         \
+            std::size_t i = 0;                                                                  \
+            for (; i < n && ((std::uintptr_t)(d + i) % sizeof(typename I::V)) != 0; i++)        \
+                d[i] += s[i];                                                                   \
+            for (; i + 4 * L <= n; i += 4 * L) {                                                \
+                typename I::V a0 = I::add(I::load(d + i), I::loadu(s + i));                     \
+                typename I::V a1 = I::add(I::load(d + i + L), I::loadu(s + i + L));             \
+                typename I::V a2 = I::add(I::load(d + i + 2 * L), I::loadu(s + i + 2 * L));     \
+                typename I::V a3 = I::add(I::load(d + i + 3 * L), I::loadu(s + i + 3 * L));     \
+                I::store(d + i, a0);                                                            \
+                I::store(d + i + L, a1);                                                        \
+                I::store(d + i + 2 * L, a2);                                                    \
+                I::store(d + i + 3 * L, a3);                                                    \
+            }                                                                                   \
+            for (; i + L <= n; i += L)                                                          \
+                I::storeu(d + i, I::add(I::loadu(d + i), I::loadu(s + i)));                     \
+            for (; i < n; i++)                                                                  \
+                d[i] += s[i];                                                                   \
+        }                                                                                       \
+                                                                                                \
+        template <class I>                                                                      \
+        TARGET void mul(typename I::T* d, const typename I::T* s, std::size_t n) {              \
+            const std::size_t L = I::L;                                                         \
+            std::size_t i = 0;                                                                  \
+            for (; i < n && ((std::uintptr_t)(d + i) % sizeof(typename I::V)) != 0; i++)        \
+                d[i] *= s[i];                                                                   \
+            for (; i + 4 * L <= n; i += 4 * L) {                                                \
+                typename I::V a0 = I::mul(I::load(d + i), I::loadu(s + i));                     \
+                typename I::V a1 = I::mul(I::load(d + i + L), I::loadu(s + i + L));             \
+                typename I::V a2 = I::mul(I::load(d + i + 2 * L), I::loadu(s + i + 2 * L));     \
+                typename I::V a3 = I::mul(I::load(d + i + 3 * L), I::loadu(s + i + 3 * L));     \
+                I::store(d + i, a0);                                                            \
+                I::store(d + i + L, a1);                                                        \
+                I::store(d + i + 2 * L, a2);                                                    \
+                I::store(d + i + 3 * L, a3);                                                    \
+            }                                                                                   \
+            for (; i + L <= n; i += L)                                                          \
+                I::storeu(d + i, I::mul(I::loadu(d + i), I::loadu(s + i)));                     \
+            for (; i < n; i++)                                                                  \
+                d[i] *= s[i];                                                                   \
+        }                                                                                       \
+                                                                                                \
+        template <class I>                                                                      \
+        TARGET void scale(typename I::T* d, typename I::T scalar, std::size_t n) {              \
+            const std::size_t L = I::L;                                                         \
+            const typename I::V sv = I::set1(scalar);                                           \
+            std::size_t i = 0;                                                                  \
+            for (; i < n && ((std::uintptr_t)(d + i) % sizeof(typename I::V)) != 0; i++)        \
+                d[i] *= scalar;                                                                 \
+            for (; i + 4 * L <= n; i += 4 * L) {                                                \
+                I::store(d + i, I::mul(I::load(d + i), sv));                                    \
+                I::store(d + i + L, I::mul(I::load(d + i + L), sv));                            \
+                I::store(d + i + 2 * L, I::mul(I::load(d + i + 2 * L), sv));                    \
+                I::store(d + i + 3 * L, I::mul(I::load(d + i + 3 * L), sv));                    \
+            }                                                                                   \
+            for (; i + L <= n; i += L)                                                          \
+                I::storeu(d + i, I::mul(I::loadu(d + i), sv));                                  \
+            for (; i < n; i++)                                                                  \
+                d[i] *= scalar;                                                                 \
+        }
+
+    #define MATRIX_SIMD_OPS_COMMON(TYPE, VEC, LANES)                                    \
+        typedef TYPE T;                                                                         \
+        typedef VEC V;                                                                          \
+        static const std::size_t L = LANES;
+
+    // ----------------------------------------------------------------------
+    // SSE2
+    // ----------------------------------------------------------------------
+
+    namespace sse2 {
+        #define MATRIX_T MATRIX_TARGET("sse2")
+
+        template <class T, int K = SimdKindOf<T>::value> struct Ops;
+
+        template <class E> struct Ops<E, KIND_F32> {
+            MATRIX_SIMD_OPS_COMMON(E, __m128, 4)
+            MATRIX_T static V load(const T* p) { return _mm_load_ps(p); }
+            MATRIX_T static V loadu(const T* p) { return _mm_loadu_ps(p); }
+            MATRIX_T static void store(T* p, V v) { _mm_store_ps(p, v); }
+            MATRIX_T static void storeu(T* p, V v) { _mm_storeu_ps(p, v); }
+            MATRIX_T static V set1(T x) { return _mm_set1_ps(x); }
+            MATRIX_T static V add(V a, V b) { return _mm_add_ps(a, b); }
+            MATRIX_T static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+        };
+
+        template <class E> struct Ops<E, KIND_F64> {
+            MATRIX_SIMD_OPS_COMMON(E, __m128d, 2)
+            MATRIX_T static V load(const T* p) { return _mm_load_pd(p); }
+            MATRIX_T static V loadu(const T* p) { return _mm_loadu_pd(p); }
+            MATRIX_T static void store(T* p, V v) { _mm_store_pd(p, v); }
+            MATRIX_T static void storeu(T* p, V v) { _mm_storeu_pd(p, v); }
+            MATRIX_T static V set1(T x) { return _mm_set1_pd(x); }
+            MATRIX_T static V add(V a, V b) { return _mm_add_pd(a, b); }
+            MATRIX_T static V mul(V a, V b) { return _mm_mul_pd(a, b); }
+        };
+
+        template <class E> struct Ops<E, KIND_I32> {
+            MATRIX_SIMD_OPS_COMMON(E, __m128i, 4)
+            MATRIX_T static V load(const T* p) { return _mm_load_si128((const __m128i*)p); }
+            MATRIX_T static V loadu(const T* p) { return _mm_loadu_si128((const __m128i*)p); }
+            MATRIX_T static void store(T* p, V v) { _mm_store_si128((__m128i*)p, v); }
+            MATRIX_T static void storeu(T* p, V v) { _mm_storeu_si128((__m128i*)p, v); }
+            MATRIX_T static V set1(T x) { return _mm_set1_epi32((int)x); }
+            MATRIX_T static V add(V a, V b) { return _mm_add_epi32(a, b); }
+            // SSE2 has no 32 bit mullo, multiply the even and odd lanes apart
+            MATRIX_T static V mul(V a, V b) {
+                __m128i even = _mm_mul_epu32(a, b);
+                __m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+                return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                                          _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+            }
+        };
+
+        template <class E> struct Ops<E, KIND_I64> {
+            MATRIX_SIMD_OPS_COMMON(E, __m128i, 2)
+            MATRIX_T static V load(const T* p) { return _mm_load_si128((const __m128i*)p); }
+            MATRIX_T static V loadu(const T* p) { return _mm_loadu_si128((const __m128i*)p); }
+            MATRIX_T static void store(T* p, V v) { _mm_store_si128((__m128i*)p, v); }
+            MATRIX_T static void storeu(T* p, V v) { _mm_storeu_si128((__m128i*)p, v); }
+            MATRIX_T static V set1(T x) { return _mm_set_epi64x((long long)x, (long long)x); }
+            MATRIX_T static V add(V a, V b) { return _mm_add_epi64(a, b); }
+            // lo*lo + ((hi*lo + lo*hi) << 32), the hi*hi part falls off the end
+            MATRIX_T static V mul(V a, V b) {
+                __m128i lo = _mm_mul_epu32(a, b);
+                __m128i cross = _mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(a, 32), b),
+                                              _mm_mul_epu32(a, _mm_srli_epi64(b, 32)));
+                return _mm_add_epi64(lo, _mm_slli_epi64(cross, 32));
+            }
+        };
+
+        MATRIX_SIMD_ELEMENTWISE(MATRIX_T)
+        #undef MATRIX_T
+    }
+
+    // ----------------------------------------------------------------------
+    // AVX2
+    // ----------------------------------------------------------------------
+
+    namespace avx2 {
+        #define MATRIX_T MATRIX_TARGET("avx2")
+
+        template <class T, int K = SimdKindOf<T>::value> struct Ops;
+
+        template <class E> struct Ops<E, KIND_F32> {
+            MATRIX_SIMD_OPS_COMMON(E, __m256, 8)
+            MATRIX_T static V load(const T* p) { return _mm256_load_ps(p); }
+            MATRIX_T static V loadu(const T* p) { return _mm256_loadu_ps(p); }
+            MATRIX_T static void store(T* p, V v) { _mm256_store_ps(p, v); }
+            MATRIX_T static void storeu(T* p, V v) { _mm256_storeu_ps(p, v); }
+            MATRIX_T static V set1(T x) { return _mm256_set1_ps(x); }
+            MATRIX_T static V add(V a, V b) { return _mm256_add_ps(a, b); }
+            MATRIX_T static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+        };
+
+        template <class E> struct Ops<E, KIND_F64> {
+            MATRIX_SIMD_OPS_COMMON(E, __m256d, 4)
+            MATRIX_T static V load(const T* p) { return _mm256_load_pd(p); }
+            MATRIX_T static V loadu(const T* p) { return _mm256_loadu_pd(p); }
+            MATRIX_T static void store(T* p, V v) { _mm256_store_pd(p, v); }
+            MATRIX_T static void storeu(T* p, V v) { _mm256_storeu_pd(p, v); }
+            MATRIX_T static V set1(T x) { return _mm256_set1_pd(x); }
+            MATRIX_T static V add(V a, V b) { return _mm256_add_pd(a, b); }
+            MATRIX_T static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+        };
+
+        template <class E> struct Ops<E, KIND_I32> {
+            MATRIX_SIMD_OPS_COMMON(E, __m256i, 8)
+            MATRIX_T static V load(const T* p) { return _mm256_load_si256((const __m256i*)p); }
+            MATRIX_T static V loadu(const T* p) { return _mm256_loadu_si256((const __m256i*)p); }
+            MATRIX_T static void store(T* p, V v) { _mm256_store_si256((__m256i*)p, v); }
+            MATRIX_T static void storeu(T* p, V v) { _mm256_storeu_si256((__m256i*)p, v); }
+            MATRIX_T static V set1(T x) { return _mm256_set1_epi32((int)x); }
+            MATRIX_T static V add(V a, V b) { return _mm256_add_epi32(a, b); }
+            MATRIX_T static V mul(V a, V b) { return _mm256_mullo_epi32(a, b); }
+        };
+
+        template <class E> struct Ops<E, KIND_I64> {
+            MATRIX_SIMD_OPS_COMMON(E, __m256i, 4)
+            MATRIX_T static V load(const T* p) { return _mm256_load_si256((const __m256i*)p); }
+            MATRIX_T static V loadu(const T* p) { return _mm256_loadu_si256((const __m256i*)p); }
+            MATRIX_T static void store(T* p, V v) { _mm256_store_si256((__m256i*)p, v); }
+            MATRIX_T static void storeu(T* p, V v) { _mm256_storeu_si256((__m256i*)p, v); }
+            MATRIX_T static V set1(T x) { return _mm256_set1_epi64x((long long)x); }
+            MATRIX_T static V add(V a, V b) { return _mm256_add_epi64(a, b); }
+            // no 64 bit mullo before AVX-512DQ, same trick as SSE2
+            MATRIX_T static V mul(V a, V b) {
+                __m256i lo = _mm256_mul_epu32(a, b);
+                __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+                                                 _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+                return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+            }
+        };
+
+        MATRIX_SIMD_ELEMENTWISE(MATRIX_T)
+        #undef MATRIX_T
+    }
+
+    // ----------------------------------------------------------------------
+    // AVX-512 (F + DQ)
+    // ----------------------------------------------------------------------
+
+    namespace avx512 {
+        #define MATRIX_T MATRIX_TARGET("avx512f,avx512dq")
+
+        template <class T, int K = SimdKindOf<T>::value> struct Ops;
+
+        template <class E> struct Ops<E, KIND_F32> {
+            MATRIX_SIMD_OPS_COMMON(E, __m512, 16)
+            MATRIX_T static V load(const T* p) { return _mm512_load_ps(p); }
+            MATRIX_T static V loadu(const T* p) { return _mm512_loadu_ps(p); }
+            MATRIX_T static void store(T* p, V v) { _mm512_store_ps(p, v); }
+            MATRIX_T static void storeu(T* p, V v) { _mm512_storeu_ps(p, v); }
+            MATRIX_T static V set1(T x) { return _mm512_set1_ps(x); }
+            MATRIX_T static V add(V a, V b) { return _mm512_add_ps(a, b); }
+            MATRIX_T static V mul(V a, V b) { return _mm512_mul_ps(a, b); }
+        };
+
+        template <class E> struct Ops<E, KIND_F64> {
+            MATRIX_SIMD_OPS_COMMON(E, __m512d, 8)
+            MATRIX_T static V load(const T* p) { return _mm512_load_pd(p); }
+            MATRIX_T static V loadu(const T* p) { return _mm512_loadu_pd(p); }
+            MATRIX_T static void store(T* p, V v) { _mm512_store_pd(p, v); }
+            MATRIX_T static void storeu(T* p, V v) { _mm512_storeu_pd(p, v); }
+            MATRIX_T static V set1(T x) { return _mm512_set1_pd(x); }
+            MATRIX_T static V add(V a, V b) { return _mm512_add_pd(a, b); }
+            MATRIX_T static V mul(V a, V b) { return _mm512_mul_pd(a, b); }
+        };
+
+        template <class E> struct Ops<E, KIND_I32> {
+            MATRIX_SIMD_OPS_COMMON(E, __m512i, 16)
+            MATRIX_T static V load(const T* p) { return _mm512_load_si512((const void*)p); }
+            MATRIX_T static V loadu(const T* p) { return _mm512_loadu_si512((const void*)p); }
+            MATRIX_T static void store(T* p, V v) { _mm512_store_si512((void*)p, v); }
+            MATRIX_T static void storeu(T* p, V v) { _mm512_storeu_si512((void*)p, v); }
+            MATRIX_T static V set1(T x) { return _mm512_set1_epi32((int)x); }
+            MATRIX_T static V add(V a, V b) { return _mm512_add_epi32(a, b); }
+            MATRIX_T static V mul(V a, V b) { return _mm512_mullo_epi32(a, b); }
+        };
+
+        template <class E> struct Ops<E, KIND_I64> {
+            MATRIX_SIMD_OPS_COMMON(E, __m512i, 8)
+            MATRIX_T static V load(const T* p) { return _mm512_load_si512((const void*)p); }
+            MATRIX_T static V loadu(const T* p) { return _mm512_loadu_si512((const void*)p); }
+            MATRIX_T static void store(T* p, V v) { _mm512_store_si512((void*)p, v); }
+            MATRIX_T static void storeu(T* p, V v) { _mm512_storeu_si512((void*)p, v); }
+            MATRIX_T static V set1(T x) { return _mm512_set1_epi64((long long)x); }
+            MATRIX_T static V add(V a, V b) { return _mm512_add_epi64(a, b); }
+            MATRIX_T static V mul(V a, V b) { return _mm512_mullo_epi64(a, b); }
+        };
+
+        MATRIX_SIMD_ELEMENTWISE(MATRIX_T)
+        #undef MATRIX_T
+    }
+
+    #undef MATRIX_SIMD_OPS_COMMON
+    #undef MATRIX_SIMD_ELEMENTWISE
+
+#endif // MATRIX_X86
+
+    // ----------------------------------------------------------------------
+    // dispatch
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief d[i] += s[i], for i in 0..n-1
+     */
+    template <class T>
+    void addTo(T* d, const T* s, std::size_t n, std::false_type) {
+        for (std::size_t i = 0; i < n; i++)
+            d[i] += s[i];
+    }
+
+    /*!
+     * @brief d[i] *= s[i], for i in 0..n-1
+     */
+    template <class T>
+    void multiplyTo(T* d, const T* s, std::size_t n, std::false_type) {
+        for (std::size_t i = 0; i < n; i++)
+            d[i] *= s[i];
+    }
+
+    /*!
+     * @brief d[i] *= scalar, for i in 0..n-1
+     */
+    template <class T>
+    void scaleBy(T* d, T scalar, std::size_t n, std::false_type) {
+        for (std::size_t i = 0; i < n; i++)
+            d[i] *= scalar;
+    }
+
+#ifdef MATRIX_X86
+    template <class T>
+    void addTo(T* d, const T* s, std::size_t n, std::true_type) {
+        switch (simdLevel()) {
+            case SIMD_AVX512: avx512::add<avx512::Ops<T> >(d, s, n); break;
+            case SIMD_AVX2:   avx2::add<avx2::Ops<T> >(d, s, n); break;
+            case SIMD_SSE2:   sse2::add<sse2::Ops<T> >(d, s, n); break;
+            default:          addTo(d, s, n, std::false_type());
+        }
+    }
+
+    template <class T>
+    void multiplyTo(T* d, const T* s, std::size_t n, std::true_type) {
+        switch (simdLevel()) {
+            case SIMD_AVX512: avx512::mul<avx512::Ops<T> >(d, s, n); break;
+            case SIMD_AVX2:   avx2::mul<avx2::Ops<T> >(d, s, n); break;
+            case SIMD_SSE2:   sse2::mul<sse2::Ops<T> >(d, s, n); break;
+            default:          multiplyTo(d, s, n, std::false_type());
+        }
+    }
+
+    template <class T>
+    void scaleBy(T* d, T scalar, std::size_t n, std::true_type) {
+        switch (simdLevel()) {
+            case SIMD_AVX512: avx512::scale<avx512::Ops<T> >(d, scalar, n); break;
+            case SIMD_AVX2:   avx2::scale<avx2::Ops<T> >(d, scalar, n); break;
+            case SIMD_SSE2:   sse2::scale<sse2::Ops<T> >(d, scalar, n); break;
+            default:          scaleBy(d, scalar, n, std::false_type());
+        }
+    }
+
+    template <class T>
+    struct HasSimd : std::integral_constant<bool, SimdKindOf<T>::value != KIND_NONE> {};
+#else
+    template <class T>
+    struct HasSimd : std::false_type {};
+#endif
+
+    template <class T>
+    void addTo(T* d, const T* s, std::size_t n) {
+        addTo(d, s, n, HasSimd<T>());
+    }
+
+    template <class T>
+    void multiplyTo(T* d, const T* s, std::size_t n) {
+        multiplyTo(d, s, n, HasSimd<T>());
+    }
+
+    template <class T>
+    void scaleBy(T* d, T scalar, std::size_t n) {
+        scaleBy(d, scalar, n, HasSimd<T>());
+    }
+
+} // namespace matrix_detail
@@ -0,0 +1,775 @@
+/*!
+ * @file matrix_solve.h
+ * @author Tony Andrioli, The Hague University of Applied Sciences
+ * @date June 2022
+ *
+ * Factorizations and linear systems of float and double matrices: LU with
+ * partial pivoting, Cholesky and Householder QR, triangular solves, and
+ * solve(), determinant() and inverse() built on them.
+ *
+ * @code{.cpp}
+ * Matrix<double> a = ..., b = ...;          // b may have several columns
+ * Matrix<double> x = solve(a, b);           // a*x = b, through LU
+ * LUDecomposition<double> lu(a);            // factorize once, solve many times
+ * Matrix<double> y = lu.solve(c);
+ * double d = lu.determinant();
+ * CholeskyDecomposition<double> chol(s);    // s symmetric positive definite
+ * QRDecomposition<double> qr(tall);         // least squares: min |tall*z - c|
+ * Matrix<double> z = qr.solve(c);
+ * @endcode
+ * The factorizations are blocked and right-looking, as in LAPACK: a panel
+ * of FACTOR_BLOCK columns is factorized element by element, then the rest
+ * of the matrix is updated with one product through the cache blocked,
+ * multithreaded kernel of matrix_gemm.h. For large matrices nearly all the
+ * work is in those products. Triangular solves work the same way, by
+ * blocks of rows, with the right hand side columns split over the threads.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "matrix_alloc.h"
+#include "matrix_expr.h"
+#include "matrix_gemm.h"
+#include "matrix_parallel.h"
+#include "matrix_profile.h"
+#include "matrix_view.h"
+
+/*!
+ * @brief Which triangle of a matrix a triangular solve uses
+ */
+enum class Triangle {
+    Lower,      //!< the diagonal and below
+    Upper       //!< the diagonal and above
+};
+
+/*!
+ * @brief Whether the diagonal of a triangular matrix is taken from it or is all ones
+ */
+enum class Diagonal {
+    NonUnit,    //!< the elements on the diagonal
+    Unit        //!< ones, the diagonal isn't read (the L of LU)
+};
+
+namespace matrix_detail {
+
+    // columns per panel of the factorizations, rows per block of the solves
+    const std::size_t FACTOR_BLOCK = 64;
+
+    // right hand side columns per task of a triangular solve
+    const std::size_t SOLVE_GRAIN = 128;
+
+    /*!
+     * @brief Solve the diagonal block, rows [i0, i1), of a triangular
+     *        system in place: t(i, j) is t[i*rs + j*cs], B has nrhs columns
+     *        and row stride ldb. Rows of B outside the block are read only.
+     */
+    template <class T>
+    void trsmDiagonal(bool lower, std::size_t i0, std::size_t i1, std::size_t nrhs,
+                      const T* t, std::ptrdiff_t rs, std::ptrdiff_t cs, bool unit, T* b, std::size_t ldb) {
+        const std::size_t nb = i1 - i0;
+        parallelFor(0, nrhs, SOLVE_GRAIN, nb * nb * nrhs / 2, [=](std::size_t c0, std::size_t c1) {
+            const std::size_t w = c1 - c0;
+            for (std::size_t s = 0; s < nb; s++) {
+                const std::size_t i = lower ? i0 + s : i1 - 1 - s;
+                const T* ti = t + (std::ptrdiff_t) i * rs;
+                T* bi = b + i * ldb + c0;
+                const std::size_t j0 = lower ? i0 : i + 1;
+                const std::size_t j1 = lower ? i : i1;
+                for (std::size_t j = j0; j < j1; j++) {
+                    const T f = ti[(std::ptrdiff_t) j * cs];
+                    if (f == T(0))
+                        continue;
+                    const T* bj = b + j * ldb + c0;
+                    MATRIX_IVDEP
+                    for (std::size_t c = 0; c < w; c++)
+                        bi[c] -= f * bj[c];
+                }
+                if (!unit) {
+                    const T d = ti[(std::ptrdiff_t) i * cs];
+                    MATRIX_IVDEP
+                    for (std::size_t c = 0; c < w; c++)
+                        bi[c] /= d;
+                }
+            }
+        });
+    }
+
+    /*!
+     * @brief B = inverse(T)*B in place, T n x n triangular with t(i, j) at
+     *        t[i*rs + j*cs] (so a transposed T is the same memory with the
+     *        strides swapped), B n x nrhs with row stride ldb.
+     *
+     * Blocks of FACTOR_BLOCK rows are solved in turn, the rows after them
+     * (before them for an upper T) updated with one product.
+     */
+    template <class T>
+    void trsm(bool lower, std::size_t n, std::size_t nrhs, const T* t, std::ptrdiff_t rs, std::ptrdiff_t cs,
+              bool unit, T* b, std::size_t ldb) {
+        if (n == 0 || nrhs == 0)
+            return;
+        const std::size_t nb = FACTOR_BLOCK;
+        if (lower) {
+            for (std::size_t i0 = 0; i0 < n; i0 += nb) {
+                const std::size_t i1 = (std::min)(n, i0 + nb);
+                trsmDiagonal(true, i0, i1, nrhs, t, rs, cs, unit, b, ldb);
+                if (i1 < n)
+                    gemmParallel<T>(n - i1, nrhs, i1 - i0, t + (std::ptrdiff_t) i1 * rs + (std::ptrdiff_t) i0 * cs, rs, cs,
+                                    b + i0 * ldb, ldb, 1, b + i1 * ldb, ldb, 1, true, T(-1));
+            }
+        } else {
+            for (std::size_t i1 = n; i1 > 0; ) {
+                const std::size_t i0 = i1 > nb ? i1 - nb : 0;
+                trsmDiagonal(false, i0, i1, nrhs, t, rs, cs, unit, b, ldb);
+                if (i0 > 0)
+                    gemmParallel<T>(i0, nrhs, i1 - i0, t + (std::ptrdiff_t) i0 * cs, rs, cs,
+                                    b + i0 * ldb, ldb, 1, b, ldb, 1, true, T(-1));
+                i1 = i0;
+            }
+        }
+    }
+
+    /*!
+     * @brief LU with partial pivoting of the n x n matrix a (row stride lda)
+     *        in place: L (unit diagonal) below the diagonal, U on and above.
+     *
+     * Row j was swapped with row pivots[j] at step j; sign is the sign of
+     * that permutation. Returns false when a pivot is 0 (a is singular),
+     * the factorization is complete anyway.
+     */
+    template <class T>
+    bool luFactor(std::size_t n, T* a, std::size_t lda, std::size_t* pivots, int& sign) {
+        bool regular = true;
+        sign = 1;
+        for (std::size_t k0 = 0; k0 < n; k0 += FACTOR_BLOCK) {
+            const std::size_t k1 = (std::min)(n, k0 + FACTOR_BLOCK);
+            // the panel, columns [k0, k1), a column at a time
+            for (std::size_t j = k0; j < k1; j++) {
+                std::size_t p = j;
+                T largest = std::abs(a[j * lda + j]);
+                for (std::size_t i = j + 1; i < n; i++) {
+                    const T v = std::abs(a[i * lda + j]);
+                    if (v > largest) {
+                        largest = v;
+                        p = i;
+                    }
+                }
+                pivots[j] = p;
+                if (p != j) {
+                    // whole rows: the columns left and right of the panel follow the swap
+                    std::swap_ranges(a + j * lda, a + j * lda + n, a + p * lda);
+                    sign = -sign;
+                }
+                const T d = a[j * lda + j];
+                if (d == T(0)) {
+                    regular = false;
+                    continue;
+                }
+                const T* uj = a + j * lda;
+                parallelFor(j + 1, n, 256, (n - j) * (k1 - j), [=](std::size_t r0, std::size_t r1) {
+                    for (std::size_t i = r0; i < r1; i++) {
+                        T* ri = a + i * lda;
+                        const T l = ri[j] / d;
+                        ri[j] = l;
+                        MATRIX_IVDEP
+                        for (std::size_t c = j + 1; c < k1; c++)
+                            ri[c] -= l * uj[c];
+                    }
+                });
+            }
+            if (k1 == n)
+                break;
+            // U12 = inverse(L11) * A12, then A22 -= L21 * U12
+            trsm<T>(true, k1 - k0, n - k1, a + k0 * lda + k0, lda, 1, true, a + k0 * lda + k1, lda);
+            gemmParallel<T>(n - k1, n - k1, k1 - k0, a + k1 * lda + k0, lda, 1, a + k0 * lda + k1, lda, 1,
+                            a + k1 * lda + k1, lda, 1, true, T(-1));
+        }
+        return regular;
+    }
+
+    /*!
+     * @brief Cholesky factorization a = L*transpose(L) of the n x n matrix a
+     *        (row stride lda) in place; only the lower triangle is read and
+     *        written. Returns false when a isn't positive definite.
+     */
+    template <class T>
+    bool choleskyFactor(std::size_t n, T* a, std::size_t lda) {
+        for (std::size_t k0 = 0; k0 < n; k0 += FACTOR_BLOCK) {
+            const std::size_t k1 = (std::min)(n, k0 + FACTOR_BLOCK);
+            const std::size_t kb = k1 - k0;
+            // the diagonal block, the columns left of it are applied already
+            for (std::size_t j = k0; j < k1; j++) {
+                const T* rj = a + j * lda;
+                T d = rj[j];
+                for (std::size_t p = k0; p < j; p++)
+                    d -= rj[p] * rj[p];
+                if (!(d > T(0)))
+                    return false;
+                d = std::sqrt(d);
+                a[j * lda + j] = d;
+                for (std::size_t i = j + 1; i < k1; i++) {
+                    T* ri = a + i * lda;
+                    T s = ri[j];
+                    for (std::size_t p = k0; p < j; p++)
+                        s -= ri[p] * rj[p];
+                    ri[j] = s / d;
+                }
+            }
+            if (k1 == n)
+                break;
+            // L21 = A21 * inverse(transpose(L11)), row by row
+            parallelFor(k1, n, 64, (n - k1) * kb * kb / 2, [=](std::size_t r0, std::size_t r1) {
+                for (std::size_t i = r0; i < r1; i++) {
+                    T* ri = a + i * lda;
+                    for (std::size_t j = k0; j < k1; j++) {
+                        const T* rj = a + j * lda;
+                        T s = ri[j];
+                        for (std::size_t p = k0; p < j; p++)
+                            s -= ri[p] * rj[p];
+                        ri[j] = s / rj[j];
+                    }
+                }
+            });
+            // A22 -= L21 * transpose(L21), lower triangle only: a block column at a time,
+            // below the diagonal block with one product, the diagonal block element-wise
+            for (std::size_t j0 = k1; j0 < n; j0 += FACTOR_BLOCK) {
+                const std::size_t j1 = (std::min)(n, j0 + FACTOR_BLOCK);
+                if (j1 < n)
+                    gemmParallel<T>(n - j1, j1 - j0, kb, a + j1 * lda + k0, lda, 1, a + j0 * lda + k0, 1, lda,
+                                    a + j1 * lda + j0, lda, 1, true, T(-1));
+            }
+            const std::size_t blocks = (n - k1 + FACTOR_BLOCK - 1) / FACTOR_BLOCK;
+            parallelFor(0, blocks, 1, (n - k1) * FACTOR_BLOCK * kb / 2, [=](std::size_t b0, std::size_t b1) {
+                for (std::size_t i = k1 + b0 * FACTOR_BLOCK; i < (std::min)(n, k1 + b1 * FACTOR_BLOCK); i++) {
+                    T* ri = a + i * lda;
+                    for (std::size_t j = k1 + (i - k1) / FACTOR_BLOCK * FACTOR_BLOCK; j <= i; j++) {
+                        const T* rj = a + j * lda;
+                        T s = T(0);
+                        for (std::size_t p = k0; p < k1; p++)
+                            s += ri[p] * rj[p];
+                        ri[j] -= s;
+                    }
+                }
+            });
+        }
+        return true;
+    }
+
+    /*!
+     * @brief The Householder reflection H = I - tau*v*transpose(v) with
+     *        H*x = beta*e1, for x of len elements at stride inc (dlarfg).
+     *
+     * x becomes beta followed by v(1..), v(0) is 1 implicitly. Returns tau,
+     * 0 when x is a multiple of e1 already.
+     */
+    template <class T>
+    T householder(std::size_t len, T* x, std::ptrdiff_t inc) {
+        T sigma = 0;
+        for (std::size_t i = 1; i < len; i++)
+            sigma += x[(std::ptrdiff_t) i * inc] * x[(std::ptrdiff_t) i * inc];
+        if (sigma == T(0))
+            return T(0);
+        const T alpha = x[0];
+        T beta = std::sqrt(alpha * alpha + sigma);
+        if (alpha > T(0))
+            beta = -beta;
+        const T scale = T(1) / (alpha - beta);
+        for (std::size_t i = 1; i < len; i++)
+            x[(std::ptrdiff_t) i * inc] *= scale;
+        x[0] = beta;
+        return (beta - alpha) / beta;
+    }
+
+    /*!
+     * @brief C = Q*C or transpose(Q)*C for the block of kb reflections of
+     *        a QR panel: Q = H(0)...H(kb-1) = I - V*T*transpose(V) (dlarfb).
+     *
+     * The vectors are below the diagonal of the rows x kb panel v (row
+     * stride ldv), as qrFactor() leaves them; C is rows x cols. Both
+     * products with V go through gemm.
+     */
+    template <class T>
+    void applyReflectors(bool trans, std::size_t rows, std::size_t cols, std::size_t kb,
+                         const T* v, std::size_t ldv, const T* tau, T* c, std::size_t ldc) {
+        if (rows == 0 || cols == 0 || kb == 0)
+            return;
+        // V with its unit diagonal and zeros above it
+        ScratchBuffer<T> vb(rows * kb);
+        T* V = vb.data();
+        for (std::size_t i = 0; i < rows; i++)
+            for (std::size_t j = 0; j < kb; j++)
+                V[i * kb + j] = i > j ? v[i * ldv + j] : (i == j ? T(1) : T(0));
+        // the upper triangular T (dlarft): T(0:i, i) = -tau(i) * T(0:i, 0:i) * transpose(V(:, 0:i)) * v(i)
+        std::vector<T> t(kb * kb, T(0)), z(kb);
+        for (std::size_t i = 0; i < kb; i++) {
+            t[i * kb + i] = tau[i];
+            if (tau[i] == T(0))
+                continue;
+            for (std::size_t j = 0; j < i; j++) {
+                T s = 0;
+                for (std::size_t r = i; r < rows; r++)
+                    s += V[r * kb + j] * V[r * kb + i];
+                z[j] = s;
+            }
+            for (std::size_t r = 0; r < i; r++) {
+                T s = 0;
+                for (std::size_t q = r; q < i; q++)
+                    s += t[r * kb + q] * z[q];
+                t[r * kb + i] = -tau[i] * s;
+            }
+        }
+        // W = transpose(V) * C, W = op(T) * W, C -= V * W
+        ScratchBuffer<T> wb(kb * cols);
+        T* W = wb.data();
+        gemmParallel<T>(kb, cols, rows, V, 1, kb, c, ldc, 1, W, cols, 1);
+        const T* tp = t.data();
+        parallelFor(0, cols, SOLVE_GRAIN, kb * kb * cols / 2, [=](std::size_t c0, std::size_t c1) {
+            std::vector<T> col(kb);
+            for (std::size_t j = c0; j < c1; j++) {
+                for (std::size_t r = 0; r < kb; r++)
+                    col[r] = W[r * cols + j];
+                for (std::size_t r = 0; r < kb; r++) {
+                    T s = 0;
+                    if (trans)              // transpose(T) is lower triangular
+                        for (std::size_t q = 0; q <= r; q++)
+                            s += tp[q * kb + r] * col[q];
+                    else
+                        for (std::size_t q = r; q < kb; q++)
+                            s += tp[r * kb + q] * col[q];
+                    W[r * cols + j] = s;
+                }
+            }
+        });
+        gemmParallel<T>(rows, cols, kb, V, kb, 1, W, cols, 1, c, ldc, 1, true, T(-1));
+    }
+
+    /*!
+     * @brief Householder QR of the m x n matrix a (row stride lda) in place:
+     *        R on and above the diagonal, the reflection vectors below it,
+     *        their factors in tau (min(m, n) of them), as LAPACK's dgeqrf.
+     */
+    template <class T>
+    void qrFactor(std::size_t m, std::size_t n, T* a, std::size_t lda, T* tau) {
+        const std::size_t k = (std::min)(m, n);
+        std::vector<T> w(FACTOR_BLOCK);
+        for (std::size_t k0 = 0; k0 < k; k0 += FACTOR_BLOCK) {
+            const std::size_t k1 = (std::min)(k, k0 + FACTOR_BLOCK);
+            // the panel, columns [k0, k1), a reflection at a time
+            for (std::size_t j = k0; j < k1; j++) {
+                const T tj = householder(m - j, a + j * lda + j, (std::ptrdiff_t) lda);
+                tau[j] = tj;
+                if (tj == T(0) || j + 1 == k1)
+                    continue;
+                // the rest of the panel: w = transpose(v) * A, A -= tau * v * w
+                const std::size_t c0 = j + 1, nc = k1 - c0;
+                for (std::size_t c = 0; c < nc; c++)
+                    w[c] = a[j * lda + c0 + c];
+                for (std::size_t i = j + 1; i < m; i++) {
+                    const T vi = a[i * lda + j];
+                    const T* ri = a + i * lda + c0;
+                    for (std::size_t c = 0; c < nc; c++)
+                        w[c] += vi * ri[c];
+                }
+                for (std::size_t c = 0; c < nc; c++)
+                    a[j * lda + c0 + c] -= tj * w[c];
+                for (std::size_t i = j + 1; i < m; i++) {
+                    const T vi = tj * a[i * lda + j];
+                    T* ri = a + i * lda + c0;
+                    for (std::size_t c = 0; c < nc; c++)
+                        ri[c] -= vi * w[c];
+                }
+            }
+            // the columns right of the panel
+            if (k1 < n)
+                applyReflectors<T>(true, m - k0, n - k1, k1 - k0, a + k0 * lda + k0, lda, tau + k0,
+                                   a + k0 * lda + k1, lda);
+        }
+    }
+
+    // row-major copy of a matrix with the default allocator, for factorizing in place
+    template <class T, class Alloc>
+    Matrix<T> factorCopy(const Matrix<T, Alloc>& a) {
+        Matrix<T> ret(a.rows(), a.cols(), MatrixInit::Uninitialized);
+        viewCopy(a.view(), ret.view());
+        return ret;
+    }
+
+    // whether b has to be solved on a row-major copy
+    template <class T, class Alloc>
+    bool columnMajor(const Matrix<T, Alloc>& b) {
+        return b.layout() != MatrixLayout::RowMajor && !b.isVector();
+    }
+
+    // the triangle of a square or trapezoidal matrix, zeros elsewhere
+    template <class T>
+    Matrix<T> triangle(const Matrix<T>& a, std::size_t rows, bool lower, bool unit) {
+        Matrix<T> ret(rows, a.cols(), MatrixInit::Zero);
+        for (std::size_t i = 0; i < rows; i++)
+            for (std::size_t j = 0; j < a.cols(); j++) {
+                if (i == j)
+                    ret.data()[i * a.cols() + j] = unit ? T(1) : a.data()[i * a.cols() + j];
+                else if ((j < i) == lower)
+                    ret.data()[i * a.cols() + j] = a.data()[i * a.cols() + j];
+            }
+        return ret;
+    }
+
+} // namespace matrix_detail
+
+/*!
+ * @brief Solve op(t)*x = b in place (b becomes x), t a square triangular
+ *        matrix, b with any number of columns (trsm of BLAS)
+ *
+ * Only the triangle of t given by uplo is read.
+ * @exception invalid_argument thrown when t isn't square or b has another number of rows.
+ */
+template <class T, class Alloc, class BAlloc>
+void solveTriangular(const Matrix<T, Alloc>& t, Matrix<T, BAlloc>& b, Triangle uplo,
+                     Transpose trans = Transpose::No, Diagonal diag = Diagonal::NonUnit) {
+    static_assert(std::is_floating_point<T>::value, "solveTriangular: T must be float or double");
+    const std::size_t n = t.rows();
+    if (t.cols() != n || b.rows() != n)
+        throw std::invalid_argument("solveTriangular: t must be square with as many rows as b.");
+    if (matrix_detail::columnMajor(b)) {
+        Matrix<T> x = matrix_detail::factorCopy(b);
+        solveTriangular(t, x, uplo, trans, diag);
+        matrix_detail::viewCopy(x.view(), b.view());
+        return;
+    }
+    matrix_detail::OpScope scope(MatrixOp::Solve, n * n * b.cols());
+    const bool transposed = trans == Transpose::Yes;
+    // transpose(lower) is upper: the same memory read with the strides swapped,
+    // and so is a column-major t
+    const std::ptrdiff_t rs = t.layout() == MatrixLayout::RowMajor ? (std::ptrdiff_t) n : 1;
+    const std::ptrdiff_t cs = t.layout() == MatrixLayout::RowMajor ? 1 : (std::ptrdiff_t) n;
+    matrix_detail::trsm<T>((uplo == Triangle::Lower) != transposed, n, b.cols(), t.data(),
+                           transposed ? cs : rs, transposed ? rs : cs,
+                           diag == Diagonal::Unit, b.data(), b.cols());
+}
+
+/*!
+ * @class LUDecomposition
+ * @brief a = P*L*U with partial pivoting, for square float and double
+ *        matrices (dgetrf), see matrix_solve.h
+ */
+template <class T>
+class LUDecomposition {
+    static_assert(std::is_floating_point<T>::value, "LUDecomposition: T must be float or double");
+public:
+    /*!
+     * @brief Factorize a; a singular matrix is factorized too, see isSingular()
+     * @exception invalid_argument thrown when a isn't square.
+     */
+    template <class Alloc>
+    explicit LUDecomposition(const Matrix<T, Alloc>& a) : lu(matrix_detail::factorCopy(a)), piv(a.rows()) {
+        const std::size_t n = a.rows();
+        if (a.cols() != n)
+            throw std::invalid_argument("LU: the matrix must be square.");
+        matrix_detail::OpScope scope(MatrixOp::Solve, 2 * n * n * n / 3);
+        regular = matrix_detail::luFactor<T>(n, lu.data(), n, piv.data(), sign);
+    }
+
+    /*!
+     * @brief Whether a pivot is 0: the determinant is 0 and solve() throws
+     */
+    bool isSingular() const { return !regular; }
+
+    /*!
+     * @brief L below the diagonal (without its unit diagonal) and U on and above it
+     */
+    const Matrix<T>& packed() const { return lu; }
+
+    /*!
+     * @brief Row i was swapped with row pivots()[i], in order of i
+     */
+    const std::vector<std::size_t>& pivots() const { return piv; }
+
+    /*!
+     * @brief L, with ones on the diagonal
+     */
+    Matrix<T> lower() const { return matrix_detail::triangle(lu, lu.rows(), true, true); }
+
+    /*!
+     * @brief U
+     */
+    Matrix<T> upper() const { return matrix_detail::triangle(lu, lu.rows(), false, false); }
+
+    /*!
+     * @brief The determinant of a: the product of the diagonal of U, times the sign of P
+     */
+    T determinant() const {
+        T d = T(sign);
+        for (std::size_t i = 0; i < lu.rows(); i++)
+            d *= lu.data()[i * lu.cols() + i];
+        return d;
+    }
+
+    /*!
+     * @brief Solve a*x = b in place, for every column of b
+     * @exception invalid_argument thrown when b has another number of rows
+     *            than a, or a is singular.
+     */
+    template <class Alloc>
+    void solveInPlace(Matrix<T, Alloc>& b) const {
+        const std::size_t n = lu.rows(), nrhs = b.cols();
+        if (b.rows() != n)
+            throw std::invalid_argument("LU solve: b must have as many rows as the matrix.");
+        if (!regular)
+            throw std::invalid_argument("LU solve: the matrix is singular.");
+        if (matrix_detail::columnMajor(b)) {
+            Matrix<T> x = matrix_detail::factorCopy(b);
+            solveInPlace(x);
+            matrix_detail::viewCopy(x.view(), b.view());
+            return;
+        }
+        matrix_detail::OpScope scope(MatrixOp::Solve, 2 * n * n * nrhs);
+        T* x = b.data();
+        for (std::size_t i = 0; i < n; i++)
+            if (piv[i] != i)
+                std::swap_ranges(x + i * nrhs, x + (i + 1) * nrhs, x + piv[i] * nrhs);
+        matrix_detail::trsm<T>(true, n, nrhs, lu.data(), n, 1, true, x, nrhs);
+        matrix_detail::trsm<T>(false, n, nrhs, lu.data(), n, 1, false, x, nrhs);
+    }
+
+    /*!
+     * @brief The solution x of a*x = b, see solveInPlace()
+     */
+    template <class Alloc>
+    Matrix<T> solve(const Matrix<T, Alloc>& b) const {
+        Matrix<T> x = matrix_detail::factorCopy(b);
+        solveInPlace(x);
+        return x;
+    }
+
+    /*!
+     * @brief The inverse of a
+     * @exception invalid_argument thrown when a is singular.
+     */
+    Matrix<T> inverse() const {
+        const std::size_t n = lu.rows();
+        Matrix<T> x(n, n, MatrixInit::Zero);
+        for (std::size_t i = 0; i < n; i++)
+            x.data()[i * n + i] = T(1);
+        solveInPlace(x);
+        return x;
+    }
+
+private:
+    Matrix<T> lu;
+    std::vector<std::size_t> piv;
+    int sign;
+    bool regular;
+};
+
+/*!
+ * @class CholeskyDecomposition
+ * @brief a = L*transpose(L) for symmetric positive definite float and
+ *        double matrices (dpotrf), see matrix_solve.h
+ */
+template <class T>
+class CholeskyDecomposition {
+    static_assert(std::is_floating_point<T>::value, "CholeskyDecomposition: T must be float or double");
+public:
+    /*!
+     * @brief Factorize a; only its lower triangle is read
+     * @exception invalid_argument thrown when a isn't square or not positive definite.
+     */
+    template <class Alloc>
+    explicit CholeskyDecomposition(const Matrix<T, Alloc>& a) : l(matrix_detail::factorCopy(a)) {
+        const std::size_t n = a.rows();
+        if (a.cols() != n)
+            throw std::invalid_argument("Cholesky: the matrix must be square.");
+        matrix_detail::OpScope scope(MatrixOp::Solve, n * n * n / 3);
+        if (!matrix_detail::choleskyFactor<T>(n, l.data(), n))
+            throw std::invalid_argument("Cholesky: the matrix is not positive definite.");
+        for (std::size_t i = 0; i < n; i++)
+            std::fill(l.data() + i * n + i + 1, l.data() + (i + 1) * n, T(0));
+    }
+
+    /*!
+     * @brief L, zeros above the diagonal
+     */
+    const Matrix<T>& lower() const { return l; }
+
+    /*!
+     * @brief The determinant of a: the square of the product of the diagonal of L
+     */
+    T determinant() const {
+        T d = 1;
+        for (std::size_t i = 0; i < l.rows(); i++)
+            d *= l.data()[i * l.cols() + i];
+        return d * d;
+    }
+
+    /*!
+     * @brief Solve a*x = b in place, for every column of b
+     * @exception invalid_argument thrown when b has another number of rows than a.
+     */
+    template <class Alloc>
+    void solveInPlace(Matrix<T, Alloc>& b) const {
+        const std::size_t n = l.rows(), nrhs = b.cols();
+        if (b.rows() != n)
+            throw std::invalid_argument("Cholesky solve: b must have as many rows as the matrix.");
+        if (matrix_detail::columnMajor(b)) {
+            Matrix<T> x = matrix_detail::factorCopy(b);
+            solveInPlace(x);
+            matrix_detail::viewCopy(x.view(), b.view());
+            return;
+        }
+        matrix_detail::OpScope scope(MatrixOp::Solve, 2 * n * n * nrhs);
+        matrix_detail::trsm<T>(true, n, nrhs, l.data(), n, 1, false, b.data(), nrhs);
+        matrix_detail::trsm<T>(false, n, nrhs, l.data(), 1, n, false, b.data(), nrhs);
+    }
+
+    /*!
+     * @brief The solution x of a*x = b, see solveInPlace()
+     */
+    template <class Alloc>
+    Matrix<T> solve(const Matrix<T, Alloc>& b) const {
+        Matrix<T> x = matrix_detail::factorCopy(b);
+        solveInPlace(x);
+        return x;
+    }
+
+    /*!
+     * @brief The inverse of a
+     */
+    Matrix<T> inverse() const {
+        const std::size_t n = l.rows();
+        Matrix<T> x(n, n, MatrixInit::Zero);
+        for (std::size_t i = 0; i < n; i++)
+            x.data()[i * n + i] = T(1);
+        solveInPlace(x);
+        return x;
+    }
+
+private:
+    Matrix<T> l;
+};
+
+/*!
+ * @class QRDecomposition
+ * @brief a = Q*R with Householder reflections, for float and double
+ *        matrices of any shape (dgeqrf), see matrix_solve.h
+ */
+template <class T>
+class QRDecomposition {
+    static_assert(std::is_floating_point<T>::value, "QRDecomposition: T must be float or double");
+public:
+    template <class Alloc>
+    explicit QRDecomposition(const Matrix<T, Alloc>& a)
+        : qr(matrix_detail::factorCopy(a)), t((std::min)(a.rows(), a.cols())) {
+        const std::size_t m = a.rows(), n = a.cols();
+        matrix_detail::OpScope scope(MatrixOp::Solve, 2 * m * n * t.size());
+        matrix_detail::qrFactor<T>(m, n, qr.data(), n, t.data());
+    }
+
+    /*!
+     * @brief R on and above the diagonal, the Householder vectors below it
+     */
+    const Matrix<T>& packed() const { return qr; }
+
+    /*!
+     * @brief The factors of the Householder reflections, see packed()
+     */
+    const std::vector<T>& tau() const { return t; }
+
+    /*!
+     * @brief The min(m, n) x n upper triangular R
+     */
+    Matrix<T> r() const { return matrix_detail::triangle(qr, t.size(), false, false); }
+
+    /*!
+     * @brief The m x min(m, n) Q with orthonormal columns (dorgqr)
+     */
+    Matrix<T> q() const {
+        const std::size_t m = qr.rows(), n = qr.cols(), k = t.size();
+        Matrix<T> ret(m, k, MatrixInit::Zero);
+        for (std::size_t i = 0; i < k; i++)
+            ret.data()[i * k + i] = T(1);
+        matrix_detail::OpScope scope(MatrixOp::Solve, 2 * m * k * k);
+        // H(0)...H(k-1) applied to the identity, last block first: a block
+        // only changes rows and columns from its first one on
+        const std::size_t nb = matrix_detail::FACTOR_BLOCK;
+        for (std::size_t blk = (k + nb - 1) / nb; blk-- > 0; ) {
+            const std::size_t k0 = blk * nb;
+            const std::size_t kb = (std::min)(k, k0 + nb) - k0;
+            matrix_detail::applyReflectors<T>(false, m - k0, k - k0, kb, qr.data() + k0 * n + k0, n, t.data() + k0,
+                                              ret.data() + k0 * k + k0, k);
+        }
+        return ret;
+    }
+
+    /*!
+     * @brief The least squares solution x of a*x = b (the exact one when a
+     *        is square), for every column of b
+     * @exception invalid_argument thrown when a has fewer rows than columns,
+     *            b another number of rows than a, or R has a 0 on its
+     *            diagonal (a doesn't have full rank).
+     */
+    template <class Alloc>
+    Matrix<T> solve(const Matrix<T, Alloc>& b) const {
+        const std::size_t m = qr.rows(), n = qr.cols(), nrhs = b.cols();
+        if (m < n)
+            throw std::invalid_argument("QR solve: the matrix has more columns than rows.");
+        if (b.rows() != m)
+            throw std::invalid_argument("QR solve: b must have as many rows as the matrix.");
+        for (std::size_t i = 0; i < n; i++)
+            if (qr.data()[i * n + i] == T(0))
+                throw std::invalid_argument("QR solve: the matrix doesn't have full rank.");
+        matrix_detail::OpScope scope(MatrixOp::Solve, 4 * m * n * nrhs);
+        Matrix<T> y = matrix_detail::factorCopy(b);
+        // y = transpose(Q) * b, then R*x = the first n rows of y
+        for (std::size_t k0 = 0; k0 < n; k0 += matrix_detail::FACTOR_BLOCK) {
+            const std::size_t kb = (std::min)(n, k0 + matrix_detail::FACTOR_BLOCK) - k0;
+            matrix_detail::applyReflectors<T>(true, m - k0, nrhs, kb, qr.data() + k0 * n + k0, n, t.data() + k0,
+                                              y.data() + k0 * nrhs, nrhs);
+        }
+        matrix_detail::trsm<T>(false, n, nrhs, qr.data(), n, 1, false, y.data(), nrhs);
+        Matrix<T> x(n, nrhs, MatrixInit::Uninitialized);
+        std::copy(y.data(), y.data() + n * nrhs, x.data());
+        return x;
+    }
+
+private:
+    Matrix<T> qr;
+    std::vector<T> t;
+};
+
+/*!
+ * @brief The solution x of a*x = b for square a, through LU; b may have
+ *        several columns
+ * @exception invalid_argument thrown when a isn't square, b has another
+ *            number of rows, or a is singular.
+ */
+template <class T, class Alloc, class BAlloc>
+Matrix<T> solve(const Matrix<T, Alloc>& a, const Matrix<T, BAlloc>& b) {
+    return LUDecomposition<T>(a).solve(b);
+}
+
+/*!
+ * @brief The determinant of a square float or double matrix, through LU
+ * @exception invalid_argument thrown when a isn't square.
+ */
+template <class T, class Alloc>
+T determinant(const Matrix<T, Alloc>& a) {
+    return LUDecomposition<T>(a).determinant();
+}
+
+/*!
+ * @brief The inverse of a square float or double matrix, through LU
+ *
+ * To solve a system, solve() is faster and more accurate than multiplying
+ * with the inverse.
+ * @exception invalid_argument thrown when a isn't square or is singular.
+ */
+template <class T, class Alloc>
+Matrix<T> inverse(const Matrix<T, Alloc>& a) {
+    return LUDecomposition<T>(a).inverse();
+}
@@ -0,0 +1,549 @@
+/*!
+ * @file matrix_sparse.h
+ * @author Tony Andrioli, The Hague University of Applied Sciences
+ * @date June 2022
+ *
+ * Sparse matrices in compressed row (CSR) or compressed column (CSC) format.
+ *
+ * Only the non-zero elements are stored, with their column (CSR) or row
+ * (CSC) index, plus where every row (column) starts. So the memory is
+ * O(nnz + rows) and the products below take O(nnz) time per column of the
+ * dense operand, instead of O(rows * cols).
+ * @code{.cpp}
+ * SparseMatrix<double> S(dense);            // drops the zeros
+ * Matrix<double> C = S * B;                 // sparse x dense
+ * std::vector<double> y = S.multiply(x);    // SpMV, in parallel
+ * @endcode
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "matrix_alloc.h"
+#include "matrix_expr.h"
+#include "matrix_parallel.h"
+#include "matrix_view.h"
+
+/*!
+ * @brief Storage order of a SparseMatrix
+ */
+enum class SparseFormat {
+    CSR,    //!< compressed sparse row: the non-zeros row by row
+    CSC     //!< compressed sparse column: the non-zeros column by column
+};
+
+/*!
+ * @brief One element (row, col, value), to build a SparseMatrix from.
+ */
+template <class T>
+struct SparseTriplet {
+    std::size_t row, col;
+    T value;
+};
+
+/*!
+ * @class SparseMatrix
+ * @brief Sparse matrix in CSR or CSC format, see matrix_sparse.h
+ *
+ * A "line" below is a row in CSR and a column in CSC. Line i has its
+ * non-zeros at positions ptr[i] .. ptr[i+1]-1 of idx (the other index,
+ * ascending) and val. The indices are 32 bit to save memory, so a line can
+ * be at most 2^32 elements long; nnz and the number of lines are 64 bit.
+ */
+template <class T>
+class SparseMatrix {
+public:
+    typedef T value_type;
+
+    // ----------------------------------------------------------------------
+    // constructors
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief Constructs an empty (0 x 0) matrix
+     */
+    SparseMatrix() : r(0), c(0), fmt(SparseFormat::CSR), ptr(1, 0) {}
+
+    /*!
+     * @brief A rows x columns matrix with only zeros
+     */
+    SparseMatrix(std::size_t rows, std::size_t columns, SparseFormat format = SparseFormat::CSR)
+        : r(rows), c(columns), fmt(format), ptr(lines(rows, columns, format) + 1, 0) {}
+
+    /*!
+     * @brief Build from a list of elements, in any order.
+     *
+     * Elements with the same position are added up, zeros are left out.
+     * @exception invalid_argument thrown when an element is out of bounds.
+     */
+    SparseMatrix(std::size_t rows, std::size_t columns, const std::vector<SparseTriplet<T> >& elements,
+                 SparseFormat format = SparseFormat::CSR)
+        : r(rows), c(columns), fmt(format), ptr(lines(rows, columns, format) + 1, 0) {
+        const bool csr = format == SparseFormat::CSR;
+        for (std::size_t i = 0; i < elements.size(); i++) {
+            if (elements[i].row >= rows || elements[i].col >= columns)
+                throw std::invalid_argument("SparseMatrix: element out of bounds");
+            ptr[(csr ? elements[i].row : elements[i].col) + 1]++;
+        }
+        for (std::size_t i = 0; i + 1 < ptr.size(); i++)
+            ptr[i + 1] += ptr[i];
+        // bucket by line, then sort every line and merge duplicates
+        std::vector<std::pair<unsigned int, T> > tmp(elements.size());
+        std::vector<std::size_t> next(ptr.begin(), ptr.end() - 1);
+        for (std::size_t i = 0; i < elements.size(); i++) {
+            const SparseTriplet<T>& e = elements[i];
+            tmp[next[csr ? e.row : e.col]++] = std::make_pair((unsigned int)(csr ? e.col : e.row), e.value);
+        }
+        std::vector<std::size_t> oldPtr(ptr);
+        idx.reserve(elements.size());
+        val.reserve(elements.size());
+        for (std::size_t l = 0; l + 1 < oldPtr.size(); l++) {
+            std::sort(tmp.begin() + oldPtr[l], tmp.begin() + oldPtr[l + 1],
+                      [](const std::pair<unsigned int, T>& a, const std::pair<unsigned int, T>& b) { return a.first < b.first; });
+            for (std::size_t k = oldPtr[l]; k < oldPtr[l + 1]; ) {
+                unsigned int at = tmp[k].first;
+                T sum = tmp[k].second;
+                for (k++; k < oldPtr[l + 1] && tmp[k].first == at; k++)
+                    sum += tmp[k].second;
+                if (sum != T(0)) {
+                    idx.push_back(at);
+                    val.push_back(sum);
+                }
+            }
+            ptr[l + 1] = idx.size();
+        }
+    }
+
+    /*!
+     * @brief Convert a dense matrix, only the non-zero elements are kept.
+     */
+    template <class Alloc>
+    explicit SparseMatrix(const Matrix<T, Alloc>& dense, SparseFormat format = SparseFormat::CSR)
+        : r(dense.rows()), c(dense.cols()), fmt(format), ptr(1, 0) {
+        lines(r, c, format);
+        Matrix<T, Alloc> copy;
+        const T* d = matrix_detail::rowMajor(dense, copy).data();
+        if (format == SparseFormat::CSR) {
+            ptr.reserve(r + 1);
+            for (std::size_t i = 0; i < r; i++) {
+                for (std::size_t j = 0; j < c; j++)
+                    if (d[i * c + j] != T(0)) {
+                        idx.push_back((unsigned int)j);
+                        val.push_back(d[i * c + j]);
+                    }
+                ptr.push_back(idx.size());
+            }
+        } else {
+            *this = SparseMatrix(dense, SparseFormat::CSR).convert(SparseFormat::CSC);
+        }
+    }
+
+    // ----------------------------------------------------------------------
+    // getters
+    // ----------------------------------------------------------------------
+
+    std::size_t rows() const { return r; }
+    std::size_t cols() const { return c; }
+
+    /*!
+     * @brief The number of stored (non-zero) elements
+     */
+    std::size_t nnz() const { return val.size(); }
+
+    SparseFormat format() const { return fmt; }
+
+    /*!
+     * @brief The raw arrays: line starts (lines+1), indices and values (nnz)
+     */
+    const std::vector<std::size_t>& pointers() const { return ptr; }
+    const std::vector<unsigned int>& indices() const { return idx; }
+    const std::vector<T>& values() const { return val; }
+
+    /*!
+     * @brief Get one element, O(log nnz of its row/column)
+     * @exception invalid_argument thrown when row or col is out of bounds.
+     */
+    T get(std::size_t row, std::size_t col) const {
+        if (row >= r || col >= c)
+            throw std::invalid_argument("Get: out of bounds");
+        const std::size_t line = fmt == SparseFormat::CSR ? row : col;
+        const unsigned int at = (unsigned int)(fmt == SparseFormat::CSR ? col : row);
+        std::vector<unsigned int>::const_iterator b = idx.begin() + ptr[line], e = idx.begin() + ptr[line + 1];
+        std::vector<unsigned int>::const_iterator it = std::lower_bound(b, e, at);
+        if (it != e && *it == at)
+            return val[it - idx.begin()];
+        return T(0);
+    }
+
+    // ----------------------------------------------------------------------
+    // conversions
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief The same matrix in the given format, O(nnz + rows + cols)
+     */
+    SparseMatrix convert(SparseFormat format) const {
+        if (format == fmt)
+            return *this;
+        // the CSR arrays of A are the CSC arrays of transpose(A): transpose the pattern
+        SparseMatrix ret;
+        ret.r = r;
+        ret.c = c;
+        ret.fmt = format;
+        transposeArrays(ret);
+        return ret;
+    }
+
+    /*!
+     * @brief The transpose, in the same format, O(nnz + rows + cols)
+     */
+    SparseMatrix transpose() const {
+        // reading our arrays in the other format gives the transpose for free,
+        // then convert back
+        SparseMatrix t(*this);
+        std::swap(t.r, t.c);
+        t.fmt = fmt == SparseFormat::CSR ? SparseFormat::CSC : SparseFormat::CSR;
+        return t.convert(fmt);
+    }
+
+    /*!
+     * @brief A dense copy
+     */
+    Matrix<T> toDense() const {
+        Matrix<T> ret(r, c);
+        T* d = ret.data();
+        const bool csr = fmt == SparseFormat::CSR;
+        for (std::size_t l = 0; l + 1 < ptr.size(); l++)
+            for (std::size_t k = ptr[l]; k < ptr[l + 1]; k++) {
+                if (csr)
+                    d[l * c + idx[k]] = val[k];
+                else
+                    d[(std::size_t)idx[k] * c + l] = val[k];
+            }
+        return ret;
+    }
+
+    // ----------------------------------------------------------------------
+    // operations
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief Sparse matrix times vector: y = this * x (SpMV)
+     *
+     * In CSR every row is a dot product and the rows are split over the
+     * thread pool. In CSC the columns are scattered into y; every thread
+     * owns a band of rows of y and takes from each column the non-zeros
+     * inside its band (found by binary search), so y is summed in the
+     * order of a serial loop, whatever the number of threads.
+     * @param[in]  x cols() elements
+     * @param[out] y rows() elements
+     */
+    void multiply(const T* x, T* y) const {
+        if (fmt == SparseFormat::CSR) {
+            const std::size_t* p = ptr.data();
+            const unsigned int* ix = idx.data();
+            const T* v = val.data();
+            const std::size_t grain = 256;
+            matrix_detail::parallelFor(0, r, grain, val.size(), [=](std::size_t b, std::size_t e) {
+                for (std::size_t i = b; i < e; i++) {
+                    T sum = T(0);
+                    for (std::size_t k = p[i]; k < p[i + 1]; k++)
+                        sum += v[k] * x[ix[k]];
+                    y[i] = sum;
+                }
+            });
+        } else {
+            const std::size_t* p = ptr.data();
+            const unsigned int* ix = idx.data();
+            const T* v = val.data();
+            const std::size_t rows = r, columns = c;
+            // every band searches all columns, so keep them few and large
+            const std::size_t grain = (std::max)((std::size_t)4096, r / (MatrixConfig::threadCount() * 4) + 1);
+            matrix_detail::parallelFor(0, r, grain, val.size(), [=](std::size_t lo, std::size_t hi) {
+                for (std::size_t i = lo; i < hi; i++)
+                    y[i] = T(0);
+                const bool all = lo == 0 && hi == rows;
+                for (std::size_t j = 0; j < columns; j++) {
+                    const unsigned int* b = ix + p[j];
+                    const unsigned int* e = ix + p[j + 1];
+                    if (!all) {
+                        b = std::lower_bound(b, e, (unsigned int)lo);
+                        e = std::lower_bound(b, e, (unsigned int)hi);
+                    }
+                    const T xj = x[j];
+                    for (const unsigned int* q = b; q < e; q++)
+                        y[*q] += v[q - ix] * xj;
+                }
+            });
+        }
+    }
+
+    /*!
+     * @brief Sparse matrix times vector, see multiply(const T*, T*)
+     * @exception invalid_argument thrown when x doesn't have cols() elements.
+     */
+    std::vector<T> multiply(const std::vector<T>& x) const {
+        if (x.size() != c)
+            throw std::invalid_argument("Multiplication: matrices sizes don't alow multiplication.");
+        std::vector<T> y(r);
+        multiply(x.data(), y.data());
+        return y;
+    }
+
+    /*!
+     * @brief Sparse times dense: this * dense, O(nnz * dense.cols())
+     *
+     * Row i of the result is the sum of the rows of dense picked out by the
+     * non-zeros of row i, each element summed in the order of k like
+     * Matrix::multiply(). Rows are split over the thread pool.
+     * @exception invalid_argument thrown when the sizes don't fit.
+     */
+    template <class Alloc>
+    Matrix<T> multiply(const Matrix<T, Alloc>& dense) const {
+        if (c != dense.rows())
+            throw std::invalid_argument("Multiplication: matrices sizes don't alow multiplication.");
+        if (fmt != SparseFormat::CSR)
+            return convert(SparseFormat::CSR).multiply(dense);
+        const std::size_t n = dense.cols();
+        Matrix<T> ret(r, n);
+        T* out = ret.data();
+        Matrix<T, Alloc> copy;
+        const T* b = matrix_detail::rowMajor(dense, copy).data();
+        const std::size_t* p = ptr.data();
+        const unsigned int* ix = idx.data();
+        const T* v = val.data();
+        const std::size_t grain = (std::max)((std::size_t)1, (std::size_t)4096 / (n ? n : 1));
+        matrix_detail::parallelFor(0, r, grain, val.size() * n / 16, [=](std::size_t lo, std::size_t hi) {
+            for (std::size_t i = lo; i < hi; i++) {
+                T* crow = out + i * n;
+                for (std::size_t k = p[i]; k < p[i + 1]; k++) {
+                    const T a = v[k];
+                    const T* brow = b + (std::size_t)ix[k] * n;
+                    MATRIX_IVDEP
+                    for (std::size_t j = 0; j < n; j++)
+                        crow[j] += a * brow[j];
+                }
+            }
+        });
+        return ret;
+    }
+
+    /*!
+     * @brief Element-wise sum of two sparse matrices, O(nnz of both)
+     *
+     * The result has the format of this matrix; elements that add up to 0
+     * are not stored.
+     * @exception invalid_argument thrown matrix dimension don't match.
+     */
+    SparseMatrix add(const SparseMatrix& other) const {
+        if (r != other.r || c != other.c)
+            throw std::invalid_argument("Addition: matrices must have the same size.");
+        if (other.fmt != fmt)
+            return add(other.convert(fmt));
+        return merge(other, true);
+    }
+
+    /*!
+     * @brief Hadamard (element-wise) product with another sparse matrix, O(nnz of both)
+     * @exception invalid_argument thrown matrix dimension don't match.
+     */
+    SparseMatrix hadamard(const SparseMatrix& other) const {
+        if (r != other.r || c != other.c)
+            throw std::invalid_argument("hadamard: matrices must have the same size.");
+        if (other.fmt != fmt)
+            return hadamard(other.convert(fmt));
+        return merge(other, false);
+    }
+
+    /*!
+     * @brief Hadamard (element-wise) product with a dense matrix, O(nnz)
+     *
+     * Only the positions stored here can be non-zero, so the result is sparse.
+     * @exception invalid_argument thrown matrix dimension don't match.
+     */
+    template <class Alloc>
+    SparseMatrix hadamard(const Matrix<T, Alloc>& dense) const {
+        if (r != dense.rows() || c != dense.cols())
+            throw std::invalid_argument("hadamard: matrices must have the same size.");
+        SparseMatrix ret(r, c, fmt);
+        Matrix<T, Alloc> copy;
+        const T* d = matrix_detail::rowMajor(dense, copy).data();
+        const bool csr = fmt == SparseFormat::CSR;
+        for (std::size_t l = 0; l + 1 < ptr.size(); l++) {
+            for (std::size_t k = ptr[l]; k < ptr[l + 1]; k++) {
+                const T x = val[k] * (csr ? d[l * c + idx[k]] : d[(std::size_t)idx[k] * c + l]);
+                if (x != T(0)) {
+                    ret.idx.push_back(idx[k]);
+                    ret.val.push_back(x);
+                }
+            }
+            ret.ptr[l + 1] = ret.idx.size();
+        }
+        return ret;
+    }
+
+    /*!
+     * @brief Multiply every element with a scalar, inplace
+     */
+    void multiplyInPlace(T scalar) {
+        for (std::size_t k = 0; k < val.size(); k++)
+            val[k] *= scalar;
+    }
+
+    /*! @brief equality operator, compares the elements, not the format
+     */
+    bool operator== (const SparseMatrix& other) const {
+        if (r != other.r || c != other.c)
+            return false;
+        if (fmt != other.fmt)
+            return *this == other.convert(fmt);
+        return ptr == other.ptr && idx == other.idx && val == other.val;
+    }
+
+    /*! @brief print the non-zeros to cout, for debug purposes.
+     */
+    void debug() const {
+        const bool csr = fmt == SparseFormat::CSR;
+        for (std::size_t l = 0; l + 1 < ptr.size(); l++)
+            for (std::size_t k = ptr[l]; k < ptr[l + 1]; k++)
+                std::cout << "(" << (csr ? l : idx[k]) << "," << (csr ? idx[k] : l) << ") " << val[k] << std::endl;
+    }
+
+private:
+    std::size_t r, c;
+    SparseFormat fmt;
+    std::vector<std::size_t> ptr;     // start of every line, lines + 1 entries
+    std::vector<unsigned int> idx;    // column (CSR) or row (CSC) of every non-zero
+    std::vector<T> val;               // the non-zeros
+
+    // the number of lines, checks that the indices fit in 32 bits
+    static std::size_t lines(std::size_t rows, std::size_t columns, SparseFormat format) {
+        if ((format == SparseFormat::CSR ? columns : rows) > 0xFFFFFFFFu)
+            throw std::invalid_argument("SparseMatrix: lines can have at most 2^32 elements");
+        return format == SparseFormat::CSR ? rows : columns;
+    }
+
+    // fill ret (r, c and fmt set, fmt the other one) with our elements: a
+    // counting sort of the non-zeros on their index
+    void transposeArrays(SparseMatrix& ret) const {
+        const std::size_t outer = lines(r, c, ret.fmt);
+        ret.ptr.assign(outer + 1, 0);
+        ret.idx.resize(val.size());
+        ret.val.resize(val.size());
+        for (std::size_t k = 0; k < idx.size(); k++)
+            ret.ptr[idx[k] + 1]++;
+        for (std::size_t i = 0; i < outer; i++)
+            ret.ptr[i + 1] += ret.ptr[i];
+        std::vector<std::size_t> next(ret.ptr.begin(), ret.ptr.end() - 1);
+        for (std::size_t l = 0; l + 1 < ptr.size(); l++)
+            for (std::size_t k = ptr[l]; k < ptr[l + 1]; k++) {
+                const std::size_t to = next[idx[k]]++;
+                ret.idx[to] = (unsigned int)l;
+                ret.val[to] = val[k];
+            }
+    }
+
+    // union (sum) or intersection (product) of two matrices in the same format
+    SparseMatrix merge(const SparseMatrix& other, bool sum) const {
+        SparseMatrix ret(r, c, fmt);
+        ret.idx.reserve(sum ? nnz() + other.nnz() : (std::min)(nnz(), other.nnz()));
+        ret.val.reserve(ret.idx.capacity());
+        for (std::size_t l = 0; l + 1 < ptr.size(); l++) {
+            std::size_t a = ptr[l], b = other.ptr[l];
+            const std::size_t ae = ptr[l + 1], be = other.ptr[l + 1];
+            while (a < ae || b < be) {
+                unsigned int at;
+                T x;
+                if (b >= be || (a < ae && idx[a] < other.idx[b])) {
+                    at = idx[a];
+                    x = sum ? val[a] : T(0);
+                    a++;
+                } else if (a >= ae || other.idx[b] < idx[a]) {
+                    at = other.idx[b];
+                    x = sum ? other.val[b] : T(0);
+                    b++;
+                } else {
+                    at = idx[a];
+                    x = sum ? val[a] + other.val[b] : val[a] * other.val[b];
+                    a++;
+                    b++;
+                }
+                if (x != T(0)) {
+                    ret.idx.push_back(at);
+                    ret.val.push_back(x);
+                }
+            }
+            ret.ptr[l + 1] = ret.idx.size();
+        }
+        return ret;
+    }
+};
+
+namespace matrix_detail {
+
+    /*!
+     * @brief Dense times sparse: dense * sparse, O(dense.rows() * nnz)
+     *
+     * Row i of the result adds, for every k, dense(i,k) times row k of sparse.
+     * Rows are split over the thread pool.
+     */
+    template <class T, class Alloc>
+    Matrix<T> denseTimesSparse(const Matrix<T, Alloc>& dense, const SparseMatrix<T>& sparse) {
+        if (dense.cols() != sparse.rows())
+            throw std::invalid_argument("Multiplication: matrices sizes don't alow multiplication.");
+        if (sparse.format() != SparseFormat::CSR)
+            return denseTimesSparse(dense, sparse.convert(SparseFormat::CSR));
+        const std::size_t m = dense.rows(), k = dense.cols(), n = sparse.cols();
+        Matrix<T> ret(m, n);
+        T* out = ret.data();
+        Matrix<T, Alloc> copy;
+        const T* a = matrix_detail::rowMajor(dense, copy).data();
+        const std::size_t* p = sparse.pointers().data();
+        const unsigned int* ix = sparse.indices().data();
+        const T* v = sparse.values().data();
+        matrix_detail::parallelFor(0, m, 1, m * sparse.nnz() / 16, [=](std::size_t lo, std::size_t hi) {
+            for (std::size_t i = lo; i < hi; i++) {
+                T* crow = out + i * n;
+                for (std::size_t kk = 0; kk < k; kk++) {
+                    const T aik = a[i * k + kk];
+                    MATRIX_IVDEP
+                    for (std::size_t q = p[kk]; q < p[kk + 1]; q++)
+                        crow[ix[q]] += aik * v[q];
+                }
+            }
+        });
+        return ret;
+    }
+
+} // namespace matrix_detail
+
+/*!
+ * @brief Sparse times dense, see SparseMatrix::multiply()
+ */
+template <class T, class Alloc>
+Matrix<T> operator* (const SparseMatrix<T>& sparse, const Matrix<T, Alloc>& dense) {
+    return sparse.multiply(dense);
+}
+
+/*!
+ * @brief Dense times sparse, O(dense.rows() * nnz)
+ * @exception invalid_argument thrown when the sizes don't fit.
+ */
+template <class T, class Alloc>
+Matrix<T> operator* (const Matrix<T, Alloc>& dense, const SparseMatrix<T>& sparse) {
+    return matrix_detail::denseTimesSparse(dense, sparse);
+}
+
+/*!
+ * @brief Sum of two sparse matrices, see SparseMatrix::add()
+ */
+template <class T>
+SparseMatrix<T> operator+ (const SparseMatrix<T>& first, const SparseMatrix<T>& second) {
+    return first.add(second);
+}
@@ -0,0 +1,241 @@
+/*!
+ * @file matrix_strassen.h
+ * @author Tony Andrioli, The Hague University of Applied Sciences
+ * @date June 2022
+ *
+ * Strassen-Winograd multiplication for large products.
+ *
+ * Each level splits A, B and C in quadrants and computes the product with
+ * 7 products of quadrants and 15 additions instead of 8 products, so d
+ * levels do (7/8)^d of the multiplications of the conventional product
+ * (two levels: 77%, three: 67%). Levels are added as long as all
+ * dimensions are larger than MatrixConfig::strassenCrossover(); below that
+ * the quadrants are multiplied by the conventional kernel of matrix_gemm.h.
+ * A dimension that doesn't halve evenly d times is padded with zeros.
+ *
+ * The temporaries of all levels come from one buffer of about a third of
+ * the size of A, B and C together, allocated once per product.
+ *
+ * Rounding: unlike Matrix::multiply() the result is not exactly that of the
+ * textbook loop. The error is bounded normwise, not per element:
+ * |C - Ĉ| <= c(d) u ||A|| ||B||, with u the unit roundoff, where the
+ * conventional product has |C - Ĉ| <= k u |A| |B| per element. The constant
+ * grows by about a factor 18 per level (Higham, Accuracy and Stability of
+ * Numerical Algorithms, ch. 23). In practice, for matrices whose elements
+ * are of similar magnitude, each level costs a fraction of a decimal digit
+ * of accuracy; elements of C much smaller than the norms of A and B (from
+ * cancellation, or rows and columns of very different scale) can lose all
+ * of their relative accuracy. That's why MultiplyAlgorithm::Auto only uses
+ * it for floating point matrices of at least MatrixConfig::strassenThreshold().
+ * For integers the result is exact, as long as no intermediate sum overflows.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+#include "matrix_alloc.h"
+#include "matrix_expr.h"
+#include "matrix_gemm.h"
+#include "matrix_parallel.h"
+
+/*!
+ * @brief How Matrix::multiply() computes a product of two matrices
+ */
+enum class MultiplyAlgorithm {
+    Auto,           //!< Strassen for large floating point products, see MatrixConfig::setStrassenThreshold()
+    Conventional,   //!< the blocked kernel, exactly the result of the textbook loop
+    Strassen        //!< Strassen-Winograd, see matrix_strassen.h
+};
+
+namespace matrix_detail {
+
+    // c = a + b or c = a - b, row by row; c may be a or b
+    template <class T>
+    void strassenCombine(std::size_t rows, std::size_t cols, const T* a, std::size_t lda,
+                         const T* b, std::size_t ldb, T* c, std::size_t ldc, bool subtract) {
+        const std::size_t grain = (std::max<std::size_t>)(1, (16 * 1024) / (cols * sizeof(T) + 1));
+        parallelFor(0, rows, grain, rows * cols, [=](std::size_t r0, std::size_t r1) {
+            for (std::size_t r = r0; r < r1; r++) {
+                const T* x = a + r * lda;
+                const T* y = b + r * ldb;
+                T* z = c + r * ldc;
+                if (subtract) {
+                    MATRIX_IVDEP
+                    for (std::size_t j = 0; j < cols; j++)
+                        z[j] = x[j] - y[j];
+                } else {
+                    MATRIX_IVDEP
+                    for (std::size_t j = 0; j < cols; j++)
+                        z[j] = x[j] + y[j];
+                }
+            }
+        });
+    }
+
+    // elements of workspace the levels below a m x k times k x n product need
+    inline std::size_t strassenWorkspace(int depth, std::size_t m, std::size_t k, std::size_t n) {
+        std::size_t total = 0;
+        for (int l = 0; l < depth; l++) {
+            m /= 2;
+            k /= 2;
+            n /= 2;
+            total += m * k + k * n + m * n;
+        }
+        return total;
+    }
+
+    /*!
+     * @brief C = A*B with 'depth' levels of Strassen-Winograd; m, k and n
+     *        must be divisible by 2^depth.
+     *
+     * Winograd's variant: with S1 = A21 + A22, S2 = S1 - A11, S3 = A11 - A21,
+     * S4 = A12 - S2, T1 = B12 - B11, T2 = B22 - T1, T3 = B22 - B12,
+     * T4 = T2 - B21 and the products P1 = A11 B11, P2 = A12 B21, P3 = S4 B22,
+     * P4 = A22 T4, P5 = S1 T1, P6 = S2 T2, P7 = S3 T3:
+     *   C11 = P1 + P2,  C12 = P1 + P6 + P5 + P3,
+     *   C21 = P1 + P6 + P7 - P4,  C22 = P1 + P6 + P7 + P5.
+     * The order below keeps the partial sums in C, so a level needs three
+     * temporaries only: X (A quadrant), Y (B quadrant) and Z (C quadrant).
+     */
+    template <class T>
+    void strassenRecurse(int depth, std::size_t m, std::size_t k, std::size_t n,
+                         const T* a, std::size_t lda, const T* b, std::size_t ldb,
+                         T* c, std::size_t ldc, T* work) {
+        if (depth == 0) {
+            gemmParallel<T>(m, n, k, a, lda, 1, b, ldb, 1, c, ldc, 1);
+            return;
+        }
+        const std::size_t m2 = m / 2, k2 = k / 2, n2 = n / 2;
+        const T* a11 = a;
+        const T* a12 = a + k2;
+        const T* a21 = a + m2 * lda;
+        const T* a22 = a21 + k2;
+        const T* b11 = b;
+        const T* b12 = b + n2;
+        const T* b21 = b + k2 * ldb;
+        const T* b22 = b21 + n2;
+        T* c11 = c;
+        T* c12 = c + n2;
+        T* c21 = c + m2 * ldc;
+        T* c22 = c21 + n2;
+        T* x = work;
+        T* y = x + m2 * k2;
+        T* z = y + k2 * n2;
+        T* next = z + m2 * n2;
+
+        strassenCombine(m2, k2, a11, lda, a21, lda, x, k2, true);           // X = S3
+        strassenCombine(k2, n2, b22, ldb, b12, ldb, y, n2, true);           // Y = T3
+        strassenRecurse(depth - 1, m2, k2, n2, x, k2, y, n2, c21, ldc, next);   // C21 = P7
+        strassenCombine(m2, k2, a21, lda, a22, lda, x, k2, false);          // X = S1
+        strassenCombine(k2, n2, b12, ldb, b11, ldb, y, n2, true);           // Y = T1
+        strassenRecurse(depth - 1, m2, k2, n2, x, k2, y, n2, c22, ldc, next);   // C22 = P5
+        strassenCombine(m2, k2, x, k2, a11, lda, x, k2, true);              // X = S2
+        strassenCombine(k2, n2, b22, ldb, y, n2, y, n2, true);              // Y = T2
+        strassenRecurse(depth - 1, m2, k2, n2, x, k2, y, n2, c12, ldc, next);   // C12 = P6
+        strassenCombine(m2, k2, a12, lda, x, k2, x, k2, true);              // X = S4
+        strassenRecurse(depth - 1, m2, k2, n2, x, k2, b22, ldb, c11, ldc, next); // C11 = P3
+        strassenRecurse(depth - 1, m2, k2, n2, a11, lda, b11, ldb, z, n2, next); // Z = P1
+        strassenCombine(m2, n2, c12, ldc, z, n2, c12, ldc, false);          // C12 = P1 + P6
+        strassenCombine(m2, n2, c21, ldc, c12, ldc, c21, ldc, false);       // C21 = P1 + P6 + P7
+        strassenCombine(m2, n2, c12, ldc, c22, ldc, c12, ldc, false);       // C12 = P1 + P6 + P5
+        strassenCombine(m2, n2, c22, ldc, c21, ldc, c22, ldc, false);       // C22 = P1 + P6 + P7 + P5
+        strassenCombine(m2, n2, c12, ldc, c11, ldc, c12, ldc, false);       // C12 = P1 + P6 + P5 + P3
+        strassenRecurse(depth - 1, m2, k2, n2, a12, lda, b21, ldb, c11, ldc, next); // C11 = P2
+        strassenCombine(m2, n2, c11, ldc, z, n2, c11, ldc, false);          // C11 = P1 + P2
+        strassenCombine(k2, n2, y, n2, b21, ldb, y, n2, true);              // Y = T4
+        strassenRecurse(depth - 1, m2, k2, n2, a22, lda, y, n2, z, n2, next);   // Z = P4
+        strassenCombine(m2, n2, c21, ldc, z, n2, c21, ldc, true);           // C21 = P1 + P6 + P7 - P4
+    }
+
+    // copy a rows x cols block into the top left of a zeroed rp x cp buffer
+    template <class T>
+    void strassenPad(const T* src, std::size_t ld, std::size_t rows, std::size_t cols,
+                     T* dst, std::size_t rp, std::size_t cp) {
+        std::memset(dst, 0, rp * cp * sizeof(T));
+        for (std::size_t r = 0; r < rows; r++)
+            std::memcpy(dst + r * cp, src + r * ld, cols * sizeof(T));
+    }
+
+    /*!
+     * @brief The number of Strassen levels for a m x k times k x n product:
+     *        halve while every dimension is above the crossover.
+     */
+    inline int strassenDepth(std::size_t m, std::size_t k, std::size_t n, std::size_t crossover) {
+        int depth = 0;
+        std::size_t smallest = (std::min)(m, (std::min)(k, n));
+        while (smallest > crossover) {
+            smallest = (smallest + 1) / 2;
+            depth++;
+        }
+        return depth;
+    }
+
+    /*!
+     * @brief C = A*B with Strassen-Winograd, C m x n with row stride ldc.
+     *
+     * C must not overlap with A or B.
+     */
+    template <class T>
+    void strassen(std::size_t m, std::size_t n, std::size_t k,
+                  const T* a, std::size_t lda, const T* b, std::size_t ldb, T* c, std::size_t ldc) {
+        const int depth = strassenDepth(m, k, n, MatrixConfig::strassenCrossover());
+        if (depth == 0) {
+            gemmParallel<T>(m, n, k, a, lda, 1, b, ldb, 1, c, ldc, 1);
+            return;
+        }
+        // round every dimension up to a multiple of 2^depth
+        const std::size_t unit = std::size_t(1) << depth;
+        const std::size_t mp = (m + unit - 1) / unit * unit;
+        const std::size_t kp = (k + unit - 1) / unit * unit;
+        const std::size_t np = (n + unit - 1) / unit * unit;
+        const bool padA = mp != m || kp != k;
+        const bool padB = kp != k || np != n;
+        const bool padC = mp != m || np != n;
+
+        ScratchBuffer<T> work(strassenWorkspace(depth, mp, kp, np) +
+                              (padA ? mp * kp : 0) + (padB ? kp * np : 0) + (padC ? mp * np : 0));
+        T* w = work.data();
+        const T* ap = a;
+        const T* bp = b;
+        T* cp = c;
+        std::size_t lda2 = lda, ldb2 = ldb, ldc2 = ldc;
+        if (padA) {
+            strassenPad(a, lda, m, k, w, mp, kp);
+            ap = w;
+            lda2 = kp;
+            w += mp * kp;
+        }
+        if (padB) {
+            strassenPad(b, ldb, k, n, w, kp, np);
+            bp = w;
+            ldb2 = np;
+            w += kp * np;
+        }
+        if (padC) {
+            cp = w;
+            ldc2 = np;
+            w += mp * np;
+        }
+        strassenRecurse(depth, mp, kp, np, ap, lda2, bp, ldb2, cp, ldc2, w);
+        if (padC)
+            for (std::size_t r = 0; r < m; r++)
+                std::memcpy(c + r * ldc, cp + r * ldc2, n * sizeof(T));
+    }
+
+    /*!
+     * @brief Whether MultiplyAlgorithm::Auto picks Strassen for this product
+     */
+    template <class T>
+    bool useStrassen(MultiplyAlgorithm algorithm, std::size_t m, std::size_t k, std::size_t n) {
+        if (algorithm != MultiplyAlgorithm::Auto)
+            return algorithm == MultiplyAlgorithm::Strassen;
+        const std::size_t threshold = MatrixConfig::strassenThreshold();
+        return std::is_floating_point<T>::value && threshold > 0 &&
+               m >= threshold && k >= threshold && n >= threshold;
+    }
+
+} // namespace matrix_detail
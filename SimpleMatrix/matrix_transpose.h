@@ -0,0 +1,320 @@
+/*!
+ * @file matrix_transpose.h
+ * @author Tony Andrioli, The Hague University of Applied Sciences
+ * @date June 2022
+ *
+ * Transpose kernels used by Matrix::transpose() and Matrix::transposeInPlace().
+ *
+ * The out of place transpose halves the larger dimension until a block is
+ * at most 32 x 32, which keeps both the rows read and the rows written in
+ * cache at every level without knowing the cache sizes (cache-oblivious).
+ * The 32 x 32 blocks are done with 8 x 8 (AVX2) or 4 x 4 (SSE2) register
+ * transposes for 4 and 8 byte elements.
+ *
+ * In place, a square matrix swaps its tiles pairwise. A rectangular one is
+ * permuted along the cycles of the transposition, with one bit of extra
+ * memory per element to remember which cycles are done.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "matrix_alloc.h"
+#include "matrix_parallel.h"
+#include "matrix_simd.h"
+
+namespace matrix_detail {
+
+    // blocks of at most TRANSPOSE_TILE x TRANSPOSE_TILE are done directly
+    const std::size_t TRANSPOSE_TILE = 32;
+
+    // ----------------------------------------------------------------------
+    // register transposes
+    // ----------------------------------------------------------------------
+
+    // All kernels: dst[c*ds + r] = src[r*ss + c] for one square block,
+    // strides in elements. The loads and stores are unaligned and may
+    // alias, so any 4 or 8 byte type can go through the float versions.
+    typedef void (*TransposeKernel)(const void* src, std::size_t ss, void* dst, std::size_t ds);
+
+#ifdef MATRIX_X86
+    namespace sse2 {
+        MATRIX_TARGET("sse2")
+        inline void transpose4x4_32(const void* src, std::size_t ss, void* dst, std::size_t ds) {
+            const float* s = (const float*)src;
+            float* d = (float*)dst;
+            __m128 r0 = _mm_loadu_ps(s);
+            __m128 r1 = _mm_loadu_ps(s + ss);
+            __m128 r2 = _mm_loadu_ps(s + 2 * ss);
+            __m128 r3 = _mm_loadu_ps(s + 3 * ss);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(d, r0);
+            _mm_storeu_ps(d + ds, r1);
+            _mm_storeu_ps(d + 2 * ds, r2);
+            _mm_storeu_ps(d + 3 * ds, r3);
+        }
+
+        MATRIX_TARGET("sse2")
+        inline void transpose2x2_64(const void* src, std::size_t ss, void* dst, std::size_t ds) {
+            const double* s = (const double*)src;
+            double* d = (double*)dst;
+            __m128d r0 = _mm_loadu_pd(s);
+            __m128d r1 = _mm_loadu_pd(s + ss);
+            _mm_storeu_pd(d, _mm_unpacklo_pd(r0, r1));
+            _mm_storeu_pd(d + ds, _mm_unpackhi_pd(r0, r1));
+        }
+    } // namespace sse2
+
+    namespace avx2 {
+        MATRIX_TARGET("avx2")
+        inline void transpose8x8_32(const void* src, std::size_t ss, void* dst, std::size_t ds) {
+            const float* s = (const float*)src;
+            float* d = (float*)dst;
+            __m256 r0 = _mm256_loadu_ps(s);
+            __m256 r1 = _mm256_loadu_ps(s + ss);
+            __m256 r2 = _mm256_loadu_ps(s + 2 * ss);
+            __m256 r3 = _mm256_loadu_ps(s + 3 * ss);
+            __m256 r4 = _mm256_loadu_ps(s + 4 * ss);
+            __m256 r5 = _mm256_loadu_ps(s + 5 * ss);
+            __m256 r6 = _mm256_loadu_ps(s + 6 * ss);
+            __m256 r7 = _mm256_loadu_ps(s + 7 * ss);
+            // interleave pairs of rows, then pairs of pairs, then swap the 128 bit halves
+            __m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpackhi_ps(r0, r1);
+            __m256 t2 = _mm256_unpacklo_ps(r2, r3), t3 = _mm256_unpackhi_ps(r2, r3);
+            __m256 t4 = _mm256_unpacklo_ps(r4, r5), t5 = _mm256_unpackhi_ps(r4, r5);
+            __m256 t6 = _mm256_unpacklo_ps(r6, r7), t7 = _mm256_unpackhi_ps(r6, r7);
+            __m256 u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+            __m256 u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+            __m256 u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+            __m256 u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+            __m256 u4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+            __m256 u5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+            __m256 u6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+            __m256 u7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+            _mm256_storeu_ps(d,          _mm256_permute2f128_ps(u0, u4, 0x20));
+            _mm256_storeu_ps(d + ds,     _mm256_permute2f128_ps(u1, u5, 0x20));
+            _mm256_storeu_ps(d + 2 * ds, _mm256_permute2f128_ps(u2, u6, 0x20));
+            _mm256_storeu_ps(d + 3 * ds, _mm256_permute2f128_ps(u3, u7, 0x20));
+            _mm256_storeu_ps(d + 4 * ds, _mm256_permute2f128_ps(u0, u4, 0x31));
+            _mm256_storeu_ps(d + 5 * ds, _mm256_permute2f128_ps(u1, u5, 0x31));
+            _mm256_storeu_ps(d + 6 * ds, _mm256_permute2f128_ps(u2, u6, 0x31));
+            _mm256_storeu_ps(d + 7 * ds, _mm256_permute2f128_ps(u3, u7, 0x31));
+        }
+
+        MATRIX_TARGET("avx2")
+        inline void transpose4x4_64(const void* src, std::size_t ss, void* dst, std::size_t ds) {
+            const double* s = (const double*)src;
+            double* d = (double*)dst;
+            __m256d r0 = _mm256_loadu_pd(s);
+            __m256d r1 = _mm256_loadu_pd(s + ss);
+            __m256d r2 = _mm256_loadu_pd(s + 2 * ss);
+            __m256d r3 = _mm256_loadu_pd(s + 3 * ss);
+            __m256d t0 = _mm256_unpacklo_pd(r0, r1), t1 = _mm256_unpackhi_pd(r0, r1);
+            __m256d t2 = _mm256_unpacklo_pd(r2, r3), t3 = _mm256_unpackhi_pd(r2, r3);
+            _mm256_storeu_pd(d,          _mm256_permute2f128_pd(t0, t2, 0x20));
+            _mm256_storeu_pd(d + ds,     _mm256_permute2f128_pd(t1, t3, 0x20));
+            _mm256_storeu_pd(d + 2 * ds, _mm256_permute2f128_pd(t0, t2, 0x31));
+            _mm256_storeu_pd(d + 3 * ds, _mm256_permute2f128_pd(t1, t3, 0x31));
+        }
+    } // namespace avx2
+#endif
+
+    // ----------------------------------------------------------------------
+    // blocks
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief dst = transpose(src) for a small block, B x B at a time with kernel.
+     */
+    template <class T, std::size_t B>
+    void transposeBlocks(const T* src, std::size_t ss, T* dst, std::size_t ds,
+                         std::size_t rows, std::size_t cols, TransposeKernel kernel) {
+        const std::size_t rb = rows - rows % B, cb = cols - cols % B;
+        for (std::size_t r = 0; r < rb; r += B)
+            for (std::size_t c = 0; c < cb; c += B)
+                kernel(src + r * ss + c, ss, dst + c * ds + r, ds);
+        for (std::size_t r = 0; r < rows; r++)
+            for (std::size_t c = cb; c < cols; c++)
+                dst[c * ds + r] = src[r * ss + c];
+        for (std::size_t r = rb; r < rows; r++)
+            for (std::size_t c = 0; c < cb; c++)
+                dst[c * ds + r] = src[r * ss + c];
+    }
+
+    /*!
+     * @brief dst = transpose(src) for a block of at most TRANSPOSE_TILE x TRANSPOSE_TILE.
+     *
+     * src is rows x cols with row stride ss, dst gets cols x rows with row stride ds.
+     */
+    template <class T>
+    void transposeTile(const T* src, std::size_t ss, T* dst, std::size_t ds,
+                       std::size_t rows, std::size_t cols) {
+    #ifdef MATRIX_X86
+        if (std::is_trivially_copyable<T>::value && (sizeof(T) == 4 || sizeof(T) == 8)) {
+            const int level = simdLevel();
+            if (sizeof(T) == 4 && level >= SIMD_AVX2)
+                return transposeBlocks<T, 8>(src, ss, dst, ds, rows, cols, &avx2::transpose8x8_32);
+            if (sizeof(T) == 8 && level >= SIMD_AVX2)
+                return transposeBlocks<T, 4>(src, ss, dst, ds, rows, cols, &avx2::transpose4x4_64);
+            if (sizeof(T) == 4 && level >= SIMD_SSE2)
+                return transposeBlocks<T, 4>(src, ss, dst, ds, rows, cols, &sse2::transpose4x4_32);
+            if (sizeof(T) == 8 && level >= SIMD_SSE2)
+                return transposeBlocks<T, 2>(src, ss, dst, ds, rows, cols, &sse2::transpose2x2_64);
+        }
+    #endif
+        for (std::size_t r = 0; r < rows; r++)
+            for (std::size_t c = 0; c < cols; c++)
+                dst[c * ds + r] = src[r * ss + c];
+    }
+
+    // ----------------------------------------------------------------------
+    // out of place
+    // ----------------------------------------------------------------------
+
+    // about half of n, a multiple of 8 so the register kernels see whole blocks
+    inline std::size_t transposeSplit(std::size_t n) {
+        return (n / 2 + 7) / 8 * 8;
+    }
+
+    /*!
+     * @brief Cache-oblivious dst = transpose(src): halve the larger side down to a tile.
+     */
+    template <class T>
+    void transposeRecursive(const T* src, std::size_t ss, T* dst, std::size_t ds,
+                            std::size_t rows, std::size_t cols) {
+        while (rows > TRANSPOSE_TILE || cols > TRANSPOSE_TILE) {
+            if (rows >= cols) {
+                const std::size_t h = transposeSplit(rows);
+                transposeRecursive(src, ss, dst, ds, h, cols);
+                src += h * ss;
+                dst += h;
+                rows -= h;
+            } else {
+                const std::size_t h = transposeSplit(cols);
+                transposeRecursive(src, ss, dst, ds, rows, h);
+                src += h;
+                dst += h * ds;
+                cols -= h;
+            }
+        }
+        transposeTile(src, ss, dst, ds, rows, cols);
+    }
+
+    /*!
+     * @brief dst (cols x rows) = transpose(src (rows x cols)), split over the thread pool.
+     *
+     * ss and ds are the row strides of src and dst. The longer side is cut
+     * in strips of 64, every strip is transposed recursively.
+     */
+    template <class T>
+    void transpose(const T* src, std::size_t ss, std::size_t rows, std::size_t cols, T* dst, std::size_t ds) {
+        const std::size_t strip = 64;
+        if (rows >= cols) {
+            parallelFor(0, (rows + strip - 1) / strip, 1, rows * cols, [=](std::size_t b, std::size_t e) {
+                const std::size_t r0 = b * strip, r1 = (std::min)(e * strip, rows);
+                transposeRecursive(src + r0 * ss, ss, dst + r0, ds, r1 - r0, cols);
+            });
+        } else {
+            parallelFor(0, (cols + strip - 1) / strip, 1, rows * cols, [=](std::size_t b, std::size_t e) {
+                const std::size_t c0 = b * strip, c1 = (std::min)(e * strip, cols);
+                transposeRecursive(src + c0, ss, dst + c0 * ds, ds, rows, c1 - c0);
+            });
+        }
+    }
+
+    /*!
+     * @brief dst (cols x rows) = transpose(src (rows x cols)), both contiguous.
+     */
+    template <class T>
+    void transpose(const T* src, std::size_t rows, std::size_t cols, T* dst) {
+        transpose(src, cols, rows, cols, dst, rows);
+    }
+
+    // ----------------------------------------------------------------------
+    // in place
+    // ----------------------------------------------------------------------
+
+    /*!
+     * @brief Transpose the n x n matrix a in place.
+     *
+     * The tiles on the diagonal are transposed by swapping elements, every
+     * other pair of tiles (I, J) and (J, I) is swapped and transposed through
+     * one tile of scratch memory. Rows of tiles are spread over the pool.
+     */
+    template <class T>
+    void transposeSquareInPlace(T* a, std::size_t n) {
+        const std::size_t tiles = (n + TRANSPOSE_TILE - 1) / TRANSPOSE_TILE;
+        parallelFor(0, tiles, 1, n * n, [=](std::size_t b, std::size_t e) {
+            ScratchBuffer<T> buf(TRANSPOSE_TILE * TRANSPOSE_TILE);
+            T* tmp = buf.data();
+            for (std::size_t I = b; I < e; I++) {
+                const std::size_t r0 = I * TRANSPOSE_TILE;
+                const std::size_t rn = (std::min)(TRANSPOSE_TILE, n - r0);
+                for (std::size_t i = 0; i < rn; i++)
+                    for (std::size_t j = i + 1; j < rn; j++)
+                        std::swap(a[(r0 + i) * n + r0 + j], a[(r0 + j) * n + r0 + i]);
+                for (std::size_t J = I + 1; J < tiles; J++) {
+                    const std::size_t c0 = J * TRANSPOSE_TILE;
+                    const std::size_t cn = (std::min)(TRANSPOSE_TILE, n - c0);
+                    T* upper = a + r0 * n + c0;   // rn x cn
+                    T* lower = a + c0 * n + r0;   // cn x rn
+                    for (std::size_t i = 0; i < rn; i++)
+                        memcpy(tmp + i * cn, upper + i * n, cn * sizeof(T));
+                    transposeTile(lower, n, upper, n, cn, rn);
+                    transposeTile(tmp, cn, lower, n, rn, cn);
+                }
+            }
+        });
+    }
+
+    /*!
+     * @brief Transpose the rows x cols matrix a in place, for any shape.
+     *
+     * Element p = r*cols + c belongs at c*rows + r. Following p to where it
+     * belongs, and the element there to where that one belongs, and so on,
+     * closes a cycle; every cycle is walked once. A bitmap (rows*cols / 8
+     * bytes) marks the elements that are already in place. Serial, and the
+     * accesses jump through the whole matrix, so this is a lot slower than
+     * transposing into a second matrix; it's for when memory is the limit.
+     */
+    template <class T>
+    void transposeCycles(T* a, std::size_t rows, std::size_t cols) {
+        const std::size_t n = rows * cols;
+        if (n < 3)
+            return;
+        std::vector<std::uint64_t> done((n + 63) / 64, 0);
+        // the first and the last element never move
+        for (std::size_t start = 1; start + 1 < n; start++) {
+            if ((done[start >> 6] >> (start & 63)) & 1)
+                continue;
+            T carry = a[start];
+            std::size_t p = start;
+            do {
+                const std::size_t q = (p % cols) * rows + p / cols;
+                std::swap(carry, a[q]);
+                done[q >> 6] |= (std::uint64_t)1 << (q & 63);
+                p = q;
+            } while (p != start);
+        }
+    }
+
+    /*!
+     * @brief Transpose the rows x cols matrix a in place; afterwards it is cols x rows.
+     */
+    template <class T>
+    void transposeInPlace(T* a, std::size_t rows, std::size_t cols) {
+        if (rows == cols)
+            transposeSquareInPlace(a, rows);
+        else if (rows > 1 && cols > 1)
+            transposeCycles(a, rows, cols);
+        // a single row or column is the same sequence of elements either way
+    }
+
+} // namespace matrix_detail
@@ -0,0 +1,640 @@
+/*!
+ * @file matrix_view.h
+ * @author Tony Andrioli, The Hague University of Applied Sciences
+ * @date June 2022
+ *
+ * Views on (a part of) a matrix, without copying it.
+ *
+ * A view is a pointer to the first element, the number of rows and columns,
+ * the layout and the stride: the distance in elements from one row to the
+ * next (one column to the next when the layout is column-major). A row, a
+ * column, a block or the whole of a matrix are all views:
+ * @code{.cpp}
+ * Matrix<double> A(1000, 1000);
+ * MatrixView<double> topLeft = A.block(0, 0, 500, 500);
+ * Matrix<double>::multiply(A.block(0, 0, 500, 1000), A.block(0, 0, 1000, 500), topLeft);
+ * A.row(3).multiplyInPlace(2.0);
+ * @endcode
+ * A view doesn't own the memory. It is only valid as long as the matrix it
+ * was taken from lives and isn't resized.
+ *
+ * transposed() is the transpose of a view without moving anything: the same
+ * elements with the other layout. All operations on views take operands of
+ * either layout; when the layouts differ the elements are transposed a tile
+ * at a time on the way (see forEachLinePair()), or, for products, the
+ * kernel just walks the memory in the other order.
+ * @code{.cpp}
+ * Matrix<double>::multiply(A.transposedView(), B, C);   // C = transpose(A)*B, no copy of A
+ * @endcode
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+
+#include "matrix_alloc.h"
+#include "matrix_expr.h"
+#include "matrix_fixed.h"
+#include "matrix_gemm.h"
+#include "matrix_parallel.h"
+#include "matrix_reduce.h"
+#include "matrix_simd.h"
+#include "matrix_transpose.h"
+
+template <class T> class MatrixView;
+
+/*!
+ * @class ConstMatrixView
+ * @brief Read only view on a matrix, see matrix_view.h
+ *
+ * Matrix, FixedMatrix and MatrixView convert to it, so a function taking a
+ * ConstMatrixView takes all of them.
+ */
+template <class T>
+class ConstMatrixView {
+public:
+    typedef T value_type;
+
+    /*!
+     * @brief An empty view
+     */
+    ConstMatrixView() : p(NULL), r(0), c(0), ld(0), lay(MatrixLayout::RowMajor) {}
+
+    /*!
+     * @brief View on rows x cols elements starting at data, rows (columns,
+     *        for a column-major view) are stride elements apart.
+     */
+    ConstMatrixView(const T* data, std::size_t rows, std::size_t cols, std::size_t stride,
+                    MatrixLayout layout = MatrixLayout::RowMajor)
+        : p(data), r(rows), c(cols), ld(stride), lay(layout) {}
+
+    /*!
+     * @brief View on a whole matrix
+     */
+    template <class Alloc>
+    ConstMatrixView(const Matrix<T, Alloc>& mat)
+        : p(mat.data()), r(mat.rows()), c(mat.cols()), ld(mat.stride()), lay(mat.layout()) {}
+
+    /*!
+     * @brief View on a whole fixed-size matrix
+     */
+    template <unsigned int R, unsigned int C>
+    ConstMatrixView(const FixedMatrix<T, R, C>& mat) : p(mat.data()), r(R), c(C), ld(C), lay(MatrixLayout::RowMajor) {}
+
+    std::size_t rows() const { return r; }
+    std::size_t cols() const { return c; }
+
+    /*!
+     * @brief Elements from the start of one row to the start of the next,
+     *        or of one column to the next for a column-major view
+     */
+    std::size_t stride() const { return ld; }
+
+    /*!
+     * @brief The order of the elements in memory
+     */
+    MatrixLayout layout() const { return lay; }
+
+    const T* data() const { return p; }
+
+    /*!
+     * @brief true when the rows (columns, when column-major) follow each other without gaps
+     */
+    bool contiguous() const {
+        return lay == MatrixLayout::RowMajor ? ld == c || r <= 1 : ld == r || c <= 1;
+    }
+
+    /*!
+     * @brief The transpose of this view, the same elements with the other layout
+     */
+    ConstMatrixView transposed() const {
+        return ConstMatrixView(p, c, r, ld, lay == MatrixLayout::RowMajor ? MatrixLayout::ColumnMajor : MatrixLayout::RowMajor);
+    }
+
+    /*!
+     * @brief Get one element
+     * @exception invalid_argument thrown when row or col is out of bounds.
+     */
+    T get(std::size_t row, std::size_t col) const {
+        if (row < r && col < c)
+            return p[offset(row, col)];
+        throw std::invalid_argument("Get: out of bounds");
+    }
+
+    /*!
+     * @brief Index operator, returns a pointer to row i
+     * @exception invalid_argument thrown when i is out of bounds or the view
+     *            is column-major, which has no rows in memory.
+     */
+    const T* operator[] (std::size_t i) const {
+        if (lay != MatrixLayout::RowMajor)
+            throw std::invalid_argument("[]: a column-major view has no row pointers");
+        if (i < r)
+            return p + i * ld;
+        throw std::invalid_argument("[]: out of bounds");
+    }
+
+    /*!
+     * @brief View on row i
+     */
+    ConstMatrixView row(std::size_t i) const {
+        return block(i, 0, 1, c);
+    }
+
+    /*!
+     * @brief View on column j, a rows x 1 view
+     */
+    ConstMatrixView col(std::size_t j) const {
+        return block(0, j, r, 1);
+    }
+
+    /*!
+     * @brief View on the rows x cols block that starts at (row, col)
+     * @exception invalid_argument thrown when the block doesn't fit.
+     */
+    ConstMatrixView block(std::size_t row, std::size_t col, std::size_t rows, std::size_t cols) const {
+        if (row + rows > r || col + cols > c)
+            throw std::invalid_argument("block: out of bounds");
+        return ConstMatrixView(p + offset(row, col), rows, cols, ld, lay);
+    }
+
+    /*!
+     * @brief Transpose the viewed elements into out, which must be cols x rows.
+     */
+    void transpose(const MatrixView<T>& out) const;
+
+protected:
+    // where element (row, col) is, relative to p
+    std::size_t offset(std::size_t row, std::size_t col) const {
+        return lay == MatrixLayout::RowMajor ? row * ld + col : col * ld + row;
+    }
+
+    const T* p;
+    std::size_t r, c, ld;
+    MatrixLayout lay;
+};
+
+/*!
+ * @class MatrixView
+ * @brief View on a matrix through which the elements can be changed, see matrix_view.h
+ *
+ * Like a pointer, a const MatrixView still changes the matrix it refers to;
+ * only the view itself (where it points) is const.
+ */
+template <class T>
+class MatrixView : public ConstMatrixView<T> {
+    using ConstMatrixView<T>::p;
+    using ConstMatrixView<T>::r;
+    using ConstMatrixView<T>::c;
+    using ConstMatrixView<T>::ld;
+    using ConstMatrixView<T>::lay;
+    using ConstMatrixView<T>::offset;
+
+public:
+    MatrixView() {}
+
+    MatrixView(T* data, std::size_t rows, std::size_t cols, std::size_t stride,
+               MatrixLayout layout = MatrixLayout::RowMajor)
+        : ConstMatrixView<T>(data, rows, cols, stride, layout) {}
+
+    // through view(), so a copy-on-write matrix gets its own elements first
+    template <class Alloc>
+    MatrixView(Matrix<T, Alloc>& mat) : ConstMatrixView<T>(mat.view()) {}
+
+    template <unsigned int R, unsigned int C>
+    MatrixView(FixedMatrix<T, R, C>& mat) : ConstMatrixView<T>(mat) {}
+
+    // made from a non-const pointer, so casting const away is fine
+    T* data() const { return const_cast<T*>(p); }
+
+    MatrixView transposed() const {
+        return MatrixView(data(), c, r, ld, lay == MatrixLayout::RowMajor ? MatrixLayout::ColumnMajor : MatrixLayout::RowMajor);
+    }
+
+    /*!
+     * @brief Set one element
+     * @exception invalid_argument thrown when row or col is out of bounds.
+     */
+    void set(std::size_t row, std::size_t col, T val) const {
+        if (row < r && col < c)
+            data()[offset(row, col)] = val;
+        else
+            throw std::invalid_argument("Set: out of bounds");
+    }
+
+    T* operator[] (std::size_t i) const {
+        if (lay != MatrixLayout::RowMajor)
+            throw std::invalid_argument("[]: a column-major view has no row pointers");
+        if (i < r)
+            return data() + i * ld;
+        throw std::invalid_argument("[]: out of bounds");
+    }
+
+    MatrixView row(std::size_t i) const {
+        return block(i, 0, 1, c);
+    }
+
+    MatrixView col(std::size_t j) const {
+        return block(0, j, r, 1);
+    }
+
+    MatrixView block(std::size_t row, std::size_t col, std::size_t rows, std::size_t cols) const {
+        if (row + rows > r || col + cols > c)
+            throw std::invalid_argument("block: out of bounds");
+        return MatrixView(data() + offset(row, col), rows, cols, ld, lay);
+    }
+
+    /*!
+     * @brief Copy the elements of other (same size) into this view
+     */
+    void assign(const ConstMatrixView<T>& other) const;
+
+    /*!
+     * @brief Set every element to val
+     */
+    void fill(T val) const;
+
+    /*!
+     * @brief Add other (same size) to the viewed elements
+     */
+    void addInPlace(const ConstMatrixView<T>& other) const;
+
+    /*!
+     * @brief Multiply the viewed elements with a scalar
+     */
+    void multiplyInPlace(T scalar) const;
+
+    /*!
+     * @brief Hadamard (element-wise) product with other (same size), in place
+     */
+    void hadamardInPlace(const ConstMatrixView<T>& other) const;
+};
+
+namespace matrix_detail {
+
+    /*!
+     * @brief fn(r, b, e) on the elements [b, e) of row r, for all rows,
+     *        split over the thread pool.
+     *
+     * When all views involved are contiguous it's one flat range (row 0).
+     */
+    template <class T, class F>
+    void forEachRow(std::size_t rows, std::size_t cols, bool contiguous, const F& fn) {
+        if (rows == 0 || cols == 0)
+            return;
+        if (contiguous) {
+            parallelElements(rows * cols, sizeof(T), [&](std::size_t b, std::size_t e) {
+                fn(0, b, e);
+            });
+            return;
+        }
+        const std::size_t grain = (std::max)((std::size_t)1, (16 * 1024 / sizeof(T)) / cols);
+        parallelFor(0, rows, grain, rows * cols, [&](std::size_t b, std::size_t e) {
+            for (std::size_t i = b; i < e; i++)
+                fn(i, 0, cols);
+        });
+    }
+
+    /*!
+     * @brief v itself when it is row-major, otherwise its transpose, which
+     *        is: the lines of memory of a view as the rows of a row-major one
+     */
+    template <class V>
+    V rowMajorView(const V& v) {
+        return v.layout() == MatrixLayout::RowMajor ? v : v.transposed();
+    }
+
+    // the distance between rows and between columns of a view, as gemm() takes them
+    template <class T>
+    std::ptrdiff_t rowStep(const ConstMatrixView<T>& v) {
+        return v.layout() == MatrixLayout::RowMajor ? (std::ptrdiff_t) v.stride() : 1;
+    }
+
+    template <class T>
+    std::ptrdiff_t colStep(const ConstMatrixView<T>& v) {
+        return v.layout() == MatrixLayout::RowMajor ? 1 : (std::ptrdiff_t) v.stride();
+    }
+
+    // true when the memory spans of a and b share at least one byte
+    template <class T>
+    bool overlaps(const ConstMatrixView<T>& a, const ConstMatrixView<T>& b) {
+        if (a.rows() == 0 || a.cols() == 0 || b.rows() == 0 || b.cols() == 0)
+            return false;
+        const ConstMatrixView<T> x = rowMajorView(a), y = rowMajorView(b);
+        const T* aEnd = x.data() + (x.rows() - 1) * x.stride() + x.cols();
+        const T* bEnd = y.data() + (y.rows() - 1) * y.stride() + y.cols();
+        return x.data() < bEnd && y.data() < aEnd;
+    }
+
+    // true when a and b are the same elements in the same order
+    template <class T>
+    bool sameElements(const ConstMatrixView<T>& a, const ConstMatrixView<T>& b) {
+        return a.data() == b.data() && a.stride() == b.stride() && a.layout() == b.layout();
+    }
+
+    /*!
+     * @brief fn(x, y, n) on pieces of the lines of a (its rows, or its
+     *        columns when it is column-major), y pointing at the same
+     *        elements of b, which has the size of a; split over the pool.
+     *
+     * When b has the other layout, a tile of it is transposed into scratch
+     * memory first, so both are read along their lines at full speed.
+     */
+    template <class VA, class VB, class F>
+    void forEachLinePair(const VA& a, const VB& b, const F& fn) {
+        typedef typename VB::value_type TB;
+        const VA x = rowMajorView(a);
+        const VB y = rowMajorView(b);
+        const std::size_t lines = x.rows(), len = x.cols();
+        if (lines == 0 || len == 0)
+            return;
+        if (a.layout() == b.layout()) {
+            forEachRow<typename VA::value_type>(lines, len, x.contiguous() && y.contiguous(), [&](std::size_t i, std::size_t lo, std::size_t hi) {
+                fn(x.data() + i * x.stride() + lo, y.data() + i * y.stride() + lo, hi - lo);
+            });
+            return;
+        }
+        // y is len x lines, line i of a is column i of y
+        const std::size_t tile = TRANSPOSE_TILE;
+        parallelFor(0, (lines + tile - 1) / tile, 1, lines * len, [&](std::size_t b0, std::size_t b1) {
+            ScratchBuffer<TB> scratch(tile * tile);
+            TB* t = scratch.data();
+            for (std::size_t blk = b0; blk < b1; blk++) {
+                const std::size_t i0 = blk * tile, ni = (std::min)(tile, lines - i0);
+                for (std::size_t j0 = 0; j0 < len; j0 += tile) {
+                    const std::size_t nj = (std::min)(tile, len - j0);
+                    transposeTile(y.data() + j0 * y.stride() + i0, y.stride(), t, nj, nj, ni);
+                    for (std::size_t i = 0; i < ni; i++)
+                        fn(x.data() + (i0 + i) * x.stride() + j0, t + i * nj, nj);
+                }
+            }
+        });
+    }
+
+    template <class T>
+    void viewCopy(const ConstMatrixView<T>& src, const MatrixView<T>& dst) {
+        checkSameSize(src, dst, "assign: matrices must have the same size.");
+        const ConstMatrixView<T> s = rowMajorView(src);
+        const MatrixView<T> d = rowMajorView(dst);
+        if (src.layout() != dst.layout()) {
+            // in memory one is the transpose of the other
+            if (overlaps(src, ConstMatrixView<T>(dst))) {
+                Matrix<T> tmp(src.rows(), src.cols(), src.layout(), MatrixInit::Uninitialized);
+                viewCopy(src, tmp.view());
+                viewCopy(ConstMatrixView<T>(tmp), dst);
+                return;
+            }
+            transpose(s.data(), s.stride(), s.rows(), s.cols(), d.data(), d.stride());
+            return;
+        }
+        if (src.data() == dst.data() && src.stride() == dst.stride())
+            return;
+        if (overlaps(src, ConstMatrixView<T>(dst))) {
+            // rows already written would be read again, and the threads would race
+            Matrix<T> tmp(src.rows(), src.cols(), src.layout(), MatrixInit::Uninitialized);
+            viewCopy(src, tmp.view());
+            viewCopy(ConstMatrixView<T>(tmp), dst);
+            return;
+        }
+        forEachRow<T>(s.rows(), s.cols(), s.contiguous() && d.contiguous(),
+                      [&](std::size_t i, std::size_t b, std::size_t e) {
+            memmove(d.data() + i * d.stride() + b, s.data() + i * s.stride() + b, (e - b) * sizeof(T));
+        });
+    }
+
+    /*!
+     * @brief out = a op b element by element, op(d, x, n) does d[i] = d[i] op x[i]
+     *        and must be commutative; out may be a or b, the layouts may differ.
+     */
+    template <class T, class Op>
+    void viewCombine(const ConstMatrixView<T>& a, const ConstMatrixView<T>& b, const MatrixView<T>& out, const Op& op) {
+        if (a.layout() == out.layout() && b.layout() == out.layout()) {
+            // an operand that partly overlaps out would be read after it has been written
+            const ConstMatrixView<T> co = ConstMatrixView<T>(out);
+            const bool first = overlaps(a, co) && !sameElements(a, co);
+            if (first || (overlaps(b, co) && !sameElements(b, co))) {
+                const ConstMatrixView<T>& v = first ? a : b;
+                Matrix<T> tmp(v.rows(), v.cols(), out.layout(), MatrixInit::Uninitialized);
+                viewCopy(v, tmp.view());
+                if (first)
+                    viewCombine(ConstMatrixView<T>(tmp), b, out, op);
+                else
+                    viewCombine(a, ConstMatrixView<T>(tmp), out, op);
+                return;
+            }
+            const ConstMatrixView<T> x = rowMajorView(a), y = rowMajorView(b);
+            const MatrixView<T> o = rowMajorView(out);
+            forEachRow<T>(o.rows(), o.cols(), x.contiguous() && y.contiguous() && o.contiguous(),
+                          [&](std::size_t i, std::size_t lo, std::size_t hi) {
+                T* d = o.data() + i * o.stride() + lo;
+                const T* xi = x.data() + i * x.stride() + lo;
+                const T* yi = y.data() + i * y.stride() + lo;
+                if (d == yi) {
+                    op(d, xi, hi - lo);
+                } else {
+                    if (d != xi)
+                        memmove(d, xi, (hi - lo) * sizeof(T));
+                    op(d, yi, hi - lo);
+                }
+            });
+            return;
+        }
+        // a in the layout of out, when one of them is
+        if (a.layout() != out.layout() && b.layout() == out.layout())
+            return viewCombine(b, a, out, op);
+        // an operand in the other layout that out overlaps would be overwritten by the copy below
+        if (overlaps(b, ConstMatrixView<T>(out)) || (a.layout() != out.layout() && overlaps(a, ConstMatrixView<T>(out)))) {
+            const bool first = a.layout() != out.layout() && overlaps(a, ConstMatrixView<T>(out));
+            const ConstMatrixView<T>& v = first ? a : b;
+            Matrix<T> tmp(v.rows(), v.cols(), out.layout(), MatrixInit::Uninitialized);
+            viewCopy(v, tmp.view());
+            if (first)
+                viewCombine(ConstMatrixView<T>(tmp), b, out, op);
+            else
+                viewCombine(a, ConstMatrixView<T>(tmp), out, op);
+            return;
+        }
+        viewCopy(a, out);
+        forEachLinePair(out, b, op);
+    }
+
+    // out = a + b; out may be a or b
+    template <class T>
+    void viewAdd(const ConstMatrixView<T>& a, const ConstMatrixView<T>& b, const MatrixView<T>& out) {
+        checkSameSize(a, b, "Addition: matrices must have the same size.");
+        checkSameSize(a, out, "Addition: matrices must have the same size.");
+        viewCombine(a, b, out, [](T* d, const T* x, std::size_t n) { addTo(d, x, n); });
+    }
+
+    // out = hadamard(a, b); out may be a or b
+    template <class T>
+    void viewHadamard(const ConstMatrixView<T>& a, const ConstMatrixView<T>& b, const MatrixView<T>& out) {
+        checkSameSize(a, b, "hadamard: matrices must have the same size.");
+        checkSameSize(a, out, "hadamard: matrices must have the same size.");
+        viewCombine(a, b, out, [](T* d, const T* x, std::size_t n) { multiplyTo(d, x, n); });
+    }
+
+    template <class T>
+    void viewScale(const MatrixView<T>& out, T scalar) {
+        const MatrixView<T> o = rowMajorView(out);
+        forEachRow<T>(o.rows(), o.cols(), o.contiguous(), [&](std::size_t i, std::size_t lo, std::size_t hi) {
+            scaleBy(o.data() + i * o.stride() + lo, scalar, hi - lo);
+        });
+    }
+
+    /*!
+     * @brief a == b element by element, in any layouts
+     */
+    template <class T>
+    bool viewEqual(const ConstMatrixView<T>& a, const ConstMatrixView<T>& b) {
+        if (a.rows() != b.rows() || a.cols() != b.cols())
+            return false;
+        std::atomic<bool> differ(false);
+        forEachLinePair(a, b, [&differ](const T* x, const T* y, std::size_t n) {
+            if (!differ.load(std::memory_order_relaxed) && !equalElements(x, y, n))
+                differ.store(true, std::memory_order_relaxed);
+        });
+        return !differ.load(std::memory_order_relaxed);
+    }
+
+    /*!
+     * @brief c = alpha*a*b (+ c with accumulate) for operands given by their
+     *        strides. A c with column stride 1 is computed as it is, any other
+     *        as transpose(c) = transpose(b)*transpose(a), so the kernel always
+     *        writes along the lines of c.
+     */
+    template <class T, class S>
+    void gemmStrided(std::size_t m, std::size_t n, std::size_t k,
+                     const S* a, std::ptrdiff_t rsa, std::ptrdiff_t csa,
+                     const S* b, std::ptrdiff_t rsb, std::ptrdiff_t csb,
+                     T* c, std::ptrdiff_t rsc, std::ptrdiff_t csc, bool accumulate = false, T alpha = T(1)) {
+        if (csc == 1 || rsc != 1)
+            gemmParallel<T>(m, n, k, a, rsa, csa, b, rsb, csb, c, rsc, csc, accumulate, alpha);
+        else
+            gemmParallel<T>(n, m, k, b, csb, rsb, a, csa, rsa, c, csc, rsc, accumulate, alpha);
+    }
+
+    // out = a * b, through a temporary when out shares memory with a or b
+    template <class T>
+    void viewMultiply(const ConstMatrixView<T>& a, const ConstMatrixView<T>& b, const MatrixView<T>& out) {
+        if (a.cols() != b.rows())
+            throw std::invalid_argument("Multiplication: matrices sizes don't alow multiplication.");
+        if (out.rows() != a.rows() || out.cols() != b.cols())
+            throw std::invalid_argument("Multiplication: the result has the wrong size.");
+        if (overlaps(a, out) || overlaps(b, out)) {
+            Matrix<T> tmp(a.rows(), b.cols(), MatrixInit::Uninitialized);
+            viewMultiply(a, b, MatrixView<T>(tmp));
+            viewCopy(ConstMatrixView<T>(tmp), out);
+            return;
+        }
+        gemmStrided<T>(out.rows(), out.cols(), a.cols(),
+                       a.data(), rowStep(a), colStep(a),
+                       b.data(), rowStep(b), colStep(b),
+                       out.data(), rowStep<T>(out), colStep<T>(out));
+    }
+
+    // out = alpha*op(a)*op(b) + beta*out, see Matrix::gemm(); through a
+    // temporary when out shares memory with a or b
+    template <class T>
+    void viewGemm(T alpha, const ConstMatrixView<T>& a, Transpose ta, const ConstMatrixView<T>& b, Transpose tb,
+                  T beta, const MatrixView<T>& out) {
+        const bool transA = ta == Transpose::Yes;
+        const bool transB = tb == Transpose::Yes;
+        const std::size_t m = transA ? a.cols() : a.rows();
+        const std::size_t k = transA ? a.rows() : a.cols();
+        const std::size_t n = transB ? b.rows() : b.cols();
+        if (k != (transB ? b.cols() : b.rows()))
+            throw std::invalid_argument("gemm: matrices sizes don't alow multiplication.");
+        if (out.rows() != m || out.cols() != n)
+            throw std::invalid_argument("gemm: the result has the wrong size.");
+        if (overlaps(a, out) || overlaps(b, out)) {
+            Matrix<T> tmp(m, n, MatrixInit::Uninitialized);
+            if (beta != T(0))
+                viewCopy(ConstMatrixView<T>(out), MatrixView<T>(tmp));
+            viewGemm(alpha, a, ta, b, tb, beta, MatrixView<T>(tmp));
+            viewCopy(ConstMatrixView<T>(tmp), out);
+            return;
+        }
+        if (alpha == T(0) || k == 0) {
+            // nothing to add, out = beta*out
+            if (beta == T(0))
+                out.fill(T(0));
+            else if (beta != T(1))
+                viewScale(out, beta);
+            return;
+        }
+        if (beta != T(0) && beta != T(1))
+            viewScale(out, beta);
+        // a transposed operand is the same memory walked with the strides swapped
+        gemmStrided<T>(m, n, k,
+                       a.data(), transA ? colStep(a) : rowStep(a), transA ? rowStep(a) : colStep(a),
+                       b.data(), transB ? colStep(b) : rowStep(b), transB ? rowStep(b) : colStep(b),
+                       out.data(), rowStep<T>(out), colStep<T>(out), beta != T(0), alpha);
+    }
+
+    // out = transpose(a), through a temporary when out shares memory with a;
+    // a plain copy when out has the other layout
+    template <class T>
+    void viewTranspose(const ConstMatrixView<T>& a, const MatrixView<T>& out) {
+        if (out.rows() != a.cols() || out.cols() != a.rows())
+            throw std::invalid_argument("Transpose: the result has the wrong size.");
+        if (overlaps(a, ConstMatrixView<T>(out))) {
+            Matrix<T> tmp(a.cols(), a.rows(), MatrixInit::Uninitialized);
+            viewCopy(a.transposed(), tmp.view());
+            viewCopy(ConstMatrixView<T>(tmp), out);
+            return;
+        }
+        viewCopy(a.transposed(), out);
+    }
+
+    /*!
+     * @brief a, or a row-major copy of it in 'copy' when it is column-major,
+     *        for code that walks the elements of a matrix row by row
+     */
+    template <class T, class Alloc>
+    const Matrix<T, Alloc>& rowMajor(const Matrix<T, Alloc>& a, Matrix<T, Alloc>& copy) {
+        if (a.layout() == MatrixLayout::RowMajor || a.isVector())
+            return a;
+        copy = Matrix<T, Alloc>(a.rows(), a.cols(), MatrixInit::Uninitialized);
+        viewCopy(a.view(), copy.view());
+        return copy;
+    }
+
+} // namespace matrix_detail
+
+template <class T>
+void ConstMatrixView<T>::transpose(const MatrixView<T>& out) const {
+    matrix_detail::viewTranspose(*this, out);
+}
+
+template <class T>
+void MatrixView<T>::assign(const ConstMatrixView<T>& other) const {
+    matrix_detail::viewCopy(other, *this);
+}
+
+template <class T>
+void MatrixView<T>::fill(T val) const {
+    const MatrixView<T> o = matrix_detail::rowMajorView(*this);
+    matrix_detail::forEachRow<T>(o.rows(), o.cols(), o.contiguous(), [&](std::size_t i, std::size_t b, std::size_t e) {
+        std::fill(o.data() + i * o.stride() + b, o.data() + i * o.stride() + e, val);
+    });
+}
+
+template <class T>
+void MatrixView<T>::addInPlace(const ConstMatrixView<T>& other) const {
+    matrix_detail::viewAdd(*this, other, *this);
+}
+
+template <class T>
+void MatrixView<T>::multiplyInPlace(T scalar) const {
+    matrix_detail::viewScale(*this, scalar);
+}
+
+template <class T>
+void MatrixView<T>::hadamardInPlace(const ConstMatrixView<T>& other) const {
+    matrix_detail::viewHadamard(*this, other, *this);
+}
@@ -0,0 +1,356 @@
+/*!
+ * @file matrix_bench.cpp
+ * @author Tony Andrioli, The Hague University of Applied Sciences
+ * @date June 2022
+ *
+ * Benchmark of the Matrix operations: multiply, gemm (c = 2*a*transpose(b)
+ * + c), gemv (a times a column), add, hadamard, transpose, convertTo,
+ * operator== and sum on square int, float and double matrices, and the product of
+ * the float and double matrices quantized to int8_t.
+ *
+ * For every operation it reports the time per call, GFLOP/s (multiply-adds
+ * count as two operations), GB/s (the least traffic the operation needs:
+ * every operand read once and the result written once) and the number of
+ * heap allocations per call. With --json the results are also written in
+ * a form that is easy to compare between runs.
+ * @code
+ * matrix_bench                                   # 4x4 .. 8192x8192, everything
+ * matrix_bench --max 1024 --ops multiply,add --types float --json float.json
+ * matrix_bench --threads 1 --min-time 1
+ * @endcode
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "matrix.h"
+
+// --------------------------------------------------------------------------
+// allocation counting
+// --------------------------------------------------------------------------
+
+static std::atomic<std::size_t> allocations(0);
+
+static void* countedAllocate(std::size_t n) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = std::malloc(n ? n : 1);
+    if (p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+// GCC pairs the inlined free() with the builtin operator new it sees at the
+// call sites, not with the replacement above, and warns for every container
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+static void countedFree(void* p) noexcept { std::free(p); }
+
+void* operator new(std::size_t n) { return countedAllocate(n); }
+void* operator new[](std::size_t n) { return countedAllocate(n); }
+void operator delete(void* p) noexcept { countedFree(p); }
+void operator delete[](void* p) noexcept { countedFree(p); }
+void operator delete(void* p, std::size_t) noexcept { countedFree(p); }
+void operator delete[](void* p, std::size_t) noexcept { countedFree(p); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+/*!
+ * @brief The default allocator of Matrix, counting what it allocates.
+ */
+template <class T>
+class CountingAllocator {
+public:
+    typedef T value_type;
+    template <class U> struct rebind { typedef CountingAllocator<U> other; };
+
+    CountingAllocator() {}
+    template <class U> CountingAllocator(const CountingAllocator<U>&) {}
+
+    T* allocate(std::size_t n) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        return AlignedAllocator<T>().allocate(n);
+    }
+    void deallocate(T* p, std::size_t n) {
+        AlignedAllocator<T>().deallocate(p, n);
+    }
+
+    template <class U> bool operator==(const CountingAllocator<U>&) const { return true; }
+    template <class U> bool operator!=(const CountingAllocator<U>&) const { return false; }
+};
+
+// --------------------------------------------------------------------------
+// measuring
+// --------------------------------------------------------------------------
+
+struct Result {
+    std::string op;
+    std::string type;
+    std::size_t n;
+    std::size_t reps;
+    double seconds;         // per call
+    double gflops;
+    double gbps;
+    double allocs;          // per call
+};
+
+struct Options {
+    std::size_t minSize = 4;
+    std::size_t maxSize = 8192;
+    double minTime = 0.2;
+    unsigned int threads = 0;
+    std::vector<std::string> types = { "int", "float", "double" };
+    std::vector<std::string> ops = { "multiply", "gemm", "gemv", "add", "hadamard", "transpose", "convertTo", "equal", "sum", "quantized" };
+    std::string json;
+};
+
+static bool contains(const std::vector<std::string>& list, const std::string& s) {
+    for (std::size_t i = 0; i < list.size(); i++)
+        if (list[i] == s)
+            return true;
+    return false;
+}
+
+static std::vector<std::string> split(const std::string& s) {
+    std::vector<std::string> ret;
+    std::size_t b = 0;
+    while (b <= s.size()) {
+        std::size_t e = s.find(',', b);
+        if (e == std::string::npos)
+            e = s.size();
+        if (e > b)
+            ret.push_back(s.substr(b, e - b));
+        b = e + 1;
+    }
+    return ret;
+}
+
+/*!
+ * @brief Call op until minTime has passed, after one call to warm up.
+ *
+ * A warm-up call that already takes minTime is the measurement, so the
+ * largest sizes run only once.
+ */
+template <class F>
+Result measure(const Options& opt, F op) {
+    typedef std::chrono::steady_clock clock;
+    Result r;
+    std::size_t a0 = allocations.load();
+    clock::time_point t0 = clock::now();
+    op();
+    double elapsed = std::chrono::duration<double>(clock::now() - t0).count();
+    r.reps = 1;
+    if (elapsed < opt.minTime || opt.minTime <= 0) {
+        a0 = allocations.load();
+        t0 = clock::now();
+        r.reps = 0;
+        do {
+            op();
+            r.reps++;
+            elapsed = std::chrono::duration<double>(clock::now() - t0).count();
+        } while (elapsed < opt.minTime);
+    }
+    r.seconds = elapsed / r.reps;
+    r.allocs = (double) (allocations.load() - a0) / r.reps;
+    return r;
+}
+
+template <class T> const char* typeName();
+template <> const char* typeName<int>() { return "int"; }
+template <> const char* typeName<float>() { return "float"; }
+template <> const char* typeName<double>() { return "double"; }
+
+// what convertTo converts T to
+template <class T> struct ConvertTarget { typedef double type; };
+template <> struct ConvertTarget<double> { typedef float type; };
+
+static void report(std::vector<Result>& results, Result r, const char* op, const char* type,
+                   std::size_t n, double flops, double bytes) {
+    r.op = op;
+    r.type = type;
+    r.n = n;
+    r.gflops = flops / r.seconds * 1e-9;
+    r.gbps = bytes / r.seconds * 1e-9;
+    results.push_back(r);
+    std::printf("%-10s %-7s %6zu %10zu %14.3f %10.2f %10.2f %8.2f\n", op, type, n, r.reps,
+                r.seconds * 1e6, r.gflops, r.gbps, r.allocs);
+    std::fflush(stdout);
+}
+
+// the product of a and b quantized to int8_t, into a matrix of T
+template <class T, class Alloc>
+void benchQuantized(const Options& opt, std::vector<Result>& results, const Matrix<T, Alloc>& a,
+                    const Matrix<T, Alloc>& b, Matrix<T, Alloc>& out, std::true_type) {
+    const std::size_t n = a.rows();
+    const double elems = (double) n * n;
+    QuantizedMatrix<std::int8_t> qa = quantizeMatrix<std::int8_t>(a);
+    QuantizedMatrix<std::int8_t> qb = quantizeMatrix<std::int8_t>(b);
+    report(results, measure(opt, [&]() { multiplyQuantized(qa, qb, out); }),
+           "quantized", typeName<T>(), n, 2 * elems * n, elems * (2 + sizeof(T)));
+}
+
+// integer matrices aren't quantized
+template <class T, class Alloc>
+void benchQuantized(const Options&, std::vector<Result>&, const Matrix<T, Alloc>&, const Matrix<T, Alloc>&,
+                    Matrix<T, Alloc>&, std::false_type) {}
+
+template <class T>
+void benchType(const Options& opt, std::vector<Result>& results) {
+    typedef Matrix<T, CountingAllocator<T> > M;
+    typedef typename ConvertTarget<T>::type To;
+    const char* type = typeName<T>();
+    if (!contains(opt.types, type))
+        return;
+
+    for (std::size_t n = opt.minSize; n <= opt.maxSize; n *= 2) {
+        const double elems = (double) n * n;
+        const double s = sizeof(T);
+        M a(n, n, MatrixInit::Uninitialized);
+        M b(n, n, MatrixInit::Uninitialized);
+        M out(n, n, MatrixInit::Uninitialized);
+        // small values, so int products don't overflow and nothing is denormal
+        for (std::size_t i = 0; i < n * n; i++) {
+            a.data()[i] = (T) (i % 7);
+            b.data()[i] = (T) (i % 5 + 1);
+        }
+
+        if (contains(opt.ops, "multiply"))
+            report(results, measure(opt, [&]() { M::multiply(a, b, out); }),
+                   "multiply", type, n, 2 * elems * n, 3 * elems * s);
+        if (contains(opt.ops, "gemm")) {
+            M c = a;
+            report(results, measure(opt, [&]() { M::gemm(T(2), a, Transpose::No, b, Transpose::Yes, T(1), c); }),
+                   "gemm", type, n, 2 * elems * n, 4 * elems * s);
+        }
+        if (contains(opt.ops, "gemv")) {
+            M x(n, 1), y(n, 1);
+            for (std::size_t i = 0; i < n; i++)
+                x.data()[i] = T(i % 7);
+            report(results, measure(opt, [&]() { M::multiply(a, x, y); }),
+                   "gemv", type, n, 2 * elems, (elems + 2 * n) * s);
+        }
+        if (contains(opt.ops, "add"))
+            report(results, measure(opt, [&]() { out = a + b; }),
+                   "add", type, n, elems, 3 * elems * s);
+        if (contains(opt.ops, "hadamard"))
+            report(results, measure(opt, [&]() { M::hadamard(a, b, out); }),
+                   "hadamard", type, n, elems, 3 * elems * s);
+        if (contains(opt.ops, "transpose"))
+            report(results, measure(opt, [&]() { a.transpose(out); }),
+                   "transpose", type, n, 0, 2 * elems * s);
+        if (contains(opt.ops, "convertTo")) {
+            Matrix<To, CountingAllocator<To> > converted(n, n, MatrixInit::Uninitialized);
+            report(results, measure(opt, [&]() { a.convertTo(converted); }),
+                   "convertTo", type, n, 0, elems * (s + sizeof(To)));
+        }
+        if (contains(opt.ops, "equal")) {
+            out = a;
+            volatile bool same = false;
+            report(results, measure(opt, [&]() { same = (a == out); }),
+                   "equal", type, n, 0, 2 * elems * s);
+            if (!same)
+                std::cerr << "equal: a copy doesn't compare equal" << std::endl;
+        }
+        if (contains(opt.ops, "sum")) {
+            volatile double total = 0;
+            report(results, measure(opt, [&]() { total = (double) a.sum(); }),
+                   "sum", type, n, elems, elems * s);
+            (void) total;
+        }
+        if (contains(opt.ops, "quantized"))
+            benchQuantized(opt, results, a, b, out, std::is_floating_point<T>());
+    }
+}
+
+static const char* simdName() {
+    switch (matrix_detail::simdLevel()) {
+    case matrix_detail::SIMD_SSE2: return "sse2";
+    case matrix_detail::SIMD_AVX2: return "avx2";
+    case matrix_detail::SIMD_AVX512: return "avx512";
+    default: return "scalar";
+    }
+}
+
+static bool writeJson(const Options& opt, const std::vector<Result>& results) {
+    std::ofstream out(opt.json.c_str());
+    out << "{\n";
+    out << "  \"threads\": " << MatrixConfig::threadCount() << ",\n";
+    out << "  \"simd\": \"" << simdName() << "\",\n";
+    out << "  \"min_time\": " << opt.minTime << ",\n";
+    out << "  \"results\": [\n";
+    for (std::size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        out << "    { \"op\": \"" << r.op << "\", \"type\": \"" << r.type << "\", \"rows\": " << r.n
+            << ", \"cols\": " << r.n << ", \"reps\": " << r.reps << ", \"seconds\": " << r.seconds
+            << ", \"gflops\": " << r.gflops << ", \"gbps\": " << r.gbps
+            << ", \"allocs_per_op\": " << r.allocs << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return (bool) out;
+}
+
+static void usage() {
+    std::cerr << "usage: matrix_bench [--min N] [--max N] [--types int,float,double]\n"
+                 "                    [--ops multiply,gemm,gemv,add,hadamard,transpose,convertTo,equal,sum,quantized]\n"
+                 "                    [--min-time seconds] [--threads N] [--json file]\n";
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        std::string val = argv[++i];
+        if (arg == "--min")
+            opt.minSize = std::strtoull(val.c_str(), NULL, 10);
+        else if (arg == "--max")
+            opt.maxSize = std::strtoull(val.c_str(), NULL, 10);
+        else if (arg == "--types")
+            opt.types = split(val);
+        else if (arg == "--ops")
+            opt.ops = split(val);
+        else if (arg == "--min-time")
+            opt.minTime = std::atof(val.c_str());
+        else if (arg == "--threads")
+            opt.threads = (unsigned int) std::atoi(val.c_str());
+        else if (arg == "--json")
+            opt.json = val;
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (opt.minSize == 0 || opt.minSize > opt.maxSize) {
+        usage();
+        return 1;
+    }
+    MatrixConfig::setThreadCount(opt.threads);
+
+    std::printf("threads %u, simd %s\n", MatrixConfig::threadCount(), simdName());
+    std::printf("%-10s %-7s %6s %10s %14s %10s %10s %8s\n", "op", "type", "n", "reps", "us/op", "GFLOP/s", "GB/s", "allocs");
+    std::vector<Result> results;
+    benchType<int>(opt, results);
+    benchType<float>(opt, results);
+    benchType<double>(opt, results);
+
+    if (!opt.json.empty() && !writeJson(opt, results)) {
+        std::cerr << "cannot write " << opt.json << std::endl;
+        return 1;
+    }
+    return 0;
+}